@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON results and flags regressions.
+
+Usage: compare.py [--threshold=PERCENT] BASELINE.json CURRENT.json
+
+Benchmarks are matched by name. If the runs were repeated, the median of
+each is compared, otherwise the fastest run. Exits with status 1 if any
+benchmark got slower by more than the threshold.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load_times(path):
+    """Returns {benchmark name: real time in ns} for one result file."""
+    with open(path) as f:
+        benchmarks = json.load(f)["benchmarks"]
+
+    units = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+    medians = {}
+    fastest = {}
+    for bench in benchmarks:
+        if bench.get("error_occurred"):
+            continue
+        time = bench["real_time"] * units[bench.get("time_unit", "ns")]
+        name = bench.get("run_name", bench["name"])
+        if bench.get("run_type") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[name] = time
+        else:
+            fastest[name] = min(time, fastest.get(name, time))
+    fastest.update(medians)
+    return fastest
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10,
+                        help="Percent slowdown which counts as a regression.")
+    args = parser.parse_args()
+
+    baseline = load_times(args.baseline)
+    current = load_times(args.current)
+
+    regressions = []
+    width = max([len(name) for name in current] + [9])
+    print("%-*s %12s %12s %8s" % (width, "benchmark", "baseline", "current",
+                                  "change"))
+    for name in sorted(current):
+        if name not in baseline:
+            print("%-*s %12s %10.1fns %8s" % (width, name, "-", current[name],
+                                              "new"))
+            continue
+        change = (current[name] / baseline[name] - 1) * 100
+        flag = ""
+        if change > args.threshold:
+            regressions.append(name)
+            flag = "  REGRESSION"
+        print("%-*s %10.1fns %10.1fns %+7.1f%%%s" % (
+            width, name, baseline[name], current[name], change, flag))
+    for name in sorted(set(baseline) - set(current)):
+        print("%-*s %10.1fns %12s %8s" % (width, name, baseline[name], "-",
+                                          "gone"))
+
+    if regressions:
+        print("\n%d benchmark(s) slower than the baseline by more than %g%%"
+              % (len(regressions), args.threshold))
+        return 1
+    print("\nNo regressions over %g%%" % args.threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,55 @@
+// Microbenchmarks for the cost of logging a game event on the game thread,
+// compared with formatting one the way the old synchronous logging did.
+
+#include <sstream>
+
+#include <benchmark/benchmark.h>
+
+#include "event_log.h"
+#include "game.h"
+#include "spsc_ring.h"
+
+namespace pong {
+namespace {
+
+void BM_SpscRingPushPop(benchmark::State& state) {
+  util::SpscRing<GameEvent> ring(1024);
+  GameEvent event = GameEvent::Pause(true);
+  for (auto _ : state) {
+    ring.TryPush(event);
+    ring.TryPop(&event);
+  }
+  benchmark::DoNotOptimize(event);
+}
+BENCHMARK(BM_SpscRingPushPop);
+
+// What the game thread pays per event, with the background thread writing
+// events out to /dev/null. Events which don't fit in the ring are dropped,
+// which costs about the same.
+void BM_EventLogLog(benchmark::State& state) {
+  EventLog log("/dev/null", state.range(0));
+  GameBoard game;
+  for (auto _ : state) {
+    log.Log(GameEvent::Bounce(BoundingWall::TOP, game.ball_.bounds_.top_left(),
+                              game.ball_.velocity_));
+  }
+  EventLog::Stats stats = log.GetStats();
+  state.counters["dropped"] = benchmark::Counter(
+      static_cast<double>(stats.dropped) / (stats.logged + stats.dropped));
+}
+BENCHMARK(BM_EventLogLog)->ArgName("capacity")->Arg(4096)->Arg(1 << 20);
+
+// Formatting a ball with boost::format, which LOG(INFO) << ball used to do
+// on the game thread (before even writing anything out).
+void BM_FormatBall(benchmark::State& state) {
+  GameBoard game;
+  std::ostringstream stream;
+  for (auto _ : state) {
+    stream.str("");
+    stream << game.ball_;
+  }
+}
+BENCHMARK(BM_FormatBall);
+
+}  // namespace
+}  // namespace pong
@@ -0,0 +1,50 @@
+// Microbenchmarks for recording frames with pong::FrameCapture, as pong
+// --capture and pong_capture do.
+
+#include <benchmark/benchmark.h>
+#include <SDL.h>
+
+#include "frame_capture.h"
+#include "game.h"
+#include "rendering.h"
+#include "util.h"
+
+namespace pong {
+namespace {
+
+// Frames per second which can be drawn and written as Y4M, waiting for the
+// writer whenever it's behind, as pong_capture does. The video goes nowhere.
+// CPU time is the drawing thread's, so it's what a live game pays per frame
+// to draw and copy it.
+void BM_FrameCaptureY4m(benchmark::State& state) {
+  util::sdl::ManagedSurface surface(SDL_CreateRGBSurfaceWithFormat(
+      0, state.range(0), state.range(1), 32, SDL_PIXELFORMAT_RGB888));
+  if (!surface) {
+    state.SkipWithError(SDL_GetError());
+    return;
+  }
+  CaptureParams params;
+  params.path = "/dev/null";
+  params.width = surface->w;
+  params.height = surface->h;
+  params.drop_when_full = false;
+  FrameCapture capture(params);
+  GameBoard game;
+  PieceBounds previous = PieceBoundsOf(game);
+  for (auto _ : state) {
+    game.Update(1.0 / 60);
+    RenderGameToSdlSurface(game, previous, 1.0, surface.get());
+    previous = PieceBoundsOf(game);
+    capture.Capture(surface.get());
+  }
+  capture.Finish();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FrameCaptureY4m)
+    ->ArgNames({"w", "h"})
+    ->Args({640, 640})
+    ->Args({1920, 1080})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace pong
@@ -0,0 +1,60 @@
+// Microbenchmarks for stepping the game: a lone ball, and whole boards with
+// each of the AI controllers playing both sides.
+
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "controller.h"
+#include "game.h"
+
+namespace pong {
+namespace {
+
+// Ball::Update with a step of state.range(0) microseconds. Long steps bounce
+// off more walls per call.
+void BM_BallUpdate(benchmark::State& state) {
+  const double seconds_delta = state.range(0) / 1e6;
+  GameBoard game;
+  for (auto _ : state) {
+    game.ball_.Update(seconds_delta);
+    if (game.IsGameOver()) {
+      game.SetupNewGame();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BallUpdate)
+    ->ArgName("usecs")
+    ->Arg(1000)     // 1000 Hz
+    ->Arg(4167)     // 240 Hz, the game's tick
+    ->Arg(16667)    // 60 Hz
+    ->Arg(100000);  // 10 Hz
+
+void BM_GameBoardUpdate(benchmark::State& state, const std::string& name) {
+  std::unique_ptr<PaddleController> left = NewAiController(name);
+  std::unique_ptr<PaddleController> right = NewAiController(name);
+  GameBoard game;
+  game.SetLeftController(left.get());
+  game.SetRightController(right.get());
+  for (auto _ : state) {
+    game.Update(1.0 / 240);
+    if (game.IsGameOver()) {
+      game.SetupNewGame();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// One GameBoard::Update benchmark per controller, named after it.
+const bool kRegisteredControllers = [] {
+  for (const std::string& name : AiControllerNames()) {
+    benchmark::RegisterBenchmark(("BM_GameBoardUpdate/" + name).c_str(),
+                                 BM_GameBoardUpdate, name);
+  }
+  return true;
+}();
+
+}  // namespace
+}  // namespace pong
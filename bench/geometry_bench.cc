@@ -0,0 +1,122 @@
+// Microbenchmarks for the bounding box arithmetic in geometry.h, which the
+// game does for every piece on every tick.
+
+#include <random>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <benchmark/benchmark.h>
+
+#include "geometry.h"
+
+namespace pong {
+namespace {
+
+// Boxes scattered over a 1x1 board, so the branches in the code being timed
+// don't all go the same way.
+BoundingBoxVector<double> RandomBoxes(size_t count) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> coord(0, 0.9);
+  BoundingBoxVector<double> boxes;
+  for (size_t i = 0; i < count; ++i) {
+    boxes.emplace_back(coord(rng), coord(rng), 0.05, 0.15);
+  }
+  return boxes;
+}
+
+// A power of two, so that cycling through the boxes is a mask rather than a
+// division.
+constexpr size_t kNumBoxes = 1024;
+constexpr size_t kBoxMask = kNumBoxes - 1;
+static_assert((kNumBoxes & kBoxMask) == 0, "kNumBoxes must be a power of 2");
+
+void BM_BoundingBoxCenter(benchmark::State& state) {
+  BoundingBoxVector<double> boxes = RandomBoxes(kNumBoxes);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(boxes[i++ & kBoxMask].Center());
+  }
+}
+BENCHMARK(BM_BoundingBoxCenter);
+
+void BM_BoundingBoxEdges(benchmark::State& state) {
+  BoundingBoxVector<double> boxes = RandomBoxes(kNumBoxes);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(boxes[i++ & kBoxMask].Edges());
+  }
+}
+BENCHMARK(BM_BoundingBoxEdges);
+
+// Bound() for each wall in turn, as the ball does when it hits one.
+void BM_BoundingBoxBound(benchmark::State& state) {
+  BoundingBoxVector<double> boxes = RandomBoxes(kNumBoxes);
+  const BoundingWall walls[] = {BoundingWall::TOP, BoundingWall::BOTTOM,
+                                BoundingWall::LEFT, BoundingWall::RIGHT};
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(boxes[i & kBoxMask].Bound(walls[i & 3]));
+    ++i;
+  }
+}
+BENCHMARK(BM_BoundingBoxBound);
+
+void BM_BoundingBoxSetCenter(benchmark::State& state) {
+  BoundingBoxVector<double> boxes = RandomBoxes(kNumBoxes);
+  Eigen::Vector2d center(0.5, 0.5);
+  size_t i = 0;
+  for (auto _ : state) {
+    BoundingBox& box = boxes[i++ & kBoxMask];
+    box.Center(center);
+    benchmark::DoNotOptimize(box);
+  }
+}
+BENCHMARK(BM_BoundingBoxSetCenter);
+
+void BM_BoundingBoxOverlaps(benchmark::State& state) {
+  BoundingBoxVector<double> boxes = RandomBoxes(kNumBoxes);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        boxes[i & kBoxMask].Overlaps(boxes[(i + 1) & kBoxMask]));
+    ++i;
+  }
+}
+BENCHMARK(BM_BoundingBoxOverlaps);
+
+// TimeToExit() is the time-of-impact test behind Ball::Update's
+// MinTimeToWall.
+void BM_MinTimeToWall(benchmark::State& state) {
+  BoundingBoxVector<double> boxes = RandomBoxes(kNumBoxes);
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d>>
+      velocities;
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<double> speed(-1, 1);
+  for (size_t i = 0; i < kNumBoxes; ++i) {
+    velocities.emplace_back(speed(rng), speed(rng));
+  }
+  BoundingBox space(0, 0, 1, 1);
+  size_t i = 0;
+  for (auto _ : state) {
+    size_t index = i++ & kBoxMask;
+    benchmark::DoNotOptimize(
+        TimeToExit(boxes[index], velocities[index], space));
+  }
+}
+BENCHMARK(BM_MinTimeToWall);
+
+void BM_ScreenTransformLerp(benchmark::State& state) {
+  BoundingBoxVector<double> boxes = RandomBoxes(kNumBoxes);
+  ScreenTransform to_px({0, 0}, {640, 480});
+  size_t i = 0;
+  for (auto _ : state) {
+    const BoundingBox& from = boxes[i & kBoxMask];
+    const BoundingBox& to = boxes[(i + 1) & kBoxMask];
+    benchmark::DoNotOptimize(to_px.Apply(Lerp(from, to, 0.5)));
+    ++i;
+  }
+}
+BENCHMARK(BM_ScreenTransformLerp);
+
+}  // namespace
+}  // namespace pong
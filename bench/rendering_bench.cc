@@ -0,0 +1,131 @@
+// Microbenchmarks for drawing the game into offscreen surfaces of a few
+// sizes. No window or display is needed.
+
+#include <benchmark/benchmark.h>
+#include <SDL.h>
+
+#include <memory>
+#include <vector>
+
+#include "game.h"
+#include "rendering.h"
+#include "thread_pool.h"
+#include "tile_rasterizer.h"
+#include "util.h"
+
+namespace pong {
+namespace {
+
+void BM_RenderGameToSdlSurface(benchmark::State& state) {
+  util::sdl::ManagedSurface surface(SDL_CreateRGBSurface(
+      0, state.range(0), state.range(1), 32, 0, 0, 0, 0));
+  if (!surface) {
+    state.SkipWithError(SDL_GetError());
+    return;
+  }
+  GameBoard game;
+  PieceBounds previous = PieceBoundsOf(game);
+  game.Update(1.0 / 240);
+  for (auto _ : state) {
+    RenderGameToSdlSurface(game, previous, 0.5, surface.get());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * surface->h * surface->pitch);
+}
+BENCHMARK(BM_RenderGameToSdlSurface)
+    ->ArgNames({"w", "h"})
+    ->Args({320, 240})
+    ->Args({640, 640})  // the game's window
+    ->Args({1920, 1080})
+    ->Args({3840, 2160})
+    ->Args({7680, 4320});
+
+util::sdl::ManagedSurface NewSurface(int w, int h) {
+  return util::sdl::ManagedSurface(
+      SDL_CreateRGBSurface(0, w, h, 32, 0, 0, 0, 0));
+}
+
+// A pool of `threads` for the rasterizer, or null (draw on the calling
+// thread) for 0.
+std::unique_ptr<util::ThreadPool> NewPool(int threads) {
+  return threads > 0 ? util::make_unique<util::ThreadPool>(threads) : nullptr;
+}
+
+// The same frames as BM_RenderGameToSdlSurface, through the tile rasterizer.
+void BM_RenderGameTiled(benchmark::State& state) {
+  util::sdl::ManagedSurface surface = NewSurface(state.range(0), state.range(1));
+  util::sdl::ManagedSurface expected =
+      NewSurface(state.range(0), state.range(1));
+  if (!surface || !expected) {
+    state.SkipWithError(SDL_GetError());
+    return;
+  }
+  std::unique_ptr<util::ThreadPool> pool = NewPool(state.range(2));
+  TileRasterizer rasterizer(pool.get());
+  GameBoard game;
+  PieceBounds previous = PieceBoundsOf(game);
+  game.Update(1.0 / 240);
+
+  RenderGameToSdlSurface(game, previous, 0.5, expected.get());
+  RenderGameToSdlSurface(game, previous, 0.5, {}, &rasterizer, surface.get());
+  if (!util::sdl::SurfacePixelsEqual(surface.get(), expected.get())) {
+    state.SkipWithError("Tiled rendering differs from SDL's");
+    return;
+  }
+  for (auto _ : state) {
+    RenderGameToSdlSurface(game, previous, 0.5, {}, &rasterizer,
+                           surface.get());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * surface->h * surface->pitch);
+}
+BENCHMARK(BM_RenderGameTiled)
+    ->ArgNames({"w", "h", "threads"})
+    ->Args({640, 640, 0})
+    ->Args({1920, 1080, 0})
+    ->Args({3840, 2160, 0})
+    ->Args({3840, 2160, 4})
+    ->Args({7680, 4320, 0})
+    ->Args({7680, 4320, 4})
+    ->UseRealTime();
+
+// Shapes the game doesn't draw yet: rounded paddles, a round ball, and a
+// trail of fading copies of the ball behind it.
+void BM_TileRasterizerShapes(benchmark::State& state) {
+  const int w = 3840;
+  const int h = 2160;
+  util::sdl::ManagedSurface surface = NewSurface(w, h);
+  if (!surface) {
+    state.SkipWithError(SDL_GetError());
+    return;
+  }
+  std::unique_ptr<util::ThreadPool> pool = NewPool(state.range(0));
+  TileRasterizer rasterizer(pool.get());
+  const SDL_Color kWhite = {0xFF, 0xFF, 0xFF, 0xFF};
+  const int ball = h / 20;
+  std::vector<RasterShape> shapes = {
+      RasterShape::RoundedRect({0, h / 3, ball, h / 6}, ball / 2, kWhite),
+      RasterShape::RoundedRect({w - ball, h / 2, ball, h / 6}, ball / 2,
+                               kWhite),
+  };
+  const int kTrail = 32;
+  for (int i = 0; i < kTrail; ++i) {
+    SDL_Color faded = {0xFF, 0xFF, 0xFF, static_cast<Uint8>(8 * (i + 1) - 1)};
+    shapes.push_back(RasterShape::RoundedRect(
+        {w / 4 + i * ball / 4, h / 4 + i * ball / 8, ball, ball}, ball / 2,
+        faded));
+  }
+  for (auto _ : state) {
+    rasterizer.Draw(shapes, {0, 0, 0, 0xFF}, surface.get());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * surface->h * surface->pitch);
+}
+BENCHMARK(BM_TileRasterizerShapes)
+    ->ArgName("threads")
+    ->Arg(0)
+    ->Arg(4)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace pong
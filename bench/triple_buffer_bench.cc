@@ -0,0 +1,61 @@
+// Microbenchmarks for handing board snapshots from the simulation thread to
+// the main thread, which --sim_thread does once per tick.
+
+#include <benchmark/benchmark.h>
+
+#include "game.h"
+#include "triple_buffer.h"
+
+namespace pong {
+namespace {
+
+// What the simulation thread pays per tick to publish the board, and the main
+// thread per frame to pick it up, with no other thread in the way.
+void BM_TripleBufferPublishAndRead(benchmark::State& state) {
+  util::TripleBuffer<GameBoardState> snapshots;
+  GameBoard game;
+  GameBoard shown;
+  for (auto _ : state) {
+    *snapshots.WriteBuffer() = game.Save();
+    snapshots.Publish();
+    if (snapshots.Update()) {
+      shown.Restore(snapshots.Read());
+    }
+  }
+  benchmark::DoNotOptimize(shown.ball_.bounds_);
+}
+BENCHMARK(BM_TripleBufferPublishAndRead);
+
+// The same, with the writer and reader on two threads. The reader only copies
+// out the values it hasn't seen yet.
+util::TripleBuffer<GameBoardState>* shared_snapshots;
+
+void BM_TripleBufferContended(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    shared_snapshots = new util::TripleBuffer<GameBoardState>;
+    *shared_snapshots->WriteBuffer() = GameBoard().Save();
+    shared_snapshots->Publish();
+  }
+  GameBoard game;
+  int64_t updates = 0;
+  for (auto _ : state) {
+    if (state.thread_index() == 0) {
+      *shared_snapshots->WriteBuffer() = game.Save();
+      shared_snapshots->Publish();
+    } else if (shared_snapshots->Update()) {
+      game.Restore(shared_snapshots->Read());
+      ++updates;
+    }
+  }
+  if (state.thread_index() == 1) {
+    state.counters["fresh"] = benchmark::Counter(
+        static_cast<double>(updates) / state.iterations());
+  }
+  if (state.thread_index() == 0) {
+    delete shared_snapshots;
+  }
+}
+BENCHMARK(BM_TripleBufferContended)->Threads(2);
+
+}  // namespace
+}  // namespace pong
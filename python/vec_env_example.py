@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Drives libpong_env.so from Python, handing it numpy arrays to fill.
+
+Usage: vec_env_example.py [--lib=bin/libpong_env.so] [--envs=64] [--steps=2000]
+
+Plays random actions in every game and checks what comes back: the arrays'
+shapes, that rewards are only given when an episode ends, and that resetting
+with the same seeds replays the same episodes. Exits with status 1 if any
+check fails. `make env-example` builds the library and runs this.
+"""
+
+import argparse
+import ctypes
+import sys
+
+import numpy as np
+
+
+def load(path):
+    """Loads the library and declares the functions in vec_env_c.h."""
+    lib = ctypes.CDLL(path)
+    lib.pong_vec_env_create.restype = ctypes.c_void_p
+    lib.pong_vec_env_create.argtypes = [
+        ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_char_p]
+    lib.pong_vec_env_destroy.argtypes = [ctypes.c_void_p]
+    lib.pong_vec_env_num_envs.argtypes = [ctypes.c_void_p]
+    lib.pong_vec_env_reset.argtypes = [
+        ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+    lib.pong_vec_env_step.argtypes = [
+        ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+        ctypes.c_void_p]
+    return lib
+
+
+def play(lib, env, seeds, actions, observation_size):
+    """Resets with `seeds`, then plays each row of `actions` as one step.
+
+    Returns the observations (one more than there are steps), rewards and
+    dones of every step, stacked."""
+    num_envs = len(seeds)
+    obs = np.zeros((num_envs, observation_size), np.float32)
+    rewards = np.zeros(num_envs, np.float32)
+    dones = np.zeros(num_envs, np.uint8)
+    lib.pong_vec_env_reset(env, seeds.ctypes.data, obs.ctypes.data)
+    all_obs = [obs.copy()]
+    all_rewards = []
+    all_dones = []
+    for step_actions in actions:
+        lib.pong_vec_env_step(env, step_actions.ctypes.data, obs.ctypes.data,
+                              rewards.ctypes.data, dones.ctypes.data)
+        all_obs.append(obs.copy())
+        all_rewards.append(rewards.copy())
+        all_dones.append(dones.copy())
+    return np.stack(all_obs), np.stack(all_rewards), np.stack(all_dones)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--lib", default="bin/libpong_env.so")
+    parser.add_argument("--envs", type=int, default=64)
+    parser.add_argument("--steps", type=int, default=2000)
+    parser.add_argument("--opponent", default="follow_ball_y")
+    args = parser.parse_args()
+
+    lib = load(args.lib)
+    observation_size = lib.pong_vec_env_observation_size()
+    num_actions = lib.pong_vec_env_num_actions()
+    env = lib.pong_vec_env_create(args.envs, 4, 0, args.opponent.encode())
+    if not env:
+        sys.exit("Could not create the environment")
+
+    failures = []
+
+    def check(ok, message):
+        if not ok:
+            failures.append(message)
+
+    try:
+        check(lib.pong_vec_env_num_envs(env) == args.envs,
+              "pong_vec_env_num_envs doesn't match the envs asked for")
+        seeds = np.arange(args.envs, dtype=np.uint64)
+        rng = np.random.default_rng(1)
+        actions = rng.integers(0, num_actions, (args.steps, args.envs),
+                               dtype=np.int32)
+        obs, rewards, dones = play(lib, env, seeds, actions, observation_size)
+
+        check(obs.shape == (args.steps + 1, args.envs, observation_size),
+              "observations have shape %s" % (obs.shape,))
+        check(np.isfinite(obs).all(), "an observation isn't finite")
+        # Ball and paddle positions are on the board, which runs from 0 to 1.
+        positions = obs[:, :, [0, 1, 4, 5]]
+        check(((positions >= 0) & (positions <= 1)).all(),
+              "a position is off the board")
+        check(np.isin(dones, [0, 1]).all(), "a done flag isn't 0 or 1")
+        check(np.isin(rewards, [-1, 0, 1]).all(), "a reward isn't -1, 0 or 1")
+        check(((rewards == 0) | (dones == 1)).all(),
+              "a reward was given before its episode ended")
+        check(dones.sum() > 0, "no episode ended in %d steps" % args.steps)
+
+        again = play(lib, env, seeds, actions, observation_size)
+        check(all(np.array_equal(a, b)
+                  for a, b in zip((obs, rewards, dones), again)),
+              "resetting with the same seeds didn't replay the same episodes")
+
+        print("%d envs, %d steps: %d episodes ended, %d won, %d lost" %
+              (args.envs, args.steps, dones.sum(), (rewards > 0).sum(),
+               (rewards < 0).sum()))
+    finally:
+        lib.pong_vec_env_destroy(env)
+
+    for failure in failures:
+        print("FAILED: " + failure)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
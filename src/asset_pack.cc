@@ -0,0 +1,234 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "asset_pack.h"
+#include "mapped_file.h"
+
+namespace pong {
+
+namespace {
+constexpr char kFileMagic[8] = {'P', 'O', 'N', 'G', 'P', 'A', 'C', 'K'};
+constexpr uint32_t kVersion = 1;
+
+struct PackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t num_assets;
+  uint32_t reserved;
+};
+
+struct IndexEntry {
+  char name[kMaxAssetNameBytes];  // NUL-terminated
+  uint64_t offset;
+  uint64_t size;
+};
+
+size_t AlignUp(size_t offset) {
+  return (offset + kAssetAlignment - 1) / kAssetAlignment * kAssetAlignment;
+}
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    PLOG(ERROR) << "Could not open " << path;
+    return false;
+  }
+  contents->clear();
+  uint8_t buffer[65536];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents->insert(contents->end(), buffer, buffer + read);
+  }
+  bool ok = !ferror(file);
+  if (!ok) {
+    PLOG(ERROR) << "Could not read " << path;
+  }
+  fclose(file);
+  return ok;
+}
+}  // namespace
+
+bool WriteAssetPack(const std::string& path,
+                    const std::vector<AssetFile>& files) {
+  std::vector<AssetFile> sorted = files;
+  std::sort(sorted.begin(), sorted.end(),
+            [](const AssetFile& a, const AssetFile& b) {
+              return a.name < b.name;
+            });
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    if (sorted[i].name.empty() ||
+        sorted[i].name.size() >= kMaxAssetNameBytes) {
+      LOG(ERROR) << "Asset name '" << sorted[i].name << "' must be 1 to "
+                 << kMaxAssetNameBytes - 1 << " bytes long";
+      return false;
+    }
+    if (i > 0 && sorted[i].name == sorted[i - 1].name) {
+      LOG(ERROR) << "Asset " << sorted[i].name << " is in the pack twice";
+      return false;
+    }
+  }
+
+  // Written to a temporary file and renamed over `path`, so a failed build
+  // never leaves a broken pack for the game to find.
+  std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == nullptr) {
+    PLOG(ERROR) << "Could not create " << temp_path;
+    return false;
+  }
+  PackHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrderMark;
+  header.num_assets = sorted.size();
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  // The index goes first, so the data's offsets have to be worked out from
+  // the files' sizes before any is read.
+  std::vector<IndexEntry> index(sorted.size());
+  size_t offset =
+      AlignUp(sizeof(PackHeader) + index.size() * sizeof(IndexEntry));
+  for (size_t i = 0; i < sorted.size() && ok; ++i) {
+    struct stat info;
+    if (stat(sorted[i].path.c_str(), &info) != 0) {
+      PLOG(ERROR) << "Could not stat " << sorted[i].path;
+      ok = false;
+      break;
+    }
+    memset(&index[i], 0, sizeof(index[i]));
+    memcpy(index[i].name, sorted[i].name.data(), sorted[i].name.size());
+    index[i].offset = offset;
+    index[i].size = info.st_size;
+    offset = AlignUp(offset + info.st_size);
+  }
+  if (ok && !index.empty()) {
+    ok = fwrite(index.data(), sizeof(IndexEntry), index.size(), file) ==
+         index.size();
+  }
+
+  std::vector<uint8_t> contents;
+  static const uint8_t kPadding[kAssetAlignment] = {};
+  for (size_t i = 0; i < sorted.size() && ok; ++i) {
+    long position = ftell(file);
+    ok = position >= 0 && fwrite(kPadding, 1, index[i].offset - position,
+                                 file) == index[i].offset - position;
+    if (!ok || !ReadFile(sorted[i].path, &contents)) {
+      ok = false;
+      break;
+    }
+    if (contents.size() != index[i].size) {
+      LOG(ERROR) << sorted[i].path << " changed while being packed";
+      ok = false;
+      break;
+    }
+    ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  }
+
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  if (ok && rename(temp_path.c_str(), path.c_str()) != 0) {
+    PLOG(ERROR) << "Could not rename " << temp_path << " to " << path;
+    ok = false;
+  }
+  if (!ok) {
+    LOG(ERROR) << "Could not write asset pack " << path;
+    unlink(temp_path.c_str());
+  }
+  return ok;
+}
+
+
+std::unique_ptr<AssetPack> AssetPack::Open(const std::string& path) {
+  std::unique_ptr<MappedFile> file =
+      MappedFile::Open(path, "asset pack", sizeof(PackHeader));
+  if (file == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<AssetPack> pack(new AssetPack);
+  pack->data_ = file->data();
+  pack->size_ = file->size();
+  pack->file_ = std::move(file);
+  if (!pack->Validate(path)) {
+    return nullptr;
+  }
+  return pack;
+}
+
+// Checks the header and that every entry lies within the file. Doesn't touch
+// the assets themselves, so they aren't paged in until they're used.
+bool AssetPack::Validate(const std::string& path) {
+  PackHeader header = ReadRecord<PackHeader>(data_);
+  if (memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) != 0) {
+    LOG(ERROR) << path << " is not an asset pack";
+    return false;
+  }
+  if (header.byte_order != kByteOrderMark) {
+    LOG(ERROR) << path << " was written on a machine with another byte order";
+    return false;
+  }
+  if (header.version != kVersion) {
+    LOG(ERROR) << path << " is version " << header.version
+               << "; this build only reads version " << kVersion;
+    return false;
+  }
+  size_t index_bytes = static_cast<size_t>(header.num_assets) *
+                       sizeof(IndexEntry);
+  if (index_bytes > size_ - sizeof(PackHeader)) {
+    LOG(ERROR) << path << " is truncated";
+    return false;
+  }
+  index_ = data_ + sizeof(PackHeader);
+  num_assets_ = header.num_assets;
+  for (int i = 0; i < num_assets_; ++i) {
+    IndexEntry entry = ReadRecord<IndexEntry>(index_ + i * sizeof(IndexEntry));
+    if (entry.name[kMaxAssetNameBytes - 1] != '\0' || entry.offset > size_ ||
+        entry.size > size_ - entry.offset) {
+      LOG(ERROR) << path << " has a bad index entry " << i;
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string AssetPack::Name(int index) const {
+  CHECK(index >= 0 && index < num_assets_) << "Bad asset index " << index;
+  return ReadRecord<IndexEntry>(index_ + index * sizeof(IndexEntry)).name;
+}
+
+bool AssetPack::Find(const std::string& name, const uint8_t** data,
+                     size_t* size) const {
+  // The index is sorted by name.
+  int low = 0;
+  int high = num_assets_;
+  while (low < high) {
+    int middle = low + (high - low) / 2;
+    const char* entry_name = reinterpret_cast<const char*>(
+        index_ + middle * sizeof(IndexEntry) + offsetof(IndexEntry, name));
+    int order = strncmp(entry_name, name.c_str(), kMaxAssetNameBytes);
+    if (order == 0) {
+      IndexEntry entry =
+          ReadRecord<IndexEntry>(index_ + middle * sizeof(IndexEntry));
+      *data = data_ + entry.offset;
+      *size = entry.size;
+      return true;
+    }
+    if (order < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
+}  // namespace pong
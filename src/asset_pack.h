@@ -0,0 +1,75 @@
+// A single file holding all of the game's assets (fonts, and later sounds and
+// sprites), so starting up maps one file instead of opening many.
+//
+// File layout (host byte order; the records are fixed-size structs defined
+// in asset_pack.cc):
+//
+//   PackHeader
+//   IndexEntry[num_assets]  -- name, offset and size, sorted by name
+//   asset data, each starting on a kAssetAlignment boundary
+//
+// Nothing needs parsing or copying at startup: the reader maps the file and
+// looks names up with a binary search over the mapped index. The data is
+// handed out in place, e.g. to SDL_RWFromConstMem(), and only the parts used
+// are ever paged in.
+
+#ifndef ASSET_PACK_H_
+#define ASSET_PACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "util.h"
+
+namespace pong {
+
+// Longest asset name, including the terminating NUL.
+constexpr size_t kMaxAssetNameBytes = 48;
+constexpr size_t kAssetAlignment = 16;
+
+struct AssetFile {
+  std::string name;  // in the pack, at most kMaxAssetNameBytes - 1 bytes
+  std::string path;  // to read it from
+};
+
+// Reads every file in `files` and writes them into a new pack at `path`.
+// Returns false (and logs why) if a file can't be read, a name is too long or
+// repeated, or the pack can't be written.
+bool WriteAssetPack(const std::string& path,
+                    const std::vector<AssetFile>& files);
+
+// Reads an asset pack through a read-only memory map.
+class AssetPack {
+ public:
+  // Returns null (and logs why) if the file can't be mapped or isn't a pack.
+  static std::unique_ptr<AssetPack> Open(const std::string& path);
+
+  int NumAssets() const { return num_assets_; }
+  std::string Name(int index) const;
+
+  // Points `data` and `size` at the asset called `name`, which stays mapped
+  // for as long as the pack is open. Returns false if there's no such asset.
+  bool Find(const std::string& name, const uint8_t** data,
+            size_t* size) const;
+
+ private:
+  AssetPack() {}
+  bool Validate(const std::string& path);
+
+  std::unique_ptr<MappedFile> file_;
+  // Where file_ is mapped, and its size.
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  int num_assets_ = 0;
+  const uint8_t* index_ = nullptr;
+
+  DISALLOW_COPY_AND_ASSIGN(AssetPack);
+};
+
+}  // namespace pong
+
+#endif  // ASSET_PACK_H_
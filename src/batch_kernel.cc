@@ -0,0 +1,153 @@
+#include <cmath>
+#include <limits>
+
+#include "batch_kernel.h"
+#include "game.h"
+
+namespace pong {
+
+namespace {
+// Mirrors FollowBallYController::DesiredMove followed by Paddle::Update for
+// one paddle of board `i`.
+void FollowBall(BatchKernelArgs* args, int i, double* paddle_y,
+                uint8_t* moving) {
+  double start_move_tolerance = args->paddle_height / 2;
+  double stop_move_tolerance = args->paddle_height / 4;
+  double delta_y = (*paddle_y + args->paddle_height * 0.5) -
+                   (args->ball_y[i] + args->ball_height * 0.5);
+  double delta_position = args->seconds_delta * args->paddle_speed[i];
+  if ((!*moving && std::abs(delta_y) > start_move_tolerance) ||
+      (*moving && std::abs(delta_y) > stop_move_tolerance)) {
+    *moving = true;
+    if (delta_y < 0) {
+      *paddle_y += delta_position;  // DOWN
+    } else {
+      *paddle_y -= delta_position;  // UP
+    }
+  } else {
+    *moving = false;
+  }
+
+  if (*paddle_y < args->paddle_top_bound) {
+    *paddle_y = args->paddle_top_bound;
+  }
+  if (*paddle_y + args->paddle_height > args->paddle_bottom_bound) {
+    *paddle_y = args->paddle_bottom_bound - args->paddle_height;
+  }
+}
+
+// Mirrors GameBoard::BounceBall for board `i`.
+void BounceBall(BatchKernelArgs* args, int i, BoundingWall hit_wall) {
+  double paddle_y;
+  switch (hit_wall) {
+    case BoundingWall::TOP:  // fallthrough
+    case BoundingWall::BOTTOM:
+      args->ball_vy[i] *= -1;
+      return;
+
+    case BoundingWall::LEFT:
+      paddle_y = args->left_paddle_y[i];
+      break;
+
+    case BoundingWall::RIGHT:
+      paddle_y = args->right_paddle_y[i];
+      break;
+
+    default:
+      LOG(FATAL) << "Unexpected value for wall off which the ball is bouncing: "
+                 << static_cast<int>(hit_wall);
+      return;
+  }
+
+  double ball_top = args->ball_y[i];
+  double ball_bottom = ball_top + args->ball_height;
+  if (ball_top > paddle_y + args->paddle_height || ball_bottom < paddle_y) {
+    if (hit_wall == BoundingWall::LEFT) {
+      args->right_score[i] += 1;
+    } else {
+      args->left_score[i] += 1;
+    }
+    args->game_over[i] = true;
+    return;
+  }
+
+  args->ball_vx[i] *= -1;
+  args->ball_vx[i] *= args->ball_speedup;
+  args->ball_vy[i] *= args->ball_speedup;
+  args->paddle_speed[i] *= args->paddle_speedup;
+  args->paddle_bounces += 1;
+}
+}  // namespace
+
+void StepBoardsScalar(BatchKernelArgs* args) {
+  for (int i = args->begin; i < args->end; ++i) {
+    if (args->game_over[i]) {
+      continue;
+    }
+
+    if (args->left_follows_ball) {
+      FollowBall(args, i, &args->left_paddle_y[i], &args->left_moving[i]);
+    }
+    if (args->right_follows_ball) {
+      FollowBall(args, i, &args->right_paddle_y[i], &args->right_moving[i]);
+    }
+
+    // Mirrors Ball::Update and MinTimeToWall in game.cc. Ties between the X
+    // and Y walls go to the Y wall, just like the tuple comparison there.
+    double seconds_delta = args->seconds_delta;
+    double& x = args->ball_x[i];
+    double& y = args->ball_y[i];
+    const double& vx = args->ball_vx[i];
+    const double& vy = args->ball_vy[i];
+
+    while (true) {
+      double time_to_x_wall = std::numeric_limits<double>::infinity();
+      BoundingWall x_wall = BoundingWall::NONE;
+      if (vx < 0) {
+        time_to_x_wall = (args->valid_left - x) / vx;
+        x_wall = BoundingWall::LEFT;
+      } else if (vx > 0) {
+        time_to_x_wall = (args->valid_right - (x + args->ball_width)) / vx;
+        x_wall = BoundingWall::RIGHT;
+      }
+
+      double time_to_y_wall = std::numeric_limits<double>::infinity();
+      BoundingWall y_wall = BoundingWall::NONE;
+      if (vy < 0) {
+        time_to_y_wall = (args->valid_top - y) / vy;
+        y_wall = BoundingWall::TOP;
+      } else if (vy > 0) {
+        time_to_y_wall = (args->valid_bottom - (y + args->ball_height)) / vy;
+        y_wall = BoundingWall::BOTTOM;
+      }
+      if (time_to_x_wall < 0 || time_to_y_wall < 0) {
+        args->bad_board = i;
+        break;
+      }
+
+      double time_to_wall = time_to_y_wall;
+      BoundingWall wall = y_wall;
+      if (time_to_x_wall < time_to_y_wall) {
+        time_to_wall = time_to_x_wall;
+        wall = x_wall;
+      }
+      if (!(time_to_wall < seconds_delta)) {
+        break;
+      }
+
+      x += time_to_wall * vx;
+      y += time_to_wall * vy;
+      seconds_delta -= time_to_wall;
+
+      BounceBall(args, i, wall);
+      if (args->game_over[i]) {
+        break;
+      }
+    }
+
+    x += seconds_delta * vx;
+    y += seconds_delta * vy;
+  }
+}
+
+}  // namespace pong
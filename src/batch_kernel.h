@@ -0,0 +1,80 @@
+// Board update kernels used by pong::BatchSimulator. There's one scalar kernel
+// and, on x86-64, SSE2 and AVX2 kernels which handle 2 or 4 boards per
+// instruction. All kernels must produce bit-identical results.
+//
+// NOTE: this header is included by translation units compiled with extra
+// instruction set flags (e.g. -mavx2). Keep it free of anything with inline
+// functions (STL, glog, Eigen), or the linker may pick an AVX2 copy of some
+// inline function and run it on a CPU which doesn't support it.
+
+#ifndef BATCH_KERNEL_H_
+#define BATCH_KERNEL_H_
+
+#include <stdint.h>
+
+namespace pong {
+
+// Raw view of the packed arrays of a BatchSimulator, plus the geometry which
+// all of its boards share.
+struct BatchKernelArgs {
+  double* ball_x;
+  double* ball_y;
+  double* ball_vx;
+  double* ball_vy;
+  double* left_paddle_y;
+  double* right_paddle_y;
+  uint8_t* left_moving;
+  uint8_t* right_moving;
+  double* paddle_speed;
+  int* left_score;
+  int* right_score;
+  uint8_t* game_over;
+
+  double ball_width;
+  double ball_height;
+  double paddle_height;
+  double paddle_top_bound;
+  double paddle_bottom_bound;
+  double valid_left;
+  double valid_right;
+  double valid_top;
+  double valid_bottom;
+
+  // Speed multipliers for the ball and paddles when the ball is returned.
+  // Normally kBallSpeedupFactor and kPaddleSpeedupFactor; passed in so the
+  // SIMD kernels don't have to include game.h.
+  double ball_speedup;
+  double paddle_speedup;
+
+  // Whether each paddle uses BatchPolicy::FOLLOW_BALL_Y, in which case the
+  // kernel moves it. Paddles with any other policy must already have been
+  // moved for this step.
+  bool left_follows_ball;
+  bool right_follows_ball;
+
+  // Range of boards to update, and by how much time.
+  int begin;
+  int end;
+  double seconds_delta;
+
+  // Outputs. Kernels add to paddle_bounces, and set bad_board to the index of
+  // any board which ended up with a negative time-to-wall (which means the
+  // ball escaped its valid space).
+  int64_t paddle_bounces;
+  int bad_board;
+};
+
+// Each of these steps every running board in [args->begin, args->end)
+// forward by args->seconds_delta: first the ball-following paddles (like
+// pong::FollowBallYController and pong::Paddle::Update), then the ball, which
+// bounces off walls and paddles with the same rules as pong::Ball::Update and
+// pong::GameBoard::BounceBall.
+void StepBoardsScalar(BatchKernelArgs* args);
+#if defined(__x86_64__)
+void StepBoardsSse2(BatchKernelArgs* args);
+void StepBoardsAvx2(BatchKernelArgs* args);
+#endif
+
+}  // namespace pong
+
+#endif  // BATCH_KERNEL_H_
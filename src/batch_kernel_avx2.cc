@@ -0,0 +1,54 @@
+// AVX2 version of the batch board kernel: four boards per instruction. See
+// batch_kernel_simd.h for the actual kernel. This file is compiled with
+// -mavx2, and must only be called after checking the CPU supports it.
+
+#include "batch_kernel.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+#include "batch_kernel_simd.h"
+
+namespace pong {
+
+namespace {
+struct Avx2 {
+  typedef __m256d Reg;
+  static const int kLanes = 4;
+
+  static Reg Load(const double* p) { return _mm256_loadu_pd(p); }
+  static void Store(double* p, Reg a) { _mm256_storeu_pd(p, a); }
+  static Reg Set1(double a) { return _mm256_set1_pd(a); }
+  static Reg AllOnes() { return _mm256_castsi256_pd(_mm256_set1_epi32(-1)); }
+
+  static Reg Add(Reg a, Reg b) { return _mm256_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm256_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm256_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm256_div_pd(a, b); }
+
+  static Reg Less(Reg a, Reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static Reg Greater(Reg a, Reg b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static Reg And(Reg a, Reg b) { return _mm256_and_pd(a, b); }
+  static Reg Or(Reg a, Reg b) { return _mm256_or_pd(a, b); }
+  static Reg AndNot(Reg mask, Reg a) { return _mm256_andnot_pd(mask, a); }
+  static Reg Select(Reg mask, Reg if_true, Reg if_false) {
+    return _mm256_blendv_pd(if_false, if_true, mask);
+  }
+
+  static int MoveMask(Reg mask) { return _mm256_movemask_pd(mask); }
+  // Widens four game_over bytes into four all-ones/all-zeros lanes.
+  static Reg MaskFromBytes(const uint8_t* bytes) {
+    int32_t packed;
+    __builtin_memcpy(&packed, bytes, sizeof(packed));
+    __m256i wide = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+    return _mm256_castsi256_pd(
+        _mm256_cmpgt_epi64(wide, _mm256_setzero_si256()));
+  }
+};
+}  // namespace
+
+void StepBoardsAvx2(BatchKernelArgs* args) { StepBoardsSimd<Avx2>(args); }
+
+}  // namespace pong
+
+#endif  // defined(__x86_64__)
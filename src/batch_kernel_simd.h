@@ -0,0 +1,224 @@
+// Shared implementation of the SIMD board kernels. Only include this from the
+// per-instruction-set kernel files (batch_kernel_sse2.cc, batch_kernel_avx2.cc);
+// everything in here has internal linkage so each of them gets its own copy
+// compiled for its own instruction set.
+//
+// `V` wraps one vector register of doubles, and must provide:
+//   typedef ... Reg;  static const int kLanes;
+//   Load, Store, Set1, Add, Sub, Mul, Div, Less, Greater, And, Or,
+//   AndNot(mask, value) (i.e. ~mask & value), AllOnes,
+//   Select(mask, if_true, if_false), MoveMask and MaskFromBytes.
+//
+// The arithmetic below is the same sequence of IEEE operations as
+// StepBoardsScalar, just done for kLanes boards at a time, so results are
+// bit-identical. Don't "simplify" any of it (e.g. into fused multiply-adds)
+// without checking `pong_sim --kernel=all` still agrees.
+
+#ifndef BATCH_KERNEL_SIMD_H_
+#define BATCH_KERNEL_SIMD_H_
+
+#include "batch_kernel.h"
+
+namespace pong {
+namespace {
+
+// Vector version of FollowBall in batch_kernel.cc, for the lanes in `started`.
+template <typename V>
+typename V::Reg FollowBallSimd(const BatchKernelArgs& args,
+                               typename V::Reg started,
+                               typename V::Reg paddle_y,
+                               typename V::Reg ball_y,
+                               typename V::Reg speed, uint8_t* moving) {
+  typedef typename V::Reg Reg;
+  const Reg zero = V::Set1(0.0);
+  const Reg sign_bit = V::Set1(-0.0);
+  const Reg paddle_height = V::Set1(args.paddle_height);
+  const Reg start_move_tolerance = V::Set1(args.paddle_height / 2);
+  const Reg stop_move_tolerance = V::Set1(args.paddle_height / 4);
+
+  Reg delta_y =
+      V::Sub(V::Add(paddle_y, V::Set1(args.paddle_height * 0.5)),
+             V::Add(ball_y, V::Set1(args.ball_height * 0.5)));
+  Reg abs_delta_y = V::AndNot(sign_bit, delta_y);
+  Reg was_moving = V::MaskFromBytes(moving);
+  Reg move = V::And(
+      started,
+      V::Or(V::AndNot(was_moving, V::Greater(abs_delta_y,
+                                             start_move_tolerance)),
+            V::And(was_moving, V::Greater(abs_delta_y, stop_move_tolerance))));
+
+  Reg delta_position = V::Mul(V::Set1(args.seconds_delta), speed);
+  Reg moved = V::Select(V::Less(delta_y, zero),
+                        V::Add(paddle_y, delta_position),   // DOWN
+                        V::Sub(paddle_y, delta_position));  // UP
+  paddle_y = V::Select(move, moved, paddle_y);
+
+  Reg top_bound = V::Set1(args.paddle_top_bound);
+  Reg bottom_bound = V::Set1(args.paddle_bottom_bound);
+  paddle_y = V::Select(V::And(started, V::Less(paddle_y, top_bound)),
+                       top_bound, paddle_y);
+  paddle_y = V::Select(
+      V::And(started,
+             V::Greater(V::Add(paddle_y, paddle_height), bottom_bound)),
+      V::Sub(bottom_bound, paddle_height), paddle_y);
+
+  int started_bits = V::MoveMask(started);
+  int move_bits = V::MoveMask(move);
+  for (int lane = 0; lane < V::kLanes; ++lane) {
+    if (started_bits & (1 << lane)) {
+      moving[lane] = (move_bits >> lane) & 1;
+    }
+  }
+  return paddle_y;
+}
+
+template <typename V>
+void StepBoardsSimd(BatchKernelArgs* args) {
+  typedef typename V::Reg Reg;
+  const int kLanes = V::kLanes;
+
+  const Reg zero = V::Set1(0.0);
+  const Reg minus_one = V::Set1(-1.0);
+  const Reg infinity = V::Set1(__builtin_inf());
+  const Reg ball_width = V::Set1(args->ball_width);
+  const Reg ball_height = V::Set1(args->ball_height);
+  const Reg paddle_height = V::Set1(args->paddle_height);
+  const Reg valid_left = V::Set1(args->valid_left);
+  const Reg valid_right = V::Set1(args->valid_right);
+  const Reg valid_top = V::Set1(args->valid_top);
+  const Reg valid_bottom = V::Set1(args->valid_bottom);
+  const Reg ball_speedup = V::Set1(args->ball_speedup);
+  const Reg paddle_speedup = V::Set1(args->paddle_speedup);
+
+  int i = args->begin;
+  for (; i + kLanes <= args->end; i += kLanes) {
+    // Boards which are already over aren't touched at all. `running` tracks
+    // the boards which still need to look for bounces this step.
+    const Reg started = V::AndNot(V::MaskFromBytes(args->game_over + i),
+                                  V::AllOnes());
+    if (V::MoveMask(started) == 0) {
+      continue;
+    }
+    Reg running = started;
+
+    Reg x = V::Load(args->ball_x + i);
+    Reg y = V::Load(args->ball_y + i);
+    Reg vx = V::Load(args->ball_vx + i);
+    Reg vy = V::Load(args->ball_vy + i);
+    Reg speed = V::Load(args->paddle_speed + i);
+    Reg left_paddle_y = V::Load(args->left_paddle_y + i);
+    Reg right_paddle_y = V::Load(args->right_paddle_y + i);
+    Reg seconds_delta = V::Set1(args->seconds_delta);
+
+    if (args->left_follows_ball) {
+      left_paddle_y = FollowBallSimd<V>(*args, started, left_paddle_y, y,
+                                        speed, args->left_moving + i);
+      V::Store(args->left_paddle_y + i, left_paddle_y);
+    }
+    if (args->right_follows_ball) {
+      right_paddle_y = FollowBallSimd<V>(*args, started, right_paddle_y, y,
+                                         speed, args->right_moving + i);
+      V::Store(args->right_paddle_y + i, right_paddle_y);
+    }
+
+    while (true) {
+      // Time to the X and Y walls, picking the wall based on direction. Only
+      // one division per axis: pick the distance first, then divide. Division
+      // by a zero velocity is harmless, it gets masked out.
+      Reg moving_left = V::Less(vx, zero);
+      Reg moving_right = V::Greater(vx, zero);
+      Reg x_distance = V::Select(moving_left, V::Sub(valid_left, x),
+                                 V::Sub(valid_right, V::Add(x, ball_width)));
+      Reg time_to_x_wall = V::Select(V::Or(moving_left, moving_right),
+                                     V::Div(x_distance, vx), infinity);
+
+      Reg moving_up = V::Less(vy, zero);
+      Reg moving_down = V::Greater(vy, zero);
+      Reg y_distance = V::Select(moving_up, V::Sub(valid_top, y),
+                                 V::Sub(valid_bottom, V::Add(y, ball_height)));
+      Reg time_to_y_wall = V::Select(V::Or(moving_up, moving_down),
+                                     V::Div(y_distance, vy), infinity);
+
+      int bad = V::MoveMask(V::And(
+          running, V::Or(V::Less(time_to_x_wall, zero),
+                         V::Less(time_to_y_wall, zero))));
+      if (bad != 0) {
+        args->bad_board = i + __builtin_ctz(bad);
+        running = V::AndNot(V::Or(V::Less(time_to_x_wall, zero),
+                                  V::Less(time_to_y_wall, zero)),
+                            running);
+      }
+
+      Reg hits_x_wall = V::Less(time_to_x_wall, time_to_y_wall);
+      Reg time_to_wall = V::Select(hits_x_wall, time_to_x_wall, time_to_y_wall);
+      Reg bouncing = V::And(running, V::Less(time_to_wall, seconds_delta));
+      if (V::MoveMask(bouncing) == 0) {
+        break;
+      }
+
+      // Move the bouncing balls up to the wall.
+      x = V::Select(bouncing, V::Add(x, V::Mul(time_to_wall, vx)), x);
+      y = V::Select(bouncing, V::Add(y, V::Mul(time_to_wall, vy)), y);
+      seconds_delta =
+          V::Select(bouncing, V::Sub(seconds_delta, time_to_wall),
+                    seconds_delta);
+
+      // TOP and BOTTOM walls just reflect the ball.
+      Reg y_bounce = V::AndNot(hits_x_wall, bouncing);
+      vy = V::Select(y_bounce, V::Mul(vy, minus_one), vy);
+
+      // LEFT and RIGHT walls need a paddle in the way.
+      Reg x_bounce = V::And(hits_x_wall, bouncing);
+      Reg paddle_y = V::Select(moving_left, left_paddle_y, right_paddle_y);
+      Reg missed = V::Or(V::Greater(y, V::Add(paddle_y, paddle_height)),
+                         V::Less(V::Add(y, ball_height), paddle_y));
+      Reg returned = V::AndNot(missed, x_bounce);
+      Reg scored = V::And(missed, x_bounce);
+
+      vx = V::Select(returned, V::Mul(V::Mul(vx, minus_one), ball_speedup),
+                     vx);
+      vy = V::Select(returned, V::Mul(vy, ball_speedup), vy);
+      speed = V::Select(returned, V::Mul(speed, paddle_speedup), speed);
+      args->paddle_bounces += __builtin_popcount(V::MoveMask(returned));
+
+      int scored_bits = V::MoveMask(scored);
+      if (scored_bits != 0) {
+        int left_bits = V::MoveMask(moving_left);
+        for (int lane = 0; lane < kLanes; ++lane) {
+          if (scored_bits & (1 << lane)) {
+            if (left_bits & (1 << lane)) {
+              args->right_score[i + lane] += 1;
+            } else {
+              args->left_score[i + lane] += 1;
+            }
+            args->game_over[i + lane] = 1;
+          }
+        }
+        running = V::AndNot(scored, running);
+      }
+    }
+
+    // Spend whatever time is left moving freely.
+    x = V::Select(started, V::Add(x, V::Mul(seconds_delta, vx)), x);
+    y = V::Select(started, V::Add(y, V::Mul(seconds_delta, vy)), y);
+
+    V::Store(args->ball_x + i, x);
+    V::Store(args->ball_y + i, y);
+    V::Store(args->ball_vx + i, vx);
+    V::Store(args->ball_vy + i, vy);
+    V::Store(args->paddle_speed + i, speed);
+  }
+
+  // Leftover boards which don't fill a whole register.
+  if (i < args->end) {
+    int begin = args->begin;
+    args->begin = i;
+    StepBoardsScalar(args);
+    args->begin = begin;
+  }
+}
+
+}  // namespace
+}  // namespace pong
+
+#endif  // BATCH_KERNEL_SIMD_H_
@@ -0,0 +1,51 @@
+// SSE2 version of the batch board kernel: two boards per instruction. See
+// batch_kernel_simd.h for the actual kernel.
+
+#include "batch_kernel.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+
+#include "batch_kernel_simd.h"
+
+namespace pong {
+
+namespace {
+struct Sse2 {
+  typedef __m128d Reg;
+  static const int kLanes = 2;
+
+  static Reg Load(const double* p) { return _mm_loadu_pd(p); }
+  static void Store(double* p, Reg a) { _mm_storeu_pd(p, a); }
+  static Reg Set1(double a) { return _mm_set1_pd(a); }
+  static Reg AllOnes() { return _mm_castsi128_pd(_mm_set1_epi32(-1)); }
+
+  static Reg Add(Reg a, Reg b) { return _mm_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm_div_pd(a, b); }
+
+  static Reg Less(Reg a, Reg b) { return _mm_cmplt_pd(a, b); }
+  static Reg Greater(Reg a, Reg b) { return _mm_cmpgt_pd(a, b); }
+  static Reg And(Reg a, Reg b) { return _mm_and_pd(a, b); }
+  static Reg Or(Reg a, Reg b) { return _mm_or_pd(a, b); }
+  static Reg AndNot(Reg mask, Reg a) { return _mm_andnot_pd(mask, a); }
+  // SSE2 has no blendv, so do it with bitwise ops.
+  static Reg Select(Reg mask, Reg if_true, Reg if_false) {
+    return _mm_or_pd(_mm_and_pd(mask, if_true),
+                     _mm_andnot_pd(mask, if_false));
+  }
+
+  static int MoveMask(Reg mask) { return _mm_movemask_pd(mask); }
+  static Reg MaskFromBytes(const uint8_t* bytes) {
+    return _mm_castsi128_pd(_mm_set_epi64x(bytes[1] ? -1 : 0,
+                                           bytes[0] ? -1 : 0));
+  }
+};
+}  // namespace
+
+void StepBoardsSse2(BatchKernelArgs* args) { StepBoardsSimd<Sse2>(args); }
+
+}  // namespace pong
+
+#endif  // defined(__x86_64__)
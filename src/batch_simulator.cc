@@ -0,0 +1,231 @@
+#include <cmath>
+#include <sstream>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <glog/logging.h>
+
+#include "batch_kernel.h"
+#include "batch_simulator.h"
+
+namespace pong {
+
+std::ostream& operator<<(std::ostream& stream, BatchKernel kernel) {
+  switch (kernel) {
+    case BatchKernel::SCALAR: return (stream << "SCALAR");
+    case BatchKernel::SSE2:   return (stream << "SSE2");
+    case BatchKernel::AVX2:   return (stream << "AVX2");
+    default:
+      LOG(WARNING) << "Tried to serialize unexpected pong::BatchKernel value: "
+                   << static_cast<int>(kernel);
+      return stream << static_cast<int>(kernel);
+  }
+}
+
+bool BatchKernelSupported(BatchKernel kernel) {
+  switch (kernel) {
+    case BatchKernel::SCALAR:
+      return true;
+#if defined(__x86_64__)
+    case BatchKernel::SSE2:
+      return true;  // part of the x86-64 baseline
+    case BatchKernel::AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+BatchKernel BestBatchKernel() {
+  // SSE2's two lanes don't make up for the extra blending and masking, so
+  // it measures slower than scalar, and is only used if asked for.
+  if (BatchKernelSupported(BatchKernel::AVX2)) {
+    return BatchKernel::AVX2;
+  }
+  return BatchKernel::SCALAR;
+}
+
+bool ParseBatchKernel(const std::string& name, BatchKernel* kernel) {
+  std::string upper = boost::algorithm::to_upper_copy(name);
+  for (BatchKernel candidate :
+       {BatchKernel::SCALAR, BatchKernel::SSE2, BatchKernel::AVX2}) {
+    std::ostringstream candidate_name;
+    candidate_name << candidate;
+    if (upper == candidate_name.str()) {
+      *kernel = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+BatchSimulator::BatchSimulator(int num_boards)
+    : ball_x_(num_boards),
+      ball_y_(num_boards),
+      ball_vx_(num_boards),
+      ball_vy_(num_boards),
+      left_paddle_y_(num_boards),
+      right_paddle_y_(num_boards),
+      paddle_speed_(num_boards),
+      left_score_(num_boards, 0),
+      right_score_(num_boards, 0),
+      game_over_(num_boards),
+      left_moves_(num_boards, MoveDirection::NONE),
+      right_moves_(num_boards, MoveDirection::NONE),
+      num_boards_(num_boards),
+      kernel_(BestBatchKernel()),
+      left_moving_(num_boards, false),
+      right_moving_(num_boards, false) {
+  CHECK(num_boards >= 0) << "Negative board count: " << num_boards;
+
+  const Ball& ball = initial_board_.ball_;
+  const Paddle& paddle = initial_board_.left_paddle_;
+  ball_width_ = ball.bounds_.Width();
+  ball_height_ = ball.bounds_.Height();
+  paddle_height_ = paddle.bounds_.Height();
+  paddle_top_bound_ = paddle.top_bound_;
+  paddle_bottom_bound_ = paddle.bottom_bound_;
+  valid_left_ = ball.valid_space_.Left();
+  valid_right_ = ball.valid_space_.Right();
+  valid_top_ = ball.valid_space_.Top();
+  valid_bottom_ = ball.valid_space_.Bottom();
+
+  for (int i = 0; i < num_boards_; ++i) {
+    ResetBoard(i);
+  }
+}
+
+void BatchSimulator::ResetBoard(int board) {
+  DCHECK(board >= 0 && board < num_boards_) << "Bad board index: " << board;
+  const GameBoard& game = initial_board_;
+  ball_x_[board] = game.ball_.bounds_.top_left().x();
+  ball_y_[board] = game.ball_.bounds_.top_left().y();
+  ball_vx_[board] = game.ball_.velocity_.x();
+  ball_vy_[board] = game.ball_.velocity_.y();
+  left_paddle_y_[board] = game.left_paddle_.bounds_.top_left().y();
+  right_paddle_y_[board] = game.right_paddle_.bounds_.top_left().y();
+  paddle_speed_[board] = game.left_paddle_.max_speed_;
+  game_over_[board] = false;
+}
+
+void BatchSimulator::ServeFinishedBoards() {
+  for (int i = 0; i < num_boards_; ++i) {
+    if (game_over_[i]) {
+      ResetBoard(i);
+    }
+  }
+}
+
+void BatchSimulator::SetKernel(BatchKernel kernel) {
+  CHECK(BatchKernelSupported(kernel))
+      << "Batch kernel " << kernel << " isn't supported on this machine";
+  kernel_ = kernel;
+}
+
+void BatchSimulator::Step(double seconds_delta) {
+  // Same order as GameBoard::Update: left paddle, right paddle, then ball.
+  // FOLLOW_BALL_Y paddles are moved by the kernel. The other policies don't
+  // look at the ball, so they can all be moved up front.
+  bool left_follows_ball = (left_policy_ == BatchPolicy::FOLLOW_BALL_Y);
+  bool right_follows_ball = (right_policy_ == BatchPolicy::FOLLOW_BALL_Y);
+  for (int i = 0; i < num_boards_; ++i) {
+    if (game_over_[i]) {
+      continue;
+    }
+    if (!left_follows_ball) {
+      UpdatePaddle(seconds_delta, paddle_speed_[i],
+                   PolicyMove(left_policy_, i, &left_moves_),
+                   &left_paddle_y_[i]);
+    }
+    if (!right_follows_ball) {
+      UpdatePaddle(seconds_delta, paddle_speed_[i],
+                   PolicyMove(right_policy_, i, &right_moves_),
+                   &right_paddle_y_[i]);
+    }
+  }
+
+  BatchKernelArgs args;
+  args.ball_x = ball_x_.data();
+  args.ball_y = ball_y_.data();
+  args.ball_vx = ball_vx_.data();
+  args.ball_vy = ball_vy_.data();
+  args.left_paddle_y = left_paddle_y_.data();
+  args.right_paddle_y = right_paddle_y_.data();
+  args.left_moving = left_moving_.data();
+  args.right_moving = right_moving_.data();
+  args.paddle_speed = paddle_speed_.data();
+  args.left_score = left_score_.data();
+  args.right_score = right_score_.data();
+  args.game_over = game_over_.data();
+  args.ball_width = ball_width_;
+  args.ball_height = ball_height_;
+  args.paddle_height = paddle_height_;
+  args.paddle_top_bound = paddle_top_bound_;
+  args.paddle_bottom_bound = paddle_bottom_bound_;
+  args.valid_left = valid_left_;
+  args.valid_right = valid_right_;
+  args.valid_top = valid_top_;
+  args.valid_bottom = valid_bottom_;
+  args.ball_speedup = kBallSpeedupFactor;
+  args.paddle_speedup = kPaddleSpeedupFactor;
+  args.left_follows_ball = left_follows_ball;
+  args.right_follows_ball = right_follows_ball;
+  args.begin = 0;
+  args.end = num_boards_;
+  args.seconds_delta = seconds_delta;
+  args.paddle_bounces = 0;
+  args.bad_board = -1;
+
+  switch (kernel_) {
+#if defined(__x86_64__)
+    case BatchKernel::AVX2:
+      StepBoardsAvx2(&args);
+      break;
+    case BatchKernel::SSE2:
+      StepBoardsSse2(&args);
+      break;
+#endif
+    default:
+      StepBoardsScalar(&args);
+      break;
+  }
+
+  CHECK(args.bad_board < 0)
+      << "Unexpected negative time_to_wall for board " << args.bad_board;
+  paddle_bounces_ += args.paddle_bounces;
+}
+
+MoveDirection BatchSimulator::PolicyMove(
+    BatchPolicy policy, int board,
+    const std::vector<MoveDirection>* external_moves) {
+  switch (policy) {
+    case BatchPolicy::NONE:
+      return MoveDirection::NONE;
+
+    case BatchPolicy::EXTERNAL:
+      return (*external_moves)[board];
+
+    default:
+      LOG(FATAL) << "Unexpected BatchPolicy: " << static_cast<int>(policy);
+  }
+  return MoveDirection::NONE;
+}
+
+void BatchSimulator::UpdatePaddle(double seconds_delta, double speed,
+                                  MoveDirection direction, double* paddle_y) {
+  // Mirrors Paddle::Update.
+  double delta_position = seconds_delta * speed;
+  if (direction == MoveDirection::UP) {
+    *paddle_y -= delta_position;
+  } else if (direction == MoveDirection::DOWN) {
+    *paddle_y += delta_position;
+  }
+
+  if (*paddle_y < paddle_top_bound_) {
+    *paddle_y = paddle_top_bound_;
+  }
+  if (*paddle_y + paddle_height_ > paddle_bottom_bound_) {
+    *paddle_y = paddle_bottom_bound_ - paddle_height_;
+  }
+}
+
+}  // namespace pong
@@ -0,0 +1,137 @@
+// Headless simulation of many independent pong games at once. This is meant
+// for evaluating controllers, where we care about simulating as many rallies
+// as possible rather than about drawing any of them.
+
+#ifndef BATCH_SIMULATOR_H_
+#define BATCH_SIMULATOR_H_
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "controller.h"
+#include "game.h"
+
+namespace pong {
+
+// Which implementation of the board update to use. See batch_kernel.h.
+enum class BatchKernel {
+  SCALAR,
+  SSE2,  // 2 boards per instruction
+  AVX2,  // 4 boards per instruction
+};
+std::ostream& operator<<(std::ostream& stream, BatchKernel kernel);
+
+// Whether `kernel` was compiled in and is supported by the CPU we're running
+// on.
+bool BatchKernelSupported(BatchKernel kernel);
+
+// The fastest kernel which BatchKernelSupported(): AVX2 if the CPU has it,
+// scalar otherwise.
+BatchKernel BestBatchKernel();
+
+// Parses a kernel name as printed by operator<< (case-insensitive). Returns
+// false if `name` isn't a known kernel.
+bool ParseBatchKernel(const std::string& name, BatchKernel* kernel);
+
+// How a paddle in a BatchSimulator decides where to move. The batch simulator
+// can't call into PaddleController implementations (they need a full
+// GameBoard), so the common policies are re-implemented on the packed arrays.
+enum class BatchPolicy {
+  NONE,           // paddle never moves
+  FOLLOW_BALL_Y,  // same behaviour as FollowBallYController
+  EXTERNAL,       // moves are read from left_moves_/right_moves_ every step
+};
+
+// Steps N game boards using the same physics as GameBoard::Update. Board
+// state is stored as a structure of arrays so that the inner loops only touch
+// the fields they need. Every board shares the geometry set up by
+// GameBoard::SetupNewGame (board size, ball size, paddle size); only the
+// dynamic state is stored per board.
+//
+// Unlike GameBoard, a finished board just sits idle until ServeFinishedBoards()
+// or ResetBoard() is called for it.
+class BatchSimulator {
+ public:
+  explicit BatchSimulator(int num_boards);
+
+  int NumBoards() const { return num_boards_; }
+
+  // Equivalent of GameBoard::SetupNewGame for a single board. Scores are kept.
+  void ResetBoard(int board);
+
+  // Calls ResetBoard() on every board which is currently game-over.
+  void ServeFinishedBoards();
+
+  void SetPolicies(BatchPolicy left, BatchPolicy right) {
+    left_policy_ = left;
+    right_policy_ = right;
+  }
+
+  // Selects the board update kernel. Defaults to BestBatchKernel(). All
+  // kernels give bit-identical results, they only differ in speed.
+  void SetKernel(BatchKernel kernel);
+  BatchKernel Kernel() const { return kernel_; }
+
+  // Advances every running board by `seconds_delta`.
+  void Step(double seconds_delta);
+
+  // Per-board dynamic state. Positions refer to the top-left corner of the
+  // game piece, like BoundingBox::top_left().
+  std::vector<double> ball_x_;
+  std::vector<double> ball_y_;
+  std::vector<double> ball_vx_;
+  std::vector<double> ball_vy_;
+  std::vector<double> left_paddle_y_;
+  std::vector<double> right_paddle_y_;
+  // Both paddles always speed up together, so one speed is enough per board.
+  std::vector<double> paddle_speed_;
+  std::vector<int> left_score_;
+  std::vector<int> right_score_;
+  std::vector<uint8_t> game_over_;
+
+  // Per-board moves for paddles using BatchPolicy::EXTERNAL.
+  std::vector<MoveDirection> left_moves_;
+  std::vector<MoveDirection> right_moves_;
+
+  // Number of times any ball was returned by a paddle. Handy as a measure of
+  // how much work was actually simulated.
+  int64_t paddle_bounces_ = 0;
+
+ private:
+  // Move for paddles which don't follow the ball. Those are handled by the
+  // kernels.
+  MoveDirection PolicyMove(BatchPolicy policy, int board,
+                           const std::vector<MoveDirection>* external_moves);
+  void UpdatePaddle(double seconds_delta, double speed, MoveDirection direction,
+                    double* paddle_y);
+
+  int num_boards_;
+  BatchKernel kernel_;
+  BatchPolicy left_policy_ = BatchPolicy::FOLLOW_BALL_Y;
+  BatchPolicy right_policy_ = BatchPolicy::FOLLOW_BALL_Y;
+
+  // State for the FOLLOW_BALL_Y policy, one per board and side. Like the state
+  // in FollowBallYController, this survives new games being served.
+  std::vector<uint8_t> left_moving_;
+  std::vector<uint8_t> right_moving_;
+
+  // Freshly set-up board from which new games are served.
+  GameBoard initial_board_;
+
+  // Geometry shared by all boards. Copied out of initial_board_.
+  double ball_width_;
+  double ball_height_;
+  double paddle_height_;
+  double paddle_top_bound_;
+  double paddle_bottom_bound_;
+  double valid_left_;
+  double valid_right_;
+  double valid_top_;
+  double valid_bottom_;
+};
+
+}  // namespace pong
+
+#endif  // BATCH_SIMULATOR_H_
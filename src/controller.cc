@@ -1,7 +1,10 @@
 #include <math.h>
+#include <algorithm>
 
 #include "controller.h"
 #include "game.h"
+#include "search.h"
+#include "util.h"
 
 namespace pong {
 
@@ -18,30 +21,79 @@ std::ostream& operator<<(std::ostream& stream, MoveDirection dir) {
   }
 }
 
+constexpr double SdlPaddleController::kMaxCatchUpSecs;
+
 MoveDirection SdlPaddleController::DesiredMove(const GameBoard& game,
                                                const Paddle& paddle) {
-  if (up_pressed_ && !down_pressed_) {
-    return MoveDirection::UP;
-  } else if (down_pressed_ && !up_pressed_) {
+  if (!timed_) {
+    if (up_pressed_ && !down_pressed_) {
+      return MoveDirection::UP;
+    } else if (down_pressed_ && !up_pressed_) {
+      return MoveDirection::DOWN;
+    }
+    return MoveDirection::NONE;
+  }
+
+  // Move a whole tick once at least half a tick is owed, so the paddle is
+  // never more than half a tick away from where the keys put it.
+  if (owed_secs_ >= seconds_per_tick_ / 2) {
+    owed_secs_ -= seconds_per_tick_;
     return MoveDirection::DOWN;
+  } else if (owed_secs_ <= -seconds_per_tick_ / 2) {
+    owed_secs_ += seconds_per_tick_;
+    return MoveDirection::UP;
   }
   return MoveDirection::NONE;
 }
 
 void SdlPaddleController::ProcessSdlEvent(const SDL_Event& event) {
-  if (event.type == SDL_KEYDOWN) {
-    if (event.key.keysym.sym == up_key_) {
-      up_pressed_ = true;
-    } else if (event.key.keysym.sym == down_key_) {
-      down_pressed_ = true;
-    }
-  } else if (event.type == SDL_KEYUP) {
-    if (event.key.keysym.sym == up_key_) {
-      up_pressed_ = false;
-    } else if (event.key.keysym.sym == down_key_) {
-      down_pressed_ = false;
-    }
+  if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) {
+    return;
+  }
+  bool pressed = event.type == SDL_KEYDOWN;
+  double event_secs = event.key.timestamp / 1000.0;
+  if (timed_) {
+    AccountUntil(event_secs);
+  }
+  int held_before = HeldSign();
+  if (event.key.keysym.sym == up_key_) {
+    up_pressed_ = pressed;
+  } else if (event.key.keysym.sym == down_key_) {
+    down_pressed_ = pressed;
   }
+  if (timed_ && event_secs < accounted_secs_) {
+    // The event took a while to get here, and the time since it happened was
+    // counted as if the keys hadn't changed yet. Count it again properly.
+    owed_secs_ += (HeldSign() - held_before) * (accounted_secs_ - event_secs);
+  }
+}
+
+void SdlPaddleController::BeginTick(double tick_end_secs,
+                                    double seconds_per_tick) {
+  if (!timed_) {
+    timed_ = true;
+    accounted_secs_ = tick_end_secs - seconds_per_tick;
+  }
+  seconds_per_tick_ = seconds_per_tick;
+  AccountUntil(tick_end_secs);
+}
+
+void SdlPaddleController::ResetTiming() {
+  timed_ = false;
+  owed_secs_ = 0;
+}
+
+void SdlPaddleController::AccountUntil(double secs) {
+  if (secs <= accounted_secs_) {
+    return;
+  }
+  if (secs - accounted_secs_ > kMaxCatchUpSecs) {
+    accounted_secs_ = secs - seconds_per_tick_;
+  }
+  owed_secs_ += HeldSign() * (secs - accounted_secs_);
+  owed_secs_ =
+      std::max(-kMaxCatchUpSecs, std::min(owed_secs_, kMaxCatchUpSecs));
+  accounted_secs_ = secs;
 }
 
 MoveDirection FollowBallYController::DesiredMove(const GameBoard& game,
@@ -64,4 +116,97 @@ MoveDirection FollowBallYController::DesiredMove(const GameBoard& game,
   return MoveDirection::NONE;
 }
 
+MoveDirection PredictiveController::DesiredMove(const GameBoard& game,
+                                               const Paddle& paddle) {
+  const Eigen::Vector2d& velocity = game.ball_.velocity_;
+  double ball_x = game.ball_.bounds_.Left();
+  // Bounces off the top and bottom walls only flip the sign of vy, and don't
+  // change where the ball ends up, so they don't need a new prediction.
+  // Anything else that moves the ball backwards (a new serve, a rollback) is
+  // a different path.
+  bool same_path = velocity.x() == predicted_vx_ &&
+                   std::abs(velocity.y()) == predicted_vy_ &&
+                   (ball_x - last_ball_x_) * velocity.x() >= 0;
+  if (!same_path) {
+    target_y_ = PredictInterceptY(game, &paddle == &game.left_paddle_);
+    predicted_vx_ = velocity.x();
+    predicted_vy_ = std::abs(velocity.y());
+  }
+  last_ball_x_ = ball_x;
+
+  // Same hysteresis as FollowBallYController, but tighter, since the target
+  // doesn't wander.
+  double start_move_tolerance = paddle.bounds_.Height() / 4;
+  double stop_move_tolerance = paddle.bounds_.Height() / 8;
+  double delta_y = paddle.bounds_.Center().y() - target_y_;
+  if ((!moving_ && std::abs(delta_y) > start_move_tolerance) ||
+      (moving_ && std::abs(delta_y) > stop_move_tolerance)) {
+    moving_ = true;
+    return delta_y < 0 ? MoveDirection::DOWN : MoveDirection::UP;
+  }
+  moving_ = false;
+  return MoveDirection::NONE;
+}
+
+double PredictiveController::PredictInterceptY(const GameBoard& game,
+                                               bool left_side) {
+  const Ball& ball = game.ball_;
+  const BoundingBox& space = ball.valid_space_;
+  double vx = ball.velocity_.x();
+  if (vx == 0) {
+    return ball.bounds_.Center().y();
+  }
+
+  // How far the ball travels in X before it reaches our side: straight there
+  // if it's coming at us, otherwise to the far side and back. Bouncing off a
+  // paddle only reverses vx and scales the velocity, so the path's slope
+  // stays the same either way.
+  double travel_x = space.Width() - ball.bounds_.Width();  // one crossing
+  bool coming_at_us = left_side == (vx < 0);
+  double to_far_wall = vx < 0 ? ball.bounds_.Left() - space.Left()
+                              : space.Right() - ball.bounds_.Right();
+  double distance_x =
+      coming_at_us ? to_far_wall : to_far_wall + travel_x;
+
+  // Unfold the bounces off the top and bottom walls: in unfolded space the
+  // ball travels in a straight line, and every 2 * range of it maps back
+  // onto one trip down and up the board.
+  double range = space.Height() - ball.bounds_.Height();
+  if (range <= 0) {
+    return space.Center().y();
+  }
+  double unfolded = ball.bounds_.Top() - space.Top() +
+                    distance_x * ball.velocity_.y() / std::abs(vx);
+  double folded = std::fmod(unfolded, 2 * range);
+  if (folded < 0) {
+    folded += 2 * range;
+  }
+  if (folded > range) {
+    folded = 2 * range - folded;
+  }
+  return space.Top() + folded + ball.bounds_.Height() / 2;
+}
+
+std::unique_ptr<PaddleController> NewAiController(const std::string& name) {
+  if (name == "none") {
+    return util::make_unique<PaddleController>();
+  } else if (name == "follow_ball_y") {
+    return util::make_unique<FollowBallYController>();
+  } else if (name == "predictive") {
+    return util::make_unique<PredictiveController>();
+  } else if (name == "search") {
+    // A node budget rather than a time budget, so that tournaments stay
+    // reproducible.
+    SearchParams params;
+    params.time_budget_secs = 0;
+    params.node_budget = 2000;
+    return util::make_unique<SearchController>(params);
+  }
+  return nullptr;
+}
+
+std::vector<std::string> AiControllerNames() {
+  return {"none", "follow_ball_y", "predictive", "search"};
+}
+
 }  // namespace pong
@@ -1,7 +1,10 @@
 #ifndef CONTROLLER_H_
 #define CONTROLLER_H_
 
+#include <memory>
 #include <ostream>
+#include <string>
+#include <vector>
 
 #include <SDL.h>
 
@@ -31,6 +34,14 @@ class PaddleController {
 
 // This controller takes input from SDL keypress events. It's meant to allow a
 // human player to control a paddle.
+//
+// Once BeginTick() has been called, moves follow how long each key was held,
+// going by the events' timestamps, rather than which keys happened to be down
+// when a tick ran. A tap shorter than a frame still moves the paddle, and a
+// key pressed halfway through a frame moves it for half a frame's worth of
+// ticks. Held time is paid out in whole ticks, so the paddle can run a tick
+// or so behind the keys, and time held before the event got here is made up
+// by carrying on moving after the key is let go.
 class SdlPaddleController : public PaddleController {
  public:
   SdlPaddleController(SDL_Keycode up_key = SDLK_UP,
@@ -45,12 +56,37 @@ class SdlPaddleController : public PaddleController {
   // nice.
   void ProcessSdlEvent(const SDL_Event& event);
 
+  // Call before each tick which will ask for a move, with the time that tick
+  // ends at, on the same clock as event timestamps (SDL_GetTicks(), but in
+  // seconds).
+  void BeginTick(double tick_end_secs, double seconds_per_tick);
+
+  // Call while the game isn't being ticked (paused, rewinding, between
+  // points), so keys held meanwhile aren't made up for once it is again.
+  // The next BeginTick() starts counting afresh.
+  void ResetTiming();
+
  private:
+  // Held time older than this is forgotten rather than made up: nothing was
+  // ticking (e.g. the game was paused), or the game fell badly behind.
+  static constexpr double kMaxCatchUpSecs = 0.25;
+
+  // +1 if only the down key is held, -1 if only the up key is, 0 otherwise.
+  int HeldSign() const { return down_pressed_ - up_pressed_; }
+
+  // Counts the keys' current state as having lasted until `secs`.
+  void AccountUntil(double secs);
+
   SDL_Keycode up_key_;
   SDL_Keycode down_key_;
 
   bool up_pressed_ = false;
   bool down_pressed_ = false;
+
+  bool timed_ = false;  // whether BeginTick() has been called
+  double seconds_per_tick_ = 0;
+  double accounted_secs_ = 0;  // held time is counted up to here
+  double owed_secs_ = 0;  // held but not moved yet; positive means down
 };
 
 // This controller represents a simple AI which always tries to keep the center
@@ -63,7 +99,52 @@ class FollowBallYController : public PaddleController {
   bool moving_ = false;
 };
 
-// TODO Add a controller which allows for net play
+// Plays whatever move it was last told to. Useful when the moves are decided
+// somewhere other than inside DesiredMove(), e.g. by a search or an agent
+// being trained.
+class FixedMoveController : public PaddleController {
+ public:
+  MoveDirection DesiredMove(const GameBoard& game,
+                            const Paddle& paddle) override {
+    return move_;
+  }
+  void SetMove(MoveDirection move) { move_ = move; }
+
+ private:
+  MoveDirection move_ = MoveDirection::NONE;
+};
+
+// This controller works out where the ball will next reach its paddle, and
+// goes there. The ball's path is unfolded across bounces off the top and
+// bottom walls, so the prediction is a closed-form calculation rather than a
+// simulation. While the ball is heading away, it assumes the other player
+// returns it. The prediction is kept until the ball's velocity changes (or
+// the ball jumps, e.g. for a new serve), so most ticks cost a comparison.
+class PredictiveController : public PaddleController {
+ public:
+  MoveDirection DesiredMove(const GameBoard& game,
+                            const Paddle& paddle) override;
+
+  // Where the center of the ball will be, in Y, when it next gets to the
+  // paddle on the given side.
+  static double PredictInterceptY(const GameBoard& game, bool left_side);
+
+ private:
+  // The ball's velocity and X position when target_y_ was predicted.
+  double predicted_vx_ = 0;
+  double predicted_vy_ = 0;
+  double last_ball_x_ = 0;
+  double target_y_ = 0;
+  bool moving_ = false;
+};
+
+// For net play, see NetworkPaddleController in netplay.h.
+
+// Creates a new computer-driven controller from its name, as listed by
+// AiControllerNames(). Returns null if there is no such controller. Meant for
+// tools which pick controllers on the command line.
+std::unique_ptr<PaddleController> NewAiController(const std::string& name);
+std::vector<std::string> AiControllerNames();
 
 }  // namespace pong
 
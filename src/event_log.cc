@@ -0,0 +1,176 @@
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "event_log.h"
+#include "game.h"
+
+namespace pong {
+
+namespace {
+// How long the background thread sleeps when there's nothing to write.
+constexpr auto kDrainInterval = std::chrono::milliseconds(2);
+
+GameEvent NewEvent(GameEvent::Type type) {
+  GameEvent event;
+  memset(&event, 0, sizeof(event));
+  event.type = type;
+  return event;
+}
+}  // namespace
+
+GameEvent GameEvent::Bounce(BoundingWall wall, const Eigen::Vector2d& position,
+                            const Eigen::Vector2d& velocity) {
+  GameEvent event = NewEvent(Type::BOUNCE);
+  event.code = static_cast<uint8_t>(wall);
+  event.values[0] = position.x();
+  event.values[1] = position.y();
+  event.values[2] = velocity.x();
+  event.values[3] = velocity.y();
+  return event;
+}
+
+GameEvent GameEvent::Score(int player, int left_score, int right_score) {
+  GameEvent event = NewEvent(Type::SCORE);
+  event.code = player;
+  event.left_score = left_score;
+  event.right_score = right_score;
+  return event;
+}
+
+GameEvent GameEvent::Pause(bool paused) {
+  GameEvent event = NewEvent(Type::PAUSE);
+  event.code = paused;
+  return event;
+}
+
+GameEvent GameEvent::FrameOverrun(double frame_secs, double budget_secs) {
+  GameEvent event = NewEvent(Type::FRAME_OVERRUN);
+  event.values[0] = frame_secs;
+  event.values[1] = budget_secs;
+  return event;
+}
+
+std::ostream& operator<<(std::ostream& stream, const GameEvent& event) {
+  using boost::format;
+  stream << format("%.6f ") % (event.time_ns / 1e9);
+  switch (event.type) {
+    case GameEvent::Type::BOUNCE:
+      return stream << format("BOUNCE wall=%s position={%lf %lf} "
+                              "velocity={%lf %lf}") %
+                           static_cast<BoundingWall>(event.code) %
+                           event.values[0] % event.values[1] %
+                           event.values[2] % event.values[3];
+    case GameEvent::Type::SCORE:
+      return stream << format("SCORE player=%s left=%d right=%d") %
+                           static_cast<GameBoard::Player>(event.code) %
+                           event.left_score % event.right_score;
+    case GameEvent::Type::PAUSE:
+      return stream << (event.code ? "PAUSE" : "UNPAUSE");
+    case GameEvent::Type::FRAME_OVERRUN:
+      return stream << format("FRAME_OVERRUN frame=%.2fms budget=%.2fms") %
+                           (event.values[0] * 1000) %
+                           (event.values[1] * 1000);
+    default:
+      return stream << "UNKNOWN type=" << static_cast<int>(event.type);
+  }
+}
+
+EventLog::EventLog(const std::string& path, int capacity, int num_producers) {
+  CHECK_GT(num_producers, 0);
+  for (int i = 0; i < num_producers; ++i) {
+    producers_.push_back(util::make_unique<Producer>(capacity));
+  }
+  if (!path.empty()) {
+    file_.open(path);
+    PCHECK(file_) << "Could not open event log " << path;
+  }
+  drain_thread_ = std::thread([this] { Drain(); });
+}
+
+EventLog::~EventLog() {
+  stopping_.store(true, std::memory_order_release);
+  drain_thread_.join();
+  Stats stats = GetStats();
+  if (stats.dropped > 0) {
+    LOG(WARNING) << "Event log dropped " << stats.dropped << " of "
+                 << stats.logged + stats.dropped << " events";
+  }
+}
+
+void EventLog::Log(GameEvent event, int producer) {
+  event.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+  Producer& p = *producers_[producer];
+  // Only this thread writes the counters, so they don't need atomic
+  // increments; they're atomic so other threads can read them.
+  if (p.ring.TryPush(event)) {
+    p.logged.store(p.logged.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  } else {
+    p.dropped.store(p.dropped.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+  }
+}
+
+EventLog::Stats EventLog::GetStats() const {
+  Stats stats;
+  for (const auto& producer : producers_) {
+    stats.logged += producer->logged.load(std::memory_order_relaxed);
+    stats.dropped += producer->dropped.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void EventLog::Drain() {
+  GameEvent event;
+  while (true) {
+    // Read the flag first, so that everything logged before the destructor
+    // set it gets written by the final pass.
+    bool stopping = stopping_.load(std::memory_order_acquire);
+    batch_.clear();
+    for (const auto& producer : producers_) {
+      while (producer->ring.TryPop(&event)) {
+        batch_.push_back(event);
+      }
+    }
+    if (producers_.size() > 1) {
+      // Each ring is in order already, but not with respect to the others.
+      std::stable_sort(batch_.begin(), batch_.end(),
+                       [](const GameEvent& a, const GameEvent& b) {
+                         return a.time_ns < b.time_ns;
+                       });
+    }
+    for (const GameEvent& e : batch_) {
+      Write(e);
+    }
+    if (!batch_.empty() && file_.is_open()) {
+      file_.flush();
+    }
+    if (stopping) {
+      break;
+    }
+    std::this_thread::sleep_for(kDrainInterval);
+  }
+}
+
+void EventLog::Write(const GameEvent& event) {
+  if (file_.is_open()) {
+    file_ << event << "\n";
+  } else if (event.type == GameEvent::Type::BOUNCE) {
+    VLOG(1) << event;
+  } else {
+    LOG(INFO) << event;
+  }
+}
+
+std::ostream& operator<<(std::ostream& stream, const EventLog::Stats& stats) {
+  return stream << boost::format("logged=%d dropped=%d") % stats.logged %
+                       stats.dropped;
+}
+
+}  // namespace pong
@@ -0,0 +1,112 @@
+// Structured log of things happening in the game (bounces, points, pauses,
+// slow frames), cheap enough to leave on in the middle of a frame.
+//
+// Logging an event just copies a fixed-size record into a lock-free ring
+// buffer. A background thread drains the ring and does the slow parts:
+// formatting, and writing to a file or the glog INFO log. If the background
+// thread falls so far behind that the ring fills up, new events are dropped
+// (and counted) rather than making the game wait.
+//
+// Each thread which logs gets a ring of its own (a "producer"), so logging
+// threads never contend with each other.
+
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "geometry.h"
+#include "spsc_ring.h"
+#include "util.h"
+
+namespace pong {
+
+// One event, as plain data. Which fields mean what depends on the type; use
+// the factory functions rather than filling them in by hand.
+struct GameEvent {
+  enum class Type : uint8_t {
+    BOUNCE,         // wall: the wall hit; x, y, vx, vy: the ball after
+    SCORE,          // player: who scored; left_score, right_score: new score
+    PAUSE,          // paused: whether the game is now paused
+    FRAME_OVERRUN,  // frame_secs: time spent on a frame; budget_secs: allowed
+  };
+
+  static GameEvent Bounce(BoundingWall wall, const Eigen::Vector2d& position,
+                          const Eigen::Vector2d& velocity);
+  // `player` is a GameBoard::Player.
+  static GameEvent Score(int player, int left_score, int right_score);
+  static GameEvent Pause(bool paused);
+  static GameEvent FrameOverrun(double frame_secs, double budget_secs);
+
+  int64_t time_ns;  // steady clock; filled in by EventLog::Log()
+  Type type;
+  uint8_t code;  // wall, player or paused, as an integer
+  int32_t left_score;
+  int32_t right_score;
+  double values[4];  // x, y, vx, vy or frame_secs, budget_secs
+};
+static_assert(sizeof(GameEvent) <= 64, "GameEvent should fit in a cache line");
+
+std::ostream& operator<<(std::ostream& stream, const GameEvent& event);
+
+class EventLog {
+ public:
+  struct Stats {
+    int64_t logged = 0;   // events which made it into the ring
+    int64_t dropped = 0;  // events lost because the ring was full
+  };
+
+  // Writes events to `path`, one per line, or to the glog INFO log if `path`
+  // is empty (bounces only with --v=1 there; they're frequent). Each of the
+  // `num_producers` producers holds up to `capacity` events which haven't
+  // been written yet.
+  explicit EventLog(const std::string& path, int capacity = 4096,
+                    int num_producers = 1);
+
+  // Writes out every event logged so far.
+  ~EventLog();
+
+  // Queues `event` to be written, stamping it with the current time. Never
+  // blocks. Each producer, 0 to num_producers - 1, must always be used from
+  // the same thread.
+  void Log(GameEvent event, int producer = 0);
+
+  // May be called from any thread. Totals over all producers.
+  Stats GetStats() const;
+
+ private:
+  struct Producer {
+    explicit Producer(int capacity) : ring(capacity) {}
+
+    util::SpscRing<GameEvent> ring;
+    // Only the producer's thread writes these.
+    std::atomic<int64_t> logged{0};
+    std::atomic<int64_t> dropped{0};
+  };
+
+  void Drain();
+  void Write(const GameEvent& event);
+
+  std::vector<std::unique_ptr<Producer>> producers_;
+  std::vector<GameEvent> batch_;  // drain thread's
+  std::ofstream file_;  // not open when logging to glog
+  std::atomic<bool> stopping_{false};
+  std::thread drain_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventLog);
+};
+
+std::ostream& operator<<(std::ostream& stream, const EventLog::Stats& stats);
+
+}  // namespace pong
+
+#endif  // EVENT_LOG_H_
@@ -0,0 +1,331 @@
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/format.hpp>
+#include <glog/logging.h>
+#include <zlib.h>
+
+#include "frame_capture.h"
+
+namespace pong {
+
+namespace {
+// How long the writer sleeps when there's nothing to write, and how long
+// Capture() sleeps between checks when waiting for a free buffer.
+constexpr auto kWriterIdleInterval = std::chrono::milliseconds(1);
+constexpr auto kCaptureWaitInterval = std::chrono::microseconds(100);
+
+// BT.601 in studio range, which is what players assume of Y4M, in 8-bit
+// fixed point.
+uint8_t RgbToY(int r, int g, int b) {
+  return 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+}
+uint8_t RgbToU(int r, int g, int b) {
+  return 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+}
+uint8_t RgbToV(int r, int g, int b) {
+  return 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+}
+
+void PutBigEndian32(uint32_t value, uint8_t* out) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+void WritePngChunk(const char type[4], const uint8_t* data, uint32_t size,
+                   std::ostream* out) {
+  uint8_t header[8];
+  PutBigEndian32(size, header);
+  memcpy(header + 4, type, 4);
+  uLong crc = crc32(0, header + 4, 4);
+  if (size > 0) {  // crc32() resets on a null buffer
+    crc = crc32(crc, data, size);
+  }
+  uint8_t footer[4];
+  PutBigEndian32(crc, footer);
+  out->write(reinterpret_cast<const char*>(header), sizeof(header));
+  out->write(reinterpret_cast<const char*>(data), size);
+  out->write(reinterpret_cast<const char*>(footer), sizeof(footer));
+}
+}  // namespace
+
+std::ostream& operator<<(std::ostream& stream, CaptureFormat format) {
+  switch (format) {
+    case CaptureFormat::Y4M: return stream << "Y4M";
+    case CaptureFormat::PNG: return stream << "PNG";
+    default:
+      LOG(WARNING) << "Tried to serialize unexpected pong::CaptureFormat "
+                   << "value: " << static_cast<int>(format);
+      return stream << static_cast<int>(format);
+  }
+}
+
+bool ParseCaptureFormat(const std::string& name, CaptureFormat* format) {
+  std::string upper = boost::algorithm::to_upper_copy(name);
+  for (CaptureFormat candidate : {CaptureFormat::Y4M, CaptureFormat::PNG}) {
+    std::ostringstream candidate_name;
+    candidate_name << candidate;
+    if (upper == candidate_name.str()) {
+      *format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+FrameCapture::FrameCapture(const CaptureParams& params)
+    : params_(params),
+      free_frames_(params.num_buffers),
+      queued_frames_(params.num_buffers) {
+  CHECK_GT(params_.width, 0);
+  CHECK_GT(params_.height, 0);
+  CHECK_GT(params_.num_buffers, 0);
+  for (int i = 0; i < params_.num_buffers; ++i) {
+    frames_.push_back(util::make_unique<Frame>());
+    frames_.back()->pixels.resize(static_cast<size_t>(params_.width) *
+                                  params_.height);
+    CHECK(free_frames_.TryPush(frames_.back().get()));
+  }
+  if (params_.format == CaptureFormat::Y4M) {
+    y4m_file_.open(params_.path, std::ios::binary);
+    PCHECK(y4m_file_) << "Could not open " << params_.path;
+    // The frame rate is a ratio; keep three decimal places of it.
+    int64_t fps_millis = std::llround(params_.fps * 1000);
+    int64_t denominator = fps_millis % 1000 == 0 ? 1 : 1000;
+    y4m_file_ << boost::format("YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 "
+                               "C420jpeg\n") %
+                     params_.width % params_.height %
+                     (fps_millis / (1000 / denominator)) % denominator;
+  }
+  writer_thread_ = std::thread([this] { Write(); });
+}
+
+FrameCapture::~FrameCapture() { Finish(); }
+
+void FrameCapture::Finish() {
+  if (!writer_thread_.joinable()) {
+    return;
+  }
+  stopping_.store(true, std::memory_order_release);
+  writer_thread_.join();
+  Stats stats = GetStats();
+  if (stats.dropped > 0) {
+    LOG(WARNING) << "Frame capture dropped " << stats.dropped << " of "
+                 << stats.captured + stats.dropped << " frames";
+  }
+}
+
+bool FrameCapture::Capture(SDL_Surface* surface) {
+  const SDL_PixelFormat* format = surface->format;
+  CHECK(surface->w == params_.width && surface->h == params_.height)
+      << "Captured a " << surface->w << "x" << surface->h << " frame into a "
+      << params_.width << "x" << params_.height << " capture";
+  CHECK(format->BytesPerPixel == 4 && format->Rloss == 0 &&
+        format->Gloss == 0 && format->Bloss == 0)
+      << "Frame capture needs 8 bits per channel in 32-bit pixels";
+
+  int64_t number = next_number_++;
+  Frame* frame;
+  while (!free_frames_.TryPop(&frame)) {
+    if (params_.drop_when_full) {
+      // Capture() is dropped_'s only writer, so a plain store will do.
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      return false;
+    }
+    std::this_thread::sleep_for(kCaptureWaitInterval);
+  }
+
+  frame->number = number;
+  frame->shifts[0] = format->Rshift;
+  frame->shifts[1] = format->Gshift;
+  frame->shifts[2] = format->Bshift;
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_LockSurface(surface);
+  }
+  size_t row_bytes = static_cast<size_t>(surface->w) * 4;
+  for (int y = 0; y < surface->h; ++y) {
+    memcpy(frame->pixels.data() + static_cast<size_t>(y) * surface->w,
+           static_cast<const uint8_t*>(surface->pixels) + y * surface->pitch,
+           row_bytes);
+  }
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_UnlockSurface(surface);
+  }
+  // There are only as many frames as slots, so there's always room.
+  CHECK(queued_frames_.TryPush(frame));
+  captured_.store(captured_.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  return true;
+}
+
+FrameCapture::Stats FrameCapture::GetStats() const {
+  Stats stats;
+  stats.captured = captured_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.written = written_.load(std::memory_order_relaxed);
+  stats.write_secs = write_nanos_.load(std::memory_order_relaxed) / 1e9;
+  return stats;
+}
+
+void FrameCapture::Write() {
+  Frame* frame;
+  while (true) {
+    // Read the flag first, so that everything captured before Finish() set it
+    // gets written by the final pass.
+    bool stopping = stopping_.load(std::memory_order_acquire);
+    bool wrote = false;
+    while (queued_frames_.TryPop(&frame)) {
+      auto start = std::chrono::steady_clock::now();
+      if (params_.format == CaptureFormat::Y4M) {
+        WriteY4m(*frame);
+      } else {
+        WritePng(*frame);
+      }
+      int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+      CHECK(free_frames_.TryPush(frame));
+      written_.store(written_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      write_nanos_.store(write_nanos_.load(std::memory_order_relaxed) + nanos,
+                         std::memory_order_relaxed);
+      wrote = true;
+    }
+    if (wrote && y4m_file_.is_open()) {
+      y4m_file_.flush();
+    }
+    if (stopping) {
+      break;
+    }
+    if (!wrote) {
+      std::this_thread::sleep_for(kWriterIdleInterval);
+    }
+  }
+}
+
+void FrameCapture::WriteY4m(const Frame& frame) {
+  const int w = params_.width;
+  const int h = params_.height;
+  const int chroma_w = (w + 1) / 2;
+  const int chroma_h = (h + 1) / 2;
+  const size_t y_size = static_cast<size_t>(w) * h;
+  const size_t chroma_size = static_cast<size_t>(chroma_w) * chroma_h;
+  static const char kFrameHeader[] = "FRAME\n";
+
+  // A Y4M stream has no timestamps, so repeat the last frame over any which
+  // were dropped, to keep the video in time with the game.
+  if (!yuv_.empty()) {
+    for (; next_written_number_ < frame.number; ++next_written_number_) {
+      y4m_file_.write(kFrameHeader, sizeof(kFrameHeader) - 1);
+      y4m_file_.write(reinterpret_cast<const char*>(yuv_.data()),
+                      yuv_.size());
+    }
+  }
+  next_written_number_ = frame.number + 1;
+
+  yuv_.resize(y_size + 2 * chroma_size);
+  uint8_t* y_plane = yuv_.data();
+  uint8_t* u_plane = y_plane + y_size;
+  uint8_t* v_plane = u_plane + chroma_size;
+  const int r_shift = frame.shifts[0];
+  const int g_shift = frame.shifts[1];
+  const int b_shift = frame.shifts[2];
+  const Uint32* pixels = frame.pixels.data();
+  for (int y = 0; y < h; ++y) {
+    const Uint32* row = pixels + static_cast<size_t>(y) * w;
+    uint8_t* y_row = y_plane + static_cast<size_t>(y) * w;
+    for (int x = 0; x < w; ++x) {
+      Uint32 p = row[x];
+      y_row[x] = RgbToY((p >> r_shift) & 0xFF, (p >> g_shift) & 0xFF,
+                        (p >> b_shift) & 0xFF);
+    }
+  }
+  // Chroma is the average color of each 2x2 block; blocks at odd edges
+  // reuse the last row or column.
+  for (int cy = 0; cy < chroma_h; ++cy) {
+    const Uint32* row0 = pixels + static_cast<size_t>(2 * cy) * w;
+    const Uint32* row1 = pixels + static_cast<size_t>(std::min(2 * cy + 1,
+                                                               h - 1)) * w;
+    for (int cx = 0; cx < chroma_w; ++cx) {
+      int x0 = 2 * cx;
+      int x1 = std::min(x0 + 1, w - 1);
+      Uint32 quad[4] = {row0[x0], row0[x1], row1[x0], row1[x1]};
+      int r = 0, g = 0, b = 0;
+      for (Uint32 p : quad) {
+        r += (p >> r_shift) & 0xFF;
+        g += (p >> g_shift) & 0xFF;
+        b += (p >> b_shift) & 0xFF;
+      }
+      size_t i = static_cast<size_t>(cy) * chroma_w + cx;
+      u_plane[i] = RgbToU((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+      v_plane[i] = RgbToV((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+    }
+  }
+  y4m_file_.write(kFrameHeader, sizeof(kFrameHeader) - 1);
+  y4m_file_.write(reinterpret_cast<const char*>(yuv_.data()), yuv_.size());
+  PCHECK(y4m_file_) << "Could not write to " << params_.path;
+}
+
+void FrameCapture::WritePng(const Frame& frame) {
+  const int w = params_.width;
+  const int h = params_.height;
+  // Each row is a filter type byte (0, none) then RGB triples. Frames are
+  // mostly flat color, so the fastest zlib level still shrinks them a lot.
+  const size_t row_bytes = 1 + static_cast<size_t>(w) * 3;
+  png_rows_.resize(row_bytes * h);
+  for (int y = 0; y < h; ++y) {
+    const Uint32* row = frame.pixels.data() + static_cast<size_t>(y) * w;
+    uint8_t* out = png_rows_.data() + y * row_bytes;
+    *out++ = 0;
+    for (int x = 0; x < w; ++x) {
+      Uint32 p = row[x];
+      *out++ = p >> frame.shifts[0];
+      *out++ = p >> frame.shifts[1];
+      *out++ = p >> frame.shifts[2];
+    }
+  }
+  uLongf compressed_size = compressBound(png_rows_.size());
+  png_data_.resize(compressed_size);
+  CHECK_EQ(compress2(png_data_.data(), &compressed_size, png_rows_.data(),
+                     png_rows_.size(), Z_BEST_SPEED),
+           Z_OK);
+
+  std::string path = (boost::format("%s/%06d.png") % params_.path %
+                      frame.number).str();
+  std::ofstream file(path, std::ios::binary);
+  PCHECK(file) << "Could not open " << path;
+  static const uint8_t kSignature[] = {0x89, 'P',  'N',  'G',
+                                       '\r', '\n', 0x1A, '\n'};
+  file.write(reinterpret_cast<const char*>(kSignature), sizeof(kSignature));
+  uint8_t header[13];
+  PutBigEndian32(w, header);
+  PutBigEndian32(h, header + 4);
+  header[8] = 8;  // bits per channel
+  header[9] = 2;  // RGB
+  header[10] = 0;  // deflate
+  header[11] = 0;  // per-row filters
+  header[12] = 0;  // not interlaced
+  WritePngChunk("IHDR", header, sizeof(header), &file);
+  WritePngChunk("IDAT", png_data_.data(), compressed_size, &file);
+  WritePngChunk("IEND", nullptr, 0, &file);
+  PCHECK(file) << "Could not write to " << path;
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const FrameCapture::Stats& stats) {
+  double ms_per_frame =
+      stats.written > 0 ? stats.write_secs * 1000 / stats.written : 0;
+  return stream << boost::format("captured=%d dropped=%d written=%d "
+                                 "write=%.2fms/frame") %
+                       stats.captured % stats.dropped % stats.written %
+                       ms_per_frame;
+}
+
+}  // namespace pong
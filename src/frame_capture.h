@@ -0,0 +1,132 @@
+// Records rendered frames to disk, for reviewing matches, without holding up
+// whoever draws them.
+//
+// All the frame buffers are allocated up front. Capture() copies a surface's
+// pixels into a free one and queues it for a background thread, which does
+// the slow parts (color conversion, compression, writing) and then hands the
+// buffer back. Buffers go back and forth through a pair of lock-free rings.
+// If the writer falls so far behind that no buffer is free, the frame is
+// dropped (and counted) rather than making the game wait, unless the capture
+// was set up to wait, which suits headless rendering.
+
+#ifndef FRAME_CAPTURE_H_
+#define FRAME_CAPTURE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+
+#include "spsc_ring.h"
+#include "util.h"
+
+namespace pong {
+
+enum class CaptureFormat {
+  Y4M,  // one YUV4MPEG2 file, 4:2:0; ffmpeg and most players read it
+  PNG,  // one file per frame
+};
+std::ostream& operator<<(std::ostream& stream, CaptureFormat format);
+
+// Parses a format name, case-insensitively (e.g. "y4m"). Returns false if
+// there's no such format.
+bool ParseCaptureFormat(const std::string& name, CaptureFormat* format);
+
+struct CaptureParams {
+  CaptureFormat format = CaptureFormat::Y4M;
+
+  // For Y4M, the file to write. For PNG, an existing directory, which gets
+  // 000000.png, 000001.png and so on, numbered by frame.
+  std::string path;
+
+  // Every frame captured must be this size.
+  int width = 0;
+  int height = 0;
+
+  // Frame rate written in the Y4M header.
+  double fps = 60;
+
+  // Frames which can be waiting to be written at once.
+  int num_buffers = 8;
+
+  // What Capture() does when every buffer is still waiting to be written:
+  // drop the frame, or wait for the writer to free one.
+  bool drop_when_full = true;
+};
+
+class FrameCapture {
+ public:
+  struct Stats {
+    int64_t captured = 0;  // frames queued for writing
+    int64_t dropped = 0;   // frames lost because no buffer was free
+    int64_t written = 0;   // frames written out so far
+    double write_secs = 0;  // writer thread time spent on them
+  };
+
+  explicit FrameCapture(const CaptureParams& params);
+
+  // Calls Finish().
+  ~FrameCapture();
+
+  // Queues the pixels of `surface` to be written as the next frame. Returns
+  // false if the frame was dropped. Must always be called from the same
+  // thread. CHECK-fails unless the surface is the size given in the params,
+  // with 8 bits per color channel in 32-bit pixels.
+  bool Capture(SDL_Surface* surface);
+
+  // Waits for every frame captured so far to be written, then stops the
+  // writer. Nothing may be captured afterwards.
+  void Finish();
+
+  // May be called from any thread.
+  Stats GetStats() const;
+
+ private:
+  struct Frame {
+    int64_t number;  // counting dropped frames too
+    uint8_t shifts[3];  // of red, green and blue in each pixel
+    std::vector<Uint32> pixels;  // rows packed, without pitch padding
+  };
+
+  void Write();
+  void WriteY4m(const Frame& frame);
+  void WritePng(const Frame& frame);
+
+  const CaptureParams params_;
+  std::vector<std::unique_ptr<Frame>> frames_;
+  util::SpscRing<Frame*> free_frames_;    // writer to capturer
+  util::SpscRing<Frame*> queued_frames_;  // capturer to writer
+  int64_t next_number_ = 0;  // capturer's
+
+  // Only the capturing thread writes captured_ and dropped_, and only the
+  // writer thread written_ and write_nanos_.
+  std::atomic<int64_t> captured_{0};
+  std::atomic<int64_t> dropped_{0};
+  std::atomic<int64_t> written_{0};
+  std::atomic<int64_t> write_nanos_{0};
+
+  // Writer thread's.
+  std::ofstream y4m_file_;
+  std::vector<uint8_t> yuv_;  // the last Y4M frame, to repeat over drops
+  int64_t next_written_number_ = 0;
+  std::vector<uint8_t> png_rows_;
+  std::vector<uint8_t> png_data_;
+
+  std::atomic<bool> stopping_{false};
+  std::thread writer_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameCapture);
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const FrameCapture::Stats& stats);
+
+}  // namespace pong
+
+#endif  // FRAME_CAPTURE_H_
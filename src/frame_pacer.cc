@@ -0,0 +1,133 @@
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include <boost/format.hpp>
+#include <SDL.h>
+#include <glog/logging.h>
+
+#include "frame_pacer.h"
+
+namespace pong {
+
+FramePacer::FramePacer(double target_fps, double spin_secs)
+    : counts_per_frame_(SDL_GetPerformanceFrequency() / target_fps),
+      spin_counts_(static_cast<uint64_t>(spin_secs *
+                                         SDL_GetPerformanceFrequency())),
+      counts_per_sec_(SDL_GetPerformanceFrequency()) {
+  CHECK(target_fps > 0) << "Bad target frame rate: " << target_fps;
+  CHECK(spin_secs >= 0) << "Bad spin time: " << spin_secs;
+}
+
+void FramePacer::Resync(uint64_t now) {
+  schedule_start_ = now;
+  schedule_frame_ = 0;
+}
+
+void FramePacer::SetPoll(std::function<void()> poll, double interval_secs) {
+  CHECK(interval_secs > 0) << "Bad poll interval: " << interval_secs;
+  poll_ = std::move(poll);
+  poll_counts_ = static_cast<uint64_t>(interval_secs * counts_per_sec_);
+}
+
+void FramePacer::SleepUntil(uint64_t deadline) {
+  uint64_t now = SDL_GetPerformanceCounter();
+  while (now + spin_counts_ < deadline) {
+    uint64_t wake = deadline - spin_counts_;
+    if (poll_) {
+      wake = std::min(wake, now + poll_counts_);
+    }
+    double sleep_secs = (wake - now) / counts_per_sec_;
+#if defined(__linux__)
+    struct timespec remaining;
+    remaining.tv_sec = static_cast<time_t>(sleep_secs);
+    remaining.tv_nsec =
+        static_cast<long>((sleep_secs - remaining.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &remaining, &remaining) ==
+           EINTR) {
+    }
+#else
+    SDL_Delay(static_cast<Uint32>(sleep_secs * 1000));
+#endif
+    if (poll_) {
+      poll_();
+    }
+    now = SDL_GetPerformanceCounter();
+  }
+
+  // Spin the rest of the way.
+  while (SDL_GetPerformanceCounter() < deadline) {
+  }
+}
+
+void FramePacer::WaitForNextFrame() {
+  uint64_t now = SDL_GetPerformanceCounter();
+  if (schedule_start_ == 0) {
+    Resync(now);
+  }
+
+  ++schedule_frame_;
+  uint64_t deadline = schedule_start_ +
+      static_cast<uint64_t>(std::llround(schedule_frame_ * counts_per_frame_));
+  if (now > deadline) {
+    ++missed_deadlines_;
+    if (now - deadline > counts_per_frame_) {
+      // More than a whole frame behind. Don't try to make it up with a burst
+      // of frames; start a new schedule from here.
+      Resync(now);
+      deadline = now;
+    }
+  } else {
+    SleepUntil(deadline);
+  }
+
+  uint64_t frame_start = SDL_GetPerformanceCounter();
+  if (last_frame_start_ != 0) {
+    double interval = (frame_start - last_frame_start_) / counts_per_sec_;
+    double error = std::abs(interval - counts_per_frame_ / counts_per_sec_);
+    ++intervals_;
+    interval_sum_ += interval;
+    interval_sum_squares_ += interval * interval;
+    max_error_ = std::max(max_error_, error);
+  }
+  last_frame_start_ = frame_start;
+}
+
+FramePacer::Stats FramePacer::GetStats() const {
+  Stats stats;
+  stats.frames = intervals_;
+  stats.target_secs = counts_per_frame_ / counts_per_sec_;
+  stats.missed_deadlines = missed_deadlines_;
+  stats.max_error_secs = max_error_;
+  if (intervals_ > 0) {
+    stats.mean_secs = interval_sum_ / intervals_;
+    double variance = interval_sum_squares_ / intervals_ -
+                      stats.mean_secs * stats.mean_secs;
+    stats.stddev_secs = std::sqrt(std::max(0.0, variance));
+  }
+  return stats;
+}
+
+void FramePacer::ResetStats() {
+  last_frame_start_ = 0;
+  intervals_ = 0;
+  interval_sum_ = 0;
+  interval_sum_squares_ = 0;
+  max_error_ = 0;
+  missed_deadlines_ = 0;
+}
+
+std::ostream& operator<<(std::ostream& stream, const FramePacer::Stats& stats) {
+  double drift = (stats.target_secs > 0 && stats.frames > 0)
+                     ? (stats.mean_secs / stats.target_secs - 1) * 100
+                     : 0;
+  return stream << boost::format(
+                       "frames=%d target=%.3fms mean=%.4fms (%+.3f%%) "
+                       "jitter(stddev)=%.3fms max_error=%.3fms missed=%d") %
+                       stats.frames % (stats.target_secs * 1000) %
+                       (stats.mean_secs * 1000) % drift %
+                       (stats.stddev_secs * 1000) %
+                       (stats.max_error_secs * 1000) % stats.missed_deadlines;
+}
+
+}  // namespace pong
@@ -0,0 +1,72 @@
+#ifndef FRAME_PACER_H_
+#define FRAME_PACER_H_
+
+#include <stdint.h>
+#include <functional>
+#include <ostream>
+
+namespace pong {
+
+// Keeps a loop running at a fixed rate, e.g. the main loop at 60 FPS.
+//
+// Frame deadlines are computed from the time the pacer started rather than
+// from the end of the previous frame, so sleep overshoot in one frame is made
+// up in the next and the long-run frame rate doesn't drift. Waiting is done
+// by sleeping until shortly before the deadline, then spinning on the
+// performance counter for the rest, since sleeps alone overshoot by up to a
+// scheduler quantum.
+class FramePacer {
+ public:
+  struct Stats {
+    int64_t frames = 0;
+    double target_secs = 0;  // frame interval we're aiming for
+    double mean_secs = 0;    // measured average frame interval
+    double stddev_secs = 0;  // jitter of the frame interval
+    double max_error_secs = 0;  // worst |interval - target|
+    int64_t missed_deadlines = 0;  // frames which started late
+  };
+
+  // `spin_secs` is how long before each deadline to stop sleeping and start
+  // spinning. Larger values burn more CPU but are more precise.
+  FramePacer(double target_fps, double spin_secs);
+
+  // Blocks until it's time to start the next frame. Call once per frame.
+  void WaitForNextFrame();
+
+  // While sleeping in WaitForNextFrame(), wakes up about every
+  // `interval_secs` to call `poll`, e.g. to pass input on to a game which
+  // doesn't wait for frames. Null stops polling.
+  void SetPoll(std::function<void()> poll, double interval_secs);
+
+  Stats GetStats() const;
+  void ResetStats();
+
+ private:
+  void Resync(uint64_t now);
+  void SleepUntil(uint64_t deadline);
+
+  const double counts_per_frame_;  // in performance counter units
+  const uint64_t spin_counts_;
+  const double counts_per_sec_;
+
+  std::function<void()> poll_;
+  uint64_t poll_counts_ = 0;
+
+  // Deadline of frame n is schedule_start_ + n * counts_per_frame_.
+  uint64_t schedule_start_ = 0;
+  int64_t schedule_frame_ = 0;
+
+  // For stats.
+  uint64_t last_frame_start_ = 0;
+  int64_t intervals_ = 0;
+  double interval_sum_ = 0;
+  double interval_sum_squares_ = 0;
+  double max_error_ = 0;
+  int64_t missed_deadlines_ = 0;
+};
+
+std::ostream& operator<<(std::ostream& stream, const FramePacer::Stats& stats);
+
+}  // namespace pong
+
+#endif  // FRAME_PACER_H_
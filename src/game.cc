@@ -1,34 +1,17 @@
+#include <string.h>
 #include <cmath>
 #include <limits>
+#include <random>
 #include <boost/format.hpp>
 #include <glog/logging.h>
 
 #include "controller.h"
+#include "event_log.h"
 #include "game.h"
 #include "util.h"
 
 namespace pong {
 
-std::ostream& operator<<(std::ostream& stream, BoundingWall wall) {
-  switch (wall) {
-    case BoundingWall::NONE:   return (stream << "NONE");
-    case BoundingWall::TOP:    return (stream << "TOP");
-    case BoundingWall::BOTTOM: return (stream << "BOTTOM");
-    case BoundingWall::LEFT:   return (stream << "LEFT");
-    case BoundingWall::RIGHT:  return (stream << "RIGHT");
-    default:
-      LOG(WARNING) << "Tried to serialize unexpected pong::BoundingWall value: "
-                   << static_cast<int>(wall);
-      return stream << static_cast<int>(wall);
-  }
-}
-
-std::ostream& operator<<(std::ostream& stream, const BoundingBox& box) {
-  using util::format::FormatVec2d;
-  return stream << boost::format("BoundingBox(top_left=%s, size=%s)") %
-                       FormatVec2d(box.top_left) % FormatVec2d(box.size);
-}
-
 void Paddle::Update(double seconds_delta) {
   if (controller_ == nullptr) {  // null controllers have no effect
     return;
@@ -38,9 +21,9 @@ void Paddle::Update(double seconds_delta) {
   double delta_position = seconds_delta * max_speed_;
   MoveDirection direction = controller_->DesiredMove(*game_board_, *this);
   if (direction == MoveDirection::UP) {
-    bounds_.top_left.y() -= delta_position;
+    bounds_.top_left().y() -= delta_position;
   } else if (direction == MoveDirection::DOWN) {
-    bounds_.top_left.y() += delta_position;
+    bounds_.top_left().y() += delta_position;
   } else {
     DCHECK(direction == MoveDirection::NONE)
         << "unexpected result from DesiredMove: "
@@ -49,10 +32,10 @@ void Paddle::Update(double seconds_delta) {
 
   // Clamp the paddle to the top and bottom bounds.
   if (bounds_.Top() < top_bound_) {
-    bounds_.top_left.y() = top_bound_;
+    bounds_.top_left().y() = top_bound_;
   }
   if (bounds_.Bottom() > bottom_bound_) {
-    bounds_.top_left.y() = bottom_bound_ - bounds_.Height();
+    bounds_.top_left().y() = bottom_bound_ - bounds_.Height();
   }
 }
 
@@ -60,46 +43,12 @@ void Paddle::Update(double seconds_delta) {
 namespace {
 using ::std::tuple;
 
-tuple<double, BoundingWall> MinTimeToWall(const Ball& ball, double vel,
-                                          BoundingWall negative_wall,
-                                          BoundingWall positive_wall) {
-  if (vel == 0) {
-    return std::make_tuple(std::numeric_limits<double>::infinity(),
-                           BoundingWall::NONE);
-  }
-
-  BoundingWall wall;
-  double wall_pos;
-  double bound;
-
-  if (vel < 0) {
-    wall = negative_wall;
-    wall_pos = ball.valid_space_.Bound(negative_wall);
-    bound = ball.bounds_.Bound(negative_wall);
-  } else {
-    wall = positive_wall;
-    wall_pos = ball.valid_space_.Bound(positive_wall);
-    bound = ball.bounds_.Bound(positive_wall);
-  }
-
-  double time_to_wall = (wall_pos - bound) / vel;
-  CHECK(time_to_wall >= 0) << "Unexpected negative time_to_wall for a Ball";
-  return std::make_tuple(time_to_wall, wall);
-}
-
 tuple<double, BoundingWall> MinTimeToWall(const Ball& ball) {
-  auto time_to_x_wall =
-      MinTimeToWall(ball, ball.velocity_.x(), BoundingWall::LEFT,
-                    BoundingWall::RIGHT);
-
-  auto time_to_y_wall =
-      MinTimeToWall(ball, ball.velocity_.y(), BoundingWall::TOP,
-                    BoundingWall::BOTTOM);
-
-  auto min_time =
-      (time_to_x_wall < time_to_y_wall) ? time_to_x_wall : time_to_y_wall;
-
-  return min_time;
+  auto time_to_wall =
+      TimeToExit(ball.bounds_, ball.velocity_, ball.valid_space_);
+  CHECK(std::get<0>(time_to_wall) >= 0)
+      << "Unexpected negative time_to_wall for a Ball";
+  return time_to_wall;
 }
 }  // namespace
 
@@ -109,7 +58,7 @@ void Ball::Update(double seconds_delta) {
   auto min_time_to_wall = MinTimeToWall(*this);
   while (std::get<0>(min_time_to_wall) < seconds_delta) {
     // Spend some time to move the ball to the point of contact with the wall
-    bounds_.top_left += std::get<0>(min_time_to_wall) * velocity_;
+    bounds_.top_left() += std::get<0>(min_time_to_wall) * velocity_;
     seconds_delta -= std::get<0>(min_time_to_wall);
 
     // Let the game board handle to bounce
@@ -127,10 +76,10 @@ void Ball::Update(double seconds_delta) {
     min_time_to_wall = MinTimeToWall(*this);
   }
 
-  bounds_.top_left += seconds_delta * velocity_;
+  bounds_.top_left() += seconds_delta * velocity_;
 }
 
-std::ostream& operator<<(std::ostream& stream, Ball ball) {
+std::ostream& operator<<(std::ostream& stream, const Ball& ball) {
   using ::util::format::FormatVec2d;
   return stream << boost::format("Ball(bounds=%s velocity=%s)") %
                        ball.bounds_ % FormatVec2d(ball.velocity_);
@@ -141,9 +90,24 @@ namespace {
 constexpr double kBallSize_gu = 0.05;
 constexpr double kInitialBallSpeed_gups = 0.2;
 constexpr double kPaddleSpeed_gups = kBallSize_gu * 10;
+// Random serves are aimed at a random side, within this angle of horizontal.
+constexpr double kMaxServeAngle_rad = M_PI / 3;
 }  // namespace
 
+Eigen::Vector2d RandomServeDirection(std::mt19937_64* rng) {
+  std::uniform_real_distribution<double> angle(-kMaxServeAngle_rad,
+                                               kMaxServeAngle_rad);
+  std::bernoulli_distribution serve_left(0.5);
+  double a = angle(*rng);
+  double x_sign = serve_left(*rng) ? -1 : 1;
+  return {x_sign * std::cos(a), std::sin(a)};
+}
+
 void GameBoard::SetupNewGame() {
+  SetupNewGame({1, 2});  // arbitrary
+}
+
+void GameBoard::SetupNewGame(const Eigen::Vector2d& serve_direction) {
   // setup left paddle
   left_paddle_.bounds_.Width(kBallSize_gu);
   left_paddle_.bounds_.Height(3 * kBallSize_gu);
@@ -163,14 +127,13 @@ void GameBoard::SetupNewGame() {
   right_paddle_.max_speed_ = kPaddleSpeed_gups;
 
   // setup ball
-  // TODO: randomized who the ball is served to, and at what angle.
-  ball_.bounds_.size = {kBallSize_gu, kBallSize_gu};
+  ball_.bounds_.size() = Eigen::Vector2d(kBallSize_gu, kBallSize_gu);
   ball_.bounds_.Center(bounds_.Center());
-  ball_.velocity_ = util::DirectionAndMagnitude(
-      {1, 2}, kInitialBallSpeed_gups);  // arbitrary
+  ball_.velocity_ =
+      util::DirectionAndMagnitude(serve_direction, kInitialBallSpeed_gups);
 
-  ball_.valid_space_.top_left = {left_paddle_.bounds_.Right(),
-                                 bounds_.Top()};
+  ball_.valid_space_.top_left() =
+      Eigen::Vector2d(left_paddle_.bounds_.Right(), bounds_.Top());
   ball_.valid_space_.Width(right_paddle_.bounds_.Left() -
                            left_paddle_.bounds_.Right());
   ball_.valid_space_.Height(bounds_.Height());
@@ -198,10 +161,6 @@ bool WillBounce(const Ball& ball, const Paddle& paddle) {
   return true;
 }
 
-// Every time the ball is successfully bounced, the speed of the ball and the
-// paddles increases by this factor.
-constexpr double kBallSpeedupFactor = 1.1;
-constexpr double kPaddleSpeedupFactor = 1.05;
 inline void BounceBallOffPaddle(GameBoard* game) {
   game->ball_.velocity_.x() *= -1;
   game->ball_.velocity_ *= kBallSpeedupFactor;
@@ -224,6 +183,8 @@ void GameBoard::BounceBall(Ball* ball, BoundingWall hit_wall) {
         right_score_ += 1;
         last_player_to_score_ = Player::RIGHT;
         game_over_ = true;
+        LogScore();
+        return;
       }
       break;
 
@@ -234,6 +195,8 @@ void GameBoard::BounceBall(Ball* ball, BoundingWall hit_wall) {
         left_score_ += 1;
         last_player_to_score_ = Player::LEFT;
         game_over_ = true;
+        LogScore();
+        return;
       }
       break;
 
@@ -241,6 +204,74 @@ void GameBoard::BounceBall(Ball* ball, BoundingWall hit_wall) {
       LOG(FATAL) << "Unexpected value for wall off which the ball is bouncing: "
                  << static_cast<int>(hit_wall);
   }
+  if (event_log_) {
+    event_log_->Log(GameEvent::Bounce(hit_wall, ball->bounds_.top_left(),
+                                      ball->velocity_));
+  }
+}
+
+void GameBoard::LogScore() {
+  if (event_log_) {
+    event_log_->Log(GameEvent::Score(static_cast<int>(last_player_to_score_),
+                                     left_score_, right_score_));
+  }
+}
+
+namespace {
+void SaveBox(const BoundingBox& box, double* out) {
+  out[0] = box.Left();
+  out[1] = box.Top();
+  out[2] = box.Width();
+  out[3] = box.Height();
+}
+
+BoundingBox LoadBox(const double* in) {
+  return BoundingBox(in[0], in[1], in[2], in[3]);
+}
+
+void SavePaddle(const Paddle& paddle, double* out) {
+  SaveBox(paddle.bounds_, out);
+  out[4] = paddle.top_bound_;
+  out[5] = paddle.bottom_bound_;
+  out[6] = paddle.max_speed_;
+}
+
+void LoadPaddle(const double* in, Paddle* paddle) {
+  paddle->bounds_ = LoadBox(in);
+  paddle->top_bound_ = in[4];
+  paddle->bottom_bound_ = in[5];
+  paddle->max_speed_ = in[6];
+}
+}  // namespace
+
+GameBoardState GameBoard::Save() const {
+  GameBoardState state;
+  memset(&state, 0, sizeof(state));
+  SaveBox(bounds_, state.board);
+  SaveBox(ball_.bounds_, state.ball);
+  state.ball_velocity[0] = ball_.velocity_.x();
+  state.ball_velocity[1] = ball_.velocity_.y();
+  SaveBox(ball_.valid_space_, state.ball_valid_space);
+  SavePaddle(left_paddle_, state.left_paddle);
+  SavePaddle(right_paddle_, state.right_paddle);
+  state.left_score = left_score_;
+  state.right_score = right_score_;
+  state.game_over = game_over_;
+  state.last_player_to_score = static_cast<uint8_t>(last_player_to_score_);
+  return state;
+}
+
+void GameBoard::Restore(const GameBoardState& state) {
+  bounds_ = LoadBox(state.board);
+  ball_.bounds_ = LoadBox(state.ball);
+  ball_.velocity_ = {state.ball_velocity[0], state.ball_velocity[1]};
+  ball_.valid_space_ = LoadBox(state.ball_valid_space);
+  LoadPaddle(state.left_paddle, &left_paddle_);
+  LoadPaddle(state.right_paddle, &right_paddle_);
+  left_score_ = state.left_score;
+  right_score_ = state.right_score;
+  game_over_ = state.game_over != 0;
+  last_player_to_score_ = static_cast<Player>(state.last_player_to_score);
 }
 
 std::ostream& operator<<(std::ostream& stream, GameBoard::Player player) {
@@ -1,80 +1,47 @@
 #ifndef GAME_H_
 #define GAME_H_
 
+#include <stdint.h>
 #include <ostream>
+#include <random>
+#include <type_traits>
 
 #include <Eigen/Dense>
 #include <glog/logging.h>
 
 #include "controller.h"
+#include "geometry.h"
 
 namespace pong {
 
-enum class BoundingWall {
-  NONE,
-  TOP,
-  BOTTOM,
-  LEFT,
-  RIGHT,
-};
-std::ostream& operator<<(std::ostream& stream, BoundingWall wall);
-
-// Bounding box for 2d objects in game-units (gu). For posterity, I'll say one
-// gu = one meter. Note that game units do not define a mapping to pixels on
-// screen.
-struct BoundingBox {
-  BoundingBox() : top_left(0, 0), size(0, 0) {}
-  BoundingBox(double left_x, double top_y, double width, double height)
-      : top_left(left_x, top_y), size(width, height) {}
-
-  // convenience method to control position based on bounding box center.
-  Eigen::Vector2d Center() const { return top_left + (size * 0.5); }
-  void Center(const Eigen::Vector2d new_val) {
-    top_left = new_val - (size * 0.5);
-  }
-
-  // Convenience methods for getting the coordinates of the edges of the
-  // bounding box.
-  double Left() const { return top_left.x(); }
-  double Right() const { return top_left.x() + size.x(); }
-  double Top() const { return top_left.y(); }
-  double Bottom() const { return top_left.y() + size.y(); }
-
-  void Left(double new_val) { top_left.x() = new_val; }
-  void Right(double new_val) { top_left.x() = new_val - size.x(); }
-  void Top(double new_val) { top_left.y() = new_val; }
-  void Bottom(double new_val) { top_left.y() = new_val - size.y(); }
-
-  // Same as Left(), Right(), Top(), or Bottom(), but takes the wall to get a
-  // bound for by parameter.
-  double Bound(BoundingWall wall) const {
-    switch (wall) {
-      case BoundingWall::TOP:    return Top();
-      case BoundingWall::BOTTOM: return Bottom();
-      case BoundingWall::LEFT:   return Left();
-      case BoundingWall::RIGHT:  return Right();
-      default:
-        LOG(FATAL) << "Tried to get bound for unsupported wall: "
-                   << static_cast<int>(wall);
-    }
-  }
-
-  // Convenience functions for the size of the box.
-  double Width() const { return size.x(); }
-  double Height() const { return size.y(); }
-
-  void Width(double new_val) { size.x() = new_val; }
-  void Height(double new_val) { size.y() = new_val; }
-
-  friend std::ostream& operator<<(std::ostream& stream, const BoundingBox& box);
-
-  Eigen::Vector2d top_left;
-  Eigen::Vector2d size;  // width, height
-};
+// Every time the ball is successfully bounced, the speed of the ball and the
+// paddles increases by this factor.
+constexpr double kBallSpeedupFactor = 1.1;
+constexpr double kPaddleSpeedupFactor = 1.05;
 
 // forward declarations for mutually-referenced classes
+class EventLog;
 class GameBoard;
 
+// Everything about a GameBoard which changes as the game is played, as plain
+// data which can be copied with memcpy or written to a file. Controllers
+// aren't part of it; they stay whatever they were set to.
+struct GameBoardState {
+  double board[4];  // bounding boxes are left, top, width, height
+  double ball[4];
+  double ball_velocity[2];
+  double ball_valid_space[4];
+  double left_paddle[7];  // bounding box, top bound, bottom bound, max speed
+  double right_paddle[7];
+  int32_t left_score;
+  int32_t right_score;
+  uint8_t game_over;
+  uint8_t last_player_to_score;
+  uint8_t reserved[6];
+};
+static_assert(std::is_trivially_copyable<GameBoardState>::value,
+              "GameBoardState must stay plain data");
+
 class Paddle {
  public:
   struct MoveParams {
@@ -98,6 +65,8 @@ class Paddle {
 
   BoundingBox bounds_;
 
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
  private:
   GameBoard* game_board_;  // the containing game board. not owned.
   PaddleController* controller_ = nullptr;  // not owned
@@ -109,7 +78,7 @@ class Ball {
 
   void Update(double seconds_delta);
 
-  friend std::ostream& operator<<(std::ostream& stream, Ball ball);
+  friend std::ostream& operator<<(std::ostream& stream, const Ball& ball);
 
   BoundingBox bounds_;
   Eigen::Vector2d velocity_;  // game units per second
@@ -125,6 +94,8 @@ class Ball {
   // object?
   BoundingBox valid_space_;
 
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
  private:
   GameBoard* game_board_;  // the containing game board. not owned.
 };
@@ -144,8 +115,17 @@ class GameBoard {
   // board, and verticall in the center), and sets the ball's initial velocity
   // to serve in the direction of the right player.
   void SetupNewGame();
-  bool IsGameOver() { return game_over_; }
-  Player LastPlayerToScore() { return last_player_to_score_; }
+
+  // Same as SetupNewGame(), but serves the ball in `serve_direction` instead.
+  // Only the direction of the vector matters, not its magnitude.
+  void SetupNewGame(const Eigen::Vector2d& serve_direction);
+  bool IsGameOver() const { return game_over_; }
+  Player LastPlayerToScore() const { return last_player_to_score_; }
+
+  // Copies the board's state out, or puts a saved state back. Both are cheap
+  // enough to do every tick.
+  GameBoardState Save() const;
+  void Restore(const GameBoardState& state);
 
   void Update(double seconds_delta);
 
@@ -158,6 +138,10 @@ class GameBoard {
     right_paddle_.SetController(controller);
   }
 
+  // If set, bounces and points are logged to `log`, from whichever thread
+  // calls Update(). Null (the default) logs nothing.
+  void SetEventLog(EventLog* log) { event_log_ = log; }
+
   // Game pieces
   Ball ball_;
   Paddle left_paddle_;
@@ -170,13 +154,22 @@ class GameBoard {
   int left_score_ = 0;
   int right_score_ = 0;
 
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
  private:
+  void LogScore();
+
   bool game_over_ = true;
   Player last_player_to_score_ = Player::NONE;
+  EventLog* event_log_ = nullptr;  // not owned
 };
 
 std::ostream& operator<<(std::ostream& stream, GameBoard::Player player);
 
+// A direction for GameBoard::SetupNewGame() which serves towards a random
+// player, at a random angle which isn't too steep.
+Eigen::Vector2d RandomServeDirection(std::mt19937_64* rng);
+
 }  // namespace pong
 
 #endif  // GAME_H_
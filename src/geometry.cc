@@ -0,0 +1,41 @@
+#include <stdlib.h>
+
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "geometry.h"
+#include "util.h"
+
+namespace pong {
+
+std::ostream& operator<<(std::ostream& stream, BoundingWall wall) {
+  switch (wall) {
+    case BoundingWall::NONE:   return (stream << "NONE");
+    case BoundingWall::TOP:    return (stream << "TOP");
+    case BoundingWall::BOTTOM: return (stream << "BOTTOM");
+    case BoundingWall::LEFT:   return (stream << "LEFT");
+    case BoundingWall::RIGHT:  return (stream << "RIGHT");
+    default:
+      LOG(WARNING) << "Tried to serialize unexpected pong::BoundingWall value: "
+                   << static_cast<int>(wall);
+      return stream << static_cast<int>(wall);
+  }
+}
+
+void DieOnUnsupportedWall(BoundingWall wall) {
+  LOG(FATAL) << "Tried to get bound for unsupported wall: "
+             << static_cast<int>(wall);
+  abort();  // not reached
+}
+
+std::ostream& operator<<(std::ostream& stream, const BoundingBox& box) {
+  using util::format::FormatVec2d;
+  return stream << boost::format("BoundingBox(top_left=%s, size=%s)") %
+                       FormatVec2d(box.top_left()) % FormatVec2d(box.size());
+}
+
+std::ostream& operator<<(std::ostream& stream, const BoundingBoxF& box) {
+  return stream << box.Cast<double>();
+}
+
+}  // namespace pong
@@ -0,0 +1,201 @@
+// Axis-aligned boxes, and the arithmetic on them which the game and the
+// renderer do every tick and every frame.
+
+#ifndef GEOMETRY_H_
+#define GEOMETRY_H_
+
+#include <limits>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+#include <Eigen/Dense>
+
+namespace pong {
+
+enum class BoundingWall {
+  NONE,
+  TOP,
+  BOTTOM,
+  LEFT,
+  RIGHT,
+};
+std::ostream& operator<<(std::ostream& stream, BoundingWall wall);
+
+// LOG(FATAL)s. Out of line, so that the checks which call it stay small.
+[[noreturn]] void DieOnUnsupportedWall(BoundingWall wall);
+
+// Bounding box for 2d objects in game-units (gu). For posterity, I'll say one
+// gu = one meter. Note that game units do not define a mapping to pixels on
+// screen.
+//
+// The position and size are packed into one 4-vector, (left, top, width,
+// height), which Eigen keeps aligned, so operations on whole boxes compile to
+// a couple of SIMD instructions. BoundingBox (double) is what the game
+// simulates with; BoundingBoxF (float) is for when half the size matters
+// more than precision.
+template <typename T>
+struct BoundingBoxT {
+  typedef Eigen::Matrix<T, 2, 1> Vector2;
+  typedef Eigen::Matrix<T, 4, 1> Vector4;
+
+  BoundingBoxT() : packed(Vector4::Zero()) {}
+  BoundingBoxT(T left_x, T top_y, T width, T height)
+      : packed(left_x, top_y, width, height) {}
+  explicit BoundingBoxT(const Vector4& packed) : packed(packed) {}
+
+  // The position of the top left corner and the size (width, height), as
+  // views into `packed`, which can be assigned to.
+  Eigen::VectorBlock<Vector4, 2> top_left() {
+    return packed.template head<2>();
+  }
+  Eigen::VectorBlock<const Vector4, 2> top_left() const {
+    return packed.template head<2>();
+  }
+  Eigen::VectorBlock<Vector4, 2> size() { return packed.template tail<2>(); }
+  Eigen::VectorBlock<const Vector4, 2> size() const {
+    return packed.template tail<2>();
+  }
+
+  // convenience method to control position based on bounding box center.
+  Vector2 Center() const { return top_left() + size() * T(0.5); }
+  void Center(const Vector2& new_val) {
+    top_left() = new_val - size() * T(0.5);
+  }
+
+  // Convenience methods for getting the coordinates of the edges of the
+  // bounding box.
+  T Left() const { return packed[0]; }
+  T Right() const { return packed[0] + packed[2]; }
+  T Top() const { return packed[1]; }
+  T Bottom() const { return packed[1] + packed[3]; }
+
+  void Left(T new_val) { packed[0] = new_val; }
+  void Right(T new_val) { packed[0] = new_val - packed[2]; }
+  void Top(T new_val) { packed[1] = new_val; }
+  void Bottom(T new_val) { packed[1] = new_val - packed[3]; }
+
+  // All four edges at once: left, top, right, bottom.
+  Vector4 Edges() const {
+    Vector4 edges = packed;
+    edges.template tail<2>() += packed.template head<2>();
+    return edges;
+  }
+
+  // Same as Left(), Right(), Top(), or Bottom(), but takes the wall to get a
+  // bound for by parameter. Only one edge is needed, so this stays scalar;
+  // Edges() is cheaper when all of them are.
+  T Bound(BoundingWall wall) const {
+    switch (wall) {
+      case BoundingWall::TOP:    return Top();
+      case BoundingWall::BOTTOM: return Bottom();
+      case BoundingWall::LEFT:   return Left();
+      case BoundingWall::RIGHT:  return Right();
+      default:                   DieOnUnsupportedWall(wall);
+    }
+  }
+
+  // Convenience functions for the size of the box.
+  T Width() const { return packed[2]; }
+  T Height() const { return packed[3]; }
+
+  void Width(T new_val) { packed[2] = new_val; }
+  void Height(T new_val) { packed[3] = new_val; }
+
+  // Whether the boxes overlap or touch.
+  bool Overlaps(const BoundingBoxT& other) const {
+    Vector4 a = Edges();
+    Vector4 b = other.Edges();
+    return (a.template head<2>().array() <= b.template tail<2>().array())
+               .all() &&
+           (b.template head<2>().array() <= a.template tail<2>().array())
+               .all();
+  }
+
+  template <typename U>
+  BoundingBoxT<U> Cast() const {
+    return BoundingBoxT<U>(packed.template cast<U>());
+  }
+
+  Vector4 packed;  // left, top, width, height
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef BoundingBoxT<double> BoundingBox;
+typedef BoundingBoxT<float> BoundingBoxF;
+
+// Boxes hold aligned Eigen vectors, so a std::vector of them needs Eigen's
+// allocator.
+template <typename T>
+using BoundingBoxVector =
+    std::vector<BoundingBoxT<T>, Eigen::aligned_allocator<BoundingBoxT<T>>>;
+
+std::ostream& operator<<(std::ostream& stream, const BoundingBox& box);
+std::ostream& operator<<(std::ostream& stream, const BoundingBoxF& box);
+
+// Linear interpolation between two bounding boxes.
+template <typename T>
+inline BoundingBoxT<T> Lerp(const BoundingBoxT<T>& from,
+                            const BoundingBoxT<T>& to, T alpha) {
+  return BoundingBoxT<T>(from.packed + alpha * (to.packed - from.packed));
+}
+
+// How long until `box`, moving at `velocity`, reaches an edge of `space`,
+// and which edge that is. Both axes are worked out at once. Ties go to the top
+// or bottom wall, and the wall is NONE if the box never gets anywhere. The
+// time is negative if the box is already past the edge it's heading for.
+template <typename T>
+std::tuple<T, BoundingWall> TimeToExit(const BoundingBoxT<T>& box,
+                                      const Eigen::Matrix<T, 2, 1>& velocity,
+                                      const BoundingBoxT<T>& space) {
+  typedef Eigen::Array<T, 2, 1> Array2;
+  Eigen::Array<T, 4, 1> box_edges = box.Edges();
+  Eigen::Array<T, 4, 1> space_edges = space.Edges();
+  Array2 vel = velocity.array();
+  Array2 bound = (vel < 0).select(box_edges.template head<2>(),
+                                  box_edges.template tail<2>());
+  Array2 wall_pos = (vel < 0).select(space_edges.template head<2>(),
+                                     space_edges.template tail<2>());
+  Array2 time = (vel == 0).select(std::numeric_limits<T>::infinity(),
+                                  (wall_pos - bound) / vel);
+
+  if (time.x() < time.y()) {
+    return std::make_tuple(time.x(), vel.x() < 0 ? BoundingWall::LEFT
+                                                 : BoundingWall::RIGHT);
+  }
+  if (vel.y() == 0) {
+    return std::make_tuple(time.y(), BoundingWall::NONE);
+  }
+  return std::make_tuple(time.y(), vel.y() < 0 ? BoundingWall::TOP
+                                               : BoundingWall::BOTTOM);
+}
+
+// Maps boxes from game units to pixels.
+template <typename T>
+class ScreenTransformT {
+ public:
+  // `scale` is the number of screen pixels per game unit. `origin` is the
+  // on-screen pixel location of the game-world origin.
+  ScreenTransformT(const Eigen::Matrix<T, 2, 1>& origin,
+                   const Eigen::Matrix<T, 2, 1>& scale)
+      : scale_(scale.x(), scale.y(), scale.x(), scale.y()),
+        offset_(origin.x(), origin.y(), 0, 0) {}
+
+  BoundingBoxT<T> Apply(const BoundingBoxT<T>& box) const {
+    return BoundingBoxT<T>(box.packed.cwiseProduct(scale_) + offset_);
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  typename BoundingBoxT<T>::Vector4 scale_;
+  typename BoundingBoxT<T>::Vector4 offset_;
+};
+
+typedef ScreenTransformT<double> ScreenTransform;
+typedef ScreenTransformT<float> ScreenTransformF;
+
+}  // namespace pong
+
+#endif  // GEOMETRY_H_
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <sstream>
+
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "latency_histogram.h"
+
+namespace pong {
+
+namespace {
+constexpr int kChartWidth = 40;  // characters in the longest bar
+}  // namespace
+
+LatencyHistogram::LatencyHistogram(double bucket_secs, int num_buckets)
+    : bucket_secs_(bucket_secs), buckets_(num_buckets + 1) {
+  CHECK(bucket_secs > 0) << "Bad bucket width: " << bucket_secs;
+  CHECK_GT(num_buckets, 0);
+}
+
+void LatencyHistogram::Add(double secs) {
+  secs = std::max(0.0, secs);
+  size_t bucket = std::min(static_cast<size_t>(secs / bucket_secs_),
+                           buckets_.size() - 1);
+  ++buckets_[bucket];
+  ++count_;
+  sum_secs_ += secs;
+  max_secs_ = std::max(max_secs_, secs);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  CHECK(bucket_secs_ == other.bucket_secs_ &&
+        buckets_.size() == other.buckets_.size())
+      << "Can't merge histograms with different buckets";
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_secs_ += other.sum_secs_;
+  max_secs_ = std::max(max_secs_, other.max_secs_);
+}
+
+void LatencyHistogram::Clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  sum_secs_ = 0;
+  max_secs_ = 0;
+}
+
+double LatencyHistogram::PercentileSecs(double fraction) const {
+  int64_t rank = static_cast<int64_t>(fraction * count_);
+  int64_t seen = 0;
+  for (size_t i = 0; i + 1 < buckets_.size(); ++i) {
+    seen += buckets_[i];
+    if (seen > rank) {
+      return std::min((i + 1) * bucket_secs_, max_secs_);
+    }
+  }
+  return max_secs_;
+}
+
+std::string LatencyHistogram::Chart() const {
+  int64_t most = *std::max_element(buckets_.begin(), buckets_.end());
+  std::ostringstream chart;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    if (buckets_[i] == 0) {
+      continue;
+    }
+    std::string range =
+        i + 1 < buckets_.size()
+            ? (boost::format("%.1f-%.1fms") % (i * bucket_secs_ * 1000) %
+               ((i + 1) * bucket_secs_ * 1000)).str()
+            : (boost::format(">%.1fms") % (i * bucket_secs_ * 1000)).str();
+    int width = std::max<int64_t>(1, buckets_[i] * kChartWidth / most);
+    std::string bar =
+        std::string(width, '#') + std::string(kChartWidth - width, ' ');
+    chart << boost::format("%14s %s %d\n") % range % bar % buckets_[i];
+  }
+  return chart.str();
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const LatencyHistogram& histogram) {
+  return stream << boost::format("n=%d mean=%.2fms p50=%.1fms p90=%.1fms "
+                                 "p99=%.1fms max=%.2fms") %
+                       histogram.Count() % (histogram.MeanSecs() * 1000) %
+                       (histogram.PercentileSecs(0.5) * 1000) %
+                       (histogram.PercentileSecs(0.9) * 1000) %
+                       (histogram.PercentileSecs(0.99) * 1000) %
+                       (histogram.MaxSecs() * 1000);
+}
+
+}  // namespace pong
@@ -0,0 +1,51 @@
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace pong {
+
+// Counts durations into fixed-width buckets, for reporting how a latency is
+// distributed without keeping every sample.
+class LatencyHistogram {
+ public:
+  // Buckets are `bucket_secs` wide. Anything past the last of `num_buckets`
+  // goes into an extra overflow bucket.
+  LatencyHistogram(double bucket_secs, int num_buckets);
+
+  void Add(double secs);
+  void Clear();
+
+  // Adds all of `other`'s samples, which must have the same buckets.
+  void Merge(const LatencyHistogram& other);
+
+  int64_t Count() const { return count_; }
+  double MeanSecs() const { return count_ > 0 ? sum_secs_ / count_ : 0; }
+  double MaxSecs() const { return max_secs_; }
+
+  // Upper edge of the bucket holding the `fraction` (0 to 1) point of the
+  // samples, e.g. 0.99 for the 99th percentile. The maximum if it's in the
+  // overflow bucket.
+  double PercentileSecs(double fraction) const;
+
+  // One line per non-empty bucket, with a bar proportional to its count.
+  std::string Chart() const;
+
+ private:
+  const double bucket_secs_;
+  std::vector<int64_t> buckets_;  // the last one is the overflow
+  int64_t count_ = 0;
+  double sum_secs_ = 0;
+  double max_secs_ = 0;
+};
+
+// Sample count, mean, percentiles and max, on one line.
+std::ostream& operator<<(std::ostream& stream,
+                         const LatencyHistogram& histogram);
+
+}  // namespace pong
+
+#endif  // LATENCY_HISTOGRAM_H_
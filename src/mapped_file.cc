@@ -0,0 +1,45 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "mapped_file.h"
+
+namespace pong {
+
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path,
+                                             const std::string& kind,
+                                             size_t min_size) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    PLOG(ERROR) << "Could not open " << kind << " " << path;
+    return nullptr;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    PLOG(ERROR) << "Could not stat " << kind << " " << path;
+    close(fd);
+    return nullptr;
+  }
+  if (static_cast<size_t>(info.st_size) < min_size) {
+    LOG(ERROR) << path << " is too small to be a valid " << kind;
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // the mapping keeps the file open
+  if (data == MAP_FAILED) {
+    PLOG(ERROR) << "Could not map " << kind << " " << path;
+    return nullptr;
+  }
+  return std::unique_ptr<MappedFile>(
+      new MappedFile(static_cast<const uint8_t*>(data), info.st_size));
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+}  // namespace pong
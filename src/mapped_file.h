@@ -0,0 +1,54 @@
+// Read-only memory maps of the game's binary files (replays and asset packs),
+// and helpers for reading the fixed-size records they're made of.
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <string>
+
+#include "util.h"
+
+namespace pong {
+
+// Written in host byte order, so reading it back tells us if the file came
+// from a machine with a different one.
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// Reads a T from a possibly unaligned position in a mapped file.
+template <typename T>
+T ReadRecord(const uint8_t* data) {
+  T record;
+  memcpy(&record, data, sizeof(T));
+  return record;
+}
+
+// A whole file mapped read-only. It stays mapped until this is destroyed.
+class MappedFile {
+ public:
+  // Returns null (and logs why) if `path` can't be mapped or is shorter than
+  // `min_size` bytes. `kind` names the sort of file in log messages, e.g.
+  // "replay".
+  static std::unique_ptr<MappedFile> Open(const std::string& path,
+                                          const std::string& kind,
+                                          size_t min_size);
+  ~MappedFile();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  const uint8_t* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+}  // namespace pong
+
+#endif  // MAPPED_FILE_H_
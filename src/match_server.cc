@@ -0,0 +1,534 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "batch_simulator.h"
+#include "match_server.h"
+#include "net.h"
+
+namespace pong {
+
+namespace {
+constexpr uint8_t kInputTag = 'I';
+constexpr uint8_t kStateTag = 'T';
+
+// Bigger than any packet a player should send.
+constexpr size_t kReceiveBufferBytes = 64;
+
+// Furthest behind a shard catches up in one go. Beyond that, ticks are
+// dropped rather than spiralling, as in the game.
+constexpr int kMaxTicksPerWake = 8;
+
+void PutFloat(float value, uint8_t* out) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  PutLittleEndian(bits, 4, out);
+}
+
+double ThreadCpuSecs() {
+  timespec now;
+  PCHECK(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+float GetFloat(const uint8_t* in) {
+  uint32_t bits = GetLittleEndian(in, 4);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+}  // namespace
+
+void EncodeMatchInput(const MatchInput& input, uint8_t* out) {
+  out[0] = kInputTag;
+  PutLittleEndian(input.match_id, 4, out + 1);
+  out[5] = input.side;
+  out[6] = static_cast<uint8_t>(input.move);
+  PutLittleEndian(input.stamp, 8, out + 7);
+}
+
+bool DecodeMatchInput(const uint8_t* in, size_t size, MatchInput* input) {
+  if (size != kInputPacketBytes || in[0] != kInputTag || in[5] > 1 ||
+      in[6] > static_cast<uint8_t>(MoveDirection::DOWN)) {
+    return false;
+  }
+  input->match_id = GetLittleEndian(in + 1, 4);
+  input->side = in[5];
+  input->move = static_cast<MoveDirection>(in[6]);
+  input->stamp = GetLittleEndian(in + 7, 8);
+  return true;
+}
+
+void EncodeMatchState(const MatchState& state, uint8_t* out) {
+  out[0] = kStateTag;
+  PutLittleEndian(state.match_id, 4, out + 1);
+  out[5] = state.side;
+  PutLittleEndian(state.tick, 4, out + 6);
+  PutLittleEndian(state.stamp, 8, out + 10);
+  PutFloat(state.ball_x, out + 18);
+  PutFloat(state.ball_y, out + 22);
+  PutFloat(state.left_paddle_y, out + 26);
+  PutFloat(state.right_paddle_y, out + 30);
+  PutLittleEndian(state.left_score, 2, out + 34);
+  PutLittleEndian(state.right_score, 2, out + 36);
+  out[38] = state.game_over;
+}
+
+bool DecodeMatchState(const uint8_t* in, size_t size, MatchState* state) {
+  if (size != kStatePacketBytes || in[0] != kStateTag || in[5] > 1) {
+    return false;
+  }
+  state->match_id = GetLittleEndian(in + 1, 4);
+  state->side = in[5];
+  state->tick = GetLittleEndian(in + 6, 4);
+  state->stamp = GetLittleEndian(in + 10, 8);
+  state->ball_x = GetFloat(in + 18);
+  state->ball_y = GetFloat(in + 22);
+  state->left_paddle_y = GetFloat(in + 26);
+  state->right_paddle_y = GetFloat(in + 30);
+  state->left_score = GetLittleEndian(in + 34, 2);
+  state->right_score = GetLittleEndian(in + 36, 2);
+  state->game_over = in[38] != 0;
+  return true;
+}
+
+
+// One core's worth of matches, and the event loop which runs them. See
+// match_server.h.
+class MatchShard {
+ public:
+  // Shard `index` of `num_shards`, listening on params.port + index.
+  MatchShard(const MatchServerParams& params, int index, int num_shards);
+  ~MatchShard();
+
+  // The event loop. Returns once Stop() is called.
+  void Run();
+  // Safe to call from any thread.
+  void Stop();
+
+  MatchServer::Stats GetStats() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Player {
+    sockaddr_in address;
+    bool joined = false;
+    uint64_t stamp = 0;  // newest received
+  };
+
+  // Indexed by board in sim_.
+  struct Match {
+    bool active = false;
+    uint32_t id = 0;
+    Clock::time_point last_heard;
+    Player players[2];
+    // Whether players have been sent the end of the current point, so the
+    // next one can be served.
+    bool point_end_sent = false;
+  };
+
+  void ReceiveInputs();
+  void HandleInput(const MatchInput& input, const sockaddr_in& from,
+                   Clock::time_point now);
+  // Returns the new match's board, or -1 if the shard is full.
+  int StartMatch(uint32_t id, Clock::time_point now);
+  void EndQuietMatches(Clock::time_point now);
+  void Tick();
+  void SendStates();
+
+  const MatchServerParams params_;
+  const int index_;
+  const int num_shards_;
+  const Clock::duration tick_period_;
+  const Clock::duration match_timeout_;
+  int socket_fd_;
+  int epoll_fd_;
+  int timer_fd_;
+  int stop_fd_;
+
+  BatchSimulator sim_;
+  std::vector<Match> matches_;
+  std::vector<int> active_boards_;  // in no particular order
+  std::vector<int> free_boards_;
+  std::unordered_map<uint32_t, int> board_by_id_;
+
+  // Ticks are due at timer_start_ + n * tick_period_, for n = 1, 2, ...
+  Clock::time_point timer_start_;
+  uint64_t ticks_due_ = 0;
+  uint32_t tick_ = 0;
+  const uint32_t ticks_per_expiry_check_;  // about a second's worth
+
+  DatagramBatcher batcher_;
+  MatchServer::Stats stats_;  // less what batcher_ counts
+
+  DISALLOW_COPY_AND_ASSIGN(MatchShard);
+};
+
+MatchShard::MatchShard(const MatchServerParams& params, int index,
+                       int num_shards)
+    : params_(params),
+      index_(index),
+      num_shards_(num_shards),
+      tick_period_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1 / params.tick_hz))),
+      match_timeout_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(params.match_timeout_secs))),
+      socket_fd_(socket(AF_INET, SOCK_DGRAM, 0)),
+      epoll_fd_(epoll_create1(0)),
+      timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)),
+      stop_fd_(eventfd(0, EFD_NONBLOCK)),
+      sim_(params.max_matches_per_shard),
+      matches_(params.max_matches_per_shard),
+      ticks_per_expiry_check_(std::max(1, static_cast<int>(params.tick_hz))),
+      batcher_(socket_fd_, kReceiveBufferBytes, kStatePacketBytes) {
+  PCHECK(socket_fd_ >= 0) << "Could not create UDP socket";
+  PCHECK(epoll_fd_ >= 0) << "Could not create epoll instance";
+  PCHECK(timer_fd_ >= 0) << "Could not create tick timer";
+  PCHECK(stop_fd_ >= 0) << "Could not create eventfd";
+  PCHECK(fcntl(socket_fd_, F_SETFL,
+               fcntl(socket_fd_, F_GETFL) | O_NONBLOCK) == 0)
+      << "Could not make socket non-blocking";
+  // Every player's state goes out in one burst each send, and their inputs
+  // pile up between ticks.
+  SetSocketBuffers(socket_fd_, 8 << 20);
+
+  int port = params.port + index;
+  sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(port);
+  PCHECK(bind(socket_fd_, reinterpret_cast<sockaddr*>(&local),
+              sizeof(local)) == 0)
+      << "Could not bind UDP port " << port;
+
+  for (int fd : {socket_fd_, timer_fd_, stop_fd_}) {
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    PCHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0)
+        << "Could not add to epoll";
+  }
+
+  // Boards without a match sit idle, as finished games do.
+  sim_.SetPolicies(BatchPolicy::EXTERNAL, BatchPolicy::EXTERNAL);
+  std::fill(sim_.game_over_.begin(), sim_.game_over_.end(), true);
+  for (int board = params.max_matches_per_shard - 1; board >= 0; --board) {
+    free_boards_.push_back(board);
+  }
+}
+
+MatchShard::~MatchShard() {
+  for (int fd : {socket_fd_, epoll_fd_, timer_fd_, stop_fd_}) {
+    close(fd);
+  }
+}
+
+void MatchShard::Stop() {
+  uint64_t one = 1;
+  PCHECK(write(stop_fd_, &one, sizeof(one)) == sizeof(one));
+}
+
+void MatchShard::Run() {
+  timespec period;
+  double period_secs = std::chrono::duration<double>(tick_period_).count();
+  period.tv_sec = static_cast<time_t>(period_secs);
+  period.tv_nsec = static_cast<long>((period_secs - period.tv_sec) * 1e9);
+  itimerspec timer;
+  timer.it_interval = period;
+  timer.it_value = period;
+  timer_start_ = Clock::now();
+  PCHECK(timerfd_settime(timer_fd_, 0, &timer, nullptr) == 0)
+      << "Could not start tick timer";
+
+  epoll_event events[3];
+  while (true) {
+    int ready = epoll_wait(epoll_fd_, events, 3, -1);
+    if (ready < 0) {
+      PCHECK(errno == EINTR) << "epoll_wait failed";
+      continue;
+    }
+    for (int i = 0; i < ready; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == stop_fd_) {
+        return;
+      } else if (fd == socket_fd_) {
+        ReceiveInputs();
+      } else if (fd == timer_fd_) {
+        Tick();
+      }
+    }
+  }
+}
+
+void MatchShard::ReceiveInputs() {
+  Clock::time_point now = Clock::now();
+  batcher_.ReceiveAll([this, now](const uint8_t* data, size_t size,
+                                  const sockaddr_in& from) {
+    MatchInput input;
+    if (!DecodeMatchInput(data, size, &input) ||
+        input.match_id % num_shards_ != static_cast<uint32_t>(index_)) {
+      // Garbage, or a match which lives on another shard. Starting it here
+      // too would split its players between two copies.
+      ++stats_.bad_packets;
+      return;
+    }
+    HandleInput(input, from, now);
+  });
+}
+
+void MatchShard::HandleInput(const MatchInput& input, const sockaddr_in& from,
+                             Clock::time_point now) {
+  auto it = board_by_id_.find(input.match_id);
+  int board = it != board_by_id_.end() ? it->second
+                                       : StartMatch(input.match_id, now);
+  if (board < 0) {
+    return;
+  }
+  Match& match = matches_[board];
+  Player& player = match.players[input.side];
+  if (!player.joined) {
+    player.joined = true;
+    player.address = from;
+  } else if (player.address.sin_addr.s_addr != from.sin_addr.s_addr ||
+             player.address.sin_port != from.sin_port) {
+    ++stats_.joins_rejected;  // someone else has this side
+    return;
+  }
+  match.last_heard = now;
+  // Inputs can arrive out of order; only a newer one changes the move.
+  if (input.stamp < player.stamp) {
+    return;
+  }
+  player.stamp = input.stamp;
+  (input.side == 0 ? sim_.left_moves_ : sim_.right_moves_)[board] =
+      input.move;
+}
+
+int MatchShard::StartMatch(uint32_t id, Clock::time_point now) {
+  if (free_boards_.empty()) {
+    ++stats_.joins_rejected;
+    return -1;
+  }
+  int board = free_boards_.back();
+  free_boards_.pop_back();
+  matches_[board] = Match();
+  matches_[board].active = true;
+  matches_[board].id = id;
+  matches_[board].last_heard = now;
+  board_by_id_[id] = board;
+  active_boards_.push_back(board);
+
+  sim_.ResetBoard(board);
+  sim_.left_score_[board] = 0;
+  sim_.right_score_[board] = 0;
+  sim_.left_moves_[board] = MoveDirection::NONE;
+  sim_.right_moves_[board] = MoveDirection::NONE;
+  ++stats_.matches_started;
+  ++stats_.matches;
+  return board;
+}
+
+void MatchShard::EndQuietMatches(Clock::time_point now) {
+  for (size_t i = 0; i < active_boards_.size();) {
+    int board = active_boards_[i];
+    Match& match = matches_[board];
+    if (now - match.last_heard < match_timeout_) {
+      ++i;
+      continue;
+    }
+    board_by_id_.erase(match.id);
+    match.active = false;
+    sim_.game_over_[board] = true;  // idle until reused
+    free_boards_.push_back(board);
+    active_boards_[i] = active_boards_.back();
+    active_boards_.pop_back();
+    ++stats_.matches_timed_out;
+    --stats_.matches;
+  }
+}
+
+void MatchShard::Tick() {
+  uint64_t expirations;
+  if (read(timer_fd_, &expirations, sizeof(expirations)) !=
+      sizeof(expirations)) {
+    return;  // spurious wakeup
+  }
+  Clock::time_point woke = Clock::now();
+  double woke_cpu_secs = ThreadCpuSecs();
+  ticks_due_ += expirations;
+  stats_.tick_lateness_secs.Add(std::chrono::duration<double>(
+      woke - (timer_start_ + tick_period_ * ticks_due_)).count());
+
+  int ticks = std::min<uint64_t>(expirations, kMaxTicksPerWake);
+  stats_.ticks_dropped += expirations - ticks;
+  const double seconds_per_tick = 1 / params_.tick_hz;
+  for (int i = 0; i < ticks; ++i) {
+    // Like network games, matches serve again by themselves, once the
+    // point's end has gone out in a state. Until then the board sits idle.
+    for (int board : active_boards_) {
+      if (sim_.game_over_[board] && matches_[board].point_end_sent) {
+        sim_.ResetBoard(board);
+        matches_[board].point_end_sent = false;
+      }
+    }
+    sim_.Step(seconds_per_tick);
+    ++tick_;
+    ++stats_.ticks;
+    if (tick_ % params_.send_every_ticks == 0) {
+      SendStates();
+    }
+    if (tick_ % ticks_per_expiry_check_ == 0) {
+      EndQuietMatches(woke);
+    }
+  }
+  stats_.tick_secs.Add(
+      std::chrono::duration<double>(Clock::now() - woke).count());
+  stats_.tick_cpu_secs.Add(ThreadCpuSecs() - woke_cpu_secs);
+}
+
+void MatchShard::SendStates() {
+  for (int board : active_boards_) {
+    Match& match = matches_[board];
+    MatchState state;
+    state.match_id = match.id;
+    state.tick = tick_;
+    state.ball_x = sim_.ball_x_[board];
+    state.ball_y = sim_.ball_y_[board];
+    state.left_paddle_y = sim_.left_paddle_y_[board];
+    state.right_paddle_y = sim_.right_paddle_y_[board];
+    state.left_score = sim_.left_score_[board];
+    state.right_score = sim_.right_score_[board];
+    state.game_over = sim_.game_over_[board];
+    match.point_end_sent = state.game_over;
+    for (int side = 0; side < 2; ++side) {
+      Player& player = match.players[side];
+      if (!player.joined) {
+        continue;
+      }
+      state.side = side;
+      state.stamp = player.stamp;
+      EncodeMatchState(state, batcher_.Queue(player.address,
+                                             kStatePacketBytes));
+    }
+  }
+  batcher_.Flush();
+}
+
+MatchServer::Stats MatchShard::GetStats() const {
+  MatchServer::Stats stats = stats_;
+  stats.packets_received = batcher_.counters().received;
+  stats.packets_sent = batcher_.counters().sent;
+  stats.send_failures = batcher_.counters().send_failures;
+  return stats;
+}
+
+
+void MatchServer::Stats::Merge(const Stats& other) {
+  matches += other.matches;
+  matches_started += other.matches_started;
+  matches_timed_out += other.matches_timed_out;
+  joins_rejected += other.joins_rejected;
+  ticks += other.ticks;
+  ticks_dropped += other.ticks_dropped;
+  packets_received += other.packets_received;
+  bad_packets += other.bad_packets;
+  packets_sent += other.packets_sent;
+  send_failures += other.send_failures;
+  tick_secs.Merge(other.tick_secs);
+  tick_cpu_secs.Merge(other.tick_cpu_secs);
+  tick_lateness_secs.Merge(other.tick_lateness_secs);
+}
+
+MatchServer::MatchServer(const MatchServerParams& params)
+    : port_(params.port) {
+  CHECK(params.port > 0) << "Match server needs a fixed port";
+  CHECK(params.tick_hz > 0) << "Tick rate must be positive";
+  CHECK(params.send_every_ticks > 0) << "send_every_ticks must be positive";
+  CHECK(params.max_matches_per_shard > 0)
+      << "max_matches_per_shard must be positive";
+  int num_shards = params.num_shards;
+  if (num_shards <= 0) {
+    num_shards = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_shards; ++i) {
+    shards_.push_back(util::make_unique<MatchShard>(params, i, num_shards));
+  }
+}
+
+MatchServer::~MatchServer() { Stop(); }
+
+int MatchServer::PortForMatch(uint32_t match_id) const {
+  return port_ + match_id % shards_.size();
+}
+
+void MatchServer::Start() {
+  CHECK(threads_.empty()) << "Match server already started";
+  unsigned num_cores = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    MatchShard* shard = shards_[i].get();
+    threads_.emplace_back([shard] { shard->Run(); });
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET(i % num_cores, &cores);
+    int error = pthread_setaffinity_np(threads_.back().native_handle(),
+                                       sizeof(cores), &cores);
+    if (error != 0) {
+      LOG(WARNING) << "Could not pin shard " << i << " to core "
+                   << i % num_cores << ": " << strerror(error);
+    }
+  }
+}
+
+void MatchServer::Stop() {
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    shards_[i]->Stop();
+    threads_[i].join();
+  }
+  threads_.clear();
+}
+
+MatchServer::Stats MatchServer::GetStats() const {
+  CHECK(threads_.empty()) << "Match server stats are only read when stopped";
+  Stats stats;
+  for (const auto& shard : shards_) {
+    stats.Merge(shard->GetStats());
+  }
+  return stats;
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const MatchServer::Stats& stats) {
+  return stream << boost::format("matches=%d started=%d timed_out=%d "
+                                 "rejected=%d ticks=%d dropped=%d "
+                                 "received=%d bad=%d sent=%d "
+                                 "send_failures=%d") %
+                       stats.matches % stats.matches_started %
+                       stats.matches_timed_out % stats.joins_rejected %
+                       stats.ticks % stats.ticks_dropped %
+                       stats.packets_received % stats.bad_packets %
+                       stats.packets_sent % stats.send_failures
+                << "\n  tick time:     " << stats.tick_secs
+                << "\n  tick CPU time: " << stats.tick_cpu_secs
+                << "\n  tick lateness: " << stats.tick_lateness_secs;
+}
+
+}  // namespace pong
@@ -0,0 +1,134 @@
+// A server hosting thousands of two-player matches at once, for players on
+// other machines.
+//
+// Matches are sharded across cores. Each shard is a thread with its own epoll
+// loop, its own UDP socket (on port + shard index) and its own
+// BatchSimulator, so shards share nothing. A shard wakes up either for
+// packets, which it reads in batches with recvmmsg(), or for its tick timer,
+// when it steps every match it hosts in one BatchSimulator::Step() and sends
+// each player the new state, in batches with sendmmsg(). Packets are read
+// into and built in buffers preallocated per shard, so nothing is allocated
+// per packet.
+//
+// Protocol, all little-endian:
+//   player -> server, kInputPacketBytes: 'I', match id (4 bytes), side (1; 0
+//     left, 1 right), move (1; a MoveDirection), stamp (8). The first input
+//     for a side joins that side, from the address it came from. Any stamp
+//     will do; the newest one is echoed back.
+//   server -> player, kStatePacketBytes: 'T', match id (4), the player's
+//     side (1), tick (4), the player's newest stamp (8), ball left and top,
+//     left and right paddle tops (4 floats, in board coordinates), left and
+//     right score (2 each), whether the point is over (1).
+// Match m lives on shard m % NumShards(), and its players must send to that
+// shard's port; other shards drop its inputs as bad packets.
+
+#ifndef MATCH_SERVER_H_
+#define MATCH_SERVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "controller.h"
+#include "latency_histogram.h"
+#include "util.h"
+
+namespace pong {
+
+constexpr size_t kInputPacketBytes = 1 + 4 + 1 + 1 + 8;
+constexpr size_t kStatePacketBytes = 1 + 4 + 1 + 4 + 8 + 4 * 4 + 2 * 2 + 1;
+
+struct MatchServerParams {
+  int port = 7900;  // of shard 0; shard i listens on port + i
+  int num_shards = 0;  // <= 0 means one per hardware thread
+  int max_matches_per_shard = 4096;
+  double tick_hz = 240;
+  int send_every_ticks = 4;  // players get the state at tick_hz / this
+  double match_timeout_secs = 10;  // matches neither player has sent to end
+};
+
+// One player's input, parsed.
+struct MatchInput {
+  uint32_t match_id;
+  int side;  // 0 left, 1 right
+  MoveDirection move;
+  uint64_t stamp;
+};
+
+// One state packet, parsed.
+struct MatchState {
+  uint32_t match_id;
+  int side;  // of the player it's sent to
+  uint32_t tick;
+  uint64_t stamp;
+  float ball_x, ball_y;
+  float left_paddle_y, right_paddle_y;
+  int left_score, right_score;
+  bool game_over;
+};
+
+void EncodeMatchInput(const MatchInput& input, uint8_t* out);
+bool DecodeMatchInput(const uint8_t* in, size_t size, MatchInput* input);
+void EncodeMatchState(const MatchState& state, uint8_t* out);
+bool DecodeMatchState(const uint8_t* in, size_t size, MatchState* state);
+
+class MatchShard;
+
+class MatchServer {
+ public:
+  struct Stats {
+    int matches = 0;  // hosted right now
+    int64_t matches_started = 0;
+    int64_t matches_timed_out = 0;
+    int64_t joins_rejected = 0;  // the shard was full, or the side taken
+    int64_t ticks = 0;  // per shard, summed
+    int64_t ticks_dropped = 0;  // too far behind to catch up
+    int64_t packets_received = 0;
+    int64_t bad_packets = 0;  // malformed, or for another shard
+    int64_t packets_sent = 0;
+    int64_t send_failures = 0;
+    // From a shard's timer firing to its matches all stepped and sent.
+    LatencyHistogram tick_secs{50e-6, 1000};
+    // CPU time the shard's thread spent on that, leaving out time other
+    // threads had the core, e.g. a load generator on the same machine.
+    LatencyHistogram tick_cpu_secs{50e-6, 1000};
+    // How long after it was due each tick started.
+    LatencyHistogram tick_lateness_secs{50e-6, 1000};
+
+    void Merge(const Stats& other);
+  };
+
+  // Binds every shard's socket. CHECK-fails if one can't be bound.
+  explicit MatchServer(const MatchServerParams& params);
+  // Stop()s.
+  ~MatchServer();
+
+  int NumShards() const { return static_cast<int>(shards_.size()); }
+  // Where players of `match_id` send their inputs.
+  int PortForMatch(uint32_t match_id) const;
+
+  // Starts a thread per shard, each pinned to a core if possible.
+  void Start();
+  // Stops and joins the shards' threads.
+  void Stop();
+
+  // Every shard's stats, summed. Only call while stopped.
+  Stats GetStats() const;
+
+ private:
+  int port_;
+  std::vector<std::unique_ptr<MatchShard>> shards_;
+  std::vector<std::thread> threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(MatchServer);
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const MatchServer::Stats& stats);
+
+}  // namespace pong
+
+#endif  // MATCH_SERVER_H_
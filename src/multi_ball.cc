@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <tuple>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "multi_ball.h"
+
+namespace pong {
+
+namespace {
+// At most this fraction of the space between the paddles is covered by balls
+// when they're first served, so they have room to move.
+constexpr double kMaxBallCoverage = 0.25;
+
+// Moves `box` back inside `space`, which must be big enough to hold it.
+void ClampInto(const BoundingBox& space, BoundingBox* box) {
+  Eigen::Vector2d low = space.top_left();
+  Eigen::Vector2d high = space.top_left() + space.size() - box->size();
+  box->top_left() = box->top_left().cwiseMax(low).cwiseMin(high);
+}
+}  // namespace
+
+std::ostream& operator<<(std::ostream& stream, Broadphase broadphase) {
+  switch (broadphase) {
+    case Broadphase::GRID:            return stream << "GRID";
+    case Broadphase::SWEEP_AND_PRUNE: return stream << "SWEEP_AND_PRUNE";
+    case Broadphase::BRUTE_FORCE:     return stream << "BRUTE_FORCE";
+    default:
+      LOG(WARNING) << "Tried to serialize unexpected pong::Broadphase value: "
+                   << static_cast<int>(broadphase);
+      return stream << static_cast<int>(broadphase);
+  }
+}
+
+bool ParseBroadphase(const std::string& name, Broadphase* broadphase) {
+  std::string upper = boost::algorithm::to_upper_copy(name);
+  for (Broadphase candidate :
+       {Broadphase::GRID, Broadphase::SWEEP_AND_PRUNE,
+        Broadphase::BRUTE_FORCE}) {
+    std::ostringstream candidate_name;
+    candidate_name << candidate;
+    if (upper == candidate_name.str()) {
+      *broadphase = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+MultiBallBoard::MultiBallBoard(int num_balls, uint64_t seed)
+    : balls_(num_balls), rng_(seed) {
+  CHECK(num_balls > 0) << "Need at least one ball";
+  board_.SetupNewGame();
+  valid_space_ = board_.ball_.valid_space_;
+  ball_speed_ = board_.ball_.velocity_.norm();
+
+  double size = std::min(
+      board_.ball_.bounds_.Width(),
+      std::sqrt(valid_space_.Width() * valid_space_.Height() *
+                kMaxBallCoverage / num_balls));
+  std::uniform_real_distribution<double> unit(0, 1);
+  for (MultiBall& ball : balls_) {
+    ball.bounds.size() = Eigen::Vector2d(size, size);
+    ball.bounds.top_left() =
+        valid_space_.top_left() +
+        (valid_space_.size() - ball.bounds.size())
+            .cwiseProduct(Eigen::Vector2d(unit(rng_), unit(rng_)));
+    ball.velocity =
+        util::DirectionAndMagnitude(RandomServeDirection(&rng_), ball_speed_);
+  }
+
+  // A touch bigger than a ball, so that rounding can't put two touching
+  // balls two cells apart.
+  cell_size_ = size * 1.01;
+  grid_columns_ = std::max(1.0, std::ceil(valid_space_.Width() / cell_size_));
+  grid_rows_ = std::max(1.0, std::ceil(valid_space_.Height() / cell_size_));
+  ball_cells_.resize(num_balls);
+  cell_starts_.resize(grid_columns_ * grid_rows_ + 1);
+  by_cell_.resize(num_balls);
+
+  sorted_.resize(num_balls);
+  for (int i = 0; i < num_balls; ++i) {
+    sorted_[i].edges = balls_[i].bounds.Edges();
+    sorted_[i].ball = i;
+  }
+  std::sort(sorted_.begin(), sorted_.end(),
+            [](const BroadphaseEntry& a, const BroadphaseEntry& b) {
+              return a.edges[0] < b.edges[0];
+            });
+}
+
+void MultiBallBoard::Update(double seconds_delta) {
+  UpdatePaddles(seconds_delta);
+  for (MultiBall& ball : balls_) {
+    UpdateBall(seconds_delta, &ball);
+  }
+
+  switch (broadphase_) {
+    case Broadphase::GRID:
+      FindOverlapsGrid();
+      break;
+    case Broadphase::SWEEP_AND_PRUNE:
+      FindOverlapsSweepAndPrune();
+      break;
+    case Broadphase::BRUTE_FORCE:
+      FindOverlapsBruteForce();
+      break;
+  }
+  for (const std::pair<int, int>& pair : candidate_pairs_) {
+    Collide(&balls_[pair.first], &balls_[pair.second]);
+  }
+  stats_.candidate_pairs += candidate_pairs_.size();
+  ++stats_.ticks;
+}
+
+void MultiBallBoard::UpdatePaddles(double seconds_delta) {
+  // The first ball to reach each paddle, by how long until it gets there.
+  int left_ball = -1;
+  int right_ball = -1;
+  double left_time = std::numeric_limits<double>::infinity();
+  double right_time = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < balls_.size(); ++i) {
+    const MultiBall& ball = balls_[i];
+    if (ball.velocity.x() < 0) {
+      double time = (valid_space_.Left() - ball.bounds.Left()) /
+                    ball.velocity.x();
+      if (time < left_time) {
+        left_time = time;
+        left_ball = i;
+      }
+    } else if (ball.velocity.x() > 0) {
+      double time = (valid_space_.Right() - ball.bounds.Right()) /
+                    ball.velocity.x();
+      if (time < right_time) {
+        right_time = time;
+        right_ball = i;
+      }
+    }
+  }
+
+  // Each paddle's controller sees only the ball coming for it.
+  if (left_ball >= 0) {
+    board_.ball_.bounds_ = balls_[left_ball].bounds;
+    board_.ball_.velocity_ = balls_[left_ball].velocity;
+  }
+  board_.left_paddle_.Update(seconds_delta);
+  if (right_ball >= 0) {
+    board_.ball_.bounds_ = balls_[right_ball].bounds;
+    board_.ball_.velocity_ = balls_[right_ball].velocity;
+  }
+  board_.right_paddle_.Update(seconds_delta);
+}
+
+// Same as Ball::Update, with the time of impact worked out per ball.
+void MultiBallBoard::UpdateBall(double seconds_delta, MultiBall* ball) {
+  auto time_to_wall = TimeToExit(ball->bounds, ball->velocity, valid_space_);
+  while (std::get<0>(time_to_wall) < seconds_delta) {
+    DCHECK(std::get<0>(time_to_wall) >= 0) << "Ball outside the valid space";
+    ball->bounds.top_left() += std::get<0>(time_to_wall) * ball->velocity;
+    seconds_delta -= std::get<0>(time_to_wall);
+    if (!BounceOffWall(std::get<1>(time_to_wall), ball)) {
+      return;
+    }
+    time_to_wall = TimeToExit(ball->bounds, ball->velocity, valid_space_);
+  }
+  ball->bounds.top_left() += seconds_delta * ball->velocity;
+}
+
+bool MultiBallBoard::BounceOffWall(BoundingWall wall, MultiBall* ball) {
+  const Paddle* paddle = nullptr;
+  switch (wall) {
+    case BoundingWall::TOP:  // fallthrough
+    case BoundingWall::BOTTOM:
+      ball->velocity.y() *= -1;
+      return true;
+    case BoundingWall::LEFT:
+      paddle = &board_.left_paddle_;
+      break;
+    case BoundingWall::RIGHT:
+      paddle = &board_.right_paddle_;
+      break;
+    default:
+      DieOnUnsupportedWall(wall);
+  }
+
+  if (ball->bounds.Top() <= paddle->bounds_.Bottom() &&
+      ball->bounds.Bottom() >= paddle->bounds_.Top()) {
+    ball->velocity.x() *= -1;
+    ++stats_.paddle_bounces;
+    return true;
+  }
+  if (wall == BoundingWall::LEFT) {
+    ++right_score_;
+  } else {
+    ++left_score_;
+  }
+  Serve(ball);
+  return false;
+}
+
+// Serves from somewhere along the middle line, so that balls served at about
+// the same time don't all land on top of each other.
+void MultiBallBoard::Serve(MultiBall* ball) {
+  std::uniform_real_distribution<double> y(
+      valid_space_.Top(), valid_space_.Bottom() - ball->bounds.Height());
+  ball->bounds.Center({valid_space_.Center().x(), 0});
+  ball->bounds.Top(y(rng_));
+  ball->velocity =
+      util::DirectionAndMagnitude(RandomServeDirection(&rng_), ball_speed_);
+}
+
+void MultiBallBoard::FindOverlapsGrid() {
+  // Counting sort of the balls by cell.
+  std::fill(cell_starts_.begin(), cell_starts_.end(), 0);
+  for (size_t i = 0; i < balls_.size(); ++i) {
+    Eigen::Vector2d offset =
+        (balls_[i].bounds.top_left() - valid_space_.top_left()) / cell_size_;
+    int column = std::min(std::max(0, static_cast<int>(offset.x())),
+                          grid_columns_ - 1);
+    int row = std::min(std::max(0, static_cast<int>(offset.y())),
+                       grid_rows_ - 1);
+    ball_cells_[i] = row * grid_columns_ + column;
+    ++cell_starts_[ball_cells_[i] + 1];
+  }
+  for (size_t cell = 1; cell < cell_starts_.size(); ++cell) {
+    cell_starts_[cell] += cell_starts_[cell - 1];
+  }
+  for (size_t i = 0; i < balls_.size(); ++i) {
+    BroadphaseEntry& entry = by_cell_[cell_starts_[ball_cells_[i]]++];
+    entry.edges = balls_[i].bounds.Edges();
+    entry.ball = i;
+  }
+  // The fill above moved each start up to the next cell's.
+  std::copy_backward(cell_starts_.begin(), cell_starts_.end() - 1,
+                     cell_starts_.end());
+  cell_starts_[0] = 0;
+
+  // Every pair of neighbouring cells is looked at once: each cell with itself,
+  // and with the cells to its right, below left, below and below right.
+  candidate_pairs_.clear();
+  auto check_cells = [this](int cell, int other_cell) {
+    for (int i = cell_starts_[cell]; i < cell_starts_[cell + 1]; ++i) {
+      const Eigen::Array4d& a = by_cell_[i].edges;
+      int j = other_cell == cell ? i + 1 : cell_starts_[other_cell];
+      for (; j < cell_starts_[other_cell + 1]; ++j) {
+        const Eigen::Array4d& b = by_cell_[j].edges;
+        // Same test as BoundingBox::Overlaps.
+        if (a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3]) {
+          candidate_pairs_.push_back(
+              std::minmax(by_cell_[i].ball, by_cell_[j].ball));
+        }
+      }
+    }
+  };
+  for (int row = 0; row < grid_rows_; ++row) {
+    for (int column = 0; column < grid_columns_; ++column) {
+      int cell = row * grid_columns_ + column;
+      if (cell_starts_[cell] == cell_starts_[cell + 1]) {
+        continue;
+      }
+      check_cells(cell, cell);
+      if (column + 1 < grid_columns_) {
+        check_cells(cell, cell + 1);
+      }
+      if (row + 1 < grid_rows_) {
+        int below = cell + grid_columns_;
+        if (column > 0) {
+          check_cells(cell, below - 1);
+        }
+        check_cells(cell, below);
+        if (column + 1 < grid_columns_) {
+          check_cells(cell, below + 1);
+        }
+      }
+    }
+  }
+  // Resolve in the same order as the brute force, so both give the same
+  // result.
+  std::sort(candidate_pairs_.begin(), candidate_pairs_.end());
+}
+
+void MultiBallBoard::FindOverlapsSweepAndPrune() {
+  for (BroadphaseEntry& entry : sorted_) {
+    entry.edges = balls_[entry.ball].bounds.Edges();
+  }
+
+  // Balls only move a little each tick, so the order from last tick is
+  // almost right, and insertion sort fixes it up in close to linear time.
+  for (size_t i = 1; i < sorted_.size(); ++i) {
+    if (sorted_[i - 1].edges[0] <= sorted_[i].edges[0]) {
+      continue;
+    }
+    BroadphaseEntry entry = sorted_[i];
+    size_t j = i;
+    for (; j > 0 && sorted_[j - 1].edges[0] > entry.edges[0]; --j) {
+      sorted_[j] = sorted_[j - 1];
+    }
+    sorted_[j] = entry;
+  }
+
+  // Only the balls which start before this one ends can touch it. Same test
+  // as BoundingBox::Overlaps.
+  candidate_pairs_.clear();
+  for (size_t i = 0; i < sorted_.size(); ++i) {
+    const Eigen::Array4d& a = sorted_[i].edges;
+    for (size_t j = i + 1; j < sorted_.size() && sorted_[j].edges[0] <= a[2];
+         ++j) {
+      const Eigen::Array4d& b = sorted_[j].edges;
+      if (b[1] <= a[3] && a[1] <= b[3]) {
+        candidate_pairs_.push_back(
+            std::minmax(sorted_[i].ball, sorted_[j].ball));
+      }
+    }
+  }
+  // Resolve in the same order as the brute force, so both give the same
+  // result.
+  std::sort(candidate_pairs_.begin(), candidate_pairs_.end());
+}
+
+void MultiBallBoard::FindOverlapsBruteForce() {
+  candidate_pairs_.clear();
+  for (size_t i = 0; i < balls_.size(); ++i) {
+    for (size_t j = i + 1; j < balls_.size(); ++j) {
+      if (balls_[i].bounds.Overlaps(balls_[j].bounds)) {
+        candidate_pairs_.emplace_back(i, j);
+      }
+    }
+  }
+}
+
+// The balls all weigh the same, so an elastic collision just swaps their
+// velocities along the axis they hit on. That's whichever axis they overlap
+// least on.
+void MultiBallBoard::Collide(MultiBall* a, MultiBall* b) {
+  Eigen::Array4d a_edges = a->bounds.Edges();
+  Eigen::Array4d b_edges = b->bounds.Edges();
+  Eigen::Array2d overlap = a_edges.tail<2>().min(b_edges.tail<2>()) -
+                           a_edges.head<2>().max(b_edges.head<2>());
+  int axis = overlap.x() < overlap.y() ? 0 : 1;
+  double a_to_b =
+      b->bounds.Center()[axis] < a->bounds.Center()[axis] ? -1 : 1;
+
+  a->bounds.top_left()[axis] -= a_to_b * overlap[axis] / 2;
+  b->bounds.top_left()[axis] += a_to_b * overlap[axis] / 2;
+  ClampInto(valid_space_, &a->bounds);
+  ClampInto(valid_space_, &b->bounds);
+
+  if ((a->velocity[axis] - b->velocity[axis]) * a_to_b > 0) {
+    std::swap(a->velocity[axis], b->velocity[axis]);
+    ++stats_.ball_collisions;
+  }
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const MultiBallBoard::Stats& stats) {
+  return stream << boost::format(
+                       "ticks=%d candidate_pairs=%d ball_collisions=%d "
+                       "paddle_bounces=%d") %
+                       stats.ticks % stats.candidate_pairs %
+                       stats.ball_collisions % stats.paddle_bounces;
+}
+
+}  // namespace pong
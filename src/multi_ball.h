@@ -0,0 +1,164 @@
+// Chaos mode: the usual two paddles against hundreds to tens of thousands of
+// balls at once, which bounce off the walls, the paddles and each other.
+//
+// Each ball moves and bounces off the walls the same way as in GameBoard, but
+// a missed ball doesn't end the game; the other player scores and the ball is
+// served again from the middle. Balls don't speed up when returned, or there
+// would soon be no keeping up with them.
+//
+// Checking every pair of balls for collisions would cost O(n^2) per tick, so a
+// broadphase narrows them down first. See Broadphase.
+
+#ifndef MULTI_BALL_H_
+#define MULTI_BALL_H_
+
+#include <stdint.h>
+#include <ostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "controller.h"
+#include "game.h"
+#include "geometry.h"
+#include "util.h"
+
+namespace pong {
+
+// How MultiBallBoard finds the pairs of balls which might be colliding. They
+// all find exactly the same pairs; only the speed differs.
+enum class Broadphase {
+  // Buckets the balls into a grid of ball-sized cells, with a counting sort,
+  // and checks each ball against the ones in its own and neighbouring cells.
+  // O(n) per tick.
+  GRID,
+
+  // Keeps the balls sorted by their left edge (an insertion sort, which is
+  // cheap since the order barely changes from one tick to the next), and
+  // checks each ball against the ones which start before it ends. With the
+  // balls spread evenly over the board, that's O(sqrt(n)) others per ball,
+  // so it falls behind GRID as the ball count goes up.
+  SWEEP_AND_PRUNE,
+
+  BRUTE_FORCE,  // every pair; for checking the others against
+};
+std::ostream& operator<<(std::ostream& stream, Broadphase broadphase);
+
+// Parses a broadphase name as printed by operator<< (case-insensitive).
+// Returns false if `name` isn't a known broadphase.
+bool ParseBroadphase(const std::string& name, Broadphase* broadphase);
+
+struct MultiBall {
+  BoundingBox bounds;
+  Eigen::Vector2d velocity;  // game units per second
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+class MultiBallBoard {
+ public:
+  struct Stats {
+    int64_t ticks = 0;
+    int64_t candidate_pairs = 0;  // found by the broadphase
+    int64_t ball_collisions = 0;  // pairs which were actually approaching
+    int64_t paddle_bounces = 0;
+  };
+
+  // Serves `num_balls` balls in random directions from random places. The
+  // more balls, the smaller they are, so they all fit on the board.
+  MultiBallBoard(int num_balls, uint64_t seed);
+
+  void SetLeftController(PaddleController* controller) {
+    board_.SetLeftController(controller);
+  }
+  void SetRightController(PaddleController* controller) {
+    board_.SetRightController(controller);
+  }
+  void SetBroadphase(Broadphase broadphase) { broadphase_ = broadphase; }
+
+  void Update(double seconds_delta);
+
+  // The board the balls are on. Its paddles are the ones in play; its ball_
+  // isn't, but each paddle's controller is shown the ball which will reach
+  // that paddle soonest there, so any PaddleController works in chaos mode.
+  const GameBoard& Board() const { return board_; }
+
+  const std::vector<MultiBall, Eigen::aligned_allocator<MultiBall>>& Balls()
+      const {
+    return balls_;
+  }
+  const Stats& GetStats() const { return stats_; }
+
+  int left_score_ = 0;
+  int right_score_ = 0;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  // Moves the ball, bouncing it off the walls and paddles on the way.
+  void UpdateBall(double seconds_delta, MultiBall* ball);
+
+  // Returns false if the ball got past a paddle, in which case it has been
+  // served again.
+  bool BounceOffWall(BoundingWall wall, MultiBall* ball);
+  void Serve(MultiBall* ball);
+
+  // Shows each paddle's controller the ball which will reach that paddle
+  // first, then moves the paddle.
+  void UpdatePaddles(double seconds_delta);
+
+  // Fills candidate_pairs_ with the pairs of balls which overlap, lower index
+  // first, in sorted order.
+  void FindOverlapsGrid();
+  void FindOverlapsSweepAndPrune();
+  void FindOverlapsBruteForce();
+
+  // Pushes an overlapping pair apart, and if they were moving towards each
+  // other, bounces them off each other.
+  void Collide(MultiBall* a, MultiBall* b);
+
+  GameBoard board_;
+  std::vector<MultiBall, Eigen::aligned_allocator<MultiBall>> balls_;
+  BoundingBox valid_space_;  // where the balls can be; between the paddles
+  double ball_speed_;
+  std::mt19937_64 rng_;
+  Broadphase broadphase_ = Broadphase::GRID;
+
+  // A ball's edges, copied out so that the broadphases can go through them
+  // in their own order without jumping around balls_.
+  struct BroadphaseEntry {
+    Eigen::Array4d edges;  // left, top, right, bottom
+    int ball;
+  };
+  typedef std::vector<BroadphaseEntry,
+                      Eigen::aligned_allocator<BroadphaseEntry>>
+      BroadphaseEntries;
+
+  // For GRID. Cells are the size of a ball, so balls can only overlap if
+  // their top left corners are in the same or neighbouring cells.
+  double cell_size_;
+  int grid_columns_;
+  int grid_rows_;
+  std::vector<int> ball_cells_;
+  std::vector<int> cell_starts_;  // into by_cell_, plus one past the end
+  BroadphaseEntries by_cell_;
+
+  // For SWEEP_AND_PRUNE. Sorted by left edge, kept from one tick to the next.
+  BroadphaseEntries sorted_;
+
+  std::vector<std::pair<int, int>> candidate_pairs_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultiBallBoard);
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const MultiBallBoard::Stats& stats);
+
+}  // namespace pong
+
+#endif  // MULTI_BALL_H_
@@ -0,0 +1,239 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "net.h"
+
+namespace pong {
+
+namespace {
+// Larger than any packet we send.
+constexpr size_t kMaxPacketBytes = 2048;
+}  // namespace
+
+UdpLink::UdpLink(int local_port, const LinkConditions& conditions)
+    : fd_(socket(AF_INET, SOCK_DGRAM, 0)),
+      conditions_(conditions),
+      rng_(conditions.seed) {
+  PCHECK(fd_ >= 0) << "Could not create UDP socket";
+  PCHECK(fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK) == 0)
+      << "Could not make socket non-blocking";
+
+  sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(local_port);
+  PCHECK(bind(fd_, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0)
+      << "Could not bind UDP port " << local_port;
+  memset(&peer_, 0, sizeof(peer_));
+}
+
+UdpLink::~UdpLink() { close(fd_); }
+
+int UdpLink::LocalPort() const {
+  sockaddr_in local;
+  socklen_t size = sizeof(local);
+  PCHECK(getsockname(fd_, reinterpret_cast<sockaddr*>(&local), &size) == 0);
+  return ntohs(local.sin_port);
+}
+
+void UdpLink::SetPeer(const std::string& host, int port) {
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* result = nullptr;
+  int error = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+  CHECK(error == 0) << "Could not resolve " << host << ": "
+                    << gai_strerror(error);
+  memcpy(&peer_, result->ai_addr, sizeof(peer_));
+  peer_.sin_port = htons(port);
+  freeaddrinfo(result);
+  have_peer_ = true;
+}
+
+void UdpLink::Send(const std::vector<uint8_t>& packet) {
+  CHECK(packet.size() <= kMaxPacketBytes) << "Packet too big";
+  FlushDelayed();
+  if (conditions_.loss > 0 &&
+      std::bernoulli_distribution(conditions_.loss)(rng_)) {
+    return;
+  }
+  double delay_secs = conditions_.latency_secs;
+  if (conditions_.jitter_secs > 0) {
+    delay_secs += std::uniform_real_distribution<double>(
+        0, conditions_.jitter_secs)(rng_);
+  }
+  if (delay_secs <= 0) {
+    SendNow(packet);
+    return;
+  }
+  delayed_.push({Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>(delay_secs)),
+                 packet});
+}
+
+bool UdpLink::Receive(std::vector<uint8_t>* packet) {
+  FlushDelayed();
+  packet->resize(kMaxPacketBytes);
+  while (true) {
+    sockaddr_in from;
+    socklen_t from_size = sizeof(from);
+    ssize_t size = recvfrom(fd_, packet->data(), packet->size(), 0,
+                            reinterpret_cast<sockaddr*>(&from), &from_size);
+    if (size < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        PLOG(WARNING) << "UDP receive failed";
+      }
+      return false;
+    }
+    // Ignore strays from anyone but the peer.
+    if (have_peer_ && (from.sin_addr.s_addr != peer_.sin_addr.s_addr ||
+                       from.sin_port != peer_.sin_port)) {
+      continue;
+    }
+    packet->resize(size);
+    return true;
+  }
+}
+
+void UdpLink::FlushDelayed() {
+  Clock::time_point now = Clock::now();
+  while (!delayed_.empty() && delayed_.top().due <= now) {
+    SendNow(delayed_.top().data);
+    delayed_.pop();
+  }
+}
+
+void UdpLink::SendNow(const std::vector<uint8_t>& packet) {
+  if (!have_peer_) {
+    return;
+  }
+  if (sendto(fd_, packet.data(), packet.size(), 0,
+             reinterpret_cast<const sockaddr*>(&peer_), sizeof(peer_)) < 0 &&
+      errno != ECONNREFUSED) {
+    PLOG(WARNING) << "UDP send failed";
+  }
+}
+
+
+void PutLittleEndian(uint64_t value, int bytes, uint8_t* out) {
+  for (int i = 0; i < bytes; ++i) {
+    out[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+uint64_t GetLittleEndian(const uint8_t* in, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+void SetSocketBuffers(int fd, int bytes) {
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+}
+
+
+constexpr int DatagramBatcher::kBatchSize;
+
+DatagramBatcher::DatagramBatcher(int fd, size_t max_receive_bytes,
+                                 size_t max_send_bytes)
+    : fd_(fd),
+      max_receive_bytes_(max_receive_bytes),
+      max_send_bytes_(max_send_bytes),
+      receive_pool_(kBatchSize * max_receive_bytes),
+      receive_addresses_(kBatchSize),
+      receive_iovecs_(kBatchSize),
+      receive_messages_(kBatchSize),
+      send_pool_(kBatchSize * max_send_bytes),
+      send_addresses_(kBatchSize),
+      send_iovecs_(kBatchSize),
+      send_messages_(kBatchSize) {}
+
+void DatagramBatcher::ReceiveAll(const ReceiveHandler& handle) {
+  while (true) {
+    for (int i = 0; i < kBatchSize; ++i) {
+      receive_iovecs_[i].iov_base = &receive_pool_[i * max_receive_bytes_];
+      receive_iovecs_[i].iov_len = max_receive_bytes_;
+      mmsghdr& message = receive_messages_[i];
+      memset(&message, 0, sizeof(message));
+      message.msg_hdr.msg_name = &receive_addresses_[i];
+      message.msg_hdr.msg_namelen = sizeof(receive_addresses_[i]);
+      message.msg_hdr.msg_iov = &receive_iovecs_[i];
+      message.msg_hdr.msg_iovlen = 1;
+    }
+    int received =
+        recvmmsg(fd_, receive_messages_.data(), kBatchSize, 0, nullptr);
+    if (received < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        PLOG(WARNING) << "UDP receive failed";
+      }
+      return;
+    }
+    counters_.received += received;
+    for (int i = 0; i < received; ++i) {
+      handle(&receive_pool_[i * max_receive_bytes_],
+             receive_messages_[i].msg_len, receive_addresses_[i]);
+    }
+    if (received < kBatchSize) {
+      return;
+    }
+  }
+}
+
+uint8_t* DatagramBatcher::Queue(const sockaddr_in& to, size_t size) {
+  CHECK(size <= max_send_bytes_) << "Datagram too big: " << size;
+  if (queued_ == kBatchSize) {
+    Flush();
+  }
+  uint8_t* data = &send_pool_[queued_ * max_send_bytes_];
+  send_addresses_[queued_] = to;
+  send_iovecs_[queued_].iov_base = data;
+  send_iovecs_[queued_].iov_len = size;
+  ++queued_;
+  return data;
+}
+
+void DatagramBatcher::Flush() {
+  for (int i = 0; i < queued_; ++i) {
+    mmsghdr& message = send_messages_[i];
+    memset(&message, 0, sizeof(message));
+    message.msg_hdr.msg_name = &send_addresses_[i];
+    message.msg_hdr.msg_namelen = sizeof(send_addresses_[i]);
+    message.msg_hdr.msg_iov = &send_iovecs_[i];
+    message.msg_hdr.msg_iovlen = 1;
+  }
+  int sent = 0;
+  while (sent < queued_) {
+    int result = sendmmsg(fd_, &send_messages_[sent], queued_ - sent, 0);
+    if (result < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // The socket buffer is full; the rest miss out.
+        counters_.send_failures += queued_ - sent;
+        break;
+      }
+      // Something wrong with this one peer; skip it.
+      ++counters_.send_failures;
+      ++sent;
+      continue;
+    }
+    for (int i = sent; i < sent + result; ++i) {
+      counters_.bytes_sent += send_messages_[i].msg_len;
+    }
+    counters_.sent += result;
+    sent += result;
+  }
+  queued_ = 0;
+}
+
+}  // namespace pong
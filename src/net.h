@@ -0,0 +1,149 @@
+// Minimal UDP networking, with a knob for making the network worse on
+// purpose, so that netplay can be tested on localhost, and batched sending
+// and receiving for servers with thousands of peers.
+
+#ifndef NET_H_
+#define NET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace pong {
+
+// Artificial network trouble, applied to outgoing packets.
+struct LinkConditions {
+  double latency_secs = 0;  // one-way delay added to every packet
+  double jitter_secs = 0;   // up to this much extra delay, uniformly random
+  double loss = 0;          // fraction of packets dropped
+  uint64_t seed = 1;        // for the random jitter and loss
+};
+
+// A non-blocking UDP socket talking to a single peer.
+class UdpLink {
+ public:
+  // Binds to `local_port` on all interfaces; port 0 picks any free port.
+  // CHECK-fails if the socket can't be set up.
+  explicit UdpLink(int local_port,
+                   const LinkConditions& conditions = LinkConditions());
+  ~UdpLink();
+
+  int LocalPort() const;
+
+  // Where Send() sends to. `host` is an IPv4 address or host name.
+  void SetPeer(const std::string& host, int port);
+
+  // Queues a packet to the peer, subject to the link conditions.
+  void Send(const std::vector<uint8_t>& packet);
+
+  // Gets the next packet from the peer, if one has arrived. Never blocks.
+  bool Receive(std::vector<uint8_t>* packet);
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+  struct DelayedPacket {
+    Clock::time_point due;
+    std::vector<uint8_t> data;
+    bool operator<(const DelayedPacket& other) const {
+      return due > other.due;  // earliest first in a priority_queue
+    }
+  };
+
+  // Sends any delayed packets which are due.
+  void FlushDelayed();
+  void SendNow(const std::vector<uint8_t>& packet);
+
+  int fd_;
+  sockaddr_in peer_;
+  bool have_peer_ = false;
+
+  const LinkConditions conditions_;
+  std::mt19937_64 rng_;
+  std::priority_queue<DelayedPacket> delayed_;
+
+  DISALLOW_COPY_AND_ASSIGN(UdpLink);
+};
+
+// Packet fields are written in little-endian order, whatever the host's.
+void PutLittleEndian(uint64_t value, int bytes, uint8_t* out);
+uint64_t GetLittleEndian(const uint8_t* in, int bytes);
+
+// Asks for `bytes` of send and receive buffer on the socket `fd`, for
+// servers whose sends go out in bursts to, and whose packets pile up from,
+// thousands of peers. The kernel caps these at net.core.wmem_max and
+// rmem_max, so this may get less.
+void SetSocketBuffers(int fd, int bytes);
+
+// Receives and sends datagrams on a non-blocking UDP socket in batches, with
+// recvmmsg() and sendmmsg(), so talking to thousands of peers costs a system
+// call per kBatchSize packets rather than per packet. All the buffers are
+// allocated up front, so nothing is allocated per packet.
+class DatagramBatcher {
+ public:
+  static constexpr int kBatchSize = 256;  // datagrams per system call
+
+  struct Counters {
+    int64_t received = 0;
+    int64_t sent = 0;
+    int64_t bytes_sent = 0;
+    // Dropped because the socket buffer was full, or the send failed.
+    int64_t send_failures = 0;
+  };
+
+  // Called for each received datagram; `data` is only valid during the call.
+  typedef std::function<void(const uint8_t* data, size_t size,
+                             const sockaddr_in& from)> ReceiveHandler;
+
+  // For `fd`, which isn't owned. Received datagrams longer than
+  // `max_receive_bytes` are truncated, and sent ones can't be longer than
+  // `max_send_bytes`.
+  DatagramBatcher(int fd, size_t max_receive_bytes, size_t max_send_bytes);
+
+  // Reads until nothing is waiting, passing each datagram to `handle`, which
+  // may Queue() replies.
+  void ReceiveAll(const ReceiveHandler& handle);
+
+  // Returns where to write a datagram of `size` bytes for `to`, which goes
+  // out on the next Flush(). Flushes first if the batch is full.
+  uint8_t* Queue(const sockaddr_in& to, size_t size);
+
+  // Sends everything queued. If the socket buffer fills up, the rest are
+  // dropped rather than waited for.
+  void Flush();
+
+  const Counters& counters() const { return counters_; }
+
+ private:
+  const int fd_;
+  const size_t max_receive_bytes_;
+  const size_t max_send_bytes_;
+
+  std::vector<uint8_t> receive_pool_;
+  std::vector<sockaddr_in> receive_addresses_;
+  std::vector<struct iovec> receive_iovecs_;
+  std::vector<struct mmsghdr> receive_messages_;
+
+  std::vector<uint8_t> send_pool_;
+  std::vector<sockaddr_in> send_addresses_;
+  std::vector<struct iovec> send_iovecs_;
+  std::vector<struct mmsghdr> send_messages_;
+  int queued_ = 0;
+
+  Counters counters_;
+
+  DISALLOW_COPY_AND_ASSIGN(DatagramBatcher);
+};
+
+}  // namespace pong
+
+#endif  // NET_H_
@@ -0,0 +1,252 @@
+#include <algorithm>
+
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "netplay.h"
+
+namespace pong {
+
+namespace {
+constexpr uint32_t kPacketMagic = 0x504E4731;  // "PNG1"
+constexpr int kMaxMovesPerPacket = 1024;
+
+// Packets are built byte by byte in little-endian order, so peers don't have
+// to share a byte order.
+void PutUint(uint64_t value, int bytes, std::vector<uint8_t>* packet) {
+  for (int i = 0; i < bytes; ++i) {
+    packet->push_back((value >> (8 * i)) & 0xFF);
+  }
+}
+
+uint64_t GetUint(const std::vector<uint8_t>& packet, size_t* pos, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(packet[*pos + i]) << (8 * i);
+  }
+  *pos += bytes;
+  return value;
+}
+
+// Packet layout: magic (4 bytes), the last of the receiver's moves which the
+// sender has (8), the tick of the first move (8), number of moves (2), then
+// one byte per move.
+constexpr size_t kPacketHeaderBytes = 4 + 8 + 8 + 2;
+}  // namespace
+
+
+InputHistory::InputHistory(int capacity)
+    : moves_(capacity, MoveDirection::NONE) {}
+
+void InputHistory::Confirm(MoveDirection move) {
+  ++confirmed_through_;
+  moves_[confirmed_through_ % moves_.size()] = move;
+}
+
+MoveDirection InputHistory::Get(int64_t tick) const {
+  if (tick > confirmed_through_) {
+    // Players tend to hold a key down, so guess they still are.
+    return confirmed_through_ < 0 ? MoveDirection::NONE
+                                  : moves_[confirmed_through_ % moves_.size()];
+  }
+  CHECK(tick >= 0 && tick > confirmed_through_ -
+                                static_cast<int64_t>(moves_.size()))
+      << "Tick " << tick << " is no longer in the input history";
+  return moves_[tick % moves_.size()];
+}
+
+MoveDirection NetworkPaddleController::DesiredMove(const GameBoard& game,
+                                                   const Paddle& paddle) {
+  return inputs_->Get(tick_);
+}
+
+
+RollbackSession::RollbackSession(GameBoard* game,
+                                 GameBoard::Player local_side,
+                                 PaddleController* local_controller,
+                                 UdpLink* link, const RollbackParams& params)
+    : game_(CHECK_NOTNULL(game)),
+      local_side_(local_side),
+      local_controller_(CHECK_NOTNULL(local_controller)),
+      link_(CHECK_NOTNULL(link)),
+      params_(params),
+      // Room for a full rollback, plus the moves a peer that's as far ahead
+      // of us as allowed could have sent.
+      history_ticks_(2 * (params.max_prediction_ticks +
+                          params.input_delay_ticks) + 16),
+      local_inputs_(history_ticks_),
+      remote_inputs_(history_ticks_),
+      local_paddle_(&local_inputs_),
+      remote_paddle_(&remote_inputs_),
+      snapshots_(history_ticks_),
+      used_remote_moves_(history_ticks_),
+      rollback_to_(0) {
+  CHECK(local_side_ != GameBoard::Player::NONE) << "Need a side to play";
+  CHECK(params_.input_delay_ticks >= 0) << "Bad input delay";
+  CHECK(params_.max_prediction_ticks > 0) << "Bad prediction window";
+  if (local_side_ == GameBoard::Player::LEFT) {
+    game_->SetLeftController(&local_paddle_);
+    game_->SetRightController(&remote_paddle_);
+  } else {
+    game_->SetLeftController(&remote_paddle_);
+    game_->SetRightController(&local_paddle_);
+  }
+  game_->SetupNewGame();
+
+  // Nobody has moved before the input delay is up.
+  for (int i = 0; i < params_.input_delay_ticks; ++i) {
+    local_inputs_.Confirm(MoveDirection::NONE);
+  }
+}
+
+bool RollbackSession::AdvanceTick() {
+  ReceiveInputs();
+  if (tick_ - remote_inputs_.ConfirmedThrough() >
+      params_.max_prediction_ticks) {
+    ++stats_.stalls;
+    SendInputs();
+    RollBack();
+    return false;
+  }
+
+  // The local move is sampled now, but takes effect input_delay_ticks later.
+  const Paddle& local_paddle = local_side_ == GameBoard::Player::LEFT
+                                   ? game_->left_paddle_
+                                   : game_->right_paddle_;
+  local_inputs_.Confirm(local_controller_->DesiredMove(*game_, local_paddle));
+  SendInputs();
+
+  RollBack();
+  SimulateTick(tick_);
+  ++tick_;
+  rollback_to_ = tick_;
+  ++stats_.ticks;
+  return true;
+}
+
+void RollbackSession::Poll() {
+  ReceiveInputs();
+  SendInputs();
+  RollBack();
+}
+
+int64_t RollbackSession::ConfirmedTicks() const {
+  return std::min(tick_, std::min(local_inputs_.ConfirmedThrough(),
+                                  remote_inputs_.ConfirmedThrough()) + 1);
+}
+
+void RollbackSession::SendInputs() {
+  int64_t first = std::max(local_acked_through_ + 1,
+                           local_inputs_.ConfirmedThrough() -
+                               history_ticks_ + 1);
+  int64_t count = std::max<int64_t>(
+      0, std::min<int64_t>(local_inputs_.ConfirmedThrough() - first + 1,
+                           kMaxMovesPerPacket));
+
+  std::vector<uint8_t> packet;
+  packet.reserve(kPacketHeaderBytes + count);
+  PutUint(kPacketMagic, 4, &packet);
+  PutUint(remote_inputs_.ConfirmedThrough(), 8, &packet);
+  PutUint(first, 8, &packet);
+  PutUint(count, 2, &packet);
+  for (int64_t i = 0; i < count; ++i) {
+    packet.push_back(static_cast<uint8_t>(local_inputs_.Get(first + i)));
+  }
+  link_->Send(packet);
+  ++stats_.packets_sent;
+}
+
+void RollbackSession::ReceiveInputs() {
+  std::vector<uint8_t> packet;
+  while (link_->Receive(&packet)) {
+    size_t pos = 0;
+    if (packet.size() < kPacketHeaderBytes ||
+        GetUint(packet, &pos, 4) != kPacketMagic) {
+      LOG(WARNING) << "Ignoring a bad netplay packet";
+      continue;
+    }
+    int64_t ack = GetUint(packet, &pos, 8);
+    int64_t first = GetUint(packet, &pos, 8);
+    int count = GetUint(packet, &pos, 2);
+    if (packet.size() != kPacketHeaderBytes + count) {
+      LOG(WARNING) << "Ignoring a truncated netplay packet";
+      continue;
+    }
+    ++stats_.packets_received;
+    local_acked_through_ = std::max(local_acked_through_, ack);
+
+    // Only take moves which continue on from the ones we have. Anything
+    // after a gap will come again in a later packet.
+    for (int i = 0; i < count; ++i) {
+      int64_t tick = first + i;
+      if (tick <= remote_inputs_.ConfirmedThrough()) {
+        continue;
+      }
+      if (tick != remote_inputs_.ConfirmedThrough() + 1) {
+        break;
+      }
+      uint8_t value = packet[pos + i];
+      if (value > static_cast<uint8_t>(MoveDirection::DOWN)) {
+        LOG(WARNING) << "Ignoring a bad move in a netplay packet";
+        break;
+      }
+      MoveDirection move = static_cast<MoveDirection>(value);
+      if (tick < tick_ &&
+          used_remote_moves_[tick % history_ticks_] != move) {
+        rollback_to_ = std::min(rollback_to_, tick);
+      }
+      remote_inputs_.Confirm(move);
+    }
+  }
+}
+
+void RollbackSession::RollBack() {
+  if (rollback_to_ >= tick_) {
+    return;
+  }
+  int depth = tick_ - rollback_to_;
+  CHECK(depth <= history_ticks_) << "Can't roll back " << depth << " ticks";
+  const Snapshot& snapshot = snapshots_[rollback_to_ % history_ticks_];
+  game_->Restore(snapshot.board);
+  point_over_ticks_ = snapshot.point_over_ticks;
+  for (int64_t tick = rollback_to_; tick < tick_; ++tick) {
+    SimulateTick(tick);
+  }
+
+  ++stats_.rollbacks;
+  stats_.resimulated_ticks += depth;
+  stats_.max_rollback_ticks = std::max(stats_.max_rollback_ticks, depth);
+  rollback_to_ = tick_;
+}
+
+void RollbackSession::SimulateTick(int64_t tick) {
+  Snapshot& snapshot = snapshots_[tick % history_ticks_];
+  snapshot.board = game_->Save();
+  snapshot.point_over_ticks = point_over_ticks_;
+  used_remote_moves_[tick % history_ticks_] = remote_inputs_.Get(tick);
+  local_paddle_.SetTick(tick);
+  remote_paddle_.SetTick(tick);
+
+  if (!game_->IsGameOver()) {
+    game_->Update(params_.seconds_per_tick);
+    return;
+  }
+  if (++point_over_ticks_ >= params_.serve_delay_ticks) {
+    // Serve towards whoever lost the point.
+    point_over_ticks_ = 0;
+    double x = game_->LastPlayerToScore() == GameBoard::Player::LEFT ? 1 : -1;
+    game_->SetupNewGame({x, 2});
+  }
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const RollbackSession::Stats& stats) {
+  return stream << boost::format(
+                       "ticks=%d stalls=%d rollbacks=%d resimulated=%d "
+                       "max_rollback=%d packets_sent=%d packets_received=%d") %
+                       stats.ticks % stats.stalls % stats.rollbacks %
+                       stats.resimulated_ticks % stats.max_rollback_ticks %
+                       stats.packets_sent % stats.packets_received;
+}
+
+}  // namespace pong
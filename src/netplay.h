@@ -0,0 +1,167 @@
+// Two-player games over the network, using input delay plus rollback.
+//
+// Both peers run the whole simulation. Each tick, a peer samples its local
+// player's move and schedules it `input_delay_ticks` in the future, then sends
+// it to the other peer. The remote player's move for a tick is predicted
+// (it's assumed to be the same as their last known move) until it arrives.
+// When a real move turns out to differ from the prediction, the board is
+// restored to the tick of the misprediction and re-simulated up to the
+// present with the corrected input. So the local player sees their own moves
+// after a small, fixed delay no matter how far away the other player is, and
+// the remote player's moves are occasionally corrected after the fact.
+//
+// Inputs are sent unreliably over UDP. Every packet repeats all the inputs
+// which the other side hasn't acknowledged yet, so lost packets don't need
+// resending.
+
+#ifndef NETPLAY_H_
+#define NETPLAY_H_
+
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+
+#include "controller.h"
+#include "game.h"
+#include "net.h"
+#include "util.h"
+
+namespace pong {
+
+// One player's moves for a window of recent ticks. A move is confirmed once
+// it's known for sure; later ticks are predicted.
+class InputHistory {
+ public:
+  // Remembers moves for up to `capacity` ticks back.
+  explicit InputHistory(int capacity);
+
+  // Records the move for ConfirmedThrough() + 1.
+  void Confirm(MoveDirection move);
+
+  // The last tick for which the move is known; -1 if none are.
+  int64_t ConfirmedThrough() const { return confirmed_through_; }
+
+  // The confirmed move for `tick` if there is one, otherwise a prediction.
+  MoveDirection Get(int64_t tick) const;
+
+ private:
+  std::vector<MoveDirection> moves_;  // ring buffer, indexed by tick
+  int64_t confirmed_through_ = -1;
+};
+
+// Moves one paddle of a networked game according to an InputHistory. The
+// RollbackSession which owns it says which tick is being simulated.
+class NetworkPaddleController : public PaddleController {
+ public:
+  explicit NetworkPaddleController(const InputHistory* inputs)
+      : inputs_(inputs) {}
+
+  void SetTick(int64_t tick) { tick_ = tick; }
+
+  MoveDirection DesiredMove(const GameBoard& game,
+                            const Paddle& paddle) override;
+
+ private:
+  const InputHistory* inputs_;  // Not owned
+  int64_t tick_ = 0;
+};
+
+struct RollbackParams {
+  double seconds_per_tick = 1.0 / 240;
+
+  // How far in the future local moves take effect. This is the latency the
+  // local player feels; the default is one frame at 60 FPS.
+  int input_delay_ticks = 4;
+
+  // How far the simulation may run ahead of the remote player's last known
+  // move before it waits for them. Also bounds how far back a rollback goes.
+  int max_prediction_ticks = 60;
+
+  // After a point, the next serve comes automatically after this long. Both
+  // peers must agree on when the board changes, so it can't wait for a key.
+  int serve_delay_ticks = 240;
+};
+
+class RollbackSession {
+ public:
+  struct Stats {
+    int64_t ticks = 0;
+    int64_t stalls = 0;        // times AdvanceTick() had to wait for the peer
+    int64_t rollbacks = 0;
+    int64_t resimulated_ticks = 0;
+    int max_rollback_ticks = 0;
+    int64_t packets_sent = 0;
+    int64_t packets_received = 0;
+  };
+
+  // Takes over both of `game`'s controllers and starts a new game. The
+  // local player's moves come from `local_controller`, the remote player's
+  // over `link`. Both peers must use the same params.
+  RollbackSession(GameBoard* game, GameBoard::Player local_side,
+                  PaddleController* local_controller, UdpLink* link,
+                  const RollbackParams& params);
+
+  // Samples the local player's move, exchanges moves with the peer, rolls
+  // back if a prediction was wrong, and simulates one tick. Returns false,
+  // without simulating, if we're too far ahead of the peer.
+  bool AdvanceTick();
+
+  // Exchanges moves with the peer and rolls back if needed, without
+  // simulating a new tick.
+  void Poll();
+
+  // Ticks simulated so far.
+  int64_t Tick() const { return tick_; }
+
+  // Ticks for which both players' moves are known, so the board up to there
+  // is final and the same on both peers.
+  int64_t ConfirmedTicks() const;
+
+  const Stats& GetStats() const { return stats_; }
+
+ private:
+  // The board just before some tick, plus our own state which changes with
+  // the simulation.
+  struct Snapshot {
+    GameBoardState board;
+    int point_over_ticks;
+  };
+
+  void SendInputs();
+  void ReceiveInputs();
+  void RollBack();
+  void SimulateTick(int64_t tick);
+
+  GameBoard* game_;  // Not owned
+  const GameBoard::Player local_side_;
+  PaddleController* local_controller_;  // Not owned
+  UdpLink* link_;  // Not owned
+  const RollbackParams params_;
+  const int history_ticks_;
+
+  InputHistory local_inputs_;
+  InputHistory remote_inputs_;
+  NetworkPaddleController local_paddle_;
+  NetworkPaddleController remote_paddle_;
+
+  int64_t tick_ = 0;
+  int point_over_ticks_ = 0;
+  std::vector<Snapshot> snapshots_;  // ring buffer, indexed by tick
+  // The remote move used when simulating each tick, to spot mispredictions.
+  std::vector<MoveDirection> used_remote_moves_;  // ring buffer
+  int64_t rollback_to_;  // earliest mispredicted tick, or tick_ if none
+
+  // The last of our moves which the peer says it has.
+  int64_t local_acked_through_ = -1;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(RollbackSession);
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const RollbackSession::Stats& stats);
+
+}  // namespace pong
+
+#endif  // NETPLAY_H_
@@ -1,6 +1,15 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <Eigen/Dense>
 #include <SDL.h>
@@ -10,117 +19,1051 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include "asset_pack.h"
 #include "controller.h"
+#include "event_log.h"
+#include "frame_capture.h"
+#include "frame_pacer.h"
 #include "game.h"
+#include "latency_histogram.h"
+#include "multi_ball.h"
+#include "net.h"
+#include "netplay.h"
+#include "profiler.h"
 #include "rendering.h"
+#include "replay.h"
+#include "rewind.h"
+#include "search.h"
+#include "spectator.h"
+#include "spsc_ring.h"
+#include "text.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
 #include "util.h"
 
 DEFINE_string(data_path, "data",
               "The directory in which to look for data files.");
+DEFINE_string(font, "font.ttf",
+              "TrueType font for the score and HUD, relative to --data_path.");
+DEFINE_string(asset_pack, "bin/assets.pongpack",
+              "Asset pack built by `make assets`. Assets are loaded from it if "
+              "it exists, and from --data_path otherwise.");
+DEFINE_double(startup_budget_ms, 50,
+              "Warn if the first frame takes longer than this to show up, "
+              "counting from the start of main(). 0 to never warn.");
+DEFINE_bool(show_fps, false, "Show the frame rate. Toggle with F3.");
+DEFINE_double(tick_hz, 240,
+              "Rate at which the game simulation is stepped, in ticks per "
+              "second. Independent of the frame rate.");
+DEFINE_int32(max_ticks_per_frame, 8,
+             "Most simulation ticks to run in one frame. If the game falls "
+             "further behind than this (e.g. after a hiccup), the extra time "
+             "is dropped rather than trying to catch up.");
+DEFINE_double(fps, 60, "Target frame rate.");
+DEFINE_bool(sim_thread, true,
+            "Step the game on a thread of its own, so that slow frames don't "
+            "hold up ticks or vice versa. Chaos mode always steps on the main "
+            "thread.");
+DEFINE_int32(input_poll_usecs, 1000,
+             "With --sim_thread, how often to check for input while waiting "
+             "for the next frame, so that it reaches the game without waiting "
+             "for the frame. 0 checks once per frame.");
+DEFINE_bool(measure_input_latency, false,
+            "Measure the time from each key press or release (going by its "
+            "SDL timestamp) to presenting the first frame drawn after the "
+            "game handled it, and log a histogram of it with the frame "
+            "stats.");
+DEFINE_int32(pacer_spin_usecs, 1000,
+             "How long before each frame deadline to stop sleeping and start "
+             "busy-waiting. Larger values give steadier frames but use more "
+             "CPU.");
+DEFINE_double(frame_stats_interval_secs, 0,
+              "If positive, log frame pacing statistics (and per-phase "
+              "timings, if built with PROFILE=1) this often. They're always "
+              "logged on exit.");
+DEFINE_string(event_log, "",
+              "If set, write game events (bounces, points, pauses and frames "
+              "which overran the frame budget) to this file. Otherwise they "
+              "go to the INFO log, bounces only with --v=1.");
+DEFINE_string(trace_file, "pong_trace.json",
+              "Where to write a Chrome trace of recent frames, one track per "
+              "thread, when F9 is pressed or the game exits. Needs a "
+              "PROFILE=1 build.");
+
+DEFINE_string(record_replay, "",
+              "If set, record the game to this file. Play it back with "
+              "--replay or inspect it with pong_replay.");
+DEFINE_string(replay, "",
+              "If set, play back this replay instead of a live game.");
+DEFINE_int64(replay_start_tick, 0, "Where to start playing --replay from.");
+
+DEFINE_string(ai, "follow_ball_y",
+              "Controller for the right paddle: follow_ball_y, predictive or "
+              "search.");
+DEFINE_double(search_budget_ms, 4,
+              "Time --ai=search may spend planning, per plan. Keep it well "
+              "under a frame.");
+DEFINE_int32(search_threads, 0,
+             "Threads for --ai=search. 0 means one per hardware thread.");
+DEFINE_double(rewind_secs, 5,
+              "How far back holding R can rewind the game. 0 disables it.");
+DEFINE_string(net_peer, "",
+              "If set (as host:port), play over the network against the pong "
+              "at this address. Your paddle is the one given by --net_side, "
+              "moved with the arrow keys.");
+DEFINE_int32(net_port, 7777, "Local UDP port for network play.");
+DEFINE_string(net_side, "left", "Which paddle you play in a network game.");
+DEFINE_int32(net_input_delay_ticks, 4,
+             "Ticks before your own moves take effect in a network game. "
+             "Both players must use the same value.");
+DEFINE_double(net_latency_ms, 0,
+              "Testing aid: extra one-way latency added to packets sent.");
+DEFINE_double(net_loss, 0,
+              "Testing aid: fraction of sent packets to drop.");
+
+DEFINE_int32(spectator_port, 0,
+             "If set, streams the game to spectators (pong --spectate) who "
+             "connect to this UDP port.");
+DEFINE_double(spectator_hz, 20,
+              "Frames per second streamed to spectators. They interpolate "
+              "between frames, so this can be well below the frame rate.");
+DEFINE_string(spectate, "",
+              "Watch the game streamed by the pong at this host:port, which "
+              "was started with --spectator_port, instead of playing.");
+DEFINE_int32(chaos_balls, 0,
+             "If positive, play chaos mode: this many balls at once, which "
+             "also bounce off each other. Missed balls are served again.");
+DEFINE_string(chaos_broadphase, "grid",
+              "How chaos mode finds colliding balls: grid, sweep_and_prune or "
+              "brute_force.");
+
+DEFINE_int32(window_width, 640, "Width of the window, in pixels.");
+DEFINE_int32(window_height, 640, "Height of the window, in pixels.");
+DEFINE_bool(tile_renderer, false,
+            "Redraw the whole window every frame with the tile-parallel "
+            "rasterizer, rather than only the parts which changed. Pays off "
+            "on big windows, e.g. wall displays, where a full redraw through "
+            "SDL is slow.");
+DEFINE_int32(render_threads, 0,
+             "Threads for --tile_renderer. 0 means one per hardware thread.");
+DEFINE_string(capture, "",
+              "If set, record every frame to this file (a directory for "
+              "--capture_format=png) as it's presented. Frames the writer "
+              "can't keep up with are dropped rather than slowing the game.");
+DEFINE_string(capture_format, "y4m", "Format for --capture: y4m or png.");
+DEFINE_int32(capture_buffers, 8,
+             "Frames --capture can hold while waiting to be written.");
+DEFINE_bool(check_dirty_rects, false,
+            "Debugging aid: every frame, also do a full redraw offscreen and "
+            "crash if the renderer's output differs from it.");
 
 using ::boost::format;
 using ::util::format::FormatSdlRect;
 using ::util::format::FormatVec2d;
+using ::util::sdl::ManagedFont;
+using ::util::sdl::ManagedSurface;
 using ::util::sdl::ManagedWindow;
 using ::util::sdl::SDLContext;
 using ::util::sdl::TTFContext;
 
 namespace pong {
 
-constexpr int kDesiredFPS = 60;
-
 class App {
  public:
-  App(SDL_Window* window);
+  // `start_counter` is the SDL performance counter when the program started,
+  // for --startup_budget_ms.
+  App(SDL_Window* window, uint64_t start_counter);
   void Run();
 
  private:
+  // Game state as of some tick, as published by the simulation thread.
+  struct Snapshot {
+    GameBoardState board;
+    PieceBounds previous_pieces;
+    // Simulation time not ticked yet, as of `counter` (an SDL performance
+    // counter).
+    double tick_accumulator_secs;
+    uint64_t counter;
+    int64_t key_events_handled;
+  };
+
+  // A key event on its way to the game, for --measure_input_latency.
+  struct PendingInput {
+    int64_t index;  // which key event it was, counting from 0
+    uint32_t timestamp_ms;  // SDL's
+  };
+
+  // The event log's producers. Whichever thread steps the game logs with
+  // kGameLogProducer, and the main loop its frame overruns with
+  // kFrameLogProducer.
+  enum { kGameLogProducer, kFrameLogProducer, kNumLogProducers };
+
+  void LoadText();
+  void LogStartup();
   void ProcessEvents();
+  void CountSentKeyEvent(const SDL_Event& event);
+  void HandleGameEvent(const SDL_Event& event);
+  void RunSimulation();
+  void PublishSnapshot();
+  double ShowLatestSnapshot();
   void UpdateGame();
-  void Render();
+  bool GameStopped() const;
+  void BroadcastToSpectators();
+  double ShowSpectatedFrame();
+  bool StepGame();
+  void RewindGame();
+  void UpdateHud(const GameBoard& game);
+  void Render(const GameBoard& game, const PieceBounds& previous,
+              double alpha);
+  void CheckAgainstFullRedraw(const GameBoard& game,
+                              const PieceBounds& previous, double alpha,
+                              SDL_Surface* screen_surface);
+  void CaptureFrame();
+  void MeasureInputLatency(int64_t key_events_handled);
+  void LogFrameStats();
+  void WriteTrace();
 
   bool running_ = false;  // Whether the main loop is currently running
   bool game_paused_ = true;  // Whether to update the game state
-  int last_game_update_msecs_ {0};
+
+  // The game is stepped in fixed ticks of seconds_per_tick_. Time which
+  // hasn't been simulated yet piles up in tick_accumulator_secs_.
+  double seconds_per_tick_;
+  double tick_accumulator_secs_ = 0;
+  uint64_t last_game_update_counter_ = 0;  // SDL performance counter
+
+  // Piece positions as of the tick before the current one. Frames are drawn
+  // between these and the current positions.
+  PieceBounds previous_pieces_;
+
+  FramePacer pacer_;
+  DirtyRectRenderer renderer_;
+  // For --tile_renderer. Null otherwise.
+  std::unique_ptr<util::ThreadPool> render_pool_;
+  std::unique_ptr<TileRasterizer> rasterizer_;
+  EventLog event_log_;
+
+  // Null if there's no --asset_pack. Anything loaded from it points into its
+  // memory map, so it's declared before everything that might.
+  std::unique_ptr<AssetPack> asset_pack_;
+  // Until the first frame is shown, when the program started. 0 after.
+  uint64_t start_counter_;
+  double asset_load_secs_ = 0;
+
+  // Text drawn over the game. All null if the font couldn't be loaded.
+  std::unique_ptr<GlyphAtlas> glyph_atlas_;
+  std::unique_ptr<TextLabel> left_score_label_;
+  std::unique_ptr<TextLabel> right_score_label_;
+  std::unique_ptr<TextLabel> fps_label_;
+  std::vector<const TextLabel*> labels_;  // the ones to draw this frame
+  bool show_fps_;
+  int64_t fps_frames_ = 0;
+  uint64_t fps_start_counter_ = 0;
+  ManagedSurface check_surface_;  // for --check_dirty_rects
+  std::unique_ptr<FrameCapture> capture_;  // for --capture
+
+  // Key events passed on to the game by the main thread, and handled by
+  // whichever thread steps the game. For --measure_input_latency, the ones
+  // not on screen yet are in pending_inputs_, oldest first.
+  int64_t key_events_sent_ = 0;
+  int64_t key_events_handled_ = 0;
+  std::deque<PendingInput> pending_inputs_;
+  LatencyHistogram input_latency_;
 
   SdlPaddleController left_controller_;
-  FollowBallYController right_controller_;
+  // For --ai=search, which plans on its own threads. Null otherwise.
+  std::unique_ptr<util::ThreadPool> search_pool_;
+  SearchController* search_controller_ = nullptr;  // right_controller_
+  std::unique_ptr<PaddleController> right_controller_;
   GameBoard game_;
 
+  // For --record_replay, moves go through the recorders on their way from the
+  // controllers to the game.
+  RecordingPaddleController left_recorder_;
+  RecordingPaddleController right_recorder_;
+  std::unique_ptr<ReplayWriter> replay_writer_;
+
+  // The board before each recent tick, for rewinding while R is held. Null
+  // in replays and network games, which can't be rewound.
+  std::unique_ptr<RewindBuffer> rewind_;
+  bool rewinding_ = false;
+
+  // For --replay. The player takes over the game's controllers.
+  std::unique_ptr<ReplayReader> replay_reader_;
+  std::unique_ptr<ReplayPlayer> replay_player_;
+
+  // For --net_peer. The session takes over the game's controllers.
+  std::unique_ptr<UdpLink> net_link_;
+  std::unique_ptr<RollbackSession> net_session_;
+
+  // For --spectator_port. Belongs to whichever thread steps the game.
+  std::unique_ptr<SpectatorServer> spectator_server_;
+  uint64_t last_broadcast_counter_ = 0;  // SDL performance counter
+
+  // For --spectate. Frames from the server are drawn in shown_game_, instead
+  // of playing game_, and interpolated from spectated_previous_ over
+  // spectated_interval_secs_ (about the time between frames).
+  static constexpr double kMaxSpectatedIntervalSecs = 0.25;
+  std::unique_ptr<SpectatorClient> spectator_client_;
+  PieceBounds spectated_previous_;
+  int32_t spectated_game_over_ = 1;
+  uint64_t spectated_counter_ = 0;  // when the latest frame arrived
+  double spectated_interval_secs_;
+
+  // For --chaos_balls. Played instead of game_, with the same controllers.
+  std::unique_ptr<MultiBallBoard> chaos_;
+
+  // For --sim_thread. Everything above which steps the game (game_, the
+  // controllers, rewinding, replays, netplay) belongs to sim_thread_, which
+  // publishes a snapshot of the board after each pass. The main thread
+  // forwards key presses to it through input_queue_, and draws the newest
+  // snapshot into shown_game_.
+  bool sim_threaded_;
+  std::atomic<bool> sim_running_{false};
+  std::thread sim_thread_;
+  util::SpscRing<SDL_Event> input_queue_;
+  // Key events which didn't fit in input_queue_, oldest first. They go ahead
+  // of any newer ones, so a released key is never lost or reordered.
+  std::deque<SDL_Event> input_backlog_;
+  util::TripleBuffer<Snapshot> snapshots_;
+  GameBoard shown_game_;
+
   SDL_Window* window_;  // Not owned
 };
 
-App::App(SDL_Window* window) : window_(CHECK_NOTNULL(window)) {
-  game_.SetLeftController(&left_controller_);
-  game_.SetRightController(&right_controller_);
+constexpr double App::kMaxSpectatedIntervalSecs;
+
+App::App(SDL_Window* window, uint64_t start_counter)
+    : seconds_per_tick_(1.0 / FLAGS_tick_hz),
+      pacer_(FLAGS_fps, FLAGS_pacer_spin_usecs / 1e6),
+      event_log_(FLAGS_event_log, 4096, kNumLogProducers),
+      start_counter_(start_counter),
+      show_fps_(FLAGS_show_fps),
+      input_latency_(0.001, 100),
+      left_recorder_(&left_controller_),
+      input_queue_(256),
+      window_(CHECK_NOTNULL(window)) {
+  if (!FLAGS_spectate.empty()) {
+    size_t colon = FLAGS_spectate.rfind(':');
+    CHECK(colon != std::string::npos) << "--spectate must be host:port";
+    spectator_client_ = util::make_unique<SpectatorClient>(
+        FLAGS_spectate.substr(0, colon),
+        std::stoi(FLAGS_spectate.substr(colon + 1)));
+    spectated_interval_secs_ = 1 / FLAGS_spectator_hz;
+    spectated_previous_ = PieceBoundsOf(shown_game_);
+    LOG(INFO) << "Spectating " << FLAGS_spectate;
+  }
+  if (FLAGS_ai == "search") {
+    SearchParams params;
+    params.seconds_per_tick = seconds_per_tick_;
+    params.time_budget_secs = FLAGS_search_budget_ms / 1000;
+    search_pool_ = util::make_unique<util::ThreadPool>(FLAGS_search_threads);
+    auto search =
+        util::make_unique<SearchController>(params, search_pool_.get());
+    search_controller_ = search.get();
+    right_controller_ = std::move(search);
+  } else {
+    right_controller_ = NewAiController(FLAGS_ai);
+    CHECK(right_controller_) << "Unknown --ai: " << FLAGS_ai;
+  }
+  right_recorder_.SetController(right_controller_.get());
+  game_.SetLeftController(&left_recorder_);
+  game_.SetRightController(&right_recorder_);
+  game_.SetEventLog(&event_log_);
+  if (!FLAGS_replay.empty()) {
+    replay_reader_ = ReplayReader::Open(FLAGS_replay);
+    CHECK(replay_reader_) << "Could not read replay " << FLAGS_replay;
+    seconds_per_tick_ = replay_reader_->SecondsPerTick();
+    replay_player_ =
+        util::make_unique<ReplayPlayer>(replay_reader_.get(), &game_);
+    replay_player_->Seek(FLAGS_replay_start_tick);
+    LOG(INFO) << "Playing " << FLAGS_replay << " from tick "
+              << FLAGS_replay_start_tick << " of "
+              << replay_reader_->NumTicks();
+  } else if (!FLAGS_net_peer.empty()) {
+    size_t colon = FLAGS_net_peer.rfind(':');
+    CHECK(colon != std::string::npos) << "--net_peer must be host:port";
+    CHECK(FLAGS_net_side == "left" || FLAGS_net_side == "right")
+        << "--net_side must be left or right";
+    LinkConditions conditions;
+    conditions.latency_secs = FLAGS_net_latency_ms / 1000;
+    conditions.loss = FLAGS_net_loss;
+    net_link_ = util::make_unique<UdpLink>(FLAGS_net_port, conditions);
+    net_link_->SetPeer(FLAGS_net_peer.substr(0, colon),
+                       std::stoi(FLAGS_net_peer.substr(colon + 1)));
+
+    RollbackParams params;
+    params.seconds_per_tick = seconds_per_tick_;
+    params.input_delay_ticks = FLAGS_net_input_delay_ticks;
+    net_session_ = util::make_unique<RollbackSession>(
+        &game_,
+        FLAGS_net_side == "left" ? GameBoard::Player::LEFT
+                                 : GameBoard::Player::RIGHT,
+        &left_controller_, net_link_.get(), params);
+    game_paused_ = false;  // there's no pausing the other player
+    LOG(INFO) << "Playing " << FLAGS_net_side << " against "
+              << FLAGS_net_peer << " from UDP port " << net_link_->LocalPort();
+  } else if (FLAGS_chaos_balls > 0) {
+    CHECK(FLAGS_record_replay.empty()) << "Chaos mode can't be recorded";
+    Broadphase broadphase;
+    CHECK(ParseBroadphase(FLAGS_chaos_broadphase, &broadphase))
+        << "Unknown --chaos_broadphase: " << FLAGS_chaos_broadphase;
+    chaos_ = util::make_unique<MultiBallBoard>(FLAGS_chaos_balls,
+                                               SDL_GetPerformanceCounter());
+    chaos_->SetBroadphase(broadphase);
+    chaos_->SetLeftController(&left_controller_);
+    chaos_->SetRightController(right_controller_.get());
+    LOG(INFO) << "Playing chaos mode with " << FLAGS_chaos_balls << " balls";
+  } else if (!FLAGS_record_replay.empty()) {
+    replay_writer_ = util::make_unique<ReplayWriter>(FLAGS_record_replay,
+                                                     seconds_per_tick_);
+    LOG(INFO) << "Recording replay to " << FLAGS_record_replay;
+  }
+  if (!replay_player_ && !net_session_ && !chaos_ && FLAGS_rewind_secs > 0) {
+    rewind_ = util::make_unique<RewindBuffer>(
+        std::max(1, static_cast<int>(FLAGS_rewind_secs / seconds_per_tick_)));
+  }
+  if (FLAGS_spectator_port > 0) {
+    CHECK(!chaos_) << "Chaos mode can't be spectated";
+    CHECK(FLAGS_spectator_hz > 0) << "--spectator_hz must be positive";
+    spectator_server_ =
+        util::make_unique<SpectatorServer>(FLAGS_spectator_port);
+    LOG(INFO) << "Streaming to spectators on UDP port "
+              << spectator_server_->LocalPort();
+  }
+  // A snapshot of thousands of balls costs more to copy than it saves, and
+  // spectators have nothing to simulate.
+  sim_threaded_ = FLAGS_sim_thread && !chaos_ && !spectator_client_;
+  if (FLAGS_tile_renderer) {
+    render_pool_ = util::make_unique<util::ThreadPool>(FLAGS_render_threads);
+    rasterizer_ = util::make_unique<TileRasterizer>(render_pool_.get());
+  }
+  if (!FLAGS_capture.empty()) {
+    CaptureParams params;
+    CHECK(ParseCaptureFormat(FLAGS_capture_format, &params.format))
+        << "Unknown --capture_format: " << FLAGS_capture_format;
+    params.path = FLAGS_capture;
+    const SDL_Surface* surface = SDL_GetWindowSurface(window_);
+    params.width = surface->w;
+    params.height = surface->h;
+    params.fps = FLAGS_fps;
+    params.num_buffers = FLAGS_capture_buffers;
+    capture_ = util::make_unique<FrameCapture>(params);
+    LOG(INFO) << "Capturing " << params.format << " to " << FLAGS_capture;
+  }
+  if (sim_threaded_ && FLAGS_input_poll_usecs > 0) {
+    pacer_.SetPoll([this] { ProcessEvents(); }, FLAGS_input_poll_usecs / 1e6);
+  }
+
+  uint64_t assets_start = SDL_GetPerformanceCounter();
+  // Checked first so that not having built a pack doesn't log an error.
+  if (!FLAGS_asset_pack.empty() &&
+      access(FLAGS_asset_pack.c_str(), F_OK) == 0) {
+    asset_pack_ = AssetPack::Open(FLAGS_asset_pack);
+  }
+  if (!asset_pack_) {
+    LOG(INFO) << "Not using an asset pack; loading assets from "
+              << FLAGS_data_path;
+  }
+  LoadText();
+  asset_load_secs_ =
+      static_cast<double>(SDL_GetPerformanceCounter() - assets_start) /
+      SDL_GetPerformanceFrequency();
 }
 
-void App::Run() {
-  constexpr int kMillisPerFrame = 1000 / kDesiredFPS;
+void App::LoadText() {
+  // Fonts are only needed to build the glyph atlas; after that, drawing text
+  // never touches SDL_ttf.
+  const SDL_Surface* screen_surface = SDL_GetWindowSurface(window_);
+  ManagedFont score_font(OpenFont(asset_pack_.get(), FLAGS_data_path,
+                                  FLAGS_font, screen_surface->h / 8));
+  ManagedFont hud_font(
+      OpenFont(asset_pack_.get(), FLAGS_data_path, FLAGS_font, 16));
+  if (!score_font || !hud_font) {
+    LOG(WARNING) << "Could not load font " << FLAGS_font << ": "
+                 << TTF_GetError() << ". Playing without the score.";
+    return;
+  }
+  enum { kScoreFace, kHudFace };
+  glyph_atlas_ = util::make_unique<GlyphAtlas>(
+      std::vector<GlyphFace>{{score_font.get(), "0123456789"},
+                             {hud_font.get(), "0123456789 .FPSms"}},
+      SDL_Color{0xAA, 0xAA, 0xAA, 0xFF});
+
+  // Scores either side of the middle line, frame rate in the corner.
+  int center_x = screen_surface->w / 2;
+  int margin = screen_surface->w / 16;
+  left_score_label_ = util::make_unique<TextLabel>(
+      glyph_atlas_.get(), kScoreFace, center_x - margin, margin / 2,
+      TextLabel::Align::RIGHT);
+  right_score_label_ = util::make_unique<TextLabel>(
+      glyph_atlas_.get(), kScoreFace, center_x + margin, margin / 2,
+      TextLabel::Align::LEFT);
+  fps_label_ = util::make_unique<TextLabel>(
+      glyph_atlas_.get(), kHudFace, 4,
+      screen_surface->h - glyph_atlas_->LineHeight(kHudFace) - 4,
+      TextLabel::Align::LEFT);
+}
 
+void App::Run() {
+#ifdef PONG_PROFILING
+  FrameProfiler::Get()->SetThreadName("Main");
+#endif
   running_ = true;
-  game_.SetupNewGame();
+  if (!replay_player_ && !net_session_) {
+    game_.SetupNewGame();
+  }
+  previous_pieces_ = PieceBoundsOf(game_);
+  if (sim_threaded_) {
+    PublishSnapshot();  // so there's something to draw straight away
+    sim_running_.store(true, std::memory_order_release);
+    sim_thread_ = std::thread([this] { RunSimulation(); });
+  }
+  uint64_t last_stats_counter = SDL_GetPerformanceCounter();
+  const double frame_budget_secs = 1 / FLAGS_fps;
   while (running_) {
-    int msecs_before = SDL_GetTicks();
-
-    ProcessEvents();
-    UpdateGame();
-    Render();
+    uint64_t frame_start = SDL_GetPerformanceCounter();
+    {
+      PROFILE_SCOPE("Frame");
+      ProcessEvents();
+      if (spectator_client_) {
+        double alpha = ShowSpectatedFrame();
+        UpdateHud(shown_game_);
+        Render(shown_game_, spectated_previous_, alpha);
+      } else if (sim_threaded_) {
+        double alpha = ShowLatestSnapshot();
+        UpdateHud(shown_game_);
+        Render(shown_game_, snapshots_.Read().previous_pieces, alpha);
+      } else {
+        UpdateGame();
+        BroadcastToSpectators();
+        UpdateHud(game_);
+        Render(game_, previous_pieces_,
+               tick_accumulator_secs_ / seconds_per_tick_);
+      }
+      if (capture_) {
+        CaptureFrame();
+      }
+      if (FLAGS_measure_input_latency) {
+        MeasureInputLatency(sim_threaded_
+                                ? snapshots_.Read().key_events_handled
+                                : key_events_handled_);
+      }
+    }
+    if (start_counter_ != 0) {
+      LogStartup();
+    }
+    double frame_secs =
+        static_cast<double>(SDL_GetPerformanceCounter() - frame_start) /
+        SDL_GetPerformanceFrequency();
+    if (frame_secs > frame_budget_secs) {
+      event_log_.Log(GameEvent::FrameOverrun(frame_secs, frame_budget_secs),
+                     kFrameLogProducer);
+    }
+    {
+      PROFILE_SCOPE("WaitForNextFrame");
+      pacer_.WaitForNextFrame();
+    }
 
-    int sleep_msecs = kMillisPerFrame - (SDL_GetTicks() - msecs_before);
-    if (sleep_msecs > 0) {
-      SDL_Delay(sleep_msecs);
+    if (FLAGS_frame_stats_interval_secs > 0) {
+      uint64_t now = SDL_GetPerformanceCounter();
+      if (now - last_stats_counter >= FLAGS_frame_stats_interval_secs *
+                                           SDL_GetPerformanceFrequency()) {
+        LogFrameStats();
+        pacer_.ResetStats();
+        last_stats_counter = now;
+      }
     }
   }
+  if (sim_threaded_) {
+    sim_running_.store(false, std::memory_order_release);
+    sim_thread_.join();
+  }
+  LogFrameStats();
+  WriteTrace();
+}
+
+void App::CaptureFrame() {
+  PROFILE_SCOPE("CaptureFrame");
+  // The window surface always holds the whole frame, even when only dirty
+  // rects were presented.
+  capture_->Capture(SDL_GetWindowSurface(window_));
+}
+
+// Called once a frame has been presented. Every key event which the game had
+// handled by the time the frame's state was drawn has now been seen.
+void App::MeasureInputLatency(int64_t key_events_handled) {
+  uint32_t now_ms = SDL_GetTicks();
+  while (!pending_inputs_.empty() &&
+         pending_inputs_.front().index < key_events_handled) {
+    input_latency_.Add((now_ms - pending_inputs_.front().timestamp_ms) / 1e3);
+    pending_inputs_.pop_front();
+  }
+}
+
+void App::LogFrameStats() {
+  LOG(INFO) << "Frame pacing: " << pacer_.GetStats();
+  if (FLAGS_measure_input_latency) {
+    LOG(INFO) << "Input latency: " << input_latency_ << "\n"
+              << input_latency_.Chart();
+    input_latency_.Clear();
+  }
+  LOG(INFO) << "Event log: " << event_log_.GetStats();
+  if (capture_) {
+    LOG(INFO) << "Capture: " << capture_->GetStats();
+  }
+  // These belong to the simulation thread while it's running, so they wait
+  // until it has stopped.
+  bool sim_stopped = !sim_thread_.joinable();
+  if (net_session_ && sim_stopped) {
+    LOG(INFO) << "Netplay: " << net_session_->GetStats();
+  }
+  if (search_controller_ && sim_stopped) {
+    LOG(INFO) << "Search: " << search_controller_->GetStats();
+  }
+  if (spectator_server_ && sim_stopped) {
+    LOG(INFO) << "Spectators: " << spectator_server_->GetStats();
+  }
+  if (spectator_client_) {
+    LOG(INFO) << "Spectating: " << spectator_client_->GetStats();
+  }
+  if (chaos_) {
+    LOG(INFO) << "Chaos mode: " << chaos_->GetStats();
+  }
+#ifdef PONG_PROFILING
+  LOG(INFO) << "Frame phases: " << FrameProfiler::Get()->Summary();
+#endif
+}
+
+void App::WriteTrace() {
+#ifdef PONG_PROFILING
+  if (FrameProfiler::WriteChromeTrace(FLAGS_trace_file)) {
+    LOG(INFO) << "Wrote Chrome trace to " << FLAGS_trace_file;
+  } else {
+    LOG(ERROR) << "Could not write Chrome trace to " << FLAGS_trace_file;
+  }
+#endif
+}
+
+void App::LogStartup() {
+  double startup_ms =
+      static_cast<double>(SDL_GetPerformanceCounter() - start_counter_) /
+      SDL_GetPerformanceFrequency() * 1000;
+  start_counter_ = 0;
+  LOG(INFO) << boost::format("First frame shown %.1fms after startup, %.1fms "
+                             "of it loading assets") %
+                   startup_ms % (asset_load_secs_ * 1000);
+  if (FLAGS_startup_budget_ms > 0 && startup_ms > FLAGS_startup_budget_ms) {
+    LOG(WARNING) << boost::format("Startup took %.1fms, over the %gms "
+                                  "budget") %
+                        startup_ms % FLAGS_startup_budget_ms;
+  }
 }
 
 void App::ProcessEvents() {
+  PROFILE_SCOPE("ProcessEvents");
+  while (!input_backlog_.empty() &&
+         input_queue_.TryPush(input_backlog_.front())) {
+    CountSentKeyEvent(input_backlog_.front());
+    input_backlog_.pop_front();
+  }
+
   SDL_Event event;
   while (SDL_PollEvent(&event) != 0) {
     if ((event.type == SDL_QUIT) ||
         (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_q)) {
       running_ = false;
     }
-    if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE &&
-        game_.IsGameOver()) {
-      game_.SetupNewGame();
+    if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9) {
+      WriteTrace();
+    }
+    if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F3) {
+      show_fps_ = !show_fps_;
+    }
+    if (event.type == SDL_WINDOWEVENT) {
+      // Resizes, exposes, etc. may have clobbered the window surface.
+      renderer_.Invalidate();
+    }
+    // Only keys matter to the game.
+    if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) {
+      continue;
+    }
+    if (!sim_threaded_) {
+      CountSentKeyEvent(event);
+      HandleGameEvent(event);
+      continue;
+    }
+    if (input_backlog_.empty() && input_queue_.TryPush(event)) {
+      CountSentKeyEvent(event);
+      continue;
+    }
+    // Auto-repeats can be dropped, since the key is still down either way.
+    if (event.key.repeat) {
+      continue;
+    }
+    if (input_backlog_.empty()) {
+      LOG(WARNING) << "Simulation thread isn't keeping up with input; "
+                   << "holding key events back";
+    }
+    input_backlog_.push_back(event);
+  }
+}
+
+// Call for each key event in the order the game gets them.
+void App::CountSentKeyEvent(const SDL_Event& event) {
+  if (FLAGS_measure_input_latency && !event.key.repeat) {
+    pending_inputs_.push_back({key_events_sent_, event.key.timestamp});
+  }
+  ++key_events_sent_;
+}
+
+// Keys which control the game, on whichever thread steps it.
+void App::HandleGameEvent(const SDL_Event& event) {
+  ++key_events_handled_;
+  if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE &&
+      game_.IsGameOver() && !replay_player_ && !net_session_) {
+    if (rewind_) {
+      rewind_->Push(game_);  // so the serve can be rewound too
+    }
+    game_.SetupNewGame();
+    if (replay_writer_) {
+      replay_writer_->Discontinuity();
+    }
+    previous_pieces_ = PieceBoundsOf(game_);  // don't interpolate the reset
+    if (game_paused_) {
       game_paused_ = false;
+      event_log_.Log(GameEvent::Pause(false));
+    }
+  }
+  if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE &&
+      !net_session_) {
+    game_paused_ = !game_paused_;
+    event_log_.Log(GameEvent::Pause(game_paused_));
+  }
+  if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) &&
+      event.key.keysym.sym == SDLK_r && rewind_) {
+    rewinding_ = event.type == SDL_KEYDOWN;
+  }
+  left_controller_.ProcessSdlEvent(event);
+}
+
+// The simulation thread, for --sim_thread. Ticks the game at --tick_hz,
+// publishing a snapshot after each pass.
+void App::RunSimulation() {
+#ifdef PONG_PROFILING
+  FrameProfiler::Get()->SetThreadName("Simulation");
+#endif
+  const double counter_hz = SDL_GetPerformanceFrequency();
+  SDL_Event event;
+  while (sim_running_.load(std::memory_order_acquire)) {
+    while (input_queue_.TryPop(&event)) {
+      HandleGameEvent(event);
     }
-    if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE) {
-      game_paused_ = !game_paused_;
+    UpdateGame();
+    BroadcastToSpectators();
+    PublishSnapshot();
+
+    // Sleep until the next tick is due. While paused nothing ever is, but
+    // keep waking up at the tick rate to check for input.
+    double due_secs =
+        seconds_per_tick_ - tick_accumulator_secs_ -
+        (SDL_GetPerformanceCounter() - last_game_update_counter_) / counter_hz;
+    if (due_secs > 0) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(due_secs));
+    }
+  }
+#ifdef PONG_PROFILING
+  LOG(INFO) << "Simulation phases: " << FrameProfiler::Get()->Summary();
+#endif
+}
+
+void App::PublishSnapshot() {
+  Snapshot* snapshot = snapshots_.WriteBuffer();
+  snapshot->board = game_.Save();
+  snapshot->previous_pieces = previous_pieces_;
+  snapshot->tick_accumulator_secs = tick_accumulator_secs_;
+  snapshot->counter = last_game_update_counter_;
+  snapshot->key_events_handled = key_events_handled_;
+  snapshots_.Publish();
+}
+
+// Puts the newest snapshot into shown_game_. Returns how far to draw its
+// pieces from their previous positions to their current ones.
+double App::ShowLatestSnapshot() {
+  if (snapshots_.Update()) {
+    shown_game_.Restore(snapshots_.Read().board);
+  }
+  // The simulation thread has most likely slept since publishing, waiting
+  // for the next tick, so the time it hadn't ticked yet has grown.
+  const Snapshot& snapshot = snapshots_.Read();
+  double secs = snapshot.tick_accumulator_secs +
+                static_cast<double>(SDL_GetPerformanceCounter() -
+                                    snapshot.counter) /
+                    SDL_GetPerformanceFrequency();
+  return std::min(1.0, secs / seconds_per_tick_);
+}
+
+// Sends spectators the board every 1/--spectator_hz seconds, paused or not,
+// so they see the pause and can join during it.
+void App::BroadcastToSpectators() {
+  if (!spectator_server_) {
+    return;
+  }
+  uint64_t now = SDL_GetPerformanceCounter();
+  if (now - last_broadcast_counter_ <
+      SDL_GetPerformanceFrequency() / FLAGS_spectator_hz) {
+    return;
+  }
+  PROFILE_SCOPE("BroadcastToSpectators");
+  spectator_server_->Broadcast(game_);
+  last_broadcast_counter_ = now;
+}
+
+// Puts the newest frame from the spectator server into shown_game_. Returns
+// how far to draw its pieces from the previous frame's positions.
+double App::ShowSpectatedFrame() {
+  uint64_t now = SDL_GetPerformanceCounter();
+  const double counter_hz = SDL_GetPerformanceFrequency();
+  if (spectator_client_->Poll()) {
+    const SpectatorFrame& frame = spectator_client_->Latest();
+    spectated_previous_ = PieceBoundsOf(shown_game_);
+    // The server's rate is only known from how often frames arrive, which
+    // jitters, so follow a moving average of that.
+    if (spectated_counter_ != 0) {
+      double gap_secs = std::min(kMaxSpectatedIntervalSecs,
+                                 (now - spectated_counter_) / counter_hz);
+      spectated_interval_secs_ += 0.1 * (gap_secs - spectated_interval_secs_);
+    }
+    spectated_counter_ = now;
+    ApplySpectatorFrame(frame, &shown_game_);
+    // Don't interpolate a serve.
+    if (frame.fields[SpectatorFrame::GAME_OVER] != spectated_game_over_) {
+      spectated_previous_ = PieceBoundsOf(shown_game_);
+      spectated_game_over_ = frame.fields[SpectatorFrame::GAME_OVER];
     }
-    left_controller_.ProcessSdlEvent(event);
   }
+  double secs = (now - spectated_counter_) / counter_hz;
+  return std::min(1.0, secs / spectated_interval_secs_);
 }
 
 void App::UpdateGame() {
-  int msecs_now = SDL_GetTicks();
-  if (last_game_update_msecs_ != 0) {  // Don't update on first frame
-    double msecs_delta = msecs_now - last_game_update_msecs_;
-
-    if (!game_paused_ && !game_.IsGameOver()) {
-      game_.Update(msecs_delta / 1000.0);
-      if (game_.IsGameOver()) {
-        LOG(INFO) << "Player " << game_.LastPlayerToScore()
-                  << " scored! Current score: left:" << game_.left_score_
-                  << " right:" << game_.right_score_;
+  PROFILE_SCOPE("UpdateGame");
+  uint64_t counter_now = SDL_GetPerformanceCounter();
+  double now_secs = SDL_GetTicks() / 1000.0;  // the clock of event timestamps
+  if (last_game_update_counter_ != 0) {  // Don't update on first frame
+    tick_accumulator_secs_ +=
+        static_cast<double>(counter_now - last_game_update_counter_) /
+        SDL_GetPerformanceFrequency();
+  }
+  last_game_update_counter_ = counter_now;
+
+  // Rewinding works even while paused, or after a point.
+  if (rewinding_) {
+    left_controller_.ResetTiming();
+    RewindGame();
+    return;
+  }
+
+  if (game_paused_ || GameStopped()) {
+    // Nothing is moving, so there's nothing to catch up on or interpolate.
+    left_controller_.ResetTiming();
+    tick_accumulator_secs_ = 0;
+    previous_pieces_ = PieceBoundsOf(game_);
+    return;
+  }
+
+  int ticks = 0;
+  while (tick_accumulator_secs_ >= seconds_per_tick_ &&
+         ticks < FLAGS_max_ticks_per_frame) {
+    PieceBounds before_tick = PieceBoundsOf(game_);
+    left_controller_.BeginTick(
+        now_secs - (tick_accumulator_secs_ - seconds_per_tick_),
+        seconds_per_tick_);
+    if (!StepGame()) {
+      break;  // waiting for the network peer; try again next frame
+    }
+    previous_pieces_ = before_tick;
+    tick_accumulator_secs_ -= seconds_per_tick_;
+    ++ticks;
+
+    // Network games serve again by themselves. The point went to the event
+    // log when it was scored.
+    if (game_.IsGameOver() && !net_session_) {
+      previous_pieces_ = PieceBoundsOf(game_);
+      tick_accumulator_secs_ = 0;
+      return;
+    }
+  }
+
+  // Too far behind to catch up; drop whole ticks rather than spiralling.
+  if (tick_accumulator_secs_ >= seconds_per_tick_) {
+    VLOG(1) << "Dropping " << tick_accumulator_secs_ << "s of simulation time";
+    tick_accumulator_secs_ =
+        std::fmod(tick_accumulator_secs_, seconds_per_tick_);
+  }
+}
+
+bool App::GameStopped() const {
+  // Replays and network games carry on through the end of each point to the
+  // next serve. In chaos mode, there's always another ball.
+  if (net_session_ || chaos_) {
+    return false;
+  }
+  return replay_player_ ? replay_player_->Done() : game_.IsGameOver();
+}
+
+// Returns false if the game couldn't be stepped yet.
+bool App::StepGame() {
+  if (net_session_) {
+    return net_session_->AdvanceTick();
+  }
+  if (replay_player_) {
+    replay_player_->Step();
+    return true;
+  }
+  if (chaos_) {
+    chaos_->Update(seconds_per_tick_);
+    return true;
+  }
+  if (rewind_) {
+    rewind_->Push(game_);
+  }
+  if (replay_writer_) {
+    replay_writer_->BeginTick(game_);
+  }
+  game_.Update(seconds_per_tick_);
+  if (replay_writer_) {
+    replay_writer_->EndTick(left_recorder_.LastMove(),
+                            right_recorder_.LastMove());
+  }
+  return true;
+}
+
+// Steps the game backwards in time, one snapshot per tick of real time.
+void App::RewindGame() {
+  int ticks = 0;
+  while (tick_accumulator_secs_ >= seconds_per_tick_ &&
+         ticks < FLAGS_max_ticks_per_frame) {
+    PieceBounds before_tick = PieceBoundsOf(game_);
+    if (!rewind_->Pop(&game_)) {
+      break;  // as far back as we can go
+    }
+    previous_pieces_ = before_tick;
+    tick_accumulator_secs_ -= seconds_per_tick_;
+    ++ticks;
+  }
+  if (ticks > 0 && replay_writer_) {
+    // The recording carries on from wherever we rewound to.
+    replay_writer_->Discontinuity();
+  }
+  // Don't let time pile up while out of snapshots, or the game would jump
+  // ahead once R is let go.
+  tick_accumulator_secs_ = std::fmod(tick_accumulator_secs_, seconds_per_tick_);
+  if (rewind_->Size() == 0) {
+    previous_pieces_ = PieceBoundsOf(game_);
+  }
+}
+
+void App::UpdateHud(const GameBoard& game) {
+  PROFILE_SCOPE("UpdateHud");
+  labels_.clear();
+  if (!glyph_atlas_) {
+    return;
+  }
+
+  // Labels only re-layout (and only get redrawn) when their text changes.
+  left_score_label_->SetText(
+      std::to_string(chaos_ ? chaos_->left_score_ : game.left_score_));
+  right_score_label_->SetText(
+      std::to_string(chaos_ ? chaos_->right_score_ : game.right_score_));
+  labels_.push_back(left_score_label_.get());
+  labels_.push_back(right_score_label_.get());
+
+  if (show_fps_) {
+    // Average over half a second, so the number is readable.
+    uint64_t now = SDL_GetPerformanceCounter();
+    ++fps_frames_;
+    double secs = static_cast<double>(now - fps_start_counter_) /
+                  SDL_GetPerformanceFrequency();
+    if (fps_start_counter_ == 0 || secs >= 0.5) {
+      if (fps_start_counter_ != 0) {
+        fps_label_->SetText(
+            (format("%.0f FPS %.1f ms") % (fps_frames_ / secs) %
+             (secs * 1000 / fps_frames_)).str());
       }
+      fps_frames_ = 0;
+      fps_start_counter_ = now;
     }
+    labels_.push_back(fps_label_.get());
+  } else {
+    fps_start_counter_ = 0;
   }
-  last_game_update_msecs_ = msecs_now;
 }
 
-void App::Render() {
+void App::Render(const GameBoard& game, const PieceBounds& previous,
+                 double alpha) {
+  PROFILE_SCOPE("Render");
   SDL_Surface* screen_surface = SDL_GetWindowSurface(window_);
-  RenderGameToSdlSurface(game_, screen_surface);
-  SDL_UpdateWindowSurface(window_);
+  if (chaos_) {
+    // Nearly everything moves every frame, so dirty rects wouldn't save
+    // anything.
+    RenderMultiBallBoardToSdlSurface(*chaos_, labels_, screen_surface);
+    PROFILE_SCOPE("UpdateWindowSurface");
+    SDL_UpdateWindowSurface(window_);
+    return;
+  }
+  if (rasterizer_) {
+    RenderGameToSdlSurface(game, previous, alpha, labels_, rasterizer_.get(),
+                           screen_surface);
+    if (FLAGS_check_dirty_rects) {
+      CheckAgainstFullRedraw(game, previous, alpha, screen_surface);
+    }
+    PROFILE_SCOPE("UpdateWindowSurface");
+    SDL_UpdateWindowSurface(window_);
+    return;
+  }
+  const std::vector<SDL_Rect>& dirty_rects =
+      renderer_.Render(game, previous, alpha, labels_, screen_surface);
+  if (FLAGS_check_dirty_rects) {
+    CheckAgainstFullRedraw(game, previous, alpha, screen_surface);
+  }
+
+  PROFILE_SCOPE("UpdateWindowSurface");
+  if (!dirty_rects.empty()) {
+    SDL_UpdateWindowSurfaceRects(window_, dirty_rects.data(),
+                                 dirty_rects.size());
+  }
+}
+
+void App::CheckAgainstFullRedraw(const GameBoard& game,
+                                 const PieceBounds& previous, double alpha,
+                                 SDL_Surface* screen_surface) {
+  if (!check_surface_ || check_surface_->w != screen_surface->w ||
+      check_surface_->h != screen_surface->h) {
+    check_surface_.reset(SDL_CreateRGBSurfaceWithFormat(
+        0, screen_surface->w, screen_surface->h,
+        screen_surface->format->BitsPerPixel, screen_surface->format->format));
+    CHECK(check_surface_) << "Could not create surface: " << SDL_GetError();
+  }
+  RenderGameToSdlSurface(game, previous, alpha, labels_,
+                         check_surface_.get());
+  CHECK(util::sdl::SurfacePixelsEqual(screen_surface, check_surface_.get()))
+      << "Rendering differs from a full redraw through SDL";
 }
 
 }  // namespace pong
 
 int main(int argc, char** argv) {
+  // Cold start is timed from here to the first frame being shown.
+  uint64_t start_counter = SDL_GetPerformanceCounter();
   google::InitGoogleLogging(argv[0]);
   gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK(FLAGS_tick_hz > 0) << "--tick_hz must be positive";
+  CHECK(FLAGS_max_ticks_per_frame > 0)
+      << "--max_ticks_per_frame must be positive";
+  CHECK(FLAGS_fps > 0) << "--fps must be positive";
+  CHECK(FLAGS_window_width > 0 && FLAGS_window_height > 0)
+      << "--window_width and --window_height must be positive";
 
   LOG(INFO) << "Initializing SDL";
   SDLContext sdl(SDL_INIT_VIDEO);
@@ -133,8 +1076,8 @@ int main(int argc, char** argv) {
   const SDL_Rect kScreenParams = {
       SDL_WINDOWPOS_UNDEFINED,  // x
       SDL_WINDOWPOS_UNDEFINED,  // y
-      640,                      // width
-      640,                      // height
+      FLAGS_window_width,       // width
+      FLAGS_window_height,      // height
   };
   LOG(INFO) << "Creating SDL window with params: "
             << FormatSdlRect(kScreenParams);
@@ -144,7 +1087,7 @@ int main(int argc, char** argv) {
   CHECK(window) << "Could not create SDL window: " << SDL_GetError();
 
   LOG(INFO) << "Starting main loop";
-  pong::App app(window.get());
+  pong::App app(window.get(), start_counter);
   app.Run();
 
   return 0;
@@ -0,0 +1,150 @@
+// Renders a replay recorded by pong or pong_tournament to video, headlessly:
+// frames are drawn to an offscreen surface as fast as they can be written,
+// without opening a window or waiting for the clock.
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "asset_pack.h"
+#include "frame_capture.h"
+#include "game.h"
+#include "rendering.h"
+#include "replay.h"
+#include "text.h"
+#include "util.h"
+
+DEFINE_string(replay, "", "The replay file to render.");
+DEFINE_string(output, "", "Where to write the video; see --format.");
+DEFINE_string(format, "y4m",
+              "y4m, for one file, or png, for one file per frame in the "
+              "--output directory.");
+DEFINE_double(fps, 60, "Frames per second of game time.");
+DEFINE_int32(width, 640, "Width of the video, in pixels.");
+DEFINE_int32(height, 640, "Height of the video, in pixels.");
+DEFINE_int32(buffers, 8, "Frames which can be waiting to be written.");
+DEFINE_bool(drop_frames, false,
+            "Drop frames the writer can't keep up with, as pong --capture "
+            "does, instead of waiting for it.");
+DEFINE_string(data_path, "data",
+              "The directory in which to look for data files.");
+DEFINE_string(font, "font.ttf",
+              "TrueType font for the score, relative to --data_path. Without "
+              "it, there's no score.");
+DEFINE_string(asset_pack, "bin/assets.pongpack",
+              "Asset pack built by `make assets`. The font is loaded from it "
+              "if it exists, and from --data_path otherwise.");
+
+using ::boost::format;
+using ::util::sdl::ManagedFont;
+using ::util::sdl::ManagedSurface;
+using ::util::sdl::TTFContext;
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK(!FLAGS_replay.empty()) << "--replay is required";
+  CHECK(!FLAGS_output.empty()) << "--output is required";
+  CHECK(FLAGS_fps > 0) << "--fps must be positive";
+
+  std::unique_ptr<pong::ReplayReader> reader =
+      pong::ReplayReader::Open(FLAGS_replay);
+  CHECK(reader) << "Could not read " << FLAGS_replay;
+
+  // No SDL_Init: drawing to a surface in memory doesn't need video.
+  ManagedSurface surface(SDL_CreateRGBSurfaceWithFormat(
+      0, FLAGS_width, FLAGS_height, 32, SDL_PIXELFORMAT_RGB888));
+  CHECK(surface) << "Could not create surface: " << SDL_GetError();
+
+  // The score, laid out as pong lays it out.
+  TTFContext ttf;
+  ttf.CheckSuccess();
+  std::unique_ptr<pong::GlyphAtlas> atlas;
+  std::unique_ptr<pong::TextLabel> left_score;
+  std::unique_ptr<pong::TextLabel> right_score;
+  std::vector<const pong::TextLabel*> labels;
+  std::unique_ptr<pong::AssetPack> pack;
+  if (!FLAGS_asset_pack.empty() &&
+      access(FLAGS_asset_pack.c_str(), F_OK) == 0) {
+    pack = pong::AssetPack::Open(FLAGS_asset_pack);
+  }
+  ManagedFont font(pong::OpenFont(pack.get(), FLAGS_data_path, FLAGS_font,
+                                  FLAGS_height / 8));
+  if (font) {
+    atlas = util::make_unique<pong::GlyphAtlas>(
+        std::vector<pong::GlyphFace>{{font.get(), "0123456789"}},
+        SDL_Color{0xAA, 0xAA, 0xAA, 0xFF});
+    int center_x = FLAGS_width / 2;
+    int margin = FLAGS_width / 16;
+    left_score = util::make_unique<pong::TextLabel>(
+        atlas.get(), 0, center_x - margin, margin / 2,
+        pong::TextLabel::Align::RIGHT);
+    right_score = util::make_unique<pong::TextLabel>(
+        atlas.get(), 0, center_x + margin, margin / 2,
+        pong::TextLabel::Align::LEFT);
+    labels = {left_score.get(), right_score.get()};
+  } else {
+    LOG(WARNING) << "Could not load font " << FLAGS_font << ": "
+                 << TTF_GetError() << ". Rendering without the score.";
+  }
+
+  pong::CaptureParams params;
+  CHECK(pong::ParseCaptureFormat(FLAGS_format, &params.format))
+      << "Unknown --format: " << FLAGS_format;
+  params.path = FLAGS_output;
+  params.width = FLAGS_width;
+  params.height = FLAGS_height;
+  params.fps = FLAGS_fps;
+  params.num_buffers = FLAGS_buffers;
+  params.drop_when_full = FLAGS_drop_frames;
+
+  pong::GameBoard game;
+  pong::ReplayPlayer player(reader.get(), &game);
+  pong::PieceBounds previous = pong::PieceBoundsOf(game);
+  const double seconds_per_tick = reader->SecondsPerTick();
+  int64_t frames = 0;
+  auto start = std::chrono::steady_clock::now();
+  pong::FrameCapture capture(params);
+  while (true) {
+    // Play up to the first tick at or after the frame's time, and draw
+    // the frame part way between that tick and the one before.
+    double frame_secs = frames / FLAGS_fps;
+    while (!player.Done() && player.Tick() * seconds_per_tick < frame_secs) {
+      previous = pong::PieceBoundsOf(game);
+      player.Step();
+    }
+    double ahead_secs = player.Tick() * seconds_per_tick - frame_secs;
+    if (ahead_secs < 0) {
+      break;  // past the end of the replay
+    }
+    double alpha = std::max(0.0, 1 - ahead_secs / seconds_per_tick);
+    if (atlas) {
+      left_score->SetText(std::to_string(game.left_score_));
+      right_score->SetText(std::to_string(game.right_score_));
+    }
+    pong::RenderGameToSdlSurface(game, previous, alpha, labels,
+                                 surface.get());
+    capture.Capture(surface.get());
+    ++frames;
+  }
+  capture.Finish();
+  double wall_secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  double video_secs = frames / FLAGS_fps;
+  std::cout << format("Rendered %d frames (%.1fs of video) in %.2fs: "
+                      "%.1f frames/s, %.1fx real time\n") %
+                   frames % video_secs % wall_secs % (frames / wall_secs) %
+                   (video_secs / wall_secs)
+            << "Capture: " << capture.GetStats() << "\n";
+  return 0;
+}
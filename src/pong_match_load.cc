@@ -0,0 +1,361 @@
+// Load generator for pong::MatchServer. Plays both sides of --matches
+// matches at once from a handful of UDP sockets, each player chasing the
+// ball, and reports how long each input took to come back in a state packet.
+// Unless --server is given, runs the server in-process too, and reports how
+// long its ticks took and how late they started.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "game.h"
+#include "latency_histogram.h"
+#include "match_server.h"
+#include "net.h"
+#include "util.h"
+
+DEFINE_int32(matches, 1000, "Matches to play, two players each.");
+DEFINE_double(secs, 10, "How long to play for.");
+DEFINE_string(server, "",
+              "host:port of a running server's first shard. If empty, a "
+              "server is run in-process.");
+DEFINE_int32(server_shards, 1,
+             "With --server, how many shards it has, for working out which "
+             "port each match's players send to.");
+DEFINE_int32(port, 7900, "In-process server's first port.");
+DEFINE_int32(shards, 0,
+             "In-process server's shards; 0 means one per hardware thread.");
+DEFINE_double(tick_hz, 240, "In-process server's tick rate.");
+DEFINE_int32(send_every_ticks, 4,
+             "In-process server sends state every this many ticks.");
+DEFINE_int32(sockets, 16, "UDP sockets to spread the players over.");
+DEFINE_bool(idle_right_players, false,
+            "Right players never move (but still keep their match alive), "
+            "so points get scored, to check that players see them end.");
+
+using ::boost::format;
+
+namespace pong {
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr size_t kReceiveBufferBytes = 64;
+
+// Players resend their move this often even if it hasn't changed, so the
+// server doesn't end their match.
+constexpr auto kKeepAliveInterval = std::chrono::seconds(1);
+
+struct Player {
+  uint32_t match_id;
+  int side;
+  int socket;  // index into LoadGenerator::sockets_
+  MoveDirection move = MoveDirection::NONE;
+  Clock::time_point last_sent;
+  uint64_t last_echo = 0;  // newest stamp the server has echoed back
+  uint32_t last_tick = 0;
+  int points = 0;  // both sides' scores added up, as of last_tick
+};
+
+// A UDP socket shared by many players.
+struct LoadSocket {
+  int fd;
+  std::unique_ptr<DatagramBatcher> batcher;
+};
+
+class LoadGenerator {
+ public:
+  LoadGenerator(const sockaddr_in& server, int num_shards, int num_matches,
+                int num_sockets);
+  ~LoadGenerator();
+
+  // Plays until `end`.
+  void Run(Clock::time_point end);
+
+  int64_t states_received() const { return states_received_; }
+  int64_t inputs_sent() const;
+  int64_t send_failures() const;
+  int64_t points() const { return points_; }
+  int64_t point_ends_seen() const { return point_ends_seen_; }
+  const LatencyHistogram& round_trip() const { return round_trip_; }
+
+ private:
+  uint64_t Stamp(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_)
+        .count();
+  }
+  void Receive(int socket);
+  void HandleState(const MatchState& state, Clock::time_point now);
+  void QueueInput(Player* player, Clock::time_point now);
+
+  const sockaddr_in server_;
+  const int num_shards_;
+  const Clock::time_point start_;
+  int epoll_fd_;
+  std::vector<LoadSocket> sockets_;
+  std::vector<Player> players_;  // 2 * match id + side
+
+  // Piece sizes, which the server doesn't send.
+  double ball_height_;
+  double paddle_height_;
+
+  int64_t states_received_ = 0;
+  // Points scored, and how many of them the left players got a state
+  // showing the end of, rather than first hearing of them after the serve.
+  int64_t points_ = 0;
+  int64_t point_ends_seen_ = 0;
+  // From sending an input to getting a state with its stamp.
+  LatencyHistogram round_trip_{0.0005, 200};
+};
+
+LoadGenerator::LoadGenerator(const sockaddr_in& server, int num_shards,
+                             int num_matches, int num_sockets)
+    : server_(server),
+      num_shards_(num_shards),
+      start_(Clock::now()),
+      epoll_fd_(epoll_create1(0)),
+      sockets_(num_sockets) {
+  PCHECK(epoll_fd_ >= 0) << "Could not create epoll instance";
+  for (int i = 0; i < num_sockets; ++i) {
+    LoadSocket& socket = sockets_[i];
+    socket.fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    PCHECK(socket.fd >= 0) << "Could not create UDP socket";
+    PCHECK(fcntl(socket.fd, F_SETFL,
+                 fcntl(socket.fd, F_GETFL) | O_NONBLOCK) == 0);
+    SetSocketBuffers(socket.fd, 4 << 20);
+    socket.batcher = util::make_unique<DatagramBatcher>(
+        socket.fd, kReceiveBufferBytes, kInputPacketBytes);
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = i;
+    PCHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket.fd, &event) == 0);
+  }
+
+  for (int i = 0; i < 2 * num_matches; ++i) {
+    Player player;
+    player.match_id = i / 2;
+    player.side = i % 2;
+    player.socket = i % num_sockets;
+    players_.push_back(player);
+  }
+
+  GameBoard game;
+  ball_height_ = game.ball_.bounds_.Height();
+  paddle_height_ = game.left_paddle_.bounds_.Height();
+}
+
+LoadGenerator::~LoadGenerator() {
+  for (LoadSocket& socket : sockets_) {
+    close(socket.fd);
+  }
+  close(epoll_fd_);
+}
+
+void LoadGenerator::Run(Clock::time_point end) {
+  // Everyone joins.
+  Clock::time_point now = Clock::now();
+  for (Player& player : players_) {
+    QueueInput(&player, now);
+  }
+  for (size_t i = 0; i < sockets_.size(); ++i) {
+    sockets_[i].batcher->Flush();
+  }
+
+  std::vector<epoll_event> events(sockets_.size());
+  Clock::time_point next_keep_alive = now + kKeepAliveInterval;
+  while ((now = Clock::now()) < end) {
+    int ready = epoll_wait(epoll_fd_, events.data(), events.size(), 10);
+    if (ready < 0) {
+      PCHECK(errno == EINTR) << "epoll_wait failed";
+      continue;
+    }
+    for (int i = 0; i < ready; ++i) {
+      Receive(events[i].data.u32);
+    }
+    now = Clock::now();
+    if (now >= next_keep_alive) {
+      for (Player& player : players_) {
+        if (now - player.last_sent >= kKeepAliveInterval) {
+          QueueInput(&player, now);
+        }
+      }
+      next_keep_alive = now + kKeepAliveInterval / 4;
+    }
+    for (size_t i = 0; i < sockets_.size(); ++i) {
+      sockets_[i].batcher->Flush();
+    }
+  }
+}
+
+int64_t LoadGenerator::inputs_sent() const {
+  int64_t sent = 0;
+  for (const LoadSocket& socket : sockets_) {
+    sent += socket.batcher->counters().sent;
+  }
+  return sent;
+}
+
+int64_t LoadGenerator::send_failures() const {
+  int64_t failures = 0;
+  for (const LoadSocket& socket : sockets_) {
+    failures += socket.batcher->counters().send_failures;
+  }
+  return failures;
+}
+
+void LoadGenerator::Receive(int index) {
+  Clock::time_point now = Clock::now();
+  sockets_[index].batcher->ReceiveAll(
+      [this, now](const uint8_t* data, size_t size, const sockaddr_in& from) {
+        MatchState state;
+        if (DecodeMatchState(data, size, &state)) {
+          HandleState(state, now);
+        }
+      });
+}
+
+void LoadGenerator::HandleState(const MatchState& state,
+                                Clock::time_point now) {
+  size_t index = 2 * static_cast<size_t>(state.match_id) + state.side;
+  if (index >= players_.size()) {
+    return;
+  }
+  ++states_received_;
+  Player& player = players_[index];
+  if (state.stamp > player.last_echo) {
+    player.last_echo = state.stamp;
+    round_trip_.Add((Stamp(now) - state.stamp) / 1e9);
+  }
+  if (state.tick <= player.last_tick) {
+    return;  // out of order
+  }
+  player.last_tick = state.tick;
+  int points = state.left_score + state.right_score;
+  if (player.side == 0 && points > player.points) {
+    points_ += points - player.points;
+    point_ends_seen_ += state.game_over;
+  }
+  player.points = points;
+
+  // Chase the ball, like FollowBallYController, and only say so when the
+  // move changes.
+  double paddle_y =
+      player.side == 0 ? state.left_paddle_y : state.right_paddle_y;
+  double offset =
+      (state.ball_y + ball_height_ / 2) - (paddle_y + paddle_height_ / 2);
+  MoveDirection move = MoveDirection::NONE;
+  if (offset > paddle_height_ / 4) {
+    move = MoveDirection::DOWN;
+  } else if (offset < -paddle_height_ / 4) {
+    move = MoveDirection::UP;
+  }
+  if (player.side == 1 && FLAGS_idle_right_players) {
+    move = MoveDirection::NONE;
+  }
+  if (move != player.move) {
+    player.move = move;
+    QueueInput(&player, now);
+  }
+}
+
+void LoadGenerator::QueueInput(Player* player, Clock::time_point now) {
+  MatchInput input;
+  input.match_id = player->match_id;
+  input.side = player->side;
+  input.move = player->move;
+  input.stamp = Stamp(now);
+  sockaddr_in destination = server_;
+  destination.sin_port =
+      htons(ntohs(server_.sin_port) + player->match_id % num_shards_);
+  EncodeMatchInput(input, sockets_[player->socket].batcher->Queue(
+                              destination, kInputPacketBytes));
+  player->last_sent = now;
+}
+
+sockaddr_in Resolve(const std::string& host_port) {
+  size_t colon = host_port.rfind(':');
+  CHECK(colon != std::string::npos) << "--server must be host:port";
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* result = nullptr;
+  std::string host = host_port.substr(0, colon);
+  int error = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+  CHECK(error == 0) << "Could not resolve " << host << ": "
+                    << gai_strerror(error);
+  sockaddr_in address;
+  memcpy(&address, result->ai_addr, sizeof(address));
+  address.sin_port = htons(std::stoi(host_port.substr(colon + 1)));
+  freeaddrinfo(result);
+  return address;
+}
+
+}  // namespace
+}  // namespace pong
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK(FLAGS_matches > 0) << "--matches must be positive";
+  CHECK(FLAGS_sockets > 0) << "--sockets must be positive";
+
+  std::unique_ptr<pong::MatchServer> server;
+  sockaddr_in server_address;
+  int num_shards = FLAGS_server_shards;
+  if (FLAGS_server.empty()) {
+    pong::MatchServerParams params;
+    params.port = FLAGS_port;
+    params.num_shards = FLAGS_shards;
+    params.tick_hz = FLAGS_tick_hz;
+    params.send_every_ticks = FLAGS_send_every_ticks;
+    server = util::make_unique<pong::MatchServer>(params);
+    server->Start();
+    num_shards = server->NumShards();
+    server_address = pong::Resolve("127.0.0.1:" + std::to_string(FLAGS_port));
+  } else {
+    server_address = pong::Resolve(FLAGS_server);
+  }
+
+  pong::LoadGenerator load(server_address, num_shards, FLAGS_matches,
+                           FLAGS_sockets);
+  auto start = pong::Clock::now();
+  load.Run(start + std::chrono::duration_cast<pong::Clock::duration>(
+                       std::chrono::duration<double>(FLAGS_secs)));
+  double secs = std::chrono::duration<double>(pong::Clock::now() - start)
+                    .count();
+
+  std::cout << format("%d matches for %.1fs: %.0f states/s received, %.0f "
+                      "inputs/s sent, %d send failures\n") %
+                   FLAGS_matches % secs % (load.states_received() / secs) %
+                   (load.inputs_sent() / secs) % load.send_failures()
+            << format("%d points, %d seen ending\n") % load.points() %
+                   load.point_ends_seen()
+            << "Input to state round trip: " << load.round_trip() << "\n";
+  if (server) {
+    server->Stop();
+    pong::MatchServer::Stats stats = server->GetStats();
+    std::cout << "Server (" << server->NumShards() << " shards): " << stats
+              << "\n";
+    if (stats.matches_started != FLAGS_matches) {
+      std::cout << format("FAILED: %d of %d matches started\n") %
+                       stats.matches_started % FLAGS_matches;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Hosts matches for remote players with pong::MatchServer until interrupted
+// (or for --run_secs), then prints its stats. See match_server.h for the
+// protocol, and pong_match_load for a client.
+
+#include <signal.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "match_server.h"
+
+DEFINE_int32(port, 7900, "UDP port of the first shard; shard i uses port + i.");
+DEFINE_int32(shards, 0, "Shards, each on its own thread and core; 0 means "
+                        "one per hardware thread.");
+DEFINE_int32(max_matches_per_shard, 4096, "Matches each shard can host.");
+DEFINE_double(tick_hz, 240, "Simulation ticks per second.");
+DEFINE_int32(send_every_ticks, 4, "Ticks between sending players the state.");
+DEFINE_double(match_timeout_secs, 10,
+              "Matches neither player has sent to for this long are ended.");
+DEFINE_double(run_secs, 0, "Stop after this long; 0 runs until interrupted.");
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  // Block the signals which stop the server before starting any threads, so
+  // they all inherit that and only sigwait() below sees them.
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  PCHECK(pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr) == 0);
+
+  pong::MatchServerParams params;
+  params.port = FLAGS_port;
+  params.num_shards = FLAGS_shards;
+  params.max_matches_per_shard = FLAGS_max_matches_per_shard;
+  params.tick_hz = FLAGS_tick_hz;
+  params.send_every_ticks = FLAGS_send_every_ticks;
+  params.match_timeout_secs = FLAGS_match_timeout_secs;
+  pong::MatchServer server(params);
+  server.Start();
+  LOG(INFO) << "Hosting matches on " << server.NumShards()
+            << " shards, UDP ports " << FLAGS_port << "-"
+            << FLAGS_port + server.NumShards() - 1;
+
+  if (FLAGS_run_secs > 0) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(FLAGS_run_secs));
+  } else {
+    int signal;
+    sigwait(&stop_signals, &signal);
+  }
+  server.Stop();
+  std::cout << server.GetStats() << "\n";
+  return 0;
+}
@@ -0,0 +1,127 @@
+// Plays a rollback netplay game between two AI players in one process, over
+// real UDP sockets on localhost, with artificial latency, jitter and packet
+// loss. Checks that both peers end up with exactly the same board.
+
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "controller.h"
+#include "game.h"
+#include "net.h"
+#include "netplay.h"
+
+DEFINE_int64(ticks, 240 * 20, "Ticks to play.");
+DEFINE_double(tick_hz, 240, "Simulation ticks per second.");
+DEFINE_double(latency_ms, 50, "One-way latency added to every packet.");
+DEFINE_double(jitter_ms, 10, "Up to this much random extra latency.");
+DEFINE_double(loss, 0.05, "Fraction of packets to drop.");
+DEFINE_int32(input_delay_ticks, 4,
+             "Ticks before a player's own moves take effect.");
+DEFINE_int32(max_prediction_ticks, 60,
+             "Furthest a peer may run ahead of the other's known moves.");
+DEFINE_string(left, "follow_ball_y", "Controller for the left peer.");
+DEFINE_string(right, "follow_ball_y", "Controller for the right peer.");
+
+using ::boost::format;
+
+namespace pong {
+namespace {
+
+// One side of the game, as it would run on a player's machine.
+struct Peer {
+  Peer(const std::string& controller_name, GameBoard::Player side,
+       const LinkConditions& conditions, uint64_t seed,
+       const RollbackParams& params)
+      : controller(NewAiController(controller_name)),
+        link(0, WithSeed(conditions, seed)),
+        session(&game, side, controller.get(), &link, params) {
+    CHECK(controller) << "Unknown controller '" << controller_name
+                      << "'. Known controllers: "
+                      << boost::algorithm::join(AiControllerNames(), ", ");
+  }
+
+  static LinkConditions WithSeed(LinkConditions conditions, uint64_t seed) {
+    conditions.seed = seed;
+    return conditions;
+  }
+
+  std::unique_ptr<PaddleController> controller;
+  GameBoard game;
+  UdpLink link;
+  RollbackSession session;
+};
+
+}  // namespace
+}  // namespace pong
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK(FLAGS_tick_hz > 0) << "--tick_hz must be positive";
+
+  pong::RollbackParams params;
+  params.seconds_per_tick = 1 / FLAGS_tick_hz;
+  params.input_delay_ticks = FLAGS_input_delay_ticks;
+  params.max_prediction_ticks = FLAGS_max_prediction_ticks;
+  pong::LinkConditions conditions;
+  conditions.latency_secs = FLAGS_latency_ms / 1000;
+  conditions.jitter_secs = FLAGS_jitter_ms / 1000;
+  conditions.loss = FLAGS_loss;
+
+  pong::Peer left(FLAGS_left, pong::GameBoard::Player::LEFT, conditions, 1,
+                  params);
+  pong::Peer right(FLAGS_right, pong::GameBoard::Player::RIGHT, conditions, 2,
+                   params);
+  left.link.SetPeer("127.0.0.1", right.link.LocalPort());
+  right.link.SetPeer("127.0.0.1", left.link.LocalPort());
+
+  // Both peers try to keep up with the wall clock, as they would in a real
+  // game, so the artificial latency means something.
+  auto start = std::chrono::steady_clock::now();
+  while (left.session.Tick() < FLAGS_ticks ||
+         right.session.Tick() < FLAGS_ticks) {
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    int64_t due = std::min<int64_t>(FLAGS_ticks, elapsed * FLAGS_tick_hz);
+    for (pong::Peer* peer : {&left, &right}) {
+      while (peer->session.Tick() < due && peer->session.AdvanceTick()) {
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+
+  // Let the last moves get across, so both boards are final.
+  while (left.session.ConfirmedTicks() < FLAGS_ticks ||
+         right.session.ConfirmedTicks() < FLAGS_ticks) {
+    left.session.Poll();
+    right.session.Poll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  std::cout << format("Local input latency: %d ticks (%.1fms)\n") %
+                   FLAGS_input_delay_ticks %
+                   (FLAGS_input_delay_ticks * 1000 / FLAGS_tick_hz);
+  std::cout << "left:  " << left.session.GetStats() << "\n"
+            << "right: " << right.session.GetStats() << "\n"
+            << "score: " << left.game.left_score_ << " - "
+            << left.game.right_score_ << "\n";
+
+  pong::GameBoardState left_board = left.game.Save();
+  pong::GameBoardState right_board = right.game.Save();
+  if (memcmp(&left_board, &right_board, sizeof(left_board)) != 0) {
+    std::cout << "DESYNC: the peers' boards differ\n"
+              << "  left peer:  " << left.game.ball_ << "\n"
+              << "  right peer: " << right.game.ball_ << "\n";
+    return 1;
+  }
+  std::cout << "Both peers' boards match\n";
+  return 0;
+}
@@ -0,0 +1,91 @@
+// Builds an asset pack (see asset_pack.h) out of every file in the given
+// directories, named by their paths relative to the directory, e.g.
+//
+//   bin/pong_pack --output=bin/assets.pongpack data
+//
+// `make assets` runs this on data/. If there's no data/, it runs with no
+// directories and writes an empty pack, so the game loads everything from
+// --data_path.
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "asset_pack.h"
+
+DEFINE_string(output, "assets.pongpack", "Where to write the pack.");
+
+namespace {
+
+// Appends every regular file under `dir` to `files`, named `prefix` plus its
+// path relative to `dir`. Returns false if a directory can't be read.
+bool ListFiles(const std::string& dir, const std::string& prefix,
+               std::vector<pong::AssetFile>* files) {
+  DIR* listing = opendir(dir.c_str());
+  if (listing == nullptr) {
+    PLOG(ERROR) << "Could not read directory " << dir;
+    return false;
+  }
+  bool ok = true;
+  while (dirent* entry = readdir(listing)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    std::string path = dir + "/" + name;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+      PLOG(ERROR) << "Could not stat " << path;
+      ok = false;
+    } else if (S_ISDIR(info.st_mode)) {
+      ok = ListFiles(path, prefix + name + "/", files) && ok;
+    } else if (S_ISREG(info.st_mode)) {
+      files->push_back({prefix + name, path});
+    }
+  }
+  closedir(listing);
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc == 1) {
+    LOG(WARNING) << "No directories to pack; writing an empty pack";
+  }
+
+  std::vector<pong::AssetFile> files;
+  for (int i = 1; i < argc; ++i) {
+    if (!ListFiles(argv[i], "", &files)) {
+      return 1;
+    }
+  }
+  if (!pong::WriteAssetPack(FLAGS_output, files)) {
+    return 1;
+  }
+
+  // Read it back, so a bad pack fails the build rather than the game.
+  std::unique_ptr<pong::AssetPack> pack = pong::AssetPack::Open(FLAGS_output);
+  if (!pack) {
+    return 1;
+  }
+  for (int i = 0; i < pack->NumAssets(); ++i) {
+    const uint8_t* data;
+    size_t size;
+    CHECK(pack->Find(pack->Name(i), &data, &size))
+        << "Asset " << pack->Name(i) << " can't be found in the index";
+    std::cout << boost::format("%10d  %s\n") % size % pack->Name(i);
+  }
+  std::cout << boost::format("Packed %d assets into %s\n") %
+                   pack->NumAssets() % FLAGS_output;
+  return 0;
+}
@@ -0,0 +1,181 @@
+// Checks headlessly that DirtyRectRenderer draws exactly what a full redraw
+// does. Plays a game between two randomly moving paddles, so that there are
+// serves, points and score changes, and draws every frame both ways onto
+// offscreen surfaces. Exits with status 1 at the first frame which differs.
+
+#include <unistd.h>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "asset_pack.h"
+#include "controller.h"
+#include "game.h"
+#include "rendering.h"
+#include "text.h"
+#include "util.h"
+
+DEFINE_int32(frames, 20000, "Frames to draw and compare.");
+DEFINE_double(tick_hz, 240, "Rate at which the game is stepped.");
+DEFINE_int32(width, 640, "Width of the surfaces, in pixels.");
+DEFINE_int32(height, 640, "Height of the surfaces, in pixels.");
+DEFINE_uint64(seed, 1, "Seed for the serves and the paddles' moves.");
+DEFINE_string(data_path, "data",
+              "The directory in which to look for data files.");
+DEFINE_string(font, "font.ttf",
+              "TrueType font for the labels, relative to --data_path. "
+              "Without it, frames are checked without labels.");
+DEFINE_string(asset_pack, "bin/assets.pongpack",
+              "Asset pack built by `make assets`. The font is loaded from it "
+              "if it exists, and from --data_path otherwise.");
+
+using ::boost::format;
+using ::util::sdl::ManagedFont;
+using ::util::sdl::ManagedSurface;
+using ::util::sdl::TTFContext;
+
+namespace {
+
+// Frames drawn after a point before serving again, as if the players were
+// slow to press space.
+constexpr int kFramesBetweenPoints = 10;
+// The paddles pick a new random move this often, in ticks.
+constexpr int kTicksPerMove = 30;
+
+ManagedSurface NewSurface() {
+  ManagedSurface surface(SDL_CreateRGBSurfaceWithFormat(
+      0, FLAGS_width, FLAGS_height, 32, SDL_PIXELFORMAT_RGB888));
+  CHECK(surface) << "Could not create surface: " << SDL_GetError();
+  return surface;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK(FLAGS_tick_hz > 0) << "--tick_hz must be positive";
+
+  // No SDL_Init: drawing to a surface in memory doesn't need video.
+  ManagedSurface dirty_surface = NewSurface();
+  ManagedSurface full_surface = NewSurface();
+
+  // The scores, laid out as pong lays them out, and a label in the corner
+  // which comes and goes like the frame rate does.
+  TTFContext ttf;
+  ttf.CheckSuccess();
+  std::unique_ptr<pong::AssetPack> pack;
+  if (!FLAGS_asset_pack.empty() &&
+      access(FLAGS_asset_pack.c_str(), F_OK) == 0) {
+    pack = pong::AssetPack::Open(FLAGS_asset_pack);
+  }
+  ManagedFont score_font(pong::OpenFont(pack.get(), FLAGS_data_path,
+                                        FLAGS_font, FLAGS_height / 8));
+  ManagedFont hud_font(
+      pong::OpenFont(pack.get(), FLAGS_data_path, FLAGS_font, 16));
+  std::unique_ptr<pong::GlyphAtlas> atlas;
+  std::unique_ptr<pong::TextLabel> left_score;
+  std::unique_ptr<pong::TextLabel> right_score;
+  std::unique_ptr<pong::TextLabel> hud;
+  if (score_font && hud_font) {
+    enum { kScoreFace, kHudFace };
+    atlas = util::make_unique<pong::GlyphAtlas>(
+        std::vector<pong::GlyphFace>{{score_font.get(), "0123456789"},
+                                     {hud_font.get(), "0123456789 .FPSms"}},
+        SDL_Color{0xAA, 0xAA, 0xAA, 0xFF});
+    int center_x = FLAGS_width / 2;
+    int margin = FLAGS_width / 16;
+    left_score = util::make_unique<pong::TextLabel>(
+        atlas.get(), kScoreFace, center_x - margin, margin / 2,
+        pong::TextLabel::Align::RIGHT);
+    right_score = util::make_unique<pong::TextLabel>(
+        atlas.get(), kScoreFace, center_x + margin, margin / 2,
+        pong::TextLabel::Align::LEFT);
+    hud = util::make_unique<pong::TextLabel>(
+        atlas.get(), kHudFace, 4,
+        FLAGS_height - atlas->LineHeight(kHudFace) - 4,
+        pong::TextLabel::Align::LEFT);
+  } else {
+    LOG(WARNING) << "Could not load font " << FLAGS_font << ": "
+                 << TTF_GetError() << ". Checking without labels.";
+  }
+
+  std::mt19937_64 rng(FLAGS_seed);
+  pong::FixedMoveController left_controller;
+  pong::FixedMoveController right_controller;
+  pong::GameBoard game;
+  game.SetLeftController(&left_controller);
+  game.SetRightController(&right_controller);
+  game.SetupNewGame(pong::RandomServeDirection(&rng));
+  pong::PieceBounds previous = pong::PieceBoundsOf(game);
+
+  const double seconds_per_tick = 1.0 / FLAGS_tick_hz;
+  std::uniform_int_distribution<int> random_move(0, 2);
+  pong::DirtyRectRenderer renderer;
+  int64_t ticks = 0;
+  int points = 0;
+  int frames_since_point = 0;
+  for (int frame = 0; frame < FLAGS_frames; ++frame) {
+    // Between 0 and 2 ticks a frame, drawn at varying points between them,
+    // as happens when the frame rate and tick rate don't divide.
+    if (game.IsGameOver()) {
+      if (++frames_since_point > kFramesBetweenPoints) {
+        game.SetupNewGame(pong::RandomServeDirection(&rng));
+        previous = pong::PieceBoundsOf(game);
+        frames_since_point = 0;
+      }
+    } else {
+      for (int tick = 0; tick < frame % 3; ++tick) {
+        if (ticks % kTicksPerMove == 0) {
+          left_controller.SetMove(
+              static_cast<pong::MoveDirection>(random_move(rng)));
+          right_controller.SetMove(
+              static_cast<pong::MoveDirection>(random_move(rng)));
+        }
+        previous = pong::PieceBoundsOf(game);
+        game.Update(seconds_per_tick);
+        ++ticks;
+        if (game.IsGameOver()) {
+          ++points;
+          break;
+        }
+      }
+    }
+    double alpha = (frame % 4) / 4.0;
+
+    std::vector<const pong::TextLabel*> labels;
+    if (atlas) {
+      left_score->SetText(std::to_string(game.left_score_));
+      right_score->SetText(std::to_string(game.right_score_));
+      labels = {left_score.get(), right_score.get()};
+      // Shown for 500 frames out of every 700, changing every 50.
+      if (frame % 700 < 500) {
+        hud->SetText(str(format("%d FPS") % (frame / 50)));
+        labels.push_back(hud.get());
+      }
+    }
+
+    renderer.Render(game, previous, alpha, labels, dirty_surface.get());
+    pong::RenderGameToSdlSurface(game, previous, alpha, labels,
+                                 full_surface.get());
+    if (!util::sdl::SurfacePixelsEqual(dirty_surface.get(),
+                                       full_surface.get())) {
+      std::cout << format("Frame %d (tick %d, alpha %.2f) differs from a "
+                          "full redraw\n") %
+                       frame % ticks % alpha;
+      return 1;
+    }
+  }
+  std::cout << format("%d frames (%d ticks, %d points) matched a full "
+                      "redraw\n") %
+                   FLAGS_frames % ticks % points;
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Inspects a replay recorded by pong or pong_tournament: plays it through
+// headlessly and prints how the match went.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "game.h"
+#include "replay.h"
+
+DEFINE_string(replay, "", "The replay file to read.");
+DEFINE_int64(seek_tick, -1,
+             "If set, print the board as it was just before this tick.");
+DEFINE_int32(verify_seeks, 0,
+             "Check this many seeks, spread over the replay, against playing "
+             "the replay from the start.");
+
+using ::boost::format;
+
+namespace pong {
+namespace {
+
+void PrintBoard(const GameBoard& game) {
+  std::cout << "  " << game.ball_ << "\n"
+            << "  left paddle: " << game.left_paddle_.bounds_ << "\n"
+            << "  right paddle: " << game.right_paddle_.bounds_ << "\n"
+            << "  score: " << game.left_score_ << " - " << game.right_score_
+            << (game.IsGameOver() ? " (point over)" : "") << "\n";
+}
+
+bool SameBoard(const GameBoard& a, const GameBoard& b) {
+  return a.ball_.bounds_.top_left() == b.ball_.bounds_.top_left() &&
+         a.ball_.velocity_ == b.ball_.velocity_ &&
+         a.left_paddle_.bounds_.top_left() ==
+             b.left_paddle_.bounds_.top_left() &&
+         a.right_paddle_.bounds_.top_left() ==
+             b.right_paddle_.bounds_.top_left() &&
+         a.left_paddle_.max_speed_ == b.left_paddle_.max_speed_ &&
+         a.right_paddle_.max_speed_ == b.right_paddle_.max_speed_ &&
+         a.left_score_ == b.left_score_ && a.right_score_ == b.right_score_ &&
+         a.IsGameOver() == b.IsGameOver();
+}
+
+// Plays the replay from the start, checking that seeking directly to each of
+// `num_seeks` ticks gives the same board. Returns false on a mismatch.
+bool VerifySeeks(const ReplayReader& reader, int num_seeks) {
+  GameBoard played;
+  ReplayPlayer player(&reader, &played);
+  GameBoard seeked;
+  ReplayPlayer seeker(&reader, &seeked);
+  int64_t num_ticks = reader.NumTicks();
+  for (int i = 0; i < num_seeks; ++i) {
+    int64_t tick = num_ticks * i / num_seeks;
+    while (player.Tick() < tick) {
+      player.Step();
+    }
+    seeker.Seek(tick);
+    if (!SameBoard(played, seeked)) {
+      std::cout << "Seeking to tick " << tick << " gave\n";
+      PrintBoard(seeked);
+      std::cout << "but playing up to it gave\n";
+      PrintBoard(played);
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+}  // namespace pong
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK(!FLAGS_replay.empty()) << "--replay is required";
+
+  std::unique_ptr<pong::ReplayReader> reader =
+      pong::ReplayReader::Open(FLAGS_replay);
+  CHECK(reader) << "Could not read " << FLAGS_replay;
+  std::cout << format("%d ticks (%.1fs of play) in %d chunks\n") %
+                   reader->NumTicks() %
+                   (reader->NumTicks() * reader->SecondsPerTick()) %
+                   reader->NumChunks();
+  if (reader->NumTicks() == 0) {
+    return 0;
+  }
+
+  pong::GameBoard game;
+  pong::ReplayPlayer player(reader.get(), &game);
+  auto start = std::chrono::steady_clock::now();
+  while (!player.Done()) {
+    player.Step();
+  }
+  double secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  std::cout << format("Played back at %.4g ticks/s. Final board:\n") %
+                   (reader->NumTicks() / secs);
+  pong::PrintBoard(game);
+
+  if (FLAGS_seek_tick >= 0) {
+    player.Seek(FLAGS_seek_tick);
+    std::cout << "Before tick " << FLAGS_seek_tick << ":\n";
+    pong::PrintBoard(game);
+  }
+
+  if (FLAGS_verify_seeks > 0) {
+    if (!pong::VerifySeeks(*reader, FLAGS_verify_seeks)) {
+      return 1;
+    }
+    std::cout << FLAGS_verify_seeks << " seeks match playback\n";
+  }
+  return 0;
+}
@@ -0,0 +1,503 @@
+// Headless driver for pong::BatchSimulator. Simulates many boards with AI
+// controllers on both sides and reports how fast it went. No window is ever
+// opened, and this binary doesn't link against SDL.
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "batch_simulator.h"
+#include "controller.h"
+#include "game.h"
+#include "geometry.h"
+#include "multi_ball.h"
+#include "rewind.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "util.h"
+#include "vec_env.h"
+
+DEFINE_int32(boards, 4096, "Number of boards to simulate at once.");
+DEFINE_int32(ticks, 10000, "Number of simulation ticks to run.");
+DEFINE_double(tick_hz, 240, "Simulation ticks per simulated second.");
+DEFINE_bool(verify, false,
+            "Step a regular GameBoard next to board 0 of the batch and fail "
+            "if the two ever disagree.");
+DEFINE_string(kernel, "best",
+              "Board update kernel: scalar, sse2, avx2, best, or all. 'all' "
+              "runs every kernel this machine supports, compares their "
+              "throughput, and checks they all end up in the same state.");
+DEFINE_bool(benchmark_controllers, false,
+            "Instead of simulating a batch, play each AI controller against "
+            "itself on a regular GameBoard and report the cost per tick.");
+DEFINE_bool(benchmark_search, false,
+            "Instead of simulating a batch, time SearchController with "
+            "--search_budget_ms on 1, 2, 4, ... threads, up to one per "
+            "hardware thread.");
+DEFINE_double(search_budget_ms, 4, "Time budget per search.");
+DEFINE_bool(benchmark_vec_env, false,
+            "Instead of simulating a batch, step a VecEnv of --boards games "
+            "with random actions for --ticks steps and report steps/second.");
+DEFINE_bool(benchmark_geometry, false,
+            "Instead of simulating a batch, time Ball::Update and the "
+            "box interpolation and transforms the renderer does.");
+DEFINE_bool(benchmark_multi_ball, false,
+            "Instead of simulating a batch, time chaos mode (MultiBallBoard) "
+            "with 64, 256, ... balls up to --max_balls, with each "
+            "broadphase, and check that they agree.");
+DEFINE_int32(max_balls, 16384, "Most balls for --benchmark_multi_ball.");
+DEFINE_bool(benchmark_snapshots, false,
+            "Instead of simulating, time GameBoard::Save() and Restore() and "
+            "the rewind buffer built on them.");
+
+using ::boost::format;
+
+namespace pong {
+namespace {
+
+// Fails if board `index` of `sim` doesn't exactly match `game`.
+void CheckBoardsMatch(const BatchSimulator& sim, int index,
+                      const GameBoard& game, int tick) {
+  CHECK(sim.ball_x_[index] == game.ball_.bounds_.top_left().x() &&
+        sim.ball_y_[index] == game.ball_.bounds_.top_left().y() &&
+        sim.ball_vx_[index] == game.ball_.velocity_.x() &&
+        sim.ball_vy_[index] == game.ball_.velocity_.y() &&
+        sim.left_paddle_y_[index] ==
+            game.left_paddle_.bounds_.top_left().y() &&
+        sim.right_paddle_y_[index] ==
+            game.right_paddle_.bounds_.top_left().y() &&
+        sim.left_score_[index] == game.left_score_ &&
+        sim.right_score_[index] == game.right_score_)
+      << "Batch simulation diverged from GameBoard at tick " << tick
+      << ". Reference board: " << game.ball_;
+}
+
+struct SimulationResult {
+  std::unique_ptr<BatchSimulator> sim;
+  double simulate_secs = 0;
+};
+
+SimulationResult RunSimulation(BatchKernel kernel) {
+  const double seconds_per_tick = 1.0 / FLAGS_tick_hz;
+  SimulationResult result;
+  result.sim = util::make_unique<BatchSimulator>(FLAGS_boards);
+  BatchSimulator& sim = *result.sim;
+  sim.SetPolicies(BatchPolicy::FOLLOW_BALL_Y, BatchPolicy::FOLLOW_BALL_Y);
+  sim.SetKernel(kernel);
+
+  FollowBallYController left_controller;
+  FollowBallYController right_controller;
+  GameBoard reference;
+  reference.SetLeftController(&left_controller);
+  reference.SetRightController(&right_controller);
+
+  for (int tick = 0; tick < FLAGS_ticks; ++tick) {
+    auto before = std::chrono::steady_clock::now();
+    sim.Step(seconds_per_tick);
+    sim.ServeFinishedBoards();
+    result.simulate_secs += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - before).count();
+
+    if (FLAGS_verify) {
+      reference.Update(seconds_per_tick);
+      if (reference.IsGameOver()) {
+        reference.SetupNewGame();
+      }
+      CheckBoardsMatch(sim, 0, reference, tick);
+    }
+  }
+  return result;
+}
+
+void PrintResult(BatchKernel kernel, const SimulationResult& result) {
+  const BatchSimulator& sim = *result.sim;
+  int64_t points = 0;
+  for (int i = 0; i < sim.NumBoards(); ++i) {
+    points += sim.left_score_[i] + sim.right_score_[i];
+  }
+  double board_ticks = static_cast<double>(FLAGS_boards) * FLAGS_ticks;
+  std::cout << format("kernel=%s boards=%d ticks=%d time=%.3fs\n") % kernel %
+                   FLAGS_boards % FLAGS_ticks % result.simulate_secs
+            << format("board_ticks/s=%.4g returns/s=%.4g points/s=%.4g\n") %
+                   (board_ticks / result.simulate_secs) %
+                   (sim.paddle_bounces_ / result.simulate_secs) %
+                   (points / result.simulate_secs);
+}
+
+// Fails unless every array of `a` is bit-for-bit equal to the same array of
+// `b`.
+void CheckSimulatorsMatch(const BatchSimulator& a, BatchKernel a_kernel,
+                          const BatchSimulator& b, BatchKernel b_kernel) {
+  CHECK(a.ball_x_ == b.ball_x_ && a.ball_y_ == b.ball_y_ &&
+        a.ball_vx_ == b.ball_vx_ && a.ball_vy_ == b.ball_vy_ &&
+        a.left_paddle_y_ == b.left_paddle_y_ &&
+        a.right_paddle_y_ == b.right_paddle_y_ &&
+        a.paddle_speed_ == b.paddle_speed_ &&
+        a.left_score_ == b.left_score_ && a.right_score_ == b.right_score_ &&
+        a.game_over_ == b.game_over_ &&
+        a.paddle_bounces_ == b.paddle_bounces_)
+      << "Kernel " << a_kernel << " disagrees with kernel " << b_kernel;
+}
+
+void RunAllKernels() {
+  std::vector<BatchKernel> kernels;
+  for (BatchKernel kernel :
+       {BatchKernel::SCALAR, BatchKernel::SSE2, BatchKernel::AVX2}) {
+    if (BatchKernelSupported(kernel)) {
+      kernels.push_back(kernel);
+    }
+  }
+
+  SimulationResult scalar = RunSimulation(BatchKernel::SCALAR);
+  PrintResult(BatchKernel::SCALAR, scalar);
+  for (BatchKernel kernel : kernels) {
+    if (kernel == BatchKernel::SCALAR) {
+      continue;
+    }
+    SimulationResult result = RunSimulation(kernel);
+    PrintResult(kernel, result);
+    CheckSimulatorsMatch(*result.sim, kernel, *scalar.sim, BatchKernel::SCALAR);
+    std::cout << format("%s: %.2fx scalar, final state identical\n") %
+                     kernel % (scalar.simulate_secs / result.simulate_secs);
+  }
+}
+
+// Times `op` over `iterations` calls, in nanoseconds per call.
+template <typename Op>
+double TimeNs(int64_t iterations, Op op) {
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < iterations; ++i) {
+    op(i);
+  }
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+void BenchmarkControllers() {
+  const double seconds_per_tick = 1.0 / FLAGS_tick_hz;
+  for (const std::string& name : AiControllerNames()) {
+    std::unique_ptr<PaddleController> left = NewAiController(name);
+    std::unique_ptr<PaddleController> right = NewAiController(name);
+    GameBoard game;
+    game.SetLeftController(left.get());
+    game.SetRightController(right.get());
+    int points = 0;
+    double ns = TimeNs(FLAGS_ticks, [&](int64_t tick) {
+      game.Update(seconds_per_tick);
+      if (game.IsGameOver()) {
+        ++points;
+        game.SetupNewGame();
+      }
+    });
+    // Better controllers keep rallies going for longer.
+    std::cout << format("%-14s %7.1fns/tick %8.1f ticks/point\n") % name %
+                     ns % (static_cast<double>(FLAGS_ticks) /
+                           std::max(points, 1));
+  }
+}
+
+void BenchmarkSearch() {
+  const double seconds_per_tick = 1.0 / FLAGS_tick_hz;
+  SearchParams params;
+  params.seconds_per_tick = seconds_per_tick;
+  params.time_budget_secs = FLAGS_search_budget_ms / 1000;
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    // Search for the right paddle from every plan's worth of positions in a
+    // game between two simple AIs, so every thread count sees the same ones.
+    util::ThreadPool pool(threads);
+    SearchController search(params, &pool);
+    FollowBallYController left_controller;
+    FollowBallYController right_controller;
+    GameBoard game;
+    game.SetLeftController(&left_controller);
+    game.SetRightController(&right_controller);
+    for (int tick = 0; tick < FLAGS_ticks; ++tick) {
+      if (tick % params.segment_ticks == 0) {
+        search.Search(game, false);
+      }
+      game.Update(seconds_per_tick);
+      if (game.IsGameOver()) {
+        game.SetupNewGame();
+      }
+    }
+    std::cout << format("threads=%d %s\n") % threads % search.GetStats();
+  }
+}
+
+void BenchmarkVecEnv() {
+  VecEnvParams params;
+  params.num_envs = FLAGS_boards;
+  params.seconds_per_tick = 1.0 / FLAGS_tick_hz;
+  VecEnv env(params);
+
+  // Buffers are set up once, as a trainer would.
+  const int n = env.NumEnvs();
+  std::vector<uint64_t> seeds(n);
+  for (int i = 0; i < n; ++i) {
+    seeds[i] = i;
+  }
+  std::vector<float> observations(n * VecEnv::kObservationSize);
+  std::vector<int32_t> actions(n);
+  std::vector<float> rewards(n);
+  std::vector<uint8_t> dones(n);
+  env.Reset(seeds.data(), observations.data());
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int32_t> action(0, VecEnv::kNumActions - 1);
+  int64_t episodes = 0;
+  double step_secs = 0;
+  for (int step = 0; step < FLAGS_ticks; ++step) {
+    for (int32_t& a : actions) {
+      a = action(rng);
+    }
+    auto before = std::chrono::steady_clock::now();
+    env.Step(actions.data(), observations.data(), rewards.data(),
+             dones.data());
+    step_secs += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - before).count();
+    for (uint8_t done : dones) {
+      episodes += done;
+    }
+  }
+  std::cout << format("envs=%d steps=%d time=%.3fs env_steps/s=%.4g "
+                      "episodes=%d\n") %
+                   n % FLAGS_ticks % step_secs %
+                   (static_cast<double>(n) * FLAGS_ticks / step_secs) %
+                   episodes;
+}
+
+// Interpolates between boxes and maps them to pixels, as the renderer does
+// for every piece every frame, and returns a checksum of the pixel rects.
+template <typename T>
+int64_t TransformBoxes(const BoundingBoxVector<T>& from,
+                       const BoundingBoxVector<T>& to, T alpha) {
+  typedef Eigen::Matrix<T, 2, 1> Vector2;
+  ScreenTransformT<T> to_px(Vector2(0, 0), Vector2(640, 480));
+  int64_t sum = 0;
+  for (size_t i = 0; i < from.size(); ++i) {
+    sum += to_px.Apply(Lerp(from[i], to[i], alpha)).packed.template cast<int>()
+               .sum();
+  }
+  return sum;
+}
+
+// The same, one coordinate at a time, for comparison.
+int64_t TransformBoxesScalar(const BoundingBoxVector<double>& from,
+                             const BoundingBoxVector<double>& to,
+                             double alpha) {
+  int64_t sum = 0;
+  for (size_t i = 0; i < from.size(); ++i) {
+    const BoundingBox& a = from[i];
+    const BoundingBox& b = to[i];
+    double left = a.Left() + alpha * (b.Left() - a.Left());
+    double top = a.Top() + alpha * (b.Top() - a.Top());
+    double width = a.Width() + alpha * (b.Width() - a.Width());
+    double height = a.Height() + alpha * (b.Height() - a.Height());
+    sum += static_cast<int>(left * 640) + static_cast<int>(top * 480) +
+           static_cast<int>(width * 640) + static_cast<int>(height * 480);
+  }
+  return sum;
+}
+
+void BenchmarkGeometry() {
+  const double seconds_per_tick = 1.0 / FLAGS_tick_hz;
+  GameBoard game;
+  double update_ns = TimeNs(FLAGS_ticks * 100, [&](int64_t tick) {
+    game.ball_.Update(seconds_per_tick);
+    if (game.IsGameOver()) {
+      game.SetupNewGame();
+    }
+  });
+
+  // Boxes scattered over the board, like game pieces between two ticks.
+  const int num_boxes = 4096;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> coord(0, 1);
+  BoundingBoxVector<double> from, to;
+  for (int i = 0; i < num_boxes; ++i) {
+    from.emplace_back(coord(rng), coord(rng), 0.05, 0.15);
+    to.emplace_back(coord(rng), coord(rng), 0.05, 0.15);
+  }
+  BoundingBoxVector<float> from_f, to_f;
+  for (int i = 0; i < num_boxes; ++i) {
+    from_f.push_back(from[i].Cast<float>());
+    to_f.push_back(to[i].Cast<float>());
+  }
+
+  const int64_t rounds = std::max(1, FLAGS_ticks / 10);
+  volatile int64_t sink = 0;
+  double scalar_ns = TimeNs(rounds, [&](int64_t i) {
+    sink = sink + TransformBoxesScalar(from, to, 0.5);
+  }) / num_boxes;
+  double double_ns = TimeNs(rounds, [&](int64_t i) {
+    sink = sink + TransformBoxes(from, to, 0.5);
+  }) / num_boxes;
+  double float_ns = TimeNs(rounds, [&](int64_t i) {
+    sink = sink + TransformBoxes(from_f, to_f, 0.5f);
+  }) / num_boxes;
+
+  std::cout << format("sizeof(BoundingBox)=%d alignof=%d "
+                      "sizeof(BoundingBoxF)=%d alignof=%d\n") %
+                   sizeof(BoundingBox) % alignof(BoundingBox) %
+                   sizeof(BoundingBoxF) % alignof(BoundingBoxF)
+            << format("ball_update=%.1fns\n") % update_ns
+            << format("box_transform: scalar=%.2fns double=%.2fns "
+                      "float=%.2fns\n") %
+                   scalar_ns % double_ns % float_ns;
+}
+
+// Ticks per second of a chaos mode board.
+double TimeMultiBall(Broadphase broadphase, int ticks, MultiBallBoard* board) {
+  FollowBallYController left_controller;
+  FollowBallYController right_controller;
+  board->SetLeftController(&left_controller);
+  board->SetRightController(&right_controller);
+  board->SetBroadphase(broadphase);
+  double ns = TimeNs(ticks, [&](int64_t tick) {
+    board->Update(1.0 / FLAGS_tick_hz);
+  });
+  return 1e9 / ns;
+}
+
+void BenchmarkMultiBall() {
+  // Checking every pair gets slow fast, so stop timing it past this.
+  const int kMaxBruteForceBalls = 4096;
+  for (int num_balls = 64; num_balls <= FLAGS_max_balls; num_balls *= 4) {
+    // Roughly the same amount of work for each ball count.
+    int ticks = std::max<int64_t>(10, int64_t{FLAGS_ticks} * 64 / num_balls);
+    std::cout << format("balls=%-6d ticks=%-6d") % num_balls % ticks;
+    std::unique_ptr<MultiBallBoard> reference;
+    for (Broadphase broadphase : {Broadphase::GRID, Broadphase::SWEEP_AND_PRUNE,
+                                  Broadphase::BRUTE_FORCE}) {
+      if (broadphase == Broadphase::BRUTE_FORCE &&
+          num_balls > kMaxBruteForceBalls) {
+        continue;
+      }
+      auto board = util::make_unique<MultiBallBoard>(num_balls, 1);
+      double hz = TimeMultiBall(broadphase, ticks, board.get());
+      std::cout << format(" %s=%.4g ticks/s (%.0fns/ball)") % broadphase % hz %
+                       (1e9 / hz / num_balls);
+      if (!reference) {
+        reference = std::move(board);
+        continue;
+      }
+      // Every broadphase finds the same pairs, so the boards must be exactly
+      // the same.
+      for (int i = 0; i < num_balls; ++i) {
+        const MultiBall& a = reference->Balls()[i];
+        const MultiBall& b = board->Balls()[i];
+        CHECK(a.bounds.packed == b.bounds.packed && a.velocity == b.velocity)
+            << broadphase << " disagrees with " << Broadphase::GRID
+            << " about ball " << i << " of " << num_balls;
+      }
+    }
+    const MultiBallBoard::Stats& stats = reference->GetStats();
+    std::cout << format(" collisions/tick=%.1f\n") %
+                     (static_cast<double>(stats.ball_collisions) / ticks);
+  }
+}
+
+void BenchmarkSnapshots() {
+  // Something to snapshot which isn't just a fresh board.
+  FollowBallYController left_controller;
+  FollowBallYController right_controller;
+  GameBoard game;
+  game.SetLeftController(&left_controller);
+  game.SetRightController(&right_controller);
+  for (int tick = 0; tick < 1000; ++tick) {
+    game.Update(1.0 / FLAGS_tick_hz);
+  }
+
+  const int64_t iterations = FLAGS_ticks * 100;
+  std::vector<GameBoardState> states(1024);
+  double save_ns = TimeNs(iterations, [&](int64_t i) {
+    states[i % states.size()] = game.Save();
+  });
+  double restore_ns = TimeNs(iterations, [&](int64_t i) {
+    game.Restore(states[i % states.size()]);
+  });
+  GameBoardState copy;
+  double memcpy_ns = TimeNs(iterations, [&](int64_t i) {
+    memcpy(&copy, &states[i % states.size()], sizeof(copy));
+  });
+  RewindBuffer rewind(states.size());
+  double push_ns = TimeNs(iterations, [&](int64_t i) { rewind.Push(game); });
+  double pop_ns = TimeNs(rewind.Size(), [&](int64_t i) { rewind.Pop(&game); });
+
+  // Restoring what was saved has to give back exactly the same board.
+  GameBoardState before = game.Save();
+  game.Restore(before);
+  GameBoardState after = game.Save();
+  CHECK(memcmp(&before, &after, sizeof(before)) == 0)
+      << "Restore() did not give back the saved board";
+
+  std::cout << format("sizeof(GameBoardState)=%d bytes\n") %
+                   sizeof(GameBoardState)
+            << format("save=%.1fns restore=%.1fns memcpy=%.1fns\n") %
+                   save_ns % restore_ns % memcpy_ns
+            << format("rewind_push=%.1fns rewind_pop=%.1fns\n") % push_ns %
+                   pop_ns;
+}
+
+}  // namespace
+}  // namespace pong
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  CHECK(FLAGS_boards > 0) << "--boards must be positive";
+  CHECK(FLAGS_tick_hz > 0) << "--tick_hz must be positive";
+
+  if (FLAGS_benchmark_controllers) {
+    pong::BenchmarkControllers();
+    return 0;
+  }
+  if (FLAGS_benchmark_search) {
+    pong::BenchmarkSearch();
+    return 0;
+  }
+  if (FLAGS_benchmark_vec_env) {
+    pong::BenchmarkVecEnv();
+    return 0;
+  }
+  if (FLAGS_benchmark_geometry) {
+    pong::BenchmarkGeometry();
+    return 0;
+  }
+  if (FLAGS_benchmark_multi_ball) {
+    pong::BenchmarkMultiBall();
+    return 0;
+  }
+  if (FLAGS_benchmark_snapshots) {
+    pong::BenchmarkSnapshots();
+    return 0;
+  }
+  if (FLAGS_kernel == "all") {
+    pong::RunAllKernels();
+  } else {
+    pong::BatchKernel kernel = pong::BestBatchKernel();
+    if (FLAGS_kernel != "best") {
+      CHECK(pong::ParseBatchKernel(FLAGS_kernel, &kernel))
+          << "Unknown --kernel: " << FLAGS_kernel;
+    }
+    pong::PrintResult(kernel, pong::RunSimulation(kernel));
+  }
+  if (FLAGS_verify) {
+    std::cout << "verify: board 0 matched GameBoard for every tick\n";
+  }
+
+  return 0;
+}
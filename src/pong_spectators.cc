@@ -0,0 +1,161 @@
+// Streams an AI game to thousands of spectators over localhost, all in one
+// process, and reports what the server costs: the fraction of a core it would
+// take at the real broadcast rate, and the bandwidth per spectator. Checks
+// that every spectator ends up seeing exactly the server's last frame.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "controller.h"
+#include "game.h"
+#include "spectator.h"
+#include "util.h"
+
+DEFINE_int32(spectators, 10000,
+             "Spectators to serve. Each has its own socket, so this is "
+             "limited by `ulimit -n`.");
+DEFINE_int32(broadcasts, 600, "Frames to broadcast.");
+DEFINE_double(tick_hz, 240, "Simulation ticks per second.");
+DEFINE_int32(broadcast_every_ticks, 12,
+             "Ticks between broadcasts; 12 at 240Hz is 20 frames a second, "
+             "which spectators interpolate between.");
+DEFINE_int32(poll_every_spectators, 1000,
+             "How many spectators to poll between taking in the server's "
+             "acknowledgements.");
+DEFINE_string(left, "follow_ball_y", "Controller for the left paddle.");
+DEFINE_string(right, "predictive", "Controller for the right paddle.");
+
+using ::boost::format;
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::unique_ptr<pong::PaddleController> NewController(
+    const std::string& name) {
+  std::unique_ptr<pong::PaddleController> controller =
+      pong::NewAiController(name);
+  CHECK(controller) << "Unknown controller '" << name
+                    << "'. Known controllers: "
+                    << boost::algorithm::join(pong::AiControllerNames(), ", ");
+  return controller;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK(FLAGS_tick_hz > 0) << "--tick_hz must be positive";
+  CHECK(FLAGS_broadcast_every_ticks > 0)
+      << "--broadcast_every_ticks must be positive";
+  CHECK(FLAGS_poll_every_spectators > 0)
+      << "--poll_every_spectators must be positive";
+
+  pong::GameBoard game;
+  std::mt19937_64 rng(1);
+  std::unique_ptr<pong::PaddleController> left = NewController(FLAGS_left);
+  std::unique_ptr<pong::PaddleController> right = NewController(FLAGS_right);
+  game.SetLeftController(left.get());
+  game.SetRightController(right.get());
+
+  pong::SpectatorServer server(0);
+  std::vector<std::unique_ptr<pong::SpectatorClient>> spectators;
+  for (int i = 0; i < FLAGS_spectators; ++i) {
+    spectators.push_back(util::make_unique<pong::SpectatorClient>(
+        "127.0.0.1", server.LocalPort()));
+  }
+
+  // Only time spent in the server counts; the spectators would be on other
+  // machines.
+  Clock::duration server_time(0);
+  auto PollSpectators = [&]() {
+    for (size_t i = 0; i < spectators.size(); ++i) {
+      spectators[i]->Poll();
+      if ((i + 1) % FLAGS_poll_every_spectators == 0) {
+        auto start = Clock::now();
+        server.Poll();
+        server_time += Clock::now() - start;
+      }
+    }
+    auto start = Clock::now();
+    server.Poll();
+    server_time += Clock::now() - start;
+  };
+
+  const double seconds_per_tick = 1 / FLAGS_tick_hz;
+  // Lets the spectators' joins in, so the first broadcast reaches everyone.
+  PollSpectators();
+  auto start = Clock::now();
+  for (int i = 0; i < FLAGS_broadcasts; ++i) {
+    for (int tick = 0; tick < FLAGS_broadcast_every_ticks; ++tick) {
+      if (game.IsGameOver()) {
+        game.SetupNewGame(pong::RandomServeDirection(&rng));
+      }
+      game.Update(seconds_per_tick);
+    }
+    auto broadcast_start = Clock::now();
+    server.Broadcast(game);
+    server_time += Clock::now() - broadcast_start;
+    PollSpectators();
+  }
+  double wall_secs = SecondsSince(start);
+
+  const pong::SpectatorServer::Stats& stats = server.GetStats();
+  double server_secs = std::chrono::duration<double>(server_time).count();
+  double broadcast_hz = FLAGS_tick_hz / FLAGS_broadcast_every_ticks;
+  double game_secs = stats.broadcasts / broadcast_hz;
+  double spectator_secs = static_cast<double>(FLAGS_spectators) * game_secs;
+  std::cout << "server: " << stats << "\n"
+            << format("%d broadcasts to %d spectators in %.2fs "
+                      "(%.2fs in the server)\n") %
+                   stats.broadcasts % FLAGS_spectators % wall_secs %
+                   server_secs
+            << format("At %.0f broadcasts/second the server needs %.1f%% of "
+                      "a core, %.1fus per spectator per second\n") %
+                   broadcast_hz % (100 * server_secs / game_secs) %
+                   (1e6 * server_secs / spectator_secs)
+            << format("Per spectator: %.0f bytes/second down, %.0f up "
+                      "(UDP payload)\n") %
+                   (stats.bytes_sent / spectator_secs) %
+                   (5 * stats.acks_received / spectator_secs);  // 5-byte acks
+
+  // Every spectator should have the last frame, unless the kernel dropped it.
+  pong::SpectatorFrame expected =
+      pong::QuantizeBoard(game, stats.broadcasts - 1);
+  int behind = 0;
+  int wrong = 0;
+  int64_t undecodable = 0;
+  for (const auto& spectator : spectators) {
+    undecodable += spectator->GetStats().undecodable;
+    const pong::SpectatorFrame& latest = spectator->Latest();
+    if (latest.number != expected.number) {
+      ++behind;
+    } else if (!std::equal(latest.fields,
+                           latest.fields + pong::SpectatorFrame::kNumFields,
+                           expected.fields)) {
+      ++wrong;
+    }
+  }
+  std::cout << format("Spectators behind: %d, undecodable packets: %d\n") %
+                   behind % undecodable;
+  if (wrong > 0) {
+    std::cout << format("MISMATCH: %d spectators decoded the last frame "
+                        "wrongly\n") %
+                     wrong;
+    return 1;
+  }
+  std::cout << "Every up to date spectator's frame matches the server's\n";
+  return 0;
+}
@@ -0,0 +1,122 @@
+// Plays a round-robin tournament between AI controllers on every core, and
+// prints who beat whom.
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/format.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "controller.h"
+#include "thread_pool.h"
+#include "tournament.h"
+
+DEFINE_string(controllers, "none,follow_ball_y",
+              "Comma-separated list of controllers to play against each "
+              "other.");
+DEFINE_int32(matches_per_pair, 100,
+             "Matches for each ordered pair of controllers.");
+DEFINE_int32(points_to_win, 5, "Points needed to win a match.");
+DEFINE_int32(threads, 0, "Worker threads. 0 means one per hardware thread.");
+DEFINE_uint64(seed, 1, "Base seed for every match's random serves.");
+DEFINE_string(match_stats_file, "",
+              "If set, write a CSV line for every match to this file.");
+DEFINE_string(replay_dir, "",
+              "If set, record every match to <replay_dir>/match_<n>.pongreplay, "
+              "where n is the match's row in --match_stats_file.");
+
+using ::boost::format;
+
+namespace pong {
+namespace {
+
+void WriteMatchStats(const TournamentResult& result, std::ostream& out) {
+  out << "match,left,right,seed,winner,left_score,right_score,ticks,"
+         "wall_secs\n";
+  for (size_t m = 0; m < result.matches.size(); ++m) {
+    const MatchResult& match = result.matches[m];
+    out << format("%d,%s,%s,%d,%s,%d,%d,%d,%.6f\n") % m %
+               match.params.left_controller % match.params.right_controller %
+               match.params.seed % match.winner % match.left_score %
+               match.right_score % match.ticks % match.wall_secs;
+  }
+}
+
+void PrintWinMatrix(const TournamentResult& result) {
+  size_t width = 6;
+  for (const std::string& name : result.controllers) {
+    width = std::max(width, name.size());
+  }
+  std::string cell = "%" + std::to_string(width + 2) + "s";
+
+  std::cout << "wins (row beat column):\n" << format(cell) % "";
+  for (const std::string& name : result.controllers) {
+    std::cout << format(cell) % name;
+  }
+  std::cout << format(cell) % "total" << "\n";
+
+  for (size_t i = 0; i < result.controllers.size(); ++i) {
+    std::cout << format(cell) % result.controllers[i];
+    int total = 0;
+    for (size_t j = 0; j < result.controllers.size(); ++j) {
+      if (i == j) {
+        std::cout << format(cell) % "-";
+      } else {
+        std::cout << format(cell) % result.wins[i][j];
+        total += result.wins[i][j];
+      }
+    }
+    std::cout << format(cell) % total << "\n";
+  }
+}
+
+}  // namespace
+}  // namespace pong
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  pong::TournamentParams params;
+  boost::algorithm::split(params.controllers, FLAGS_controllers,
+                          [](char c) { return c == ','; });
+  for (const std::string& name : params.controllers) {
+    CHECK(pong::NewAiController(name))
+        << "Unknown controller '" << name << "'. Known controllers: "
+        << boost::algorithm::join(pong::AiControllerNames(), ", ");
+  }
+  CHECK(params.controllers.size() >= 2) << "Need at least two controllers";
+  params.matches_per_pair = FLAGS_matches_per_pair;
+  params.points_to_win = FLAGS_points_to_win;
+  params.seed = FLAGS_seed;
+  params.replay_dir = FLAGS_replay_dir;
+
+  util::ThreadPool pool(FLAGS_threads);
+  LOG(INFO) << "Running tournament on " << pool.NumThreads() << " threads";
+  pong::TournamentResult result = pong::RunTournament(params, &pool);
+
+  pong::PrintWinMatrix(result);
+  int64_t ticks = 0;
+  for (const pong::MatchResult& match : result.matches) {
+    ticks += match.ticks;
+  }
+  std::cout << format("%d matches in %.3fs on %d threads: %.1f matches/s, "
+                      "%.4g ticks/s\n") %
+                   result.matches.size() % result.wall_secs %
+                   pool.NumThreads() %
+                   (result.matches.size() / result.wall_secs) %
+                   (ticks / result.wall_secs);
+
+  if (!FLAGS_match_stats_file.empty()) {
+    std::ofstream out(FLAGS_match_stats_file);
+    CHECK(out) << "Could not open " << FLAGS_match_stats_file;
+    pong::WriteMatchStats(result, out);
+  }
+
+  return 0;
+}
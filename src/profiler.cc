@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <boost/format.hpp>
+
+#include "profiler.h"
+
+namespace pong {
+
+namespace {
+// Every thread's profiler, in the order they were created.
+struct ProfilerRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<FrameProfiler>> profilers;
+};
+
+ProfilerRegistry& GetRegistry() {
+  static ProfilerRegistry registry;
+  return registry;
+}
+}  // namespace
+
+constexpr int FrameProfiler::kCapacity;
+
+FrameProfiler* FrameProfiler::Get() {
+  static thread_local FrameProfiler* profiler = nullptr;
+  if (profiler == nullptr) {
+    ProfilerRegistry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    int tid = static_cast<int>(registry.profilers.size()) + 1;
+    registry.profilers.emplace_back(new FrameProfiler(tid));
+    profiler = registry.profilers.back().get();
+  }
+  return profiler;
+}
+
+FrameProfiler::FrameProfiler(int tid) : tid_(tid), events_(kCapacity) {}
+
+void FrameProfiler::SetThreadName(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  thread_name_ = name;
+}
+
+std::vector<FrameProfiler::Event> FrameProfiler::Events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Event> events;
+  events.reserve(size_);
+  int oldest = (next_ - size_ + kCapacity) % kCapacity;
+  for (int i = 0; i < size_; ++i) {
+    events.push_back(events_[(oldest + i) % kCapacity]);
+  }
+  return events;
+}
+
+std::string FrameProfiler::Summary() const {
+  // Group durations by phase. Phases are listed in order of first appearance.
+  std::vector<std::string> names;
+  std::map<std::string, std::vector<double>> durations_ms;
+  for (const Event& event : Events()) {
+    std::vector<double>& durations = durations_ms[event.name];
+    if (durations.empty()) {
+      names.push_back(event.name);
+    }
+    durations.push_back(
+        std::chrono::duration<double, std::milli>(event.end - event.start)
+            .count());
+  }
+
+  std::ostringstream summary;
+  for (const std::string& name : names) {
+    std::vector<double>& durations = durations_ms[name];
+    std::sort(durations.begin(), durations.end());
+    auto percentile = [&durations](double p) {
+      return durations[static_cast<size_t>(p * (durations.size() - 1))];
+    };
+    if (summary.tellp() > 0) {
+      summary << " | ";
+    }
+    summary << boost::format("%s p50=%.3fms p99=%.3fms max=%.3fms") % name %
+                   percentile(0.5) % percentile(0.99) % durations.back();
+  }
+  return summary.str();
+}
+
+bool FrameProfiler::WriteChromeTrace(const std::string& path) {
+  std::ofstream out(path);
+  if (!out) {
+    return false;
+  }
+
+  ProfilerRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  out << "{\"traceEvents\":[\n";
+  const char* separator = "";
+  for (const std::unique_ptr<FrameProfiler>& profiler : registry.profilers) {
+    // "M" events are metadata, here naming the thread.
+    std::string thread_name;
+    {
+      std::lock_guard<std::mutex> profiler_lock(profiler->mutex_);
+      thread_name = profiler->thread_name_;
+    }
+    if (!thread_name.empty()) {
+      out << boost::format("%s{\"name\":\"thread_name\",\"ph\":\"M\","
+                           "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}") %
+                 separator % profiler->tid_ % thread_name;
+      separator = ",\n";
+    }
+    // "X" events are complete events: a start time plus a duration, both in
+    // microseconds. steady_clock is the same on every thread, so the
+    // threads line up.
+    for (const Event& event : profiler->Events()) {
+      double ts_us = std::chrono::duration<double, std::micro>(
+                         event.start.time_since_epoch()).count();
+      double dur_us =
+          std::chrono::duration<double, std::micro>(event.end - event.start)
+              .count();
+      out << boost::format("%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                           "\"dur\":%.3f,\"pid\":1,\"tid\":%d}") %
+                 separator % event.name % ts_us % dur_us % profiler->tid_;
+      separator = ",\n";
+    }
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return static_cast<bool>(out);
+}
+
+}  // namespace pong
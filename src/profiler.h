@@ -0,0 +1,115 @@
+// Lightweight instrumentation for finding out where frame time goes.
+//
+// Wrap a phase of work in PROFILE_SCOPE("Name") and its duration gets
+// recorded into a fixed-size ring buffer, from which FrameProfiler can
+// summarize recent timings or dump a Chrome trace (load it in
+// chrome://tracing or https://ui.perfetto.dev).
+//
+// PROFILE_SCOPE compiles to nothing unless PONG_PROFILING is defined
+// (`make PROFILE=1`), so instrumentation can be left in hot code.
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace pong {
+
+// Holds the most recent kCapacity timed phases of one thread. Only that
+// thread records into it, but any thread may read it.
+class FrameProfiler {
+ public:
+  static constexpr int kCapacity = 1 << 14;
+
+  // The profiler which PROFILE_SCOPE records into. Each thread gets its own,
+  // so e.g. the simulation thread's phases don't end up in the main loop's
+  // summary. They live until the program exits, so a thread's phases are
+  // still in the trace after it has finished.
+  static FrameProfiler* Get();
+
+  // Writes every thread's profiler in Chrome's trace_event JSON format, each
+  // as a thread of its own. Returns false if the file couldn't be written.
+  static bool WriteChromeTrace(const std::string& path);
+
+  // Labels this profiler's thread in the trace.
+  void SetThreadName(const std::string& name);
+
+  // `name` must outlive the profiler; in practice it's a string literal.
+  void Record(const char* name, std::chrono::steady_clock::time_point start,
+              std::chrono::steady_clock::time_point end) {
+    // Only contended while a trace is being written.
+    std::lock_guard<std::mutex> lock(mutex_);
+    Event& event = events_[next_];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    next_ = (next_ + 1) % kCapacity;
+    size_ += (size_ < kCapacity);
+  }
+
+  // One line with p50, p99 and max duration of each phase in the buffer.
+  std::string Summary() const;
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_ = size_ = 0;
+  }
+
+ private:
+  struct Event {
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+  };
+
+  explicit FrameProfiler(int tid);
+  // The buffered events, oldest first.
+  std::vector<Event> Events() const;
+
+  const int tid_;  // in the trace; 1 for the first thread to profile
+  mutable std::mutex mutex_;  // guards everything below
+  std::string thread_name_;
+  std::vector<Event> events_;
+  int next_ = 0;  // where the next event goes
+  int size_ = 0;  // number of valid events
+
+  DISALLOW_COPY_AND_ASSIGN(FrameProfiler);
+};
+
+// Records the time between its construction and destruction into
+// FrameProfiler::Get(). Use it through PROFILE_SCOPE.
+class ScopedPhaseTimer {
+ public:
+  explicit ScopedPhaseTimer(const char* name)
+      : name_(name), start_(std::chrono::steady_clock::now()) {}
+  ~ScopedPhaseTimer() {
+    FrameProfiler::Get()->Record(name_, start_,
+                                 std::chrono::steady_clock::now());
+  }
+
+ private:
+  const char* name_;
+  std::chrono::steady_clock::time_point start_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedPhaseTimer);
+};
+
+}  // namespace pong
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef PONG_PROFILING
+#define PROFILE_SCOPE(name) \
+  ::pong::ScopedPhaseTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#endif
+
+#endif  // PROFILER_H_
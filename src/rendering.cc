@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <array>
+
 #include <Eigen/Dense>
 #include <SDL_ttf.h>
 #include <boost/format.hpp>
@@ -8,64 +11,218 @@
 namespace pong {
 
 namespace {
-// converts a pong::BoundingBox to an SDL_Rect.
-// `scale` defines the number of screen pixels per game unit.
-// `origin` defines the on-screen pixel location of the game-world origin.
-SDL_Rect BoundsToSdlRect(const BoundingBox& bounds,
-                         const Eigen::Vector2d& origin,
-                         const Eigen::Vector2d& scale) {
-  return {
-    static_cast<int>(bounds.Left() * scale.x() + origin.x()),
-    static_cast<int>(bounds.Top() * scale.y() + origin.y()),
-    static_cast<int>(bounds.Width() * scale.x()),
-    static_cast<int>(bounds.Height() * scale.y()),
-  };
+// Converts a box which has already been mapped to pixels to an SDL_Rect.
+SDL_Rect ToSdlRect(const BoundingBox& px) {
+  Eigen::Vector4i rect = px.packed.cast<int>();
+  return {rect[0], rect[1], rect[2], rect[3]};
 }
 }  // namespace
 
+PieceBounds PieceBoundsOf(const GameBoard& game) {
+  return {game.ball_.bounds_, game.left_paddle_.bounds_,
+          game.right_paddle_.bounds_};
+}
 
-// NOTE on variable names: px := pixel(s), gu := game_unit(s)
 void RenderGameToSdlSurface(const GameBoard& game, SDL_Surface* surface) {
-  // Clear screen w/ black color
-  SDL_FillRect(surface, nullptr,
-               SDL_MapRGB(surface->format, 0, 0, 0));
+  RenderGameToSdlSurface(game, PieceBoundsOf(game), 1.0, surface);
+}
 
+namespace {
+// Everything which gets drawn in white, in drawing order. The rest of the
+// surface is black.
+enum ScenePiece {
+  kBall,
+  kLeftPaddle,
+  kRightPaddle,
+  kMiddleLine,
+  kNumScenePieces,
+};
+typedef std::array<SDL_Rect, kNumScenePieces> SceneRects;
+static_assert(kNumScenePieces == DirtyRectRenderer::kNumPieces,
+              "DirtyRectRenderer needs updating for the new scene pieces");
+
+// NOTE on variable names: px := pixel(s), gu := game_unit(s)
+SceneRects LayoutScene(const GameBoard& game, const PieceBounds& previous,
+                       double alpha, const SDL_Surface* surface) {
+  PieceBounds current = PieceBoundsOf(game);
   Eigen::Vector2d px_per_gu = {surface->w / game.bounds_.Width(),
                                surface->h / game.bounds_.Height()};
-  Eigen::Vector2d origin_px = {game.bounds_.top_left.x() * px_per_gu.x(),
-                               game.bounds_.top_left.y() * px_per_gu.y()};
-
-  // Fill in a white rect for the ball
-  SDL_Rect rect = BoundsToSdlRect(game.ball_.bounds_, origin_px, px_per_gu);
-  SDL_FillRect(surface, &rect,
-               SDL_MapRGB(surface->format, 0xFF, 0xFF, 0xFF));
-
-  // Fill in a white rect for the left paddle
-  rect =
-      BoundsToSdlRect(game.left_paddle_.bounds_, origin_px, px_per_gu);
-  SDL_FillRect(surface, &rect,
-               SDL_MapRGB(surface->format, 0xFF, 0xFF, 0xFF));
-
-  // Fill in a white rect for the right paddle
-  rect =
-      BoundsToSdlRect(game.right_paddle_.bounds_, origin_px, px_per_gu);
-  SDL_FillRect(surface, &rect,
-               SDL_MapRGB(surface->format, 0xFF, 0xFF, 0xFF));
+  Eigen::Vector2d origin_px =
+      game.bounds_.top_left().cwiseProduct(px_per_gu);
+  ScreenTransform to_px(origin_px, px_per_gu);
+
+  SceneRects rects;
+  rects[kBall] =
+      ToSdlRect(to_px.Apply(Lerp(previous.ball, current.ball, alpha)));
+  rects[kLeftPaddle] = ToSdlRect(
+      to_px.Apply(Lerp(previous.left_paddle, current.left_paddle, alpha)));
+  rects[kRightPaddle] = ToSdlRect(
+      to_px.Apply(Lerp(previous.right_paddle, current.right_paddle, alpha)));
 
   // White line in the middle.
   int line_width_px =
       (game.ball_.bounds_.Width() / 2) * px_per_gu.x();
   int board_center_x = static_cast<int>(origin_px.x()) + surface->w / 2;
-  SDL_Rect middle_line_rect = {
+  rects[kMiddleLine] = {
       board_center_x - (line_width_px / 2),  // x
       0,                                     // y
       line_width_px,                         // width
       surface->h,                            // height
   };
-  SDL_FillRect(surface, &middle_line_rect,
-               SDL_MapRGB(surface->format, 0xFF, 0xFF, 0xFF));
+  return rects;
+}
+
+bool operator==(const SDL_Rect& a, const SDL_Rect& b) {
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+// Adds `changed` to `dirty_rects` if any of it is on the surface.
+void AddDirtyRect(const SDL_Rect& changed, const SDL_Rect& surface_rect,
+                  std::vector<SDL_Rect>* dirty_rects) {
+  SDL_Rect clipped;
+  if (SDL_IntersectRect(&changed, &surface_rect, &clipped)) {
+    dirty_rects->push_back(clipped);
+  }
+}
+
+// Draws the part of the scene inside `clip`: black, then the white pieces,
+// then the labels on top. The result inside `clip` doesn't depend on what was
+// there before.
+void DrawScene(const SceneRects& rects,
+               const std::vector<const TextLabel*>& labels,
+               const SDL_Rect& clip, SDL_Surface* surface) {
+  SDL_FillRect(surface, &clip, SDL_MapRGB(surface->format, 0, 0, 0));
+  Uint32 white = SDL_MapRGB(surface->format, 0xFF, 0xFF, 0xFF);
+  for (const SDL_Rect& rect : rects) {
+    SDL_Rect overlap;
+    if (SDL_IntersectRect(&rect, &clip, &overlap)) {
+      SDL_FillRect(surface, &overlap, white);
+    }
+  }
+  for (const TextLabel* label : labels) {
+    label->Draw(clip, surface);
+  }
+}
+}  // namespace
+
+void RenderGameToSdlSurface(const GameBoard& game, const PieceBounds& previous,
+                            double alpha, SDL_Surface* surface) {
+  RenderGameToSdlSurface(game, previous, alpha, {}, surface);
+}
+
+void RenderGameToSdlSurface(const GameBoard& game, const PieceBounds& previous,
+                            double alpha,
+                            const std::vector<const TextLabel*>& labels,
+                            SDL_Surface* surface) {
+  SceneRects rects = LayoutScene(game, previous, alpha, surface);
+  SDL_Rect surface_rect = {0, 0, surface->w, surface->h};
+  DrawScene(rects, labels, surface_rect, surface);
+}
+
+void RenderGameToSdlSurface(const GameBoard& game, const PieceBounds& previous,
+                            double alpha,
+                            const std::vector<const TextLabel*>& labels,
+                            TileRasterizer* rasterizer, SDL_Surface* surface) {
+  const SDL_Color kBlack = {0, 0, 0, 0xFF};
+  const SDL_Color kWhite = {0xFF, 0xFF, 0xFF, 0xFF};
+  SceneRects rects = LayoutScene(game, previous, alpha, surface);
+  std::vector<RasterShape> shapes;
+  for (const SDL_Rect& rect : rects) {
+    shapes.push_back(RasterShape::Rect(rect, kWhite));
+  }
+  rasterizer->Draw(shapes, kBlack, surface);
+
+  // Blits share state in the atlas surface, so labels aren't drawn on the
+  // rasterizer's threads.
+  SDL_Rect surface_rect = {0, 0, surface->w, surface->h};
+  for (const TextLabel* label : labels) {
+    label->Draw(surface_rect, surface);
+  }
+}
+
+void RenderMultiBallBoardToSdlSurface(
+    const MultiBallBoard& board, const std::vector<const TextLabel*>& labels,
+    SDL_Surface* surface) {
+  const GameBoard& game = board.Board();
+  SceneRects scene = LayoutScene(game, PieceBoundsOf(game), 1.0, surface);
+  Eigen::Vector2d px_per_gu = {surface->w / game.bounds_.Width(),
+                               surface->h / game.bounds_.Height()};
+  ScreenTransform to_px(game.bounds_.top_left().cwiseProduct(px_per_gu),
+                        px_per_gu);
+
+  // One SDL call for all the balls. Small balls are still drawn at least a
+  // pixel across.
+  std::vector<SDL_Rect> rects(scene.begin() + kLeftPaddle, scene.end());
+  rects.reserve(rects.size() + board.Balls().size());
+  for (const MultiBall& ball : board.Balls()) {
+    SDL_Rect rect = ToSdlRect(to_px.Apply(ball.bounds));
+    rect.w = std::max(rect.w, 1);
+    rect.h = std::max(rect.h, 1);
+    rects.push_back(rect);
+  }
+
+  SDL_Rect surface_rect = {0, 0, surface->w, surface->h};
+  SDL_FillRect(surface, &surface_rect, SDL_MapRGB(surface->format, 0, 0, 0));
+  SDL_FillRects(surface, rects.data(), rects.size(),
+                SDL_MapRGB(surface->format, 0xFF, 0xFF, 0xFF));
+  for (const TextLabel* label : labels) {
+    label->Draw(surface_rect, surface);
+  }
+}
+
+void DirtyRectRenderer::Invalidate() { valid_ = false; }
+
+const std::vector<SDL_Rect>& DirtyRectRenderer::Render(
+    const GameBoard& game, const PieceBounds& previous, double alpha,
+    const std::vector<const TextLabel*>& labels, SDL_Surface* surface) {
+  SceneRects rects = LayoutScene(game, previous, alpha, surface);
+  SDL_Rect surface_rect = {0, 0, surface->w, surface->h};
+  dirty_rects_.clear();
+
+  bool same_labels = labels.size() == last_labels_.size();
+  for (size_t i = 0; same_labels && i < labels.size(); ++i) {
+    same_labels = labels[i] == last_labels_[i].label;
+  }
+
+  if (!valid_ || surface != last_surface_ || surface->w != last_w_ ||
+      surface->h != last_h_ || !same_labels) {
+    DrawScene(rects, labels, surface_rect, surface);
+    dirty_rects_.push_back(surface_rect);
+  } else {
+    // Anything which moved dirties both where it was and where it is now.
+    for (int i = 0; i < kNumScenePieces; ++i) {
+      if (rects[i] == last_rects_[i]) {
+        continue;
+      }
+      SDL_Rect changed;
+      SDL_UnionRect(&last_rects_[i], &rects[i], &changed);
+      AddDirtyRect(changed, surface_rect, &dirty_rects_);
+    }
+    for (size_t i = 0; i < labels.size(); ++i) {
+      if (labels[i]->Version() == last_labels_[i].version) {
+        continue;
+      }
+      SDL_Rect changed;
+      SDL_UnionRect(&last_labels_[i].bounds, &labels[i]->Bounds(), &changed);
+      AddDirtyRect(changed, surface_rect, &dirty_rects_);
+    }
+
+    // Repaint the dirty areas exactly like a full redraw would.
+    for (const SDL_Rect& dirty : dirty_rects_) {
+      DrawScene(rects, labels, dirty, surface);
+    }
+  }
 
-  // TODO: render the player score.
+  std::copy(rects.begin(), rects.end(), last_rects_.begin());
+  last_labels_.clear();
+  for (const TextLabel* label : labels) {
+    last_labels_.push_back({label, label->Bounds(), label->Version()});
+  }
+  last_surface_ = surface;
+  last_w_ = surface->w;
+  last_h_ = surface->h;
+  valid_ = true;
+  return dirty_rects_;
 }
 
 }  // namespace pong
@@ -1,11 +1,28 @@
 #ifndef RENDERING_H_
 #define RENDERING_H_
 
+#include <stdint.h>
+#include <array>
+#include <vector>
+
 #include <SDL.h>
 
+#include "game.h"
+#include "multi_ball.h"
+#include "text.h"
+#include "tile_rasterizer.h"
+
 namespace pong {
 
-class GameBoard;
+// Positions of the moving game pieces at one instant. Keeping the positions
+// from the previous simulation tick lets the renderer draw a frame part way
+// between two ticks.
+struct PieceBounds {
+  BoundingBox ball;
+  BoundingBox left_paddle;
+  BoundingBox right_paddle;
+};
+PieceBounds PieceBoundsOf(const GameBoard& game);
 
 // Renders a pong::GameBoard to a given SDL surface. It fills simple white
 // rectangles on a black surface to give a look and feel similar to classic
@@ -15,6 +32,67 @@ class GameBoard;
 // TODO add a way to preserve aspect ratio w/ letter-boxing.
 void RenderGameToSdlSurface(const GameBoard& game, SDL_Surface *surface);
 
+// Same as above, but draws the moving pieces `alpha` of the way from
+// `previous` (alpha = 0) to their current positions in `game` (alpha = 1).
+void RenderGameToSdlSurface(const GameBoard& game, const PieceBounds& previous,
+                            double alpha, SDL_Surface* surface);
+
+// Same again, with `labels` (e.g. the score) drawn over the game.
+void RenderGameToSdlSurface(const GameBoard& game, const PieceBounds& previous,
+                            double alpha,
+                            const std::vector<const TextLabel*>& labels,
+                            SDL_Surface* surface);
+
+// Same again, but drawn by `rasterizer`, which is faster on big surfaces.
+// The pixels come out the same.
+void RenderGameToSdlSurface(const GameBoard& game, const PieceBounds& previous,
+                            double alpha,
+                            const std::vector<const TextLabel*>& labels,
+                            TileRasterizer* rasterizer, SDL_Surface* surface);
+
+// Renders chaos mode: the board's paddles and all of its balls, with `labels`
+// over them. There's no interpolation between ticks; with thousands of balls
+// on screen, nobody can tell.
+void RenderMultiBallBoardToSdlSurface(
+    const MultiBallBoard& board, const std::vector<const TextLabel*>& labels,
+    SDL_Surface* surface);
+
+// Renders exactly the same image as RenderGameToSdlSurface, but only repaints
+// the parts of the surface which changed since the previous frame: for each
+// piece which moved, the union of its old and new rectangles. Meant for
+// rendering to the window surface every frame, then presenting just the
+// dirty rects with SDL_UpdateWindowSurfaceRects.
+class DirtyRectRenderer {
+ public:
+  static constexpr int kNumPieces = 4;  // ball, paddles and middle line
+
+  // Draws the frame and returns the rects which changed (possibly none). The
+  // first frame, and any frame where the surface or the set of labels
+  // changed, is a full redraw. Labels are only redrawn when their text
+  // changes or something moves under them.
+  const std::vector<SDL_Rect>& Render(
+      const GameBoard& game, const PieceBounds& previous, double alpha,
+      const std::vector<const TextLabel*>& labels, SDL_Surface* surface);
+
+  // Forces a full redraw on the next frame. Call when the surface contents
+  // may have been lost (e.g. on window events).
+  void Invalidate();
+
+ private:
+  bool valid_ = false;
+  const SDL_Surface* last_surface_ = nullptr;
+  int last_w_ = 0;
+  int last_h_ = 0;
+  std::array<SDL_Rect, kNumPieces> last_rects_;
+  struct LabelState {
+    const TextLabel* label;
+    SDL_Rect bounds;
+    int64_t version;
+  };
+  std::vector<LabelState> last_labels_;
+  std::vector<SDL_Rect> dirty_rects_;
+};
+
 }  // namespace pong
 
 #endif  // RENDERING_H_
@@ -0,0 +1,316 @@
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "mapped_file.h"
+#include "replay.h"
+
+namespace pong {
+
+namespace {
+constexpr char kFileMagic[8] = {'P', 'O', 'N', 'G', 'R', 'P', 'L', 'Y'};
+constexpr char kFooterMagic[8] = {'P', 'O', 'N', 'G', 'I', 'D', 'X', '1'};
+constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  double seconds_per_tick;
+  uint32_t keyframe_interval;
+  uint32_t reserved;
+};
+
+struct ChunkHeader {
+  int64_t first_tick;
+  uint32_t num_ticks;
+  uint32_t reserved;
+  GameBoardState keyframe;
+};
+
+struct IndexEntry {
+  int64_t first_tick;
+  uint64_t offset;
+};
+
+struct FileFooter {
+  uint64_t index_offset;
+  uint64_t num_chunks;
+  int64_t num_ticks;
+  char magic[8];
+};
+
+// Moves are packed two ticks to a byte: the low nibble is the even tick. In
+// each nibble, bits 0-1 are the left paddle's move and bits 2-3 the right's.
+constexpr int kLeftShift = 0;
+constexpr int kRightShift = 2;
+
+size_t MovesBytes(int64_t num_ticks) { return (num_ticks + 1) / 2; }
+
+void WriteOrDie(FILE* file, const void* data, size_t size) {
+  PCHECK(fwrite(data, 1, size, file) == size) << "Could not write replay";
+}
+}  // namespace
+
+MoveDirection RecordingPaddleController::DesiredMove(const GameBoard& game,
+                                                     const Paddle& paddle) {
+  last_move_ = controller_ == nullptr
+                   ? MoveDirection::NONE
+                   : controller_->DesiredMove(game, paddle);
+  return last_move_;
+}
+
+
+ReplayWriter::ReplayWriter(const std::string& path, double seconds_per_tick,
+                           int keyframe_interval)
+    : file_(fopen(path.c_str(), "wb")),
+      keyframe_interval_(keyframe_interval) {
+  PCHECK(file_ != nullptr) << "Could not create replay " << path;
+  CHECK(keyframe_interval_ > 0) << "Bad keyframe interval";
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrderMark;
+  header.seconds_per_tick = seconds_per_tick;
+  header.keyframe_interval = keyframe_interval_;
+  WriteOrDie(file_, &header, sizeof(header));
+}
+
+ReplayWriter::~ReplayWriter() { Close(); }
+
+void ReplayWriter::BeginTick(const GameBoard& game) {
+  CHECK(file_ != nullptr) << "Replay is already closed";
+  if (!need_keyframe_ && chunk_ticks_ < keyframe_interval_) {
+    return;
+  }
+  FlushChunk();
+  chunk_keyframe_ = game.Save();
+  chunk_first_tick_ = num_ticks_;
+  need_keyframe_ = false;
+}
+
+void ReplayWriter::EndTick(MoveDirection left, MoveDirection right) {
+  DCHECK(!need_keyframe_) << "EndTick called without BeginTick";
+  uint8_t nibble = (static_cast<uint8_t>(left) << kLeftShift) |
+                   (static_cast<uint8_t>(right) << kRightShift);
+  if (chunk_ticks_ % 2 == 0) {
+    chunk_moves_.push_back(nibble);
+  } else {
+    chunk_moves_.back() |= nibble << 4;
+  }
+  ++chunk_ticks_;
+  ++num_ticks_;
+}
+
+void ReplayWriter::FlushChunk() {
+  if (chunk_ticks_ == 0) {
+    return;
+  }
+  long offset = ftell(file_);
+  PCHECK(offset >= 0) << "Could not tell replay position";
+
+  ChunkHeader header;
+  memset(&header, 0, sizeof(header));
+  header.first_tick = chunk_first_tick_;
+  header.num_ticks = chunk_ticks_;
+  header.keyframe = chunk_keyframe_;
+  WriteOrDie(file_, &header, sizeof(header));
+  WriteOrDie(file_, chunk_moves_.data(), chunk_moves_.size());
+
+  chunk_first_ticks_.push_back(chunk_first_tick_);
+  chunk_offsets_.push_back(offset);
+  chunk_moves_.clear();
+  chunk_ticks_ = 0;
+}
+
+void ReplayWriter::Close() {
+  if (file_ == nullptr) {
+    return;
+  }
+  FlushChunk();
+
+  FileFooter footer;
+  memset(&footer, 0, sizeof(footer));
+  long index_offset = ftell(file_);
+  PCHECK(index_offset >= 0) << "Could not tell replay position";
+  footer.index_offset = index_offset;
+  for (size_t i = 0; i < chunk_offsets_.size(); ++i) {
+    IndexEntry entry = {chunk_first_ticks_[i], chunk_offsets_[i]};
+    WriteOrDie(file_, &entry, sizeof(entry));
+  }
+  footer.num_chunks = chunk_offsets_.size();
+  footer.num_ticks = num_ticks_;
+  memcpy(footer.magic, kFooterMagic, sizeof(kFooterMagic));
+  WriteOrDie(file_, &footer, sizeof(footer));
+
+  PCHECK(fclose(file_) == 0) << "Could not close replay";
+  file_ = nullptr;
+}
+
+
+std::unique_ptr<ReplayReader> ReplayReader::Open(const std::string& path) {
+  std::unique_ptr<MappedFile> file =
+      MappedFile::Open(path, "replay", sizeof(FileHeader));
+  if (file == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<ReplayReader> reader(new ReplayReader);
+  reader->data_ = file->data();
+  reader->size_ = file->size();
+  reader->file_ = std::move(file);
+  if (!reader->Index(path)) {
+    return nullptr;
+  }
+  return reader;
+}
+
+bool ReplayReader::Index(const std::string& path) {
+  FileHeader header = ReadRecord<FileHeader>(data_);
+  if (memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) != 0) {
+    LOG(ERROR) << path << " is not a replay";
+    return false;
+  }
+  if (header.byte_order != kByteOrderMark || header.version != kVersion) {
+    LOG(ERROR) << path << " is a replay from an incompatible version or "
+               << "machine";
+    return false;
+  }
+  seconds_per_tick_ = header.seconds_per_tick;
+
+  // Returns false if there isn't a valid chunk at `offset`.
+  auto add_chunk = [this](uint64_t offset) {
+    if (offset > size_ || size_ - offset < sizeof(ChunkHeader)) {
+      return false;
+    }
+    ChunkHeader chunk_header = ReadRecord<ChunkHeader>(data_ + offset);
+    uint64_t moves_offset = offset + sizeof(ChunkHeader);
+    if (chunk_header.first_tick != num_ticks_ ||
+        size_ - moves_offset < MovesBytes(chunk_header.num_ticks)) {
+      return false;
+    }
+    chunks_.push_back({chunk_header.first_tick,
+                       static_cast<int>(chunk_header.num_ticks),
+                       data_ + offset + offsetof(ChunkHeader, keyframe),
+                       data_ + moves_offset});
+    num_ticks_ += chunk_header.num_ticks;
+    return true;
+  };
+
+  // Prefer the index at the end of the file.
+  if (size_ >= sizeof(FileHeader) + sizeof(FileFooter)) {
+    FileFooter footer =
+        ReadRecord<FileFooter>(data_ + size_ - sizeof(FileFooter));
+    if (memcmp(footer.magic, kFooterMagic, sizeof(kFooterMagic)) == 0 &&
+        footer.index_offset + footer.num_chunks * sizeof(IndexEntry) ==
+            size_ - sizeof(FileFooter)) {
+      bool ok = true;
+      for (uint64_t i = 0; ok && i < footer.num_chunks; ++i) {
+        IndexEntry entry = ReadRecord<IndexEntry>(
+            data_ + footer.index_offset + i * sizeof(IndexEntry));
+        ok = entry.first_tick == num_ticks_ && add_chunk(entry.offset);
+      }
+      if (ok && num_ticks_ == footer.num_ticks) {
+        return true;
+      }
+      LOG(ERROR) << path << " has a corrupt index";
+      return false;
+    }
+  }
+
+  // No index; the recording was probably cut short. Walk the chunks instead.
+  chunks_.clear();
+  num_ticks_ = 0;
+  uint64_t offset = sizeof(FileHeader);
+  while (add_chunk(offset)) {
+    offset += sizeof(ChunkHeader) + MovesBytes(chunks_.back().num_ticks);
+  }
+  LOG(WARNING) << path << " has no index. Recovered " << num_ticks_
+               << " ticks in " << chunks_.size() << " chunks";
+  return true;
+}
+
+const ReplayReader::Chunk& ReplayReader::ChunkFor(int64_t tick) const {
+  CHECK(tick >= 0 && tick < num_ticks_)
+      << "Tick " << tick << " is outside the replay (" << num_ticks_
+      << " ticks)";
+  auto after = std::upper_bound(
+      chunks_.begin(), chunks_.end(), tick,
+      [](int64_t t, const Chunk& chunk) { return t < chunk.first_tick; });
+  return *(after - 1);
+}
+
+int ReplayReader::MoveBits(int64_t tick, int shift) const {
+  const Chunk& chunk = ChunkFor(tick);
+  int64_t i = tick - chunk.first_tick;
+  int nibble = (chunk.moves[i / 2] >> ((i % 2) * 4)) & 0xF;
+  int bits = (nibble >> shift) & 0x3;
+  DCHECK(bits <= static_cast<int>(MoveDirection::DOWN))
+      << "Corrupt move in replay at tick " << tick;
+  return bits;
+}
+
+MoveDirection ReplayReader::LeftMove(int64_t tick) const {
+  return static_cast<MoveDirection>(MoveBits(tick, kLeftShift));
+}
+
+MoveDirection ReplayReader::RightMove(int64_t tick) const {
+  return static_cast<MoveDirection>(MoveBits(tick, kRightShift));
+}
+
+bool ReplayReader::IsKeyframe(int64_t tick) const {
+  return ChunkFor(tick).first_tick == tick;
+}
+
+int64_t ReplayReader::RestoreKeyframe(int64_t tick, GameBoard* game) const {
+  const Chunk& chunk = ChunkFor(tick);
+  game->Restore(ReadRecord<GameBoardState>(chunk.keyframe));
+  return chunk.first_tick;
+}
+
+
+MoveDirection ReplayPaddleController::DesiredMove(const GameBoard& game,
+                                                  const Paddle& paddle) {
+  return side_ == GameBoard::Player::LEFT ? reader_->LeftMove(tick_)
+                                          : reader_->RightMove(tick_);
+}
+
+
+ReplayPlayer::ReplayPlayer(const ReplayReader* reader, GameBoard* game)
+    : reader_(CHECK_NOTNULL(reader)),
+      game_(CHECK_NOTNULL(game)),
+      left_controller_(reader, GameBoard::Player::LEFT),
+      right_controller_(reader, GameBoard::Player::RIGHT) {
+  CHECK(reader_->NumTicks() > 0) << "Replay is empty";
+  game_->SetLeftController(&left_controller_);
+  game_->SetRightController(&right_controller_);
+  Seek(0);
+}
+
+void ReplayPlayer::Step() {
+  // Keyframes are where the recording started, or the board was changed
+  // outside of the simulation (e.g. a new serve), so always start from them.
+  if (reader_->IsKeyframe(tick_)) {
+    reader_->RestoreKeyframe(tick_, game_);
+  }
+  left_controller_.SetTick(tick_);
+  right_controller_.SetTick(tick_);
+  game_->Update(reader_->SecondsPerTick());
+  ++tick_;
+}
+
+void ReplayPlayer::Seek(int64_t tick) {
+  CHECK(tick >= 0 && tick <= reader_->NumTicks())
+      << "Can't seek to tick " << tick << " of " << reader_->NumTicks();
+  tick_ = reader_->RestoreKeyframe(
+      std::min(tick, reader_->NumTicks() - 1), game_);
+  while (tick_ < tick) {
+    Step();
+  }
+}
+
+}  // namespace pong
@@ -0,0 +1,197 @@
+// Recording and playback of games, for reproducing a match exactly.
+//
+// A replay stores what each paddle's controller did on every tick: 2 bits per
+// paddle per tick. Since the simulation is deterministic, that's all we need
+// to re-run the game, given where it started. Ticks are grouped into chunks,
+// and each chunk starts with a keyframe holding the complete board state.
+// Keyframes let playback start from (or seek to) the middle of a replay, and
+// capture changes made outside GameBoard::Update(), such as serves.
+//
+// File layout (host byte order; every record is a fixed-size struct defined
+// in replay.cc):
+//
+//   FileHeader
+//   chunk 0: ChunkHeader (incl. keyframe), ceil(num_ticks / 2) bytes of moves
+//   chunk 1: ...
+//   IndexEntry[num_chunks]  -- first tick and file offset of each chunk
+//   FileFooter
+//
+// The index lets playback find the chunk holding any tick with a binary
+// search. If the recorder died before writing it, the reader rebuilds it by
+// walking the chunks.
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "controller.h"
+#include "game.h"
+#include "mapped_file.h"
+#include "util.h"
+
+namespace pong {
+
+// Wraps another controller and remembers what it asked for, so the move can be
+// recorded after the tick.
+class RecordingPaddleController : public PaddleController {
+ public:
+  explicit RecordingPaddleController(PaddleController* controller = nullptr)
+      : controller_(controller) {}
+
+  void SetController(PaddleController* controller) { controller_ = controller; }
+
+  MoveDirection DesiredMove(const GameBoard& game,
+                            const Paddle& paddle) override;
+
+  // What the wrapped controller asked for most recently.
+  MoveDirection LastMove() const { return last_move_; }
+
+ private:
+  PaddleController* controller_;  // Not owned
+  MoveDirection last_move_ = MoveDirection::NONE;
+};
+
+class ReplayWriter {
+ public:
+  // Ticks are grouped into chunks of up to `keyframe_interval` ticks. Smaller
+  // chunks make seeking faster and files bigger. CHECK-fails if the file
+  // can't be created.
+  ReplayWriter(const std::string& path, double seconds_per_tick,
+               int keyframe_interval = 1024);
+  ~ReplayWriter();  // calls Close()
+
+  // Records one game tick. Call BeginTick before GameBoard::Update, and
+  // EndTick after it with the moves that the paddles made.
+  void BeginTick(const GameBoard& game);
+  void EndTick(MoveDirection left, MoveDirection right);
+
+  // Call after changing the board outside of GameBoard::Update() (e.g. with
+  // SetupNewGame), so that the next tick starts a new keyframe.
+  void Discontinuity() { need_keyframe_ = true; }
+
+  int64_t NumTicks() const { return num_ticks_; }
+
+  // Flushes the last chunk and writes the index. No more ticks may be added.
+  void Close();
+
+ private:
+  void FlushChunk();
+
+  FILE* file_;
+  const int keyframe_interval_;
+
+  bool need_keyframe_ = true;
+  int64_t num_ticks_ = 0;
+
+  // The chunk being recorded.
+  int64_t chunk_first_tick_ = 0;
+  int chunk_ticks_ = 0;
+  GameBoardState chunk_keyframe_;
+  std::vector<uint8_t> chunk_moves_;
+
+  // The index: where each chunk written so far starts.
+  std::vector<int64_t> chunk_first_ticks_;
+  std::vector<uint64_t> chunk_offsets_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayWriter);
+};
+
+// Reads a replay through a read-only memory map, so opening is cheap and only
+// the parts being played back are paged in.
+class ReplayReader {
+ public:
+  // Returns null (and logs why) if the file can't be mapped or isn't a replay.
+  static std::unique_ptr<ReplayReader> Open(const std::string& path);
+
+  double SecondsPerTick() const { return seconds_per_tick_; }
+  int64_t NumTicks() const { return num_ticks_; }
+  int NumChunks() const { return chunks_.size(); }
+
+  // The moves made on `tick`, where 0 <= tick < NumTicks().
+  MoveDirection LeftMove(int64_t tick) const;
+  MoveDirection RightMove(int64_t tick) const;
+
+  // Whether `tick` starts a chunk, in which case RestoreKeyframe(tick) gives
+  // the board state just before it.
+  bool IsKeyframe(int64_t tick) const;
+
+  // Overwrites `game` with the keyframe of the chunk containing `tick`, and
+  // returns the tick it was taken at. Finding the chunk is a binary search.
+  int64_t RestoreKeyframe(int64_t tick, GameBoard* game) const;
+
+ private:
+  struct Chunk {
+    int64_t first_tick;
+    int num_ticks;
+    const uint8_t* keyframe;
+    const uint8_t* moves;
+  };
+
+  ReplayReader() {}
+  bool Index(const std::string& path);
+  const Chunk& ChunkFor(int64_t tick) const;
+  int MoveBits(int64_t tick, int shift) const;
+
+  std::unique_ptr<MappedFile> file_;
+  // Where file_ is mapped, and its size.
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  double seconds_per_tick_ = 0;
+  int64_t num_ticks_ = 0;
+  std::vector<Chunk> chunks_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayReader);
+};
+
+// Plays back one side of a replay. The ReplayPlayer which owns it tells it
+// which tick is being played.
+class ReplayPaddleController : public PaddleController {
+ public:
+  ReplayPaddleController(const ReplayReader* reader, GameBoard::Player side)
+      : reader_(reader), side_(side) {}
+
+  void SetTick(int64_t tick) { tick_ = tick; }
+
+  MoveDirection DesiredMove(const GameBoard& game,
+                            const Paddle& paddle) override;
+
+ private:
+  const ReplayReader* reader_;  // Not owned
+  const GameBoard::Player side_;
+  int64_t tick_ = 0;
+};
+
+// Drives a GameBoard through a replay, tick by tick.
+class ReplayPlayer {
+ public:
+  // Installs replay controllers on `game` and moves it to the start of the
+  // replay.
+  ReplayPlayer(const ReplayReader* reader, GameBoard* game);
+
+  // Plays the next tick. Must not be called once Done().
+  void Step();
+  bool Done() const { return tick_ >= reader_->NumTicks(); }
+
+  // Puts the game in the state it was in just before `tick`. Costs a binary
+  // search plus replaying at most one chunk's worth of ticks.
+  void Seek(int64_t tick);
+  int64_t Tick() const { return tick_; }
+
+ private:
+  const ReplayReader* reader_;  // Not owned
+  GameBoard* game_;  // Not owned
+  ReplayPaddleController left_controller_;
+  ReplayPaddleController right_controller_;
+  int64_t tick_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayPlayer);
+};
+
+}  // namespace pong
+
+#endif  // REPLAY_H_
@@ -0,0 +1,29 @@
+#include <glog/logging.h>
+
+#include "rewind.h"
+
+namespace pong {
+
+RewindBuffer::RewindBuffer(int capacity) : snapshots_(capacity) {
+  CHECK(capacity > 0) << "Rewind buffer needs room for a snapshot";
+}
+
+void RewindBuffer::Push(const GameBoard& game) {
+  snapshots_[next_] = game.Save();
+  next_ = (next_ + 1) % snapshots_.size();
+  if (size_ < Capacity()) {
+    ++size_;
+  }
+}
+
+bool RewindBuffer::Pop(GameBoard* game) {
+  if (size_ == 0) {
+    return false;
+  }
+  next_ = (next_ + Capacity() - 1) % Capacity();
+  --size_;
+  game->Restore(snapshots_[next_]);
+  return true;
+}
+
+}  // namespace pong
@@ -0,0 +1,43 @@
+// Rewinding a game, by keeping the board from each of the last few seconds'
+// worth of ticks.
+
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include <vector>
+
+#include "game.h"
+#include "util.h"
+
+namespace pong {
+
+// A fixed-size ring of board snapshots, newest last. Pushing onto a full
+// buffer drops the oldest snapshot. Nothing is allocated after construction,
+// so it's cheap enough to push every tick.
+class RewindBuffer {
+ public:
+  // Holds up to `capacity` snapshots.
+  explicit RewindBuffer(int capacity);
+
+  // Saves `game` as the newest snapshot.
+  void Push(const GameBoard& game);
+
+  // Restores `game` to the newest snapshot and forgets it. Returns false,
+  // leaving `game` alone, if there are none left.
+  bool Pop(GameBoard* game);
+
+  int Size() const { return size_; }
+  int Capacity() const { return snapshots_.size(); }
+  void Clear() { size_ = 0; }
+
+ private:
+  std::vector<GameBoardState> snapshots_;
+  int next_ = 0;  // where the next Push() goes
+  int size_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(RewindBuffer);
+};
+
+}  // namespace pong
+
+#endif  // REWIND_H_
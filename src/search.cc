@@ -0,0 +1,215 @@
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "search.h"
+#include "thread_pool.h"
+
+namespace pong {
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+constexpr MoveDirection kMoves[] = {MoveDirection::UP, MoveDirection::NONE,
+                                    MoveDirection::DOWN};
+constexpr int kNumMoves = sizeof(kMoves) / sizeof(kMoves[0]);
+
+// Winning or losing the point outweighs any position.
+constexpr double kPointScore = 1000;
+}  // namespace
+
+// The board at the end of a plan, and how good it looks.
+struct SearchController::Node {
+  GameBoardState state;
+  MoveDirection first_move;
+  int ticks;  // simulated since the root
+  bool point_over;
+  double score;
+};
+
+struct SearchController::Rollout {
+  GameBoard game;
+  FixedMoveController self;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+SearchController::SearchController(const SearchParams& params,
+                                   util::ThreadPool* pool)
+    : params_(params), pool_(pool) {
+  CHECK(params_.segment_ticks > 0) << "Bad segment length";
+  CHECK(params_.beam_width > 0) << "Bad beam width";
+  CHECK(params_.max_depth > 0) << "Bad search depth";
+  int threads = pool_ ? pool_->NumThreads() : 1;
+  for (int i = 0; i < threads; ++i) {
+    rollouts_.emplace_back(new Rollout);
+  }
+}
+
+SearchController::~SearchController() {}
+
+MoveDirection SearchController::DesiredMove(const GameBoard& game,
+                                            const Paddle& paddle) {
+  if (ticks_until_search_ <= 0) {
+    move_ = Search(game, &paddle == &game.left_paddle_);
+    ticks_until_search_ = params_.segment_ticks;
+  }
+  --ticks_until_search_;
+  return move_;
+}
+
+void SearchController::Expand(const Node& parent, MoveDirection move,
+                              bool left_side, Rollout* rollout, Node* child) {
+  *child = parent;
+  if (parent.point_over) {
+    return;  // nothing more can happen
+  }
+
+  // The opponent's prediction only depends on the board, so a fresh one
+  // picks up where the parent's left off.
+  PredictiveController opponent;
+  GameBoard& game = rollout->game;
+  game.Restore(parent.state);
+  rollout->self.SetMove(move);
+  game.SetLeftController(left_side ? static_cast<PaddleController*>(
+                                         &rollout->self)
+                                   : &opponent);
+  game.SetRightController(left_side ? static_cast<PaddleController*>(
+                                          &opponent)
+                                    : &rollout->self);
+  int ticks = 0;
+  while (ticks < params_.segment_ticks && !game.IsGameOver()) {
+    game.Update(params_.seconds_per_tick);
+    ++ticks;
+  }
+
+  child->state = game.Save();
+  if (parent.ticks == 0) {
+    child->first_move = move;
+  }
+  child->ticks = parent.ticks + ticks;
+  child->point_over = game.IsGameOver();
+  if (child->point_over) {
+    bool won = (game.LastPlayerToScore() == GameBoard::Player::LEFT) ==
+               left_side;
+    // Win as soon as possible, or lose as late as possible.
+    child->score = won ? kPointScore - child->ticks
+                       : -kPointScore + child->ticks;
+  } else {
+    const Paddle& paddle = left_side ? game.left_paddle_ : game.right_paddle_;
+    child->score =
+        -std::abs(paddle.bounds_.Center().y() -
+                  PredictiveController::PredictInterceptY(game, left_side));
+  }
+  game.SetLeftController(nullptr);
+  game.SetRightController(nullptr);
+}
+
+MoveDirection SearchController::Search(const GameBoard& game, bool left_side) {
+  Clock::time_point start = Clock::now();
+  Clock::time_point deadline =
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(params_.time_budget_secs));
+  ++stats_.searches;
+
+  Node root;
+  root.state = game.Save();
+  root.first_move = MoveDirection::NONE;
+  root.ticks = 0;
+  root.point_over = false;
+  root.score = 0;
+  std::vector<Node> beam = {root};
+  std::vector<Node> children;
+  int64_t nodes = 0;
+  int depth = 0;
+  std::vector<std::pair<int, MoveDirection>> expansions;  // parent, move
+  while (depth < params_.max_depth) {
+    // Plans which have already decided the point are carried over as they
+    // are; the rest get each of the moves.
+    expansions.clear();
+    int64_t new_nodes = 0;  // at most
+    for (int i = 0; i < static_cast<int>(beam.size()); ++i) {
+      if (beam[i].point_over) {
+        expansions.emplace_back(i, MoveDirection::NONE);
+        continue;
+      }
+      for (MoveDirection move : kMoves) {
+        expansions.emplace_back(i, move);
+      }
+      new_nodes += kNumMoves * params_.segment_ticks;
+    }
+    if (params_.node_budget > 0 && depth > 0 &&
+        nodes + new_nodes > params_.node_budget) {
+      break;
+    }
+
+    // The first depth always finishes, so there's always a move to make.
+    bool check_deadline = params_.time_budget_secs > 0 && depth > 0;
+    std::atomic<bool> out_of_time{false};
+    children.resize(expansions.size());
+    auto expand = [&](int i) {
+      if (check_deadline && (out_of_time.load(std::memory_order_relaxed) ||
+                             Clock::now() > deadline)) {
+        out_of_time.store(true, std::memory_order_relaxed);
+        return;
+      }
+      int worker = pool_ ? util::ThreadPool::CurrentWorker() : 0;
+      Expand(beam[expansions[i].first], expansions[i].second, left_side,
+             rollouts_[worker].get(), &children[i]);
+    };
+    if (pool_) {
+      pool_->ParallelFor(0, expansions.size(), expand);
+    } else {
+      for (int i = 0; i < static_cast<int>(expansions.size()); ++i) {
+        expand(i);
+      }
+    }
+    if (out_of_time) {
+      ++stats_.out_of_time;
+      break;
+    }
+
+    for (size_t i = 0; i < children.size(); ++i) {
+      nodes += children[i].ticks - beam[expansions[i].first].ticks;
+    }
+    ++depth;
+    // Stable, so ties always go the same way whatever the thread count.
+    std::stable_sort(children.begin(), children.end(),
+                     [](const Node& a, const Node& b) {
+                       return a.score > b.score;
+                     });
+    if (static_cast<int>(children.size()) > params_.beam_width) {
+      children.resize(params_.beam_width);
+    }
+    beam.swap(children);
+    if (std::all_of(beam.begin(), beam.end(),
+                    [](const Node& node) { return node.point_over; })) {
+      break;  // the point's decided down every line we're still looking at
+    }
+  }
+
+  stats_.nodes += nodes;
+  stats_.total_depth += depth;
+  stats_.max_depth = std::max(stats_.max_depth, depth);
+  stats_.search_secs +=
+      std::chrono::duration<double>(Clock::now() - start).count();
+  return beam.front().first_move;
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const SearchController::Stats& stats) {
+  double searches = std::max<int64_t>(stats.searches, 1);
+  return stream << boost::format(
+                       "searches=%d nodes/s=%.4g avg_depth=%.1f max_depth=%d "
+                       "out_of_time=%d avg_search=%.2fms") %
+                       stats.searches % (stats.nodes / stats.search_secs) %
+                       (stats.total_depth / searches) % stats.max_depth %
+                       stats.out_of_time %
+                       (stats.search_secs * 1000 / searches);
+}
+
+}  // namespace pong
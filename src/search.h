@@ -0,0 +1,101 @@
+// An AI which plans its moves by simulating the game ahead.
+
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "controller.h"
+#include "game.h"
+#include "util.h"
+
+namespace util {
+class ThreadPool;
+}  // namespace util
+
+namespace pong {
+
+struct SearchParams {
+  // Must match the game being played, since plans are simulated in ticks.
+  double seconds_per_tick = 1.0 / 240;
+
+  // A plan is a sequence of moves, each held for this many ticks. A new plan
+  // is made every time the first move of the last one is done.
+  int segment_ticks = 12;
+
+  // Plans kept at each depth of the search, and the deepest it goes.
+  int beam_width = 16;
+  int max_depth = 32;
+
+  // A search stops at whichever of these limits it hits first. Zero means no
+  // limit. The time budget makes results depend on the machine's speed;
+  // the node budget (in simulated ticks) keeps them reproducible.
+  double time_budget_secs = 0.004;
+  int64_t node_budget = 0;
+};
+
+// Beam search over move plans. Each depth of the search extends the best
+// plans found so far by one more segment of UP, NONE or DOWN, simulating
+// copies of the board forward in parallel. The other paddle is assumed to be
+// played by a PredictiveController. Plans which lose the point score worst,
+// then plans which leave the paddle furthest from where the ball is headed.
+//
+// When the time budget runs out part way through a depth, that depth is
+// thrown away and the best plan from the depth before is used, so
+// DesiredMove() takes at most about one time budget plus one segment's
+// simulation.
+class SearchController : public PaddleController {
+ public:
+  struct Stats {
+    int64_t searches = 0;
+    int64_t nodes = 0;  // ticks simulated
+    int64_t total_depth = 0;  // of completed depths, over all searches
+    int max_depth = 0;
+    int64_t out_of_time = 0;  // searches cut short by the time budget
+    double search_secs = 0;
+  };
+
+  // Searches on `pool`, or on the calling thread if it's null.
+  explicit SearchController(const SearchParams& params,
+                            util::ThreadPool* pool = nullptr);
+  ~SearchController();
+
+  MoveDirection DesiredMove(const GameBoard& game,
+                            const Paddle& paddle) override;
+
+  // Searches from `game` for the paddle on the given side, returning the
+  // first move of the best plan. Normally called by DesiredMove().
+  MoveDirection Search(const GameBoard& game, bool left_side);
+
+  const Stats& GetStats() const { return stats_; }
+
+ private:
+  struct Node;
+  struct Rollout;
+
+  // Simulates one more segment of `parent`'s plan, with `move`.
+  void Expand(const Node& parent, MoveDirection move, bool left_side,
+              Rollout* rollout, Node* child);
+
+  const SearchParams params_;
+  util::ThreadPool* pool_;  // Not owned. May be null.
+  // Scratch boards, one per thread that can search.
+  std::vector<std::unique_ptr<Rollout>> rollouts_;
+
+  MoveDirection move_ = MoveDirection::NONE;
+  int ticks_until_search_ = 0;
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(SearchController);
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const SearchController::Stats& stats);
+
+}  // namespace pong
+
+#endif  // SEARCH_H_
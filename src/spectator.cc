@@ -0,0 +1,379 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+
+#include <boost/format.hpp>
+#include <glog/logging.h>
+
+#include "spectator.h"
+
+namespace pong {
+
+namespace {
+// Every byte is paid for once per spectator, so packets have a one-byte tag
+// rather than netplay's four-byte magic.
+constexpr uint8_t kFrameTag = 'S';
+constexpr uint8_t kAckTag = 'A';
+
+// Frame packet layout: tag (1 byte), frame number (4), how many frames back
+// its baseline is (1; 0 for none), mask of the fields which differ from the
+// baseline (2), then for each of those, the difference as a zigzag varint.
+constexpr size_t kFrameHeaderBytes = 1 + 4 + 1 + 2;
+constexpr size_t kMaxFramePacketBytes =
+    kFrameHeaderBytes + 5 * SpectatorFrame::kNumFields;
+static_assert(SpectatorFrame::kNumFields <= 16, "Field mask is 16 bits");
+
+// Ack packet layout: tag (1 byte), newest frame number received (4), or
+// kNoFrame before the first. Also how spectators join, and stay joined.
+constexpr size_t kAckBytes = 1 + 4;
+constexpr uint32_t kNoFrame = 0xFFFFFFFF;
+
+// Bigger than any packet a spectator should send.
+constexpr size_t kReceiveBufferBytes = 16;
+
+// How often a spectator acknowledges even when nothing new arrived, to join
+// and to stay joined.
+constexpr auto kKeepAliveInterval = std::chrono::milliseconds(250);
+
+constexpr double kPositionScale = 65536;
+
+// Small differences, either way, make small varints.
+uint32_t ZigZag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^ (value >> 31);
+}
+
+int32_t UnZigZag(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+void PutVarint(uint32_t value, std::vector<uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out->push_back(value);
+}
+
+// Returns false if the varint runs off the end.
+bool GetVarint(const std::vector<uint8_t>& in, size_t* pos, uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 35 && *pos < in.size(); shift += 7) {
+    uint8_t byte = in[(*pos)++];
+    *value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t AddressKey(const sockaddr_in& address) {
+  return (static_cast<uint64_t>(address.sin_addr.s_addr) << 16) |
+         address.sin_port;
+}
+
+void QuantizeBox(const BoundingBox& box, const BoundingBox& board,
+                 int32_t* out) {
+  Eigen::Vector4d relative = box.packed;
+  relative.head<2>() -= board.top_left();
+  relative.head<2>().array() /= board.size().array();
+  relative.tail<2>().array() /= board.size().array();
+  for (int i = 0; i < 4; ++i) {
+    out[i] = static_cast<int32_t>(std::lround(relative[i] * kPositionScale));
+  }
+}
+
+BoundingBox UnquantizeBox(const int32_t* in, const BoundingBox& board) {
+  Eigen::Vector4d relative(in[0], in[1], in[2], in[3]);
+  relative /= kPositionScale;
+  BoundingBox box;
+  box.top_left() = board.top_left().array() +
+                   relative.head<2>().array() * board.size().array();
+  box.size() = relative.tail<2>().array() * board.size().array();
+  return box;
+}
+}  // namespace
+
+SpectatorFrame QuantizeBoard(const GameBoard& game, uint32_t number) {
+  SpectatorFrame frame;
+  frame.number = number;
+  QuantizeBox(game.ball_.bounds_, game.bounds_,
+              &frame.fields[SpectatorFrame::BALL_X]);
+  QuantizeBox(game.left_paddle_.bounds_, game.bounds_,
+              &frame.fields[SpectatorFrame::LEFT_X]);
+  QuantizeBox(game.right_paddle_.bounds_, game.bounds_,
+              &frame.fields[SpectatorFrame::RIGHT_X]);
+  frame.fields[SpectatorFrame::LEFT_SCORE] = game.left_score_;
+  frame.fields[SpectatorFrame::RIGHT_SCORE] = game.right_score_;
+  frame.fields[SpectatorFrame::GAME_OVER] = game.IsGameOver();
+  return frame;
+}
+
+void ApplySpectatorFrame(const SpectatorFrame& frame, GameBoard* game) {
+  game->ball_.bounds_ =
+      UnquantizeBox(&frame.fields[SpectatorFrame::BALL_X], game->bounds_);
+  game->left_paddle_.bounds_ =
+      UnquantizeBox(&frame.fields[SpectatorFrame::LEFT_X], game->bounds_);
+  game->right_paddle_.bounds_ =
+      UnquantizeBox(&frame.fields[SpectatorFrame::RIGHT_X], game->bounds_);
+  game->left_score_ = frame.fields[SpectatorFrame::LEFT_SCORE];
+  game->right_score_ = frame.fields[SpectatorFrame::RIGHT_SCORE];
+}
+
+
+constexpr int SpectatorServer::kHistoryFrames;
+
+SpectatorServer::SpectatorServer(int port, double client_timeout_secs)
+    : fd_(socket(AF_INET, SOCK_DGRAM, 0)),
+      client_timeout_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(client_timeout_secs))),
+      history_(kHistoryFrames),
+      encoded_(kHistoryFrames),
+      encoded_valid_(kHistoryFrames),
+      batcher_(fd_, kReceiveBufferBytes, kMaxFramePacketBytes) {
+  PCHECK(fd_ >= 0) << "Could not create UDP socket";
+  PCHECK(fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK) == 0)
+      << "Could not make socket non-blocking";
+  // A broadcast to thousands of spectators goes out in one burst, and their
+  // acknowledgements come back in one.
+  SetSocketBuffers(fd_, 8 << 20);
+
+  sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(port);
+  PCHECK(bind(fd_, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0)
+      << "Could not bind UDP port " << port;
+  for (std::vector<uint8_t>& packet : encoded_) {
+    packet.reserve(kMaxFramePacketBytes);
+  }
+}
+
+SpectatorServer::~SpectatorServer() { close(fd_); }
+
+int SpectatorServer::LocalPort() const {
+  sockaddr_in local;
+  socklen_t size = sizeof(local);
+  PCHECK(getsockname(fd_, reinterpret_cast<sockaddr*>(&local), &size) == 0);
+  return ntohs(local.sin_port);
+}
+
+void SpectatorServer::Broadcast(const GameBoard& game) {
+  Clock::time_point now = Clock::now();
+  ReceiveAcks(now);
+  ForgetQuietClients(now);
+
+  uint32_t number = next_number_++;
+  history_[number % kHistoryFrames] = QuantizeBoard(game, number);
+  std::fill(encoded_valid_.begin(), encoded_valid_.end(), false);
+  ++stats_.broadcasts;
+
+  for (Client& client : clients_) {
+    // Deltas go against the newest frame the spectator has said it has, if
+    // that's still in the history.
+    int back = 0;
+    if (client.acked_number >= 0) {
+      uint32_t distance = number - static_cast<uint32_t>(client.acked_number);
+      if (distance > 0 && distance < kHistoryFrames) {
+        back = distance;
+      }
+    }
+    if (back == 0) {
+      ++stats_.full_frames_sent;
+    }
+    const std::vector<uint8_t>& packet = EncodedFrame(number, back);
+    memcpy(batcher_.Queue(client.address, packet.size()), packet.data(),
+           packet.size());
+  }
+  batcher_.Flush();
+  stats_.clients = clients_.size();
+}
+
+void SpectatorServer::ReceiveAcks(Clock::time_point now) {
+  batcher_.ReceiveAll([this, now](const uint8_t* data, size_t size,
+                                  const sockaddr_in& from) {
+    if (size != kAckBytes || data[0] != kAckTag) {
+      return;
+    }
+    ++stats_.acks_received;
+    uint64_t key = AddressKey(from);
+    auto it = client_index_.find(key);
+    if (it == client_index_.end()) {
+      it = client_index_.emplace(key, clients_.size()).first;
+      clients_.push_back({from, -1, now});
+    }
+    Client& client = clients_[it->second];
+    client.last_heard = now;
+    uint32_t acked = GetLittleEndian(data + 1, 4);
+    // Acks can arrive out of order; keep the newest.
+    if (acked != kNoFrame &&
+        (client.acked_number < 0 ||
+         static_cast<int32_t>(acked - client.acked_number) > 0)) {
+      client.acked_number = acked;
+    }
+  });
+}
+
+void SpectatorServer::ForgetQuietClients(Clock::time_point now) {
+  for (size_t i = 0; i < clients_.size();) {
+    if (now - clients_[i].last_heard < client_timeout_) {
+      ++i;
+      continue;
+    }
+    // Move the last spectator into the gap.
+    client_index_.erase(AddressKey(clients_[i].address));
+    if (i + 1 != clients_.size()) {
+      clients_[i] = clients_.back();
+      client_index_[AddressKey(clients_[i].address)] = i;
+    }
+    clients_.pop_back();
+  }
+}
+
+const std::vector<uint8_t>& SpectatorServer::EncodedFrame(uint32_t number,
+                                                          int back) {
+  std::vector<uint8_t>& packet = encoded_[back];
+  if (encoded_valid_[back]) {
+    return packet;
+  }
+  static const SpectatorFrame kZeroFrame;
+  const SpectatorFrame& frame = history_[number % kHistoryFrames];
+  const SpectatorFrame& baseline =
+      back == 0 ? kZeroFrame : history_[(number - back) % kHistoryFrames];
+  uint16_t mask = 0;
+  for (int i = 0; i < SpectatorFrame::kNumFields; ++i) {
+    if (frame.fields[i] != baseline.fields[i]) {
+      mask |= 1 << i;
+    }
+  }
+  packet.resize(kFrameHeaderBytes);
+  packet[0] = kFrameTag;
+  PutLittleEndian(number, 4, &packet[1]);
+  packet[5] = back;
+  packet[6] = mask & 0xFF;
+  packet[7] = mask >> 8;
+  for (int i = 0; i < SpectatorFrame::kNumFields; ++i) {
+    if (mask & (1 << i)) {
+      PutVarint(ZigZag(frame.fields[i] - baseline.fields[i]), &packet);
+    }
+  }
+  encoded_valid_[back] = true;
+  return packet;
+}
+
+SpectatorServer::Stats SpectatorServer::GetStats() const {
+  Stats stats = stats_;
+  stats.packets_sent = batcher_.counters().sent;
+  stats.bytes_sent = batcher_.counters().bytes_sent;
+  stats.send_failures = batcher_.counters().send_failures;
+  return stats;
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const SpectatorServer::Stats& stats) {
+  double bytes_per_packet =
+      stats.packets_sent > 0
+          ? static_cast<double>(stats.bytes_sent) / stats.packets_sent
+          : 0;
+  return stream << boost::format("clients=%d broadcasts=%d packets=%d "
+                                 "full=%d bytes/packet=%.1f acks=%d "
+                                 "send_failures=%d") %
+                       stats.clients % stats.broadcasts % stats.packets_sent %
+                       stats.full_frames_sent % bytes_per_packet %
+                       stats.acks_received % stats.send_failures;
+}
+
+
+SpectatorClient::SpectatorClient(const std::string& host, int port)
+    : link_(0),
+      history_(SpectatorServer::kHistoryFrames),
+      have_(SpectatorServer::kHistoryFrames, false) {
+  link_.SetPeer(host, port);
+  SendAck();  // to join
+}
+
+bool SpectatorClient::Poll() {
+  int64_t latest_before = latest_number_;
+  while (link_.Receive(&packet_)) {
+    stats_.bytes_received += packet_.size();
+    if (!Decode(packet_)) {
+      ++stats_.undecodable;
+    }
+  }
+  bool fresh = latest_number_ != latest_before;
+  if (fresh || Clock::now() - last_ack_ >= kKeepAliveInterval) {
+    SendAck();
+  }
+  return fresh;
+}
+
+bool SpectatorClient::Decode(const std::vector<uint8_t>& packet) {
+  const int history = history_.size();
+  if (packet.size() < kFrameHeaderBytes || packet[0] != kFrameTag) {
+    return false;
+  }
+  uint32_t number = GetLittleEndian(&packet[1], 4);
+  int back = packet[5];
+  uint16_t mask = packet[6] | (packet[7] << 8);
+  static const SpectatorFrame kZeroFrame;
+  const SpectatorFrame* baseline = &kZeroFrame;
+  if (back > 0) {
+    int slot = (number - back) % history;
+    if (back >= history || !have_[slot] ||
+        history_[slot].number != number - back) {
+      return false;
+    }
+    baseline = &history_[slot];
+  }
+  SpectatorFrame frame;
+  frame.number = number;
+  size_t pos = kFrameHeaderBytes;
+  for (int i = 0; i < SpectatorFrame::kNumFields; ++i) {
+    frame.fields[i] = baseline->fields[i];
+    if (mask & (1 << i)) {
+      uint32_t delta;
+      if (!GetVarint(packet, &pos, &delta)) {
+        return false;
+      }
+      frame.fields[i] += UnZigZag(delta);
+    }
+  }
+  int slot = number % history;
+  history_[slot] = frame;
+  have_[slot] = true;
+  ++stats_.frames;
+  if (back == 0) {
+    ++stats_.full_frames;
+  }
+  // Frames can arrive out of order; only a newer one replaces the latest.
+  if (latest_number_ < 0 ||
+      static_cast<int32_t>(number - static_cast<uint32_t>(latest_number_)) >
+          0) {
+    latest_number_ = number;
+    latest_slot_ = slot;
+  }
+  return true;
+}
+
+void SpectatorClient::SendAck() {
+  std::vector<uint8_t> ack(kAckBytes);
+  ack[0] = kAckTag;
+  PutLittleEndian(latest_number_ < 0 ? kNoFrame : latest_number_, 4,
+                  &ack[1]);
+  link_.Send(ack);
+  last_ack_ = Clock::now();
+}
+
+std::ostream& operator<<(std::ostream& stream,
+                         const SpectatorClient::Stats& stats) {
+  return stream << boost::format("frames=%d full=%d undecodable=%d "
+                                 "bytes=%d") %
+                       stats.frames % stats.full_frames % stats.undecodable %
+                       stats.bytes_received;
+}
+
+}  // namespace pong
@@ -0,0 +1,174 @@
+// Streams a live game to any number of spectators over UDP.
+//
+// Each broadcast, the server quantizes the board into a SpectatorFrame: the
+// pieces' boxes in fixed point, plus the score. Each spectator acknowledges
+// the frames it receives, and gets the new frame as a delta against the last
+// one it acknowledged: a mask of the fields which changed, then the change in
+// each as a variable-length integer. Usually that's the ball and maybe a
+// paddle, a dozen bytes or so. Spectators whose acknowledged frame is too old
+// (or who have never acknowledged one) get a delta against an all-zero frame,
+// i.e. the full state. Nothing is ever resent; a lost frame just makes the
+// next delta against an older frame.
+//
+// Spectators mostly acknowledge the same frames, so the server encodes each
+// delta once per distinct baseline, and sends to everyone in batches with
+// sendmmsg(), which is what lets one core keep up with thousands of them.
+
+#ifndef SPECTATOR_H_
+#define SPECTATOR_H_
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "game.h"
+#include "net.h"
+#include "util.h"
+
+namespace pong {
+
+// What spectators see of the board, in fixed point.
+struct SpectatorFrame {
+  enum Field {
+    BALL_X, BALL_Y, BALL_W, BALL_H,
+    LEFT_X, LEFT_Y, LEFT_W, LEFT_H,
+    RIGHT_X, RIGHT_Y, RIGHT_W, RIGHT_H,
+    LEFT_SCORE, RIGHT_SCORE, GAME_OVER,
+    kNumFields,
+  };
+
+  uint32_t number = 0;  // counts broadcasts
+  int32_t fields[kNumFields] = {};
+};
+
+// Boxes are stored in 1/65536ths of the board's size, which is finer than a
+// pixel on any display.
+SpectatorFrame QuantizeBoard(const GameBoard& game, uint32_t number);
+
+// Puts the pieces and score of `frame` on `game`, for drawing.
+void ApplySpectatorFrame(const SpectatorFrame& frame, GameBoard* game);
+
+class SpectatorServer {
+ public:
+  struct Stats {
+    int clients = 0;
+    int64_t broadcasts = 0;
+    int64_t packets_sent = 0;
+    int64_t full_frames_sent = 0;  // to spectators without a usable baseline
+    int64_t bytes_sent = 0;  // UDP payload
+    int64_t acks_received = 0;
+    int64_t send_failures = 0;  // e.g. the socket buffer was full
+  };
+
+  // Frames a spectator's acknowledgement can be behind and still serve as a
+  // baseline.
+  static constexpr int kHistoryFrames = 64;
+
+  // Listens on UDP `port`; 0 picks any free port. Spectators who haven't
+  // been heard from for `client_timeout_secs` are forgotten.
+  explicit SpectatorServer(int port, double client_timeout_secs = 5);
+  ~SpectatorServer();
+
+  int LocalPort() const;
+
+  // Takes in acknowledgements and new spectators, then sends every
+  // spectator the board as the next frame. Never blocks.
+  void Broadcast(const GameBoard& game);
+
+  // Just takes in acknowledgements and new spectators. With thousands of
+  // spectators, call this between broadcasts too, so their acknowledgements
+  // don't overflow the socket's receive buffer.
+  void Poll() { ReceiveAcks(Clock::now()); }
+
+  Stats GetStats() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Client {
+    sockaddr_in address;
+    int64_t acked_number;  // -1 if none
+    Clock::time_point last_heard;
+  };
+
+  void ReceiveAcks(Clock::time_point now);
+  void ForgetQuietClients(Clock::time_point now);
+  // The packet for frame `number` against the baseline `back` frames
+  // earlier, or the full frame for 0. Cached for this broadcast.
+  const std::vector<uint8_t>& EncodedFrame(uint32_t number, int back);
+
+  const int fd_;
+  const Clock::duration client_timeout_;
+
+  std::vector<Client> clients_;
+  std::unordered_map<uint64_t, int> client_index_;  // by address and port
+
+  uint32_t next_number_ = 0;
+  std::vector<SpectatorFrame> history_;  // ring buffer, indexed by number
+
+  // Per broadcast: one encoding of the new frame per baseline in use.
+  std::vector<std::vector<uint8_t>> encoded_;  // indexed by `back`
+  std::vector<bool> encoded_valid_;
+
+  DatagramBatcher batcher_;
+  Stats stats_;  // less what batcher_ counts
+
+  DISALLOW_COPY_AND_ASSIGN(SpectatorServer);
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const SpectatorServer::Stats& stats);
+
+// One spectator's end: receives frames from a SpectatorServer and
+// acknowledges them.
+class SpectatorClient {
+ public:
+  struct Stats {
+    int64_t frames = 0;   // decoded
+    int64_t full_frames = 0;
+    int64_t undecodable = 0;  // baseline unknown, or a malformed packet
+    int64_t bytes_received = 0;
+  };
+
+  // Binds any free local port, and starts asking `host`:`port` for frames.
+  SpectatorClient(const std::string& host, int port);
+
+  // Reads every frame which has arrived, then acknowledges the newest.
+  // Returns whether there's a newer frame than before. Never blocks.
+  bool Poll();
+
+  // Only meaningful once Poll() has returned true.
+  const SpectatorFrame& Latest() const { return history_[latest_slot_]; }
+
+  const Stats& GetStats() const { return stats_; }
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  bool Decode(const std::vector<uint8_t>& packet);
+  void SendAck();
+
+  UdpLink link_;
+  std::vector<SpectatorFrame> history_;  // ring buffer, indexed by number
+  std::vector<bool> have_;  // whether each slot of history_ holds a frame
+  int latest_slot_ = 0;
+  int64_t latest_number_ = -1;
+  Clock::time_point last_ack_;
+  std::vector<uint8_t> packet_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpectatorClient);
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const SpectatorClient::Stats& stats);
+
+}  // namespace pong
+
+#endif  // SPECTATOR_H_
@@ -0,0 +1,93 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <type_traits>
+#include <vector>
+
+#include "util.h"
+
+namespace util {
+
+// Fixed-capacity FIFO queue for exactly one producer thread and one consumer
+// thread, without locks. Neither side ever blocks: TryPush() fails when the
+// queue is full and TryPop() when it's empty, and it's up to the caller what
+// to do about it.
+//
+// Each side keeps a cached copy of the other side's index, and only reloads
+// it (a cache miss, since the other thread wrote it) when the cached value
+// says the queue is full or empty. The indices are padded onto separate
+// cache lines so the two threads don't fight over them.
+template <typename T>
+class SpscRing {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SpscRing items are copied around as plain data");
+
+  // Holds at least `min_capacity` items; rounded up to a power of two.
+  explicit SpscRing(size_t min_capacity)
+      : slots_(RoundUpToPowerOfTwo(min_capacity)), mask_(slots_.size() - 1) {}
+
+  size_t Capacity() const { return slots_.size(); }
+
+  // Producer only. Returns false, without copying `item`, if the queue is
+  // full.
+  bool TryPush(const T& item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - producer_cached_head_ == slots_.size()) {
+      producer_cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - producer_cached_head_ == slots_.size()) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the queue is empty.
+  bool TryPop(T* item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == consumer_cached_tail_) {
+      consumer_cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == consumer_cached_tail_) {
+        return false;
+      }
+    }
+    *item = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  static constexpr size_t kCacheLineBytes = 64;
+
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    size_t capacity = 1;
+    while (capacity < n) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+
+  std::vector<T> slots_;
+  const size_t mask_;
+  char pad0_[kCacheLineBytes];
+
+  // Written by the consumer.
+  std::atomic<size_t> head_{0};  // next slot to pop
+  size_t consumer_cached_tail_ = 0;
+  char pad1_[kCacheLineBytes];
+
+  // Written by the producer.
+  std::atomic<size_t> tail_{0};  // next slot to push
+  size_t producer_cached_head_ = 0;
+  char pad2_[kCacheLineBytes];
+
+  DISALLOW_COPY_AND_ASSIGN(SpscRing);
+};
+
+}  // namespace util
+
+#endif  // SPSC_RING_H_
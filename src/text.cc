@@ -0,0 +1,163 @@
+#include <limits.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "asset_pack.h"
+#include "text.h"
+
+namespace pong {
+
+namespace {
+// Glyphs are packed into rows of at most this many pixels.
+constexpr int kMaxAtlasWidth = 1024;
+}  // namespace
+
+TTF_Font* OpenFont(const AssetPack* pack, const std::string& data_path,
+                   const std::string& name, int point_size) {
+  const uint8_t* data;
+  size_t size;
+  if (pack != nullptr && pack->Find(name, &data, &size)) {
+    CHECK_LE(size, static_cast<size_t>(INT_MAX)) << "Font " << name
+                                                  << " is too big";
+    SDL_RWops* rw = SDL_RWFromConstMem(data, static_cast<int>(size));
+    if (rw == nullptr) {
+      return nullptr;
+    }
+    return TTF_OpenFontRW(rw, 1, point_size);  // closes rw
+  }
+  return TTF_OpenFont((data_path + "/" + name).c_str(), point_size);
+}
+
+GlyphAtlas::GlyphAtlas(const std::vector<GlyphFace>& faces, SDL_Color color)
+    : faces_(faces.size()) {
+  // Render every glyph to its own surface, and shelf-pack them.
+  struct PendingGlyph {
+    util::sdl::ManagedSurface surface;
+    Glyph* glyph;
+  };
+  std::vector<PendingGlyph> pending;
+  int atlas_w = 1;
+  int pen_x = 0;
+  int shelf_y = 0;
+  int shelf_h = 0;
+  for (size_t f = 0; f < faces.size(); ++f) {
+    TTF_Font* font = CHECK_NOTNULL(faces[f].font);
+    faces_[f].line_height = TTF_FontHeight(font);
+    for (char c : faces[f].characters) {
+      CHECK(c > 0) << "Only ASCII characters are supported";
+      Glyph& glyph = faces_[f].glyphs[static_cast<int>(c)];
+      if (glyph.present) {
+        continue;
+      }
+      int min_x, max_x, min_y, max_y;
+      CHECK(TTF_GlyphMetrics(font, c, &min_x, &max_x, &min_y, &max_y,
+                             &glyph.advance) == 0)
+          << "Font has no glyph for '" << c << "': " << TTF_GetError();
+      glyph.x_offset = std::min(0, min_x);
+      glyph.present = true;
+
+      // Rendering a one-character string (rather than TTF_RenderGlyph_*)
+      // gives a surface which is a full line tall, with the baseline in the
+      // same place for every glyph.
+      const char text[] = {c, '\0'};
+      util::sdl::ManagedSurface rendered(
+          TTF_RenderText_Blended(font, text, color));
+      if (!rendered || rendered->w == 0) {
+        continue;  // e.g. a space; nothing to draw
+      }
+      if (pen_x + rendered->w > kMaxAtlasWidth && pen_x > 0) {
+        pen_x = 0;
+        shelf_y += shelf_h;
+        shelf_h = 0;
+      }
+      glyph.source = {pen_x, shelf_y, rendered->w, rendered->h};
+      pen_x += rendered->w;
+      shelf_h = std::max(shelf_h, rendered->h);
+      atlas_w = std::max(atlas_w, pen_x);
+      pending.push_back({std::move(rendered), &glyph});
+    }
+  }
+
+  surface_.reset(SDL_CreateRGBSurfaceWithFormat(
+      0, atlas_w, std::max(1, shelf_y + shelf_h), 32,
+      SDL_PIXELFORMAT_ARGB8888));
+  CHECK(surface_) << "Could not create glyph atlas: " << SDL_GetError();
+  SDL_FillRect(surface_.get(), nullptr, 0);  // fully transparent
+  for (PendingGlyph& p : pending) {
+    // Copy the glyph's alpha as-is rather than blending it onto the atlas.
+    SDL_SetSurfaceBlendMode(p.surface.get(), SDL_BLENDMODE_NONE);
+    SDL_Rect dest = p.glyph->source;
+    SDL_BlitSurface(p.surface.get(), nullptr, surface_.get(), &dest);
+  }
+  SDL_SetSurfaceBlendMode(surface_.get(), SDL_BLENDMODE_BLEND);
+
+  LOG(INFO) << "Built " << surface_->w << "x" << surface_->h
+            << " glyph atlas with " << pending.size() << " glyphs";
+}
+
+SDL_Rect GlyphAtlas::Layout(int face, const std::string& text,
+                            std::vector<GlyphBlit>* blits) const {
+  const Face& f = faces_.at(face);
+  blits->clear();
+  int pen_x = 0;
+  for (char c : text) {
+    if (c <= 0 || !f.glyphs[static_cast<int>(c)].present) {
+      continue;
+    }
+    const Glyph& glyph = f.glyphs[static_cast<int>(c)];
+    if (glyph.source.w > 0) {
+      blits->push_back({glyph.source,
+                        {pen_x + glyph.x_offset, 0, glyph.source.w,
+                         glyph.source.h}});
+    }
+    pen_x += glyph.advance;
+  }
+  return {0, 0, pen_x, f.line_height};
+}
+
+TextLabel::TextLabel(const GlyphAtlas* atlas, int face, int x, int y,
+                     Align align)
+    : atlas_(CHECK_NOTNULL(atlas)), face_(face), x_(x), y_(y),
+      align_(align) {
+  bounds_ = {x_, y_, 0, atlas_->LineHeight(face_)};
+}
+
+bool TextLabel::SetText(const std::string& text) {
+  if (text == text_) {
+    return false;
+  }
+  text_ = text;
+  ++version_;
+
+  SDL_Rect size = atlas_->Layout(face_, text_, &blits_);
+  int left = x_;
+  if (align_ == Align::CENTER) {
+    left -= size.w / 2;
+  } else if (align_ == Align::RIGHT) {
+    left -= size.w;
+  }
+  bounds_ = {left, y_, size.w, size.h};
+  for (GlyphBlit& blit : blits_) {
+    blit.dest.x += left;
+    blit.dest.y += y_;
+    // Glyphs may overhang the advance-based bounds a little.
+    SDL_UnionRect(&bounds_, &blit.dest, &bounds_);
+  }
+  return true;
+}
+
+void TextLabel::Draw(const SDL_Rect& clip, SDL_Surface* surface) const {
+  for (const GlyphBlit& blit : blits_) {
+    SDL_Rect dest;
+    if (!SDL_IntersectRect(&blit.dest, &clip, &dest)) {
+      continue;
+    }
+    SDL_Rect source = {blit.source.x + (dest.x - blit.dest.x),
+                       blit.source.y + (dest.y - blit.dest.y), dest.w,
+                       dest.h};
+    SDL_BlitSurface(atlas_->surface(), &source, surface, &dest);
+  }
+}
+
+}  // namespace pong
@@ -0,0 +1,115 @@
+// Text drawing without per-frame font rendering.
+//
+// Rasterizing text with SDL_ttf is slow, so a GlyphAtlas rasterizes every
+// character we'll ever need once, up front, into a single surface. Drawing a
+// string is then just a blit per glyph out of that surface.
+
+#ifndef TEXT_H_
+#define TEXT_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "util.h"
+
+namespace pong {
+
+class AssetPack;
+
+// Opens the font `name` at `point_size` straight out of `pack`'s memory map
+// if it's in there, without copying it (so the pack must stay open until the
+// font is closed). Otherwise, or if `pack` is null, opens the file
+// `data_path`/`name`. Returns null if that fails too; see TTF_GetError().
+TTF_Font* OpenFont(const AssetPack* pack, const std::string& data_path,
+                   const std::string& name, int point_size);
+
+// The characters in one font at one size which should be put in an atlas.
+struct GlyphFace {
+  TTF_Font* font;  // only used while building the atlas
+  std::string characters;
+};
+
+// Where to copy one glyph from the atlas to draw it.
+struct GlyphBlit {
+  SDL_Rect source;  // in the atlas
+  SDL_Rect dest;    // relative to the start of the text
+};
+
+class GlyphAtlas {
+ public:
+  // Rasterizes every character of every face in `color`. This is the only
+  // place that SDL_ttf rendering happens.
+  GlyphAtlas(const std::vector<GlyphFace>& faces, SDL_Color color);
+
+  // Computes the glyph blits for `text` drawn with faces[face], starting at
+  // the origin, and returns the size of the text. Characters which weren't in
+  // the face are skipped.
+  SDL_Rect Layout(int face, const std::string& text,
+                  std::vector<GlyphBlit>* blits) const;
+
+  int LineHeight(int face) const { return faces_[face].line_height; }
+
+  SDL_Surface* surface() const { return surface_.get(); }
+
+ private:
+  struct Glyph {
+    SDL_Rect source = {0, 0, 0, 0};
+    int x_offset = 0;  // from the pen position to the left of `source`
+    int advance = 0;
+    bool present = false;
+  };
+  struct Face {
+    int line_height;
+    Glyph glyphs[128];  // ASCII only
+  };
+
+  std::vector<Face> faces_;
+  util::sdl::ManagedSurface surface_;
+
+  DISALLOW_COPY_AND_ASSIGN(GlyphAtlas);
+};
+
+// A string drawn at a fixed place on the screen, such as the score. Glyph
+// layout is redone only when the text actually changes.
+class TextLabel {
+ public:
+  enum class Align { LEFT, CENTER, RIGHT };
+
+  // The text is placed so that its top edge is at `y` and its `align` edge
+  // (or center) is at `x`.
+  TextLabel(const GlyphAtlas* atlas, int face, int x, int y, Align align);
+
+  // Returns whether the text changed.
+  bool SetText(const std::string& text);
+  const std::string& Text() const { return text_; }
+
+  // Where the text was drawn, and a counter which increments whenever the
+  // text changes. Together they tell a renderer whether to redraw the label.
+  const SDL_Rect& Bounds() const { return bounds_; }
+  int64_t Version() const { return version_; }
+
+  // Blends the part of the label which lies inside `clip` onto `surface`.
+  void Draw(const SDL_Rect& clip, SDL_Surface* surface) const;
+
+ private:
+  const GlyphAtlas* atlas_;  // Not owned
+  const int face_;
+  const int x_;
+  const int y_;
+  const Align align_;
+
+  std::string text_;
+  int64_t version_ = 0;
+  SDL_Rect bounds_ = {0, 0, 0, 0};
+  std::vector<GlyphBlit> blits_;  // with dest in screen coordinates
+
+  DISALLOW_COPY_AND_ASSIGN(TextLabel);
+};
+
+}  // namespace pong
+
+#endif  // TEXT_H_
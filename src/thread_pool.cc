@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <glog/logging.h>
+
+#include "thread_pool.h"
+
+namespace util {
+
+namespace {
+// The pool and worker index of the current thread, if it's a pool thread.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_worker = -1;
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(new Worker);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+int ThreadPool::CurrentWorker() { return current_worker; }
+
+void ThreadPool::Submit(std::function<void()> task) {
+  int index = current_worker;
+  if (current_pool != this) {
+    index = next_worker_.fetch_add(1, std::memory_order_relaxed) %
+            workers_.size();
+  }
+
+  {
+    // queued_ only goes up while holding mutex_, so a worker checking it
+    // before going to sleep can't miss the notification below. It goes up
+    // before the task is pushed, so a thief can't take queued_ below zero; a
+    // worker that wakes in between just finds nothing and checks again.
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++unfinished_;
+    queued_.fetch_add(1);
+  }
+  {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  }
+  work_available_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  CHECK(current_pool != this) << "ThreadPool::Wait called from its own thread";
+  std::unique_lock<std::mutex> lock(mutex_);
+  all_done_.wait(lock, [this] { return unfinished_ == 0; });
+}
+
+void ThreadPool::ParallelFor(int begin, int end,
+                             const std::function<void(int)>& fn,
+                             int tasks_per_thread) {
+  if (end <= begin) {
+    return;
+  }
+  int num_chunks = std::min(end - begin, NumThreads() * tasks_per_thread);
+  int chunk_size = (end - begin + num_chunks - 1) / num_chunks;
+  for (int chunk_begin = begin; chunk_begin < end; chunk_begin += chunk_size) {
+    int chunk_end = std::min(end, chunk_begin + chunk_size);
+    Submit([&fn, chunk_begin, chunk_end] {
+      for (int i = chunk_begin; i < chunk_end; ++i) {
+        fn(i);
+      }
+    });
+  }
+  Wait();
+}
+
+bool ThreadPool::PopOrSteal(int index, std::function<void()>* task) {
+  {
+    Worker& self = *workers_[index];
+    std::lock_guard<std::mutex> lock(self.mutex);
+    if (!self.tasks.empty()) {
+      *task = std::move(self.tasks.back());
+      self.tasks.pop_back();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+
+  // Steal the oldest task from the next worker which has any.
+  int num_workers = NumThreads();
+  for (int offset = 1; offset < num_workers; ++offset) {
+    Worker& victim = *workers_[(index + offset) % num_workers];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(int index) {
+  current_pool = this;
+  current_worker = index;
+  std::function<void()> task;
+  while (true) {
+    if (PopOrSteal(index, &task)) {
+      task();
+      task = nullptr;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--unfinished_ == 0) {
+        all_done_.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_available_.wait(lock,
+                         [this] { return stopping_ || queued_.load() > 0; });
+    if (stopping_ && queued_.load() == 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace util
@@ -0,0 +1,76 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+
+namespace util {
+
+// Fixed-size pool of worker threads with work stealing. Every worker has its
+// own task queue. Workers run tasks from the back of their own queue, and
+// when it runs dry they steal from the front of the other workers' queues, so
+// an uneven mix of long and short tasks still keeps every core busy.
+//
+// Tasks submitted from outside the pool are dealt out round-robin; tasks
+// submitted from inside a task go on the submitting worker's own queue.
+class ThreadPool {
+ public:
+  // `num_threads` <= 0 means one thread per hardware thread.
+  explicit ThreadPool(int num_threads = 0);
+
+  // Waits for all submitted tasks to finish.
+  ~ThreadPool();
+
+  int NumThreads() const { return static_cast<int>(workers_.size()); }
+
+  void Submit(std::function<void()> task);
+
+  // Blocks until every task submitted so far has finished running. Must not
+  // be called from inside one of this pool's tasks.
+  void Wait();
+
+  // Calls fn(i) for every i in [begin, end), split into roughly
+  // `tasks_per_thread` chunks per worker, then Wait()s.
+  void ParallelFor(int begin, int end, const std::function<void(int)>& fn,
+                   int tasks_per_thread = 4);
+
+  // Index in [0, NumThreads()) of the worker calling this, or -1 if called
+  // from a thread which doesn't belong to any pool.
+  static int CurrentWorker();
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void WorkerLoop(int index);
+  bool PopOrSteal(int index, std::function<void()>* task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<unsigned> next_worker_{0};
+
+  // Tasks sitting in some queue, and tasks submitted but not yet finished.
+  std::atomic<int> queued_{0};
+  int unfinished_ = 0;  // guarded by mutex_
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable all_done_;
+  bool stopping_ = false;  // guarded by mutex_
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace util
+
+#endif  // THREAD_POOL_H_
@@ -0,0 +1,241 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <glog/logging.h>
+
+#include "tile_rasterizer.h"
+
+namespace pong {
+
+namespace {
+
+// Sets pixels [x0, x1) of `row` to `pixel`.
+void FillSpan(Uint32* row, int x0, int x1, Uint32 pixel) {
+  Uint32* p = row + x0;
+  Uint32* end = row + x1;
+#if defined(__SSE2__)
+  // Scalar up to a 16-byte boundary, then four aligned stores (16 pixels)
+  // at a time.
+  while (p < end && (reinterpret_cast<uintptr_t>(p) & 15) != 0) {
+    *p++ = pixel;
+  }
+  __m128i fill = _mm_set1_epi32(pixel);
+  for (; end - p >= 16; p += 16) {
+    _mm_store_si128(reinterpret_cast<__m128i*>(p), fill);
+    _mm_store_si128(reinterpret_cast<__m128i*>(p + 4), fill);
+    _mm_store_si128(reinterpret_cast<__m128i*>(p + 8), fill);
+    _mm_store_si128(reinterpret_cast<__m128i*>(p + 12), fill);
+  }
+  for (; end - p >= 4; p += 4) {
+    _mm_store_si128(reinterpret_cast<__m128i*>(p), fill);
+  }
+#endif
+  while (p < end) {
+    *p++ = pixel;
+  }
+}
+
+// Blends `pixel` over pixels [x0, x1) of `row`, `alpha` of the way. Works a
+// byte at a time, so it doesn't matter what order the channels are in.
+void BlendSpan(Uint32* row, int x0, int x1, Uint32 pixel, uint8_t alpha) {
+  Uint32* p = row + x0;
+  Uint32* end = row + x1;
+  // dst' = (src * a + dst * (256 - a)) / 256, which fits in 16 bits.
+  const unsigned a = alpha;
+  const unsigned inv_a = 256 - alpha;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i src_a = _mm_mullo_epi16(
+      _mm_unpacklo_epi8(_mm_set1_epi32(pixel), zero), _mm_set1_epi16(a));
+  const __m128i inv = _mm_set1_epi16(inv_a);
+  for (; end - p >= 4; p += 4) {
+    __m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i lo = _mm_unpacklo_epi8(dst, zero);
+    __m128i hi = _mm_unpackhi_epi8(dst, zero);
+    lo = _mm_srli_epi16(_mm_add_epi16(src_a, _mm_mullo_epi16(lo, inv)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(src_a, _mm_mullo_epi16(hi, inv)), 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(lo, hi));
+  }
+#endif
+  for (; p < end; ++p) {
+    Uint32 dst = *p;
+    Uint32 out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      Uint32 s = (pixel >> shift) & 0xFF;
+      Uint32 d = (dst >> shift) & 0xFF;
+      out |= ((s * a + d * inv_a) >> 8) << shift;
+    }
+    *p = out;
+  }
+}
+
+// Copies `n` pixels from `line` to `dest`. Uses non-temporal stores, which
+// skip reading the destination into the cache first; nothing will read it
+// again until the surface is presented.
+void StreamSpan(const Uint32* line, int n, Uint32* dest) {
+  const Uint32* end = line + n;
+#if defined(__SSE2__)
+  while (line < end && (reinterpret_cast<uintptr_t>(dest) & 15) != 0) {
+    *dest++ = *line++;
+  }
+  for (; end - line >= 4; line += 4, dest += 4) {
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dest),
+                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(line)));
+  }
+#endif
+  while (line < end) {
+    *dest++ = *line++;
+  }
+}
+
+// How far in from each side a rounded rect's row `y` starts, for a rect
+// `height` rows tall with corners of `radius`.
+int RoundedInset(int y, int height, int radius) {
+  int from_edge = std::min(y, height - 1 - y);
+  if (from_edge >= radius) {
+    return 0;
+  }
+  // Distance from the corner circle's center to the middle of the row.
+  double dy = radius - from_edge - 0.5;
+  return radius -
+         static_cast<int>(std::lround(std::sqrt(radius * radius - dy * dy)));
+}
+
+}  // namespace
+
+RasterShape RasterShape::Rect(const SDL_Rect& rect, SDL_Color color) {
+  return {rect, 0, color, Kind::RECT};
+}
+
+RasterShape RasterShape::RoundedRect(const SDL_Rect& rect, int radius,
+                                     SDL_Color color) {
+  radius = std::max(0, std::min(radius, std::min(rect.w, rect.h) / 2));
+  return {rect, radius, color, Kind::ROUNDED_RECT};
+}
+
+Uint32 PixelColorCache::Map(const SDL_PixelFormat* format, SDL_Color color) {
+  if (format != format_ || format->format != format_enum_) {
+    format_ = format;
+    format_enum_ = format->format;
+    pixels_.clear();
+  }
+  Uint32 key = (color.r << 16) | (color.g << 8) | color.b;
+  auto it = pixels_.find(key);
+  if (it == pixels_.end()) {
+    it = pixels_.emplace(key, SDL_MapRGB(format, color.r, color.g, color.b))
+             .first;
+  }
+  return it->second;
+}
+
+constexpr int TileRasterizer::kMaxTileWidth;
+
+TileRasterizer::TileRasterizer(util::ThreadPool* pool, int tile_width,
+                               int tile_height)
+    : pool_(pool), tile_width_(tile_width), tile_height_(tile_height) {
+  CHECK(tile_width > 0 && tile_width <= kMaxTileWidth)
+      << "Bad tile width: " << tile_width;
+  CHECK_GT(tile_height, 0);
+}
+
+void TileRasterizer::Draw(const std::vector<RasterShape>& shapes,
+                          SDL_Color background, SDL_Surface* surface) {
+  CHECK_EQ(surface->format->BytesPerPixel, 4)
+      << "TileRasterizer only draws to 32-bit surfaces";
+
+  // Map colors and clip to the surface up front, and put each shape in the
+  // bins of the tiles it touches, so that tiles only look at their own.
+  SDL_Rect surface_rect = {0, 0, surface->w, surface->h};
+  tiles_x_ = (surface->w + tile_width_ - 1) / tile_width_;
+  tiles_y_ = (surface->h + tile_height_ - 1) / tile_height_;
+  tile_shapes_.resize(tiles_x_ * tiles_y_);
+  for (std::vector<int>& bin : tile_shapes_) {
+    bin.clear();
+  }
+  prepared_.clear();
+  for (const RasterShape& shape : shapes) {
+    SDL_Rect clipped;
+    if (shape.color.a == 0 ||
+        !SDL_IntersectRect(&shape.rect, &surface_rect, &clipped)) {
+      continue;
+    }
+    int index = prepared_.size();
+    prepared_.push_back({shape.rect, shape.radius,
+                         colors_.Map(surface->format, shape.color),
+                         shape.color.a, shape.kind});
+    int tx1 = (clipped.x + clipped.w - 1) / tile_width_;
+    int ty1 = (clipped.y + clipped.h - 1) / tile_height_;
+    for (int ty = clipped.y / tile_height_; ty <= ty1; ++ty) {
+      for (int tx = clipped.x / tile_width_; tx <= tx1; ++tx) {
+        tile_shapes_[ty * tiles_x_ + tx].push_back(index);
+      }
+    }
+  }
+
+  Uint32 background_pixel = colors_.Map(surface->format, background);
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_LockSurface(surface);
+  }
+  auto draw_tile = [this, background_pixel, surface](int tile) {
+    DrawTile(tile, background_pixel, surface);
+  };
+  if (pool_) {
+    pool_->ParallelFor(0, tiles_x_ * tiles_y_, draw_tile);
+  } else {
+    for (int tile = 0; tile < tiles_x_ * tiles_y_; ++tile) {
+      draw_tile(tile);
+    }
+  }
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_UnlockSurface(surface);
+  }
+}
+
+void TileRasterizer::DrawTile(int tile, Uint32 background,
+                              SDL_Surface* surface) const {
+  int x0 = (tile % tiles_x_) * tile_width_;
+  int y0 = (tile / tiles_x_) * tile_height_;
+  int x1 = std::min(x0 + tile_width_, surface->w);
+  int y1 = std::min(y0 + tile_height_, surface->h);
+  const std::vector<int>& bin = tile_shapes_[tile];
+
+  // Each row of the tile is drawn into `line`, which stays in L1, and then
+  // written to the surface once.
+  alignas(16) Uint32 line[kMaxTileWidth];
+  for (int y = y0; y < y1; ++y) {
+    FillSpan(line, 0, x1 - x0, background);
+    for (int index : bin) {
+      const Prepared& shape = prepared_[index];
+      if (y < shape.rect.y || y >= shape.rect.y + shape.rect.h) {
+        continue;
+      }
+      int inset = 0;
+      if (shape.kind == RasterShape::Kind::ROUNDED_RECT) {
+        inset = RoundedInset(y - shape.rect.y, shape.rect.h, shape.radius);
+      }
+      int left = std::max(x0, shape.rect.x + inset) - x0;
+      int right = std::min(x1, shape.rect.x + shape.rect.w - inset) - x0;
+      if (left >= right) {
+        continue;
+      }
+      if (shape.alpha == 0xFF) {
+        FillSpan(line, left, right, shape.pixel);
+      } else {
+        BlendSpan(line, left, right, shape.pixel, shape.alpha);
+      }
+    }
+    Uint32* row = reinterpret_cast<Uint32*>(
+        static_cast<uint8_t*>(surface->pixels) + y * surface->pitch);
+    StreamSpan(line, x1 - x0, row + x0);
+  }
+#if defined(__SSE2__)
+  _mm_sfence();  // make the streamed stores visible to other threads
+#endif
+}
+
+}  // namespace pong
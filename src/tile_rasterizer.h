@@ -0,0 +1,101 @@
+// Software rasterizer for big surfaces, e.g. a 4K or 8K wall display.
+//
+// The surface is split into tiles, and each tile is drawn start to finish
+// (background, then every shape touching it, in order) by one thread of a
+// pool, so tiles fill in parallel. Each row of a tile is put together in a
+// small buffer which stays in L1, a span at a time with SIMD stores, and then
+// streamed out to the surface. Every pixel of the surface is written exactly
+// once, however many shapes overlap it, and never read; at these sizes memory
+// bandwidth is what limits a full redraw.
+//
+// Only 32-bit surfaces are supported, which is what window surfaces are in
+// practice.
+
+#ifndef TILE_RASTERIZER_H_
+#define TILE_RASTERIZER_H_
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <SDL.h>
+
+#include "thread_pool.h"
+#include "util.h"
+
+namespace pong {
+
+// Something to fill, in pixels. The color's alpha blends it over what's
+// underneath; 0xFF is opaque, and fastest.
+struct RasterShape {
+  enum class Kind : uint8_t {
+    RECT,
+    ROUNDED_RECT,  // corners rounded by `radius`; a circle if it's half the
+                   // size of a square
+  };
+
+  static RasterShape Rect(const SDL_Rect& rect, SDL_Color color);
+  static RasterShape RoundedRect(const SDL_Rect& rect, int radius,
+                                 SDL_Color color);
+
+  SDL_Rect rect;
+  int radius;
+  SDL_Color color;
+  Kind kind;
+};
+
+// Maps colors to pixel values for one surface format at a time, so drawing
+// a shape doesn't call SDL_MapRGB. Switching formats empties it.
+class PixelColorCache {
+ public:
+  Uint32 Map(const SDL_PixelFormat* format, SDL_Color color);
+
+ private:
+  const SDL_PixelFormat* format_ = nullptr;
+  Uint32 format_enum_ = 0;
+  std::unordered_map<Uint32, Uint32> pixels_;  // RGB -> pixel value
+};
+
+class TileRasterizer {
+ public:
+  static constexpr int kMaxTileWidth = 1024;
+
+  // Draws tiles on `pool`'s threads, or all on the calling thread if `pool`
+  // is null. The pool isn't owned. Tiles may be at most kMaxTileWidth wide.
+  explicit TileRasterizer(util::ThreadPool* pool, int tile_width = 256,
+                          int tile_height = 64);
+
+  // Fills `surface` with `background`, then draws `shapes` over it in order.
+  // CHECK-fails unless the surface has 4 bytes per pixel.
+  void Draw(const std::vector<RasterShape>& shapes, SDL_Color background,
+            SDL_Surface* surface);
+
+ private:
+  // A shape with its color mapped, ready to draw.
+  struct Prepared {
+    SDL_Rect rect;
+    int radius;
+    Uint32 pixel;
+    uint8_t alpha;
+    RasterShape::Kind kind;
+  };
+
+  void DrawTile(int tile, Uint32 background, SDL_Surface* surface) const;
+
+  util::ThreadPool* pool_;  // not owned; may be null
+  const int tile_width_;
+  const int tile_height_;
+  PixelColorCache colors_;
+
+  // Rebuilt every Draw(); kept to reuse their memory.
+  std::vector<Prepared> prepared_;
+  int tiles_x_ = 0;
+  int tiles_y_ = 0;
+  std::vector<std::vector<int>> tile_shapes_;  // indices into prepared_
+
+  DISALLOW_COPY_AND_ASSIGN(TileRasterizer);
+};
+
+}  // namespace pong
+
+#endif  // TILE_RASTERIZER_H_
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <glog/logging.h>
+
+#include "controller.h"
+#include "replay.h"
+#include "thread_pool.h"
+#include "tournament.h"
+
+namespace pong {
+
+namespace {
+// Scrambles a seed so that consecutive match indices give unrelated seeds.
+// This is the finalizer from SplitMix64.
+uint64_t MixSeed(uint64_t seed) {
+  seed += 0x9E3779B97F4A7C15ull;
+  seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+  seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+  return seed ^ (seed >> 31);
+}
+}  // namespace
+
+MatchResult PlayMatch(const MatchParams& params) {
+  auto start = std::chrono::steady_clock::now();
+
+  std::unique_ptr<PaddleController> left =
+      NewAiController(params.left_controller);
+  std::unique_ptr<PaddleController> right =
+      NewAiController(params.right_controller);
+  CHECK(left) << "Unknown controller: " << params.left_controller;
+  CHECK(right) << "Unknown controller: " << params.right_controller;
+
+  // Moves are recorded on their way from the controllers to the board.
+  RecordingPaddleController left_recorder(left.get());
+  RecordingPaddleController right_recorder(right.get());
+  std::unique_ptr<ReplayWriter> replay;
+  if (!params.replay_path.empty()) {
+    replay = util::make_unique<ReplayWriter>(params.replay_path,
+                                             params.seconds_per_tick);
+  }
+
+  GameBoard game;
+  game.SetLeftController(&left_recorder);
+  game.SetRightController(&right_recorder);
+  std::mt19937_64 rng(params.seed);
+
+  MatchResult result;
+  result.params = params;
+  bool draw = false;
+  while (game.left_score_ < params.points_to_win &&
+         game.right_score_ < params.points_to_win) {
+    game.SetupNewGame(RandomServeDirection(&rng));
+    if (replay) {
+      replay->Discontinuity();
+    }
+    int point_ticks = 0;
+    while (!game.IsGameOver() && point_ticks < params.max_ticks_per_point) {
+      if (replay) {
+        replay->BeginTick(game);
+        game.Update(params.seconds_per_tick);
+        replay->EndTick(left_recorder.LastMove(), right_recorder.LastMove());
+      } else {
+        game.Update(params.seconds_per_tick);
+      }
+      ++point_ticks;
+    }
+    result.ticks += point_ticks;
+    if (!game.IsGameOver()) {
+      draw = true;
+      break;
+    }
+  }
+
+  result.left_score = game.left_score_;
+  result.right_score = game.right_score_;
+  if (!draw) {
+    result.winner = (game.left_score_ > game.right_score_)
+                        ? GameBoard::Player::LEFT
+                        : GameBoard::Player::RIGHT;
+  }
+  result.wall_secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+TournamentResult RunTournament(const TournamentParams& params,
+                               util::ThreadPool* pool) {
+  auto start = std::chrono::steady_clock::now();
+  const int num_controllers = params.controllers.size();
+
+  // Build the whole schedule up front, so every match's seed only depends on
+  // its position in the schedule.
+  std::vector<MatchParams> schedule;
+  for (int i = 0; i < num_controllers; ++i) {
+    for (int j = 0; j < num_controllers; ++j) {
+      if (i == j) {
+        continue;
+      }
+      for (int k = 0; k < params.matches_per_pair; ++k) {
+        MatchParams match;
+        match.left_controller = params.controllers[i];
+        match.right_controller = params.controllers[j];
+        match.points_to_win = params.points_to_win;
+        match.seed = MixSeed(params.seed + schedule.size());
+        if (!params.replay_dir.empty()) {
+          match.replay_path = params.replay_dir + "/match_" +
+                              std::to_string(schedule.size()) + ".pongreplay";
+        }
+        schedule.push_back(match);
+      }
+    }
+  }
+
+  // Each task writes only its own slot, so no locking is needed.
+  TournamentResult result;
+  result.controllers = params.controllers;
+  result.matches.resize(schedule.size());
+  for (size_t m = 0; m < schedule.size(); ++m) {
+    pool->Submit([&schedule, &result, m] {
+      result.matches[m] = PlayMatch(schedule[m]);
+    });
+  }
+  pool->Wait();
+
+  result.wins.assign(num_controllers, std::vector<int>(num_controllers, 0));
+  result.draws.assign(num_controllers, std::vector<int>(num_controllers, 0));
+  size_t m = 0;
+  for (int i = 0; i < num_controllers; ++i) {
+    for (int j = 0; j < num_controllers; ++j) {
+      if (i == j) {
+        continue;
+      }
+      for (int k = 0; k < params.matches_per_pair; ++k, ++m) {
+        switch (result.matches[m].winner) {
+          case GameBoard::Player::LEFT:
+            result.wins[i][j] += 1;
+            break;
+          case GameBoard::Player::RIGHT:
+            result.wins[j][i] += 1;
+            break;
+          default:
+            result.draws[i][j] += 1;
+            result.draws[j][i] += 1;
+            break;
+        }
+      }
+    }
+  }
+
+  result.wall_secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+}  // namespace pong
@@ -0,0 +1,82 @@
+// Round-robin tournaments between AI paddle controllers, used to rank them.
+
+#ifndef TOURNAMENT_H_
+#define TOURNAMENT_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "game.h"
+
+namespace util {
+class ThreadPool;
+}  // namespace util
+
+namespace pong {
+
+struct MatchParams {
+  // Names of the controllers, as accepted by NewAiController().
+  std::string left_controller;
+  std::string right_controller;
+
+  // Every serve direction in the match is drawn from an RNG seeded with this,
+  // so a match can be replayed exactly from its seed.
+  uint64_t seed = 0;
+
+  int points_to_win = 5;
+  double seconds_per_tick = 1.0 / 240;
+
+  // If a single point takes longer than this, the match is called a draw.
+  // Two perfect players would otherwise rally forever.
+  int max_ticks_per_point = 240 * 120;
+
+  // If set, the match is recorded to this file (see replay.h).
+  std::string replay_path;
+};
+
+struct MatchResult {
+  MatchParams params;
+  GameBoard::Player winner = GameBoard::Player::NONE;  // NONE means a draw
+  int left_score = 0;
+  int right_score = 0;
+  int64_t ticks = 0;
+  double wall_secs = 0;
+};
+
+// Plays one match to completion on the calling thread.
+MatchResult PlayMatch(const MatchParams& params);
+
+struct TournamentParams {
+  std::vector<std::string> controllers;
+  // Matches per ordered pair of controllers, so every pair meets
+  // 2 * matches_per_pair times: half with each controller on the left.
+  int matches_per_pair = 10;
+  uint64_t seed = 0;
+  int points_to_win = 5;
+
+  // If set, every match is recorded to a replay file in this directory,
+  // named after its position in the schedule.
+  std::string replay_dir;
+};
+
+struct TournamentResult {
+  std::vector<std::string> controllers;
+  // wins[i][j] is how many matches controllers[i] won against controllers[j],
+  // playing on either side. Draws are counted in draws[i][j].
+  std::vector<std::vector<int>> wins;
+  std::vector<std::vector<int>> draws;
+  std::vector<MatchResult> matches;  // in schedule order
+  double wall_secs = 0;
+};
+
+// Plays every controller against every other controller, spreading matches
+// over the threads of `pool`. Each match gets its own seed derived from
+// params.seed and its position in the schedule, so results don't depend on
+// which thread ran which match or how many threads there were.
+TournamentResult RunTournament(const TournamentParams& params,
+                               util::ThreadPool* pool);
+
+}  // namespace pong
+
+#endif  // TOURNAMENT_H_
@@ -0,0 +1,77 @@
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "util.h"
+
+namespace util {
+
+// Hands the latest value of something from exactly one writer thread to
+// exactly one reader thread, without locks, and without either side ever
+// waiting for the other. Unlike a queue, the reader only sees the newest
+// value; ones published while it wasn't looking are simply overwritten.
+//
+// There are three slots. The writer owns one (the back), the reader owns one
+// (the front), and the third sits in the middle. Publishing swaps the back
+// slot with the middle one; picking up a new value swaps the middle slot with
+// the front. The middle slot's index and a "fresh" bit share one atomic byte,
+// so each swap is a single exchange.
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() = default;
+
+  // Writer only. The slot to fill in before calling Publish(). It holds
+  // whatever was last written to it, which isn't necessarily the last value
+  // published, so overwrite all of it.
+  T* WriteBuffer() { return &slots_[back_].value; }
+
+  // Writer only. Makes the contents of WriteBuffer() the latest value, and
+  // gives the writer another slot to fill in.
+  void Publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+            kIndexMask;
+  }
+
+  // Reader only. Picks up the latest value, if one was published since the
+  // last call. Returns false, leaving Read() as it was, if not.
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  // Reader only. The value picked up by the last successful Update(). Only
+  // meaningful once there has been one.
+  const T& Read() const { return slots_[front_].value; }
+
+ private:
+  static constexpr size_t kCacheLineBytes = 64;
+  static constexpr uint8_t kIndexMask = 3;
+  static constexpr uint8_t kFresh = 4;
+
+  // Padded so that the writer filling in one slot doesn't keep knocking the
+  // reader's slot out of its cache.
+  struct Slot {
+    T value;
+    char pad[kCacheLineBytes];
+  };
+  Slot slots_[3];
+
+  uint8_t back_ = 0;  // writer's
+  char pad0_[kCacheLineBytes];
+  std::atomic<uint8_t> middle_{1};
+  char pad1_[kCacheLineBytes];
+  uint8_t front_ = 2;  // reader's
+
+  DISALLOW_COPY_AND_ASSIGN(TripleBuffer);
+};
+
+}  // namespace util
+
+#endif  // TRIPLE_BUFFER_H_
@@ -3,6 +3,7 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <string.h>
 #include <memory>
 #include <ostream>
 #include <utility>
@@ -68,6 +69,27 @@ typedef std::unique_ptr<SDL_Window, WindowDeleter> ManagedWindow;
 typedef std::unique_ptr<TTF_Font, FontDeleter> ManagedFont;
 typedef std::unique_ptr<SDL_Surface, SurfaceDeleter> ManagedSurface;
 
+// Returns true if both surfaces have the same size and format, and identical
+// pixels. Only compares the visible part of each row, not pitch padding.
+inline bool SurfacePixelsEqual(SDL_Surface* a, SDL_Surface* b) {
+  if (a->w != b->w || a->h != b->h ||
+      a->format->format != b->format->format) {
+    return false;
+  }
+  if (SDL_MUSTLOCK(a)) { SDL_LockSurface(a); }
+  if (SDL_MUSTLOCK(b)) { SDL_LockSurface(b); }
+  size_t row_bytes = static_cast<size_t>(a->w) * a->format->BytesPerPixel;
+  bool equal = true;
+  for (int y = 0; y < a->h && equal; ++y) {
+    equal = memcmp(static_cast<const Uint8*>(a->pixels) + y * a->pitch,
+                   static_cast<const Uint8*>(b->pixels) + y * b->pitch,
+                   row_bytes) == 0;
+  }
+  if (SDL_MUSTLOCK(b)) { SDL_UnlockSurface(b); }
+  if (SDL_MUSTLOCK(a)) { SDL_UnlockSurface(a); }
+  return equal;
+}
+
 // Simple class that calls SDL_Init when instantiated and calls SDL_Quit when
 // destroyed.
 class SDLContext {
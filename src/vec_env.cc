@@ -0,0 +1,122 @@
+#include <random>
+
+#include <glog/logging.h>
+
+#include "controller.h"
+#include "game.h"
+#include "thread_pool.h"
+#include "vec_env.h"
+
+namespace pong {
+
+constexpr int VecEnv::kObservationSize;
+constexpr int VecEnv::kNumActions;
+
+struct VecEnv::Env {
+  GameBoard game;
+  FixedMoveController agent;
+  std::unique_ptr<PaddleController> opponent;
+  std::mt19937_64 rng;
+  int episode_ticks = 0;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  void Serve() {
+    game.SetupNewGame(RandomServeDirection(&rng));
+    episode_ticks = 0;
+  }
+
+  void Observe(float* out) const {
+    Eigen::Vector2d ball = game.ball_.bounds_.Center();
+    out[0] = ball.x();
+    out[1] = ball.y();
+    out[2] = game.ball_.velocity_.x();
+    out[3] = game.ball_.velocity_.y();
+    out[4] = game.left_paddle_.bounds_.Center().y();
+    out[5] = game.right_paddle_.bounds_.Center().y();
+    out[6] = game.left_paddle_.max_speed_;
+  }
+};
+
+VecEnv::VecEnv(const VecEnvParams& params) : params_(params) {
+  CHECK(params_.num_envs > 0) << "Need at least one environment";
+  CHECK(params_.ticks_per_step > 0) << "Bad ticks per step";
+  for (int i = 0; i < params_.num_envs; ++i) {
+    std::unique_ptr<Env> env(new Env);
+    env->opponent = NewAiController(params_.opponent);
+    CHECK(env->opponent) << "Unknown opponent: " << params_.opponent;
+    env->game.SetLeftController(&env->agent);
+    env->game.SetRightController(env->opponent.get());
+    envs_.push_back(std::move(env));
+  }
+  if (params_.threads != 1) {
+    pool_ = util::make_unique<util::ThreadPool>(params_.threads);
+  }
+}
+
+VecEnv::~VecEnv() {}
+
+void VecEnv::Reset(const uint64_t* seeds, float* observations) {
+  for (int i = 0; i < NumEnvs(); ++i) {
+    Env& env = *envs_[i];
+    // A new opponent and a still agent, so that nothing left over from the
+    // last episode (e.g. a cached intercept) can make the same seeds play out
+    // differently.
+    env.opponent = NewAiController(params_.opponent);
+    env.game.SetRightController(env.opponent.get());
+    env.agent.SetMove(MoveDirection::NONE);
+    env.rng.seed(seeds[i]);
+    env.game.left_score_ = 0;
+    env.game.right_score_ = 0;
+    env.Serve();
+    env.Observe(observations + i * kObservationSize);
+  }
+}
+
+void VecEnv::Step(const int32_t* actions, float* observations, float* rewards,
+                  uint8_t* dones) {
+  auto step = [&](int i) {
+    StepEnv(i, actions[i], observations + i * kObservationSize, rewards + i,
+            dones + i);
+  };
+  if (pool_) {
+    pool_->ParallelFor(0, NumEnvs(), step);
+  } else {
+    for (int i = 0; i < NumEnvs(); ++i) {
+      step(i);
+    }
+  }
+}
+
+void VecEnv::StepEnv(int index, int32_t action, float* observation,
+                     float* reward, uint8_t* done) {
+  Env& env = *envs_[index];
+  if (action < 0 || action >= kNumActions) {
+    LOG_EVERY_N(WARNING, 1000) << "Ignoring bad action " << action;
+    action = 0;
+  }
+  env.agent.SetMove(static_cast<MoveDirection>(action));
+
+  *reward = 0;
+  *done = 0;
+  for (int tick = 0; tick < params_.ticks_per_step; ++tick) {
+    env.game.Update(params_.seconds_per_tick);
+    ++env.episode_ticks;
+    if (env.game.IsGameOver()) {
+      *reward = env.game.LastPlayerToScore() == GameBoard::Player::LEFT ? 1
+                                                                        : -1;
+      *done = 1;
+      break;
+    }
+    if (env.episode_ticks >= params_.max_ticks_per_episode) {
+      *done = 1;
+      break;
+    }
+  }
+  if (*done) {
+    env.Serve();
+  }
+  env.Observe(observation);
+}
+
+}  // namespace pong
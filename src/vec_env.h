@@ -0,0 +1,92 @@
+// A batch of pong games for training paddle agents with reinforcement
+// learning, in the style of a gym VecEnv. The agent plays the left paddle
+// against a built-in AI. One step of the batch advances every game at once;
+// results are written into flat arrays owned by the caller, so nothing is
+// allocated per step and a trainer can hand in its own tensors' memory.
+//
+// Each point is an episode. When a point ends (or runs too long), that game
+// is served again straight away, so the batch never stops.
+//
+// See vec_env_c.h for a C interface to this, e.g. for Python's ctypes.
+
+#ifndef VEC_ENV_H_
+#define VEC_ENV_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace util {
+class ThreadPool;
+}  // namespace util
+
+namespace pong {
+
+struct VecEnvParams {
+  int num_envs = 1;
+  double seconds_per_tick = 1.0 / 240;
+
+  // Game ticks per step, with the agent's action repeated for all of them.
+  // The default lets the agent act 60 times per game second.
+  int ticks_per_step = 4;
+
+  // An episode which lasts longer than this is cut short, with no reward.
+  int max_ticks_per_episode = 240 * 60;
+
+  // Controller for the right paddle, as accepted by NewAiController().
+  std::string opponent = "follow_ball_y";
+
+  // Threads to step the games on. 0 means one per hardware thread; 1 steps
+  // them on the calling thread.
+  int threads = 0;
+};
+
+class VecEnv {
+ public:
+  // Floats per game in an observation: the ball's center x and y, the ball's
+  // velocity x and y, the agent's paddle's center y, the opponent's paddle's
+  // center y, and the paddles' speed. Positions are in game units, with the
+  // board running from 0 to 1; speeds are in game units per second.
+  static constexpr int kObservationSize = 7;
+
+  // Actions are MoveDirection values: 0 = NONE, 1 = UP, 2 = DOWN.
+  static constexpr int kNumActions = 3;
+
+  // CHECK-fails if params.opponent isn't a known controller.
+  explicit VecEnv(const VecEnvParams& params);
+  ~VecEnv();
+
+  int NumEnvs() const { return params_.num_envs; }
+
+  // Starts a new episode in every game. Game i's serves are random, drawn
+  // from `seeds[i]`. Writes NumEnvs() * kObservationSize floats to
+  // `observations`.
+  void Reset(const uint64_t* seeds, float* observations);
+
+  // Plays `actions[i]` in game i for one step. Writes each game's
+  // observation, reward (+1 if the agent won the point, -1 if it lost it,
+  // otherwise 0) and whether its episode ended. A game whose episode ended
+  // has already been served again, so its observation is the first of its
+  // next episode.
+  void Step(const int32_t* actions, float* observations, float* rewards,
+            uint8_t* dones);
+
+ private:
+  struct Env;
+
+  void StepEnv(int index, int32_t action, float* observation, float* reward,
+               uint8_t* done);
+
+  const VecEnvParams params_;
+  std::vector<std::unique_ptr<Env>> envs_;
+  std::unique_ptr<util::ThreadPool> pool_;  // Null if single-threaded
+
+  DISALLOW_COPY_AND_ASSIGN(VecEnv);
+};
+
+}  // namespace pong
+
+#endif  // VEC_ENV_H_
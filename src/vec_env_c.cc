@@ -0,0 +1,48 @@
+#include "controller.h"
+#include "vec_env.h"
+#include "vec_env_c.h"
+
+struct PongVecEnv {
+  explicit PongVecEnv(const pong::VecEnvParams& params) : env(params) {}
+  pong::VecEnv env;
+};
+
+PongVecEnv* pong_vec_env_create(int num_envs, int ticks_per_step,
+                                int num_threads, const char* opponent) {
+  pong::VecEnvParams params;
+  params.num_envs = num_envs;
+  params.ticks_per_step = ticks_per_step;
+  params.threads = num_threads;
+  if (opponent) {
+    params.opponent = opponent;
+  }
+  // VecEnv CHECK-fails on bad params, which would kill the caller's whole
+  // process, so catch what we can here.
+  if (num_envs <= 0 || ticks_per_step <= 0 || num_threads < 0 ||
+      !pong::NewAiController(params.opponent)) {
+    return nullptr;
+  }
+  return new PongVecEnv(params);
+}
+
+void pong_vec_env_destroy(PongVecEnv* env) { delete env; }
+
+int pong_vec_env_num_envs(const PongVecEnv* env) {
+  return env->env.NumEnvs();
+}
+
+int pong_vec_env_observation_size(void) {
+  return pong::VecEnv::kObservationSize;
+}
+
+int pong_vec_env_num_actions(void) { return pong::VecEnv::kNumActions; }
+
+void pong_vec_env_reset(PongVecEnv* env, const uint64_t* seeds,
+                        float* observations) {
+  env->env.Reset(seeds, observations);
+}
+
+void pong_vec_env_step(PongVecEnv* env, const int32_t* actions,
+                       float* observations, float* rewards, uint8_t* dones) {
+  env->env.Step(actions, observations, rewards, dones);
+}
@@ -0,0 +1,45 @@
+/* C interface to pong::VecEnv (see vec_env.h), built into libpong_env.so so
+ * that trainers in other languages can load it, e.g. with Python's ctypes.
+ * All arrays are owned by the caller and must be contiguous:
+ *
+ *   seeds         num_envs uint64
+ *   observations  num_envs * pong_vec_env_observation_size() float32
+ *   actions       num_envs int32 (0 = stay, 1 = up, 2 = down)
+ *   rewards       num_envs float32
+ *   dones         num_envs uint8
+ *
+ * so numpy arrays can be passed straight in, without copying. See
+ * python/vec_env_example.py. */
+
+#ifndef VEC_ENV_C_H_
+#define VEC_ENV_C_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PongVecEnv PongVecEnv;
+
+/* Returns NULL if the arguments are bad, e.g. an unknown opponent. `opponent`
+ * may be NULL for the default. `num_threads` 0 means one per hardware
+ * thread. */
+PongVecEnv* pong_vec_env_create(int num_envs, int ticks_per_step,
+                                int num_threads, const char* opponent);
+void pong_vec_env_destroy(PongVecEnv* env);
+
+int pong_vec_env_num_envs(const PongVecEnv* env);
+int pong_vec_env_observation_size(void);
+int pong_vec_env_num_actions(void);
+
+void pong_vec_env_reset(PongVecEnv* env, const uint64_t* seeds,
+                        float* observations);
+void pong_vec_env_step(PongVecEnv* env, const int32_t* actions,
+                       float* observations, float* rewards, uint8_t* dones);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* VEC_ENV_C_H_ */